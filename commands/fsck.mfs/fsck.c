@@ -148,8 +148,13 @@ int nfreeinode, nregular, ndirectory, nblkspec, ncharspec, nbadinode;
 int nsock, npipe, nsyml, ztype[NLEVEL];
 long nfreezone;
 
+/* Fragmentation counters.  An extent is a run of consecutive data zones. */
+long ndatafile, nfragfile, nextent;
+long fileextent;		/* # extents of the file being checked */
+zone_nr lastzone;		/* last data zone of the file being checked */
+
 int repair, notrepaired = 0, automatic, listing, listsuper;	/* flags */
-int preen = 0, markdirty = 0;
+int preen = 0, markdirty = 0, fragreport = 0;
 int firstlist;			/* has the listing header been printed? */
 unsigned part_offset;		/* sector offset for this partition */
 char answer[] = "Answer questions with y or n.  Then hit RETURN";
@@ -232,6 +237,7 @@ void initvars()
 
   nregular = ndirectory = nblkspec = ncharspec =
   nbadinode = nsock = npipe = nsyml = 0;
+  ndatafile = nfragfile = nextent = 0;
   for (level = 0; level < NLEVEL; level++) ztype[level] = 0;
   changed = 0;
   thisblk = NO_BLOCK;
@@ -1280,6 +1286,8 @@ int zonechk(ino_t ino, d_inode *ip, off_t *pos, zone_nr zno, int level)
 	if ((ip->i_mode & I_TYPE) == I_SYMBOLIC_LINK &&
 	    !chksymlinkzone(ino, ip, *pos, zno))
 		return(0);
+	if (zno != lastzone + 1) fileextent++;
+	lastzone = zno;
 	*pos += ZONE_SIZE;
 	return(1);
   } else
@@ -1313,9 +1321,16 @@ int chkfile(ino_t ino, d_inode *ip)
   register ok, i, level;
   off_t pos = 0;
 
+  fileextent = 0;
+  lastzone = NO_ZONE;
   ok = chkzones(ino, ip, &pos, &ip->i_zone[0], NR_DZONE_NUM, 0);
   for (i = NR_DZONE_NUM, level = 1; i < NR_ZONE_NUMS; i++, level++)
 	ok &= chkzones(ino, ip, &pos, &ip->i_zone[i], 1, level);
+  if (fileextent > 0) {
+	ndatafile++;
+	nextent += fileextent;
+	if (fileextent > 1) nfragfile++;
+  }
   return(ok);
 }
 
@@ -1526,6 +1541,16 @@ void printtotal()
   pr("%8u    Double indirect zone%s\n",	  ztype[2],	 "",   "s");
 */
   lpr("%8ld    Free zone%s\n", nfreezone, "", "s");
+
+  if (fragreport) {
+	printf("\n");
+	lpr("%8ld    File%s with data\n", ndatafile, "", "s");
+	lpr("%8ld    Fragmented file%s\n", nfragfile, "", "s");
+	lpr("%8ld    Extent%s\n", nextent, "", "s");
+	if (ndatafile > 0)
+		printf("%5ld.%02ld  Extents per file\n", nextent / ndatafile,
+			(nextent % ndatafile) * 100 / ndatafile);
+  }
 }
 
 /* Check the device which name is given by `f'.  The inodes listed by `clist'
@@ -1646,6 +1671,7 @@ char **argv;
 		    case 'r':	repair ^= 1;	break;
 		    case 'l':	listing ^= 1;	break;
 		    case 's':	listsuper ^= 1;	break;
+		    case 'e':	fragreport ^= 1; break;
 		    case 'f':	break;
 		    default:
 			printf("%s: unknown flag '%s'\n", prog, arg);
@@ -1659,7 +1685,7 @@ char **argv;
 		devgiven = 1;
 	}
   if (!devgiven || badflag) {
-	printf("Usage: fsck [-dyfpacilrsz] file\n");
+	printf("Usage: fsck [-dyfpaceilrsz] file\n");
 	exit(FSCK_EXIT_USAGE);
   }
   return(0);
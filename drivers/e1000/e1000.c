@@ -33,6 +33,8 @@ static void e1000_init_buf(e1000_t *e);
 static void e1000_reset_hw(e1000_t *e);
 static void e1000_writev_s(message *mp, int from_int);
 static void e1000_readv_s(message *mp, int from_int);
+static void e1000_writev_m(message *mp, int from_int);
+static void e1000_readv_m(message *mp, int from_int);
 static void e1000_getstat_s(message *mp);
 static void e1000_interrupt(message *mp);
 static int e1000_link_changed(e1000_t *e);
@@ -93,6 +95,8 @@ int main(int argc, char *argv[])
 	{
 	    case DL_WRITEV_S:   e1000_writev_s(&m, FALSE);	break;
 	    case DL_READV_S:    e1000_readv_s(&m, FALSE);	break;
+	    case DL_WRITEV_M:   e1000_writev_m(&m, FALSE);	break;
+	    case DL_READV_M:    e1000_readv_m(&m, FALSE);	break;
 	    case DL_CONF:	e1000_init(&m);			break;
 	    case DL_GETSTAT_S:  e1000_getstat_s(&m);		break;
 	    default:
@@ -173,6 +177,7 @@ static void e1000_init(message *mp)
 {
     static int first_time = 1;
     message reply_mess;
+    vir_bytes pool;
     e1000_t *e;
 
     E1000_DEBUG(3, ("e1000: init()\n"));
@@ -193,9 +198,19 @@ static void e1000_init(message *mp)
         mess_reply(mp, &reply_mess);
         return;
     }
-    /* Reply back to INET. */
-    reply_mess.m_type  = DL_CONF_REPLY;
+    /* Reply back to INET. We also take batched requests. */
+    reply_mess.m_type  = DL_CONF_REPLY_M;
     reply_mess.DL_STAT = OK;
+    reply_mess.DL_CAPS = 0;
+    reply_mess.DL_POOL = NULL;
+
+    /* Share our packet pool, if the client wants it. */
+    if ((mp->DL_MODE & DL_POOL_REQ) &&
+	netdriver_pool_map(mp->m_source, &pool) == OK)
+    {
+	reply_mess.DL_CAPS |= DL_CAP_POOL;
+	reply_mess.DL_POOL  = (char *) pool;
+    }
     *(ether_addr_t *) reply_mess.DL_HWADDR = e->address;
     mess_reply(mp, &reply_mess);
 }
@@ -477,7 +492,7 @@ e1000_t *e;
 static void e1000_init_buf(e)
 e1000_t *e;
 {
-    phys_bytes rx_desc_p, rx_buff_p;
+    phys_bytes rx_desc_p;
     phys_bytes tx_desc_p, tx_buff_p;
     int i;
 
@@ -498,20 +513,19 @@ e1000_t *e;
     	memset(e->rx_desc, 0, sizeof(e1000_rx_desc_t) * e->rx_desc_count);
 
        /*
-        * Allocate 2048-byte buffers.
+        * Allocate 2048-byte buffers, as slots of a packet pool that
+        * can be shared with the client.
         */
-	e->rx_buffer_size = E1000_RXDESC_NR * E1000_IOBUF_SIZE;
-    
-	/* Attempt to allocate. */
-	if ((e->rx_buffer = alloc_contig(e->rx_buffer_size,
-					 AC_ALIGN4K, &rx_buff_p)) == NULL)
+	if (netdriver_pool_init(E1000_RXDESC_NR + E1000_POOL_SPARE,
+				E1000_POOL_TX, E1000_IOBUF_SIZE) == NULL)
 	{
 	    panic("failed to allocate RX buffers");
 	}
 	/* Setup receive descriptors. */
 	for (i = 0; i < E1000_RXDESC_NR; i++)
 	{
-	    e->rx_desc[i].buffer = rx_buff_p + (i * E1000_IOBUF_SIZE);
+	    e->rx_slot[i] = netdriver_pool_get();
+	    e->rx_desc[i].buffer = netdriver_pool_phys(e->rx_slot[i]);
 	}
     }
     /*
@@ -537,6 +551,7 @@ e1000_t *e;
 	{
 	    panic("failed to allocate TX buffers");
 	}
+	e->tx_buffer_p = tx_buff_p;
 	/* Setup transmit descriptors. */
 	for (i = 0; i < E1000_TXDESC_NR; i++)
 	{
@@ -645,6 +660,7 @@ int from_int;
 		panic("sys_safecopyfrom() failed: %d", r);
 	    }
 	    /* Mark this descriptor ready. */
+	    desc->buffer  = e->tx_buffer_p + (tail * E1000_IOBUF_SIZE);
 	    desc->status  = 0;
 	    desc->command = 0;
 	    desc->length  = size;
@@ -739,8 +755,8 @@ int from_int;
 			  i, iovec[i].iov_size, size));
 
 	    if ((r = sys_safecopyto(e->rx_message.m_source, iovec[i].iov_grant,
-				   0, (vir_bytes) e->rx_buffer + bytes + 
-				   (cur * E1000_IOBUF_SIZE),
+				   0, (vir_bytes)
+				   netdriver_pool_addr(e->rx_slot[cur]) + bytes,
 				    size, D)) != OK)
 	    {
 		panic("sys_safecopyto() failed: %d", r);
@@ -762,6 +778,218 @@ int from_int;
     reply(e);
 }
 
+/*===========================================================================*
+ *				e1000_writev_m				     *
+ *===========================================================================*/
+static void e1000_writev_m(mp, from_int)
+message *mp;
+int from_int;
+{
+    e1000_t *e = &e1000_state;
+    e1000_tx_desc_t *desc;
+    dl_pack_t *pack;
+    int r, head, tail, size, queued = 0;
+
+    E1000_DEBUG(3, ("e1000: writev_m(%p,%d)\n", mp, from_int));
+
+    if (!from_int)
+    {
+	/* Copy write message and the packet descriptors. */
+	e->tx_message = *mp;
+	e->client = mp->m_source;
+	e->status |= E1000_WRITING;
+	e->status &= ~E1000_TRANSMIT;
+	e->tx_next = 0;
+
+	if ((r = netdriver_copyin_packs(e->tx_message.m_source,
+					e->tx_message.DL_GRANT,
+					e->tx_packs,
+					e->tx_message.DL_COUNT)) != OK)
+	{
+	    panic("netdriver_copyin_packs() failed: %d", r);
+	}
+    }
+    else if (!(e->status & E1000_WRITING))
+    {
+	return;
+    }
+
+    /*
+     * Put as many packets of the batch in the ring as fit. Each packet
+     * gets a single descriptor; the rest waits for the next TX interrupt.
+     */
+    head = e1000_reg_read(e, E1000_REG_TDH);
+    tail = e1000_reg_read(e, E1000_REG_TDT);
+
+    while (e->tx_next < e->tx_message.DL_COUNT &&
+	   (tail + 1) % e->tx_desc_count != head)
+    {
+	desc = &e->tx_desc[tail];
+	pack = &e->tx_packs[e->tx_next];
+
+	if (pack->dp_count == 0)
+	{
+	    /* The packet is in the packet pool already. Send it from there. */
+	    if (!netdriver_pool_tx_slot(e->tx_message.m_source, pack->dp_slot))
+	    {
+		panic("bad transmit slot: %d", pack->dp_slot);
+	    }
+	    desc->buffer = netdriver_pool_phys(pack->dp_slot);
+	    size = pack->dp_size < E1000_IOBUF_SIZE ?
+		   pack->dp_size : E1000_IOBUF_SIZE;
+	}
+	else
+	{
+	    desc->buffer = e->tx_buffer_p + (tail * E1000_IOBUF_SIZE);
+	    size = netdriver_copyfrom_pack(e->tx_message.m_source, pack,
+					   e->tx_buffer +
+					   (tail * E1000_IOBUF_SIZE),
+					   E1000_IOBUF_SIZE);
+	}
+
+	desc->status  = 0;
+	desc->length  = size;
+	desc->command = E1000_TX_CMD_EOP |
+			E1000_TX_CMD_FCS |
+			E1000_TX_CMD_RS;
+
+	tail = (tail + 1) % e->tx_desc_count;
+	e->tx_next++;
+	queued++;
+    }
+
+    /* Increment tail once for the whole batch. Start transmission. */
+    if (queued > 0)
+    {
+	e1000_reg_write(e, E1000_REG_TDT, tail);
+
+	E1000_DEBUG(2, ("e1000: queued %d packets\n", queued));
+    }
+    else if (from_int && e->tx_next == e->tx_message.DL_COUNT &&
+	     head == tail)
+    {
+	/*
+	 * Everything queued earlier has been sent now. The client may
+	 * reuse the packet pool slots of the batch only after this.
+	 */
+	e->status |= E1000_TRANSMIT;
+    }
+    reply(e);
+}
+
+/*===========================================================================*
+ *				e1000_readv_m				     *
+ *===========================================================================*/
+static void e1000_readv_m(mp, from_int)
+message *mp;
+int from_int;
+{
+    e1000_t *e = &e1000_state;
+    e1000_rx_desc_t *desc;
+    dl_pack_t *pack;
+    int i, r, tail, cur, slot;
+
+    E1000_DEBUG(3, ("e1000: readv_m(%p,%d)\n", mp, from_int));
+
+    if (!from_int)
+    {
+	e->rx_message = *mp;
+	e->client     = mp->m_source;
+	e->status    |= E1000_READING;
+	e->rx_count   = 0;
+
+	if ((r = netdriver_copyin_packs(e->rx_message.m_source,
+					e->rx_message.DL_GRANT,
+					e->rx_packs,
+					e->rx_message.DL_COUNT)) != OK)
+	{
+	    panic("netdriver_copyin_packs() failed: %d", r);
+	}
+
+	/* Take back the packet pool slots the client is done with. */
+	for (i = 0; i < e->rx_message.DL_COUNT; i++)
+	{
+	    pack = &e->rx_packs[i];
+	    if (pack->dp_count == 0 && pack->dp_slot >= 0 &&
+		netdriver_pool_put(mp->m_source, pack->dp_slot) != OK)
+	    {
+		E1000_DEBUG(1, ("%s: bad slot %d returned\n",
+				e->name, pack->dp_slot));
+	    }
+	}
+    }
+    if (!(e->status & E1000_READING))
+    {
+	return;
+    }
+
+    /*
+     * Hand out every complete packet in the ring, up to the number of
+     * buffers the client gave us.
+     */
+    tail = e1000_reg_read(e, E1000_REG_RDT);
+    cur  = (tail + 1) % e->rx_desc_count;
+    desc = &e->rx_desc[cur];
+
+    while (e->rx_count < e->rx_message.DL_COUNT &&
+	   (desc->status & E1000_RX_STATUS_EOP))
+    {
+	pack = &e->rx_packs[e->rx_count];
+
+	if (pack->dp_count == 0)
+	{
+	    /*
+	     * Hand over the slot with the packet, and put a free one in
+	     * the ring instead. Without a free slot, the packet has to wait
+	     * until the client gives some back.
+	     */
+	    if (!netdriver_pool_mapped(e->rx_message.m_source) ||
+		(slot = netdriver_pool_get()) < 0)
+	    {
+		break;
+	    }
+	    pack->dp_slot = e->rx_slot[cur];
+	    pack->dp_size = desc->length;
+	    netdriver_pool_give(e->rx_slot[cur]);
+
+	    e->rx_slot[cur] = slot;
+	    desc->buffer = netdriver_pool_phys(slot);
+	}
+	else
+	{
+	    netdriver_copyto_pack(e->rx_message.m_source, pack,
+				  netdriver_pool_addr(e->rx_slot[cur]),
+				  desc->length);
+	}
+
+	if (pack->dp_size < ETH_MIN_PACK_SIZE)
+	    pack->dp_size = ETH_MIN_PACK_SIZE;
+
+	desc->status = 0;
+	e->rx_count++;
+
+	tail = cur;
+	cur  = (cur + 1) % e->rx_desc_count;
+	desc = &e->rx_desc[cur];
+    }
+
+    if (e->rx_count > 0)
+    {
+	if ((r = netdriver_copyout_packs(e->rx_message.m_source,
+					 e->rx_message.DL_GRANT,
+					 e->rx_packs, e->rx_count)) != OK)
+	{
+	    panic("netdriver_copyout_packs() failed: %d", r);
+	}
+	e->status |= E1000_RECEIVED;
+	E1000_DEBUG(2, ("e1000: got %d packets\n", e->rx_count));
+
+	/* Increment tail once for the whole batch. */
+	e1000_reg_write(e, E1000_REG_RDT, tail);
+    }
+    reply(e);
+}
+
 /*===========================================================================*
  *				e1000_getstat_s				     *
  *===========================================================================*/
@@ -826,11 +1054,21 @@ message *mp;
 	    e1000_link_changed(e);
 
 	if (cause & (E1000_REG_ICR_RXO | E1000_REG_ICR_RXT))
-	    e1000_readv_s(&e->rx_message, TRUE);
+	{
+	    if (e->rx_message.m_type == DL_READV_M)
+		e1000_readv_m(&e->rx_message, TRUE);
+	    else
+		e1000_readv_s(&e->rx_message, TRUE);
+	}
 	
 	if ((cause & E1000_REG_ICR_TXQE) ||
 	    (cause & E1000_REG_ICR_TXDW))
-	    e1000_writev_s(&e->tx_message, TRUE);
+	{
+	    if (e->tx_message.m_type == DL_WRITEV_M)
+		e1000_writev_m(&e->tx_message, TRUE);
+	    else
+		e1000_writev_s(&e->tx_message, TRUE);
+	}
     }
 }
 
@@ -1166,8 +1404,11 @@ e1000_t *e;
 	e->status & E1000_RECEIVED)
     {
 	msg.DL_FLAGS |= DL_PACK_RECV;
-	msg.DL_COUNT = e->rx_size >= ETH_MIN_PACK_SIZE ?
-		       e->rx_size  : ETH_MIN_PACK_SIZE;
+	if (e->rx_message.m_type == DL_READV_M)
+	    msg.DL_COUNT = e->rx_count;
+	else
+	    msg.DL_COUNT = e->rx_size >= ETH_MIN_PACK_SIZE ?
+			   e->rx_size  : ETH_MIN_PACK_SIZE;
 
         /* Clear flags. */
 	e->status &= ~(E1000_READING | E1000_RECEIVED);
@@ -44,6 +44,12 @@
 /** Size of each I/O buffer per descriptor. */
 #define E1000_IOBUF_SIZE 2048
 
+/** Receive slots in the packet pool beyond those in the receive ring. */
+#define E1000_POOL_SPARE 64
+
+/** Transmit slots in the packet pool. */
+#define E1000_POOL_TX 32
+
 /** Debug verbosity. */
 #define E1000_VERBOSE 1
 
@@ -156,18 +162,25 @@ typedef struct e1000
 
     e1000_rx_desc_t *rx_desc;	  /**< Receive Descriptor table. */
     int rx_desc_count;		  /**< Number of Receive Descriptors. */
-    char *rx_buffer;		  /**< Receive buffer returned by malloc(). */
-    int rx_buffer_size;		  /**< Size of the receive buffer. */
+    int rx_slot[E1000_RXDESC_NR]; /**< Packet pool slot of each Receive
+				       Descriptor. */
 
     e1000_tx_desc_t *tx_desc;	  /**< Transmit Descriptor table. */
     int tx_desc_count;		  /**< Number of Transmit Descriptors. */
     char *tx_buffer;		  /**< Transmit buffer returned by malloc(). */
     int tx_buffer_size;		  /**< Size of the transmit buffer. */
+    phys_bytes tx_buffer_p;	  /**< Physical address of the transmit
+				       buffer. */
 
     int client;                   /**< Process ID being served by e1000. */
     message rx_message;		  /**< Read message received from client. */
     message tx_message;		  /**< Write message received from client. */
     size_t rx_size;		  /**< Size of one packet received. */
+
+    dl_pack_t rx_packs[DL_BATCH_MAX]; /**< Packets of a batched read. */
+    int rx_count;		  /**< Packets received into rx_packs. */
+    dl_pack_t tx_packs[DL_BATCH_MAX]; /**< Packets of a batched write. */
+    int tx_next;		  /**< Next packet of tx_packs to queue. */
 }
 e1000_t;
 
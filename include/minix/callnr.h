@@ -65,6 +65,8 @@
 #define SETGROUPS_O	  66
 #define GETMCONTEXT       67
 #define SETMCONTEXT       68
+#define KQUEUE		  69	/* to VFS */
+#define KEVENT		  70	/* to VFS */
 
 /* Posix signal handling. */
 #define SIGACTION	  71
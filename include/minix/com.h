@@ -259,11 +259,16 @@
 #define DL_GETSTAT_S	(DL_RQ_BASE + 1)
 #define DL_WRITEV_S	(DL_RQ_BASE + 2)
 #define DL_READV_S	(DL_RQ_BASE + 3)
+#define DL_WRITEV_M	(DL_RQ_BASE + 4)	/* send a batch of packets */
+#define DL_READV_M	(DL_RQ_BASE + 5)	/* receive a batch of packets */
 
 /* Message type for data link layer replies. */
 #define DL_CONF_REPLY	(DL_RS_BASE + 0)
 #define DL_STAT_REPLY	(DL_RS_BASE + 1)
 #define DL_TASK_REPLY	(DL_RS_BASE + 2)
+#define DL_CONF_REPLY_M	(DL_RS_BASE + 3)	/* DL_CONF_REPLY from a driver
+						 * that takes DL_*V_M requests
+						 */
 
 /* Field names for data link layer messages. */
 #define DL_COUNT	m2_i3
@@ -272,6 +277,8 @@
 #define DL_GRANT	m2_l2
 #define DL_STAT		m3_i1
 #define DL_HWADDR	m3_ca1
+#define DL_CAPS		m3_i2	/* DL_CONF_REPLY_M only */
+#define DL_POOL		m3_p1	/* DL_CONF_REPLY_M only */
 
 /* Bits in 'DL_FLAGS' field of DL replies. */
 #  define DL_NOFLAGS		0x00
@@ -283,6 +290,28 @@
 #  define DL_PROMISC_REQ	0x1
 #  define DL_MULTI_REQ		0x2
 #  define DL_BROAD_REQ		0x4
+#  define DL_POOL_REQ		0x8	/* map the packet pool into caller */
+
+/* Bits in 'DL_CAPS' field of DL_CONF_REPLY_M. */
+#  define DL_CAP_POOL		0x01	/* packet pool mapped at DL_POOL */
+
+/* In DL_WRITEV_M and DL_READV_M requests, DL_GRANT is a grant for an array
+ * of DL_COUNT dl_pack_t packet descriptors (see <minix/type.h>). The driver
+ * answers a DL_READV_M with DL_PACK_RECV as soon as at least one packet has
+ * been received; DL_COUNT in the reply is then the number of descriptors
+ * filled, and their dp_size fields have been written back. DL_PACK_SEND for
+ * a DL_WRITEV_M means that all packets of the batch have been sent.
+ */
+#define DL_BATCH_MAX	32	/* max. packets per batched request */
+
+/* A driver may share a packet pool with its client (see dl_pool_t). A packet
+ * descriptor with a dp_count of zero then refers to pool slot dp_slot instead
+ * of to granted fragments. In DL_WRITEV_M the client sends dp_size bytes from
+ * one of its transmit slots. In DL_READV_M a descriptor with a dp_count of
+ * zero accepts a packet in a receive slot, which the client owns until it
+ * passes the slot back in the dp_slot field of a later DL_READV_M; -1 there
+ * means there is nothing to give back.
+ */
 
 /*===========================================================================*
  *                  SYSTASK request types and field names                    *
@@ -850,6 +879,25 @@
 					 * implementations. See <minix/vfsif.h>
 					 */
 
+/* Requests from VM to VFS for mapped files. VM sends them asynchronously and
+ * VFS answers with a VM_VFS_REPLY message.
+ */
+#define VFS_VMCALL		(VFS_BASE+0xFF)
+#	define VFS_VMCALL_REQ		m10_i1	/* VMVFSREQ_* */
+#	define VFS_VMCALL_FD		m10_i2
+#	define VFS_VMCALL_REQID		m10_i3
+#	define VFS_VMCALL_ENDPOINT	m10_i4	/* FDLOOKUP: owner of the fd */
+#	define VFS_VMCALL_OFFSET	m10_l1	/* FDREAD, FDWRITE */
+#	define VFS_VMCALL_LENGTH	m10_l2	/* FDREAD, FDWRITE */
+#	define VFS_VMCALL_ADDR		m10_l3	/* FDREAD, FDWRITE: VM buffer */
+#	define VFS_VMCALL_MODE		m10_l3	/* FDLOOKUP: R_BIT, W_BIT */
+
+/* Requests in VFS_VMCALL. */
+#define VMVFSREQ_FDLOOKUP	101	/* give VM its own fd for a file */
+#define VMVFSREQ_FDCLOSE	102	/* close an fd of VM */
+#define VMVFSREQ_FDREAD		103	/* read from a file into VM */
+#define VMVFSREQ_FDWRITE	104	/* write from VM to a file */
+
 /*===========================================================================*
  *                Common requests and miscellaneous field names		     *
  *===========================================================================*/
@@ -895,6 +943,14 @@
 #define SEL_ERRORFDS   m8_p3
 #define SEL_TIMEOUT    m8_p4
 
+/* Field names for KQUEUE and KEVENT (FS). */
+#define KEV_KQ		m1_i1	/* file descriptor of the event queue */
+#define KEV_NCHANGES	m1_i2
+#define KEV_NEVENTS	m1_i3
+#define KEV_CHANGES	m1_p1
+#define KEV_EVENTS	m1_p2
+#define KEV_TIMEOUT	m1_p3
+
 /* Field names for the fstatvfs call */
 #define FSTATVFS_FD m1_i1
 #define FSTATVFS_BUF m1_p1
@@ -1004,12 +1060,15 @@
 #define VMYBGB_YIELDIDHI		m2_l1
 #define VMYBGB_YIELDIDLO		m2_l2
 
-/* Calls from VFS. */
-#	define VMV_ENDPOINT		m1_i1	/* for all VM_VFS_REPLY_* */
-#define VM_VFS_REPLY_OPEN	(VM_RQ_BASE+30)
-#	define VMVRO_FD			m1_i2
-#define VM_VFS_REPLY_MMAP	(VM_RQ_BASE+31)
-#define VM_VFS_REPLY_CLOSE	(VM_RQ_BASE+32)
+/* Calls from VFS: the answer to a VFS_VMCALL. */
+#define VM_VFS_REPLY		(VM_RQ_BASE+30)
+#	define VMV_RESULT		m10_i1	/* bytes transferred, or error */
+#	define VMV_REQID		m10_i2
+#	define VMV_FD			m10_i3	/* FDLOOKUP: fd of VM */
+#	define VMV_DEV			m10_i4	/* FDLOOKUP: device of the file */
+#	define VMV_INO			m10_l1	/* FDLOOKUP: inode of the file */
+#	define VMV_SIZE			m10_l2	/* FDLOOKUP: size of the file */
+#	define VMV_FS			m10_l3	/* FDLOOKUP: its file system */
 
 #define VM_REMAP		(VM_RQ_BASE+33)
 #	define VMRE_D			m1_i1
@@ -1074,8 +1133,14 @@
 #define VM_REMAP_RO		(VM_RQ_BASE+44)
 /* same args as VM_REMAP */
 
+/* Write back changes to a shared file mapping. */
+#define VM_MSYNC		(VM_RQ_BASE+45)
+#	define VMMS_ADDR		m1_p1
+#	define VMMS_LEN			m1_i1
+#	define VMMS_FLAGS		m1_i2
+
 /* Total. */
-#define NR_VM_CALLS				45
+#define NR_VM_CALLS				46
 #define VM_CALL_MASK_SIZE			BITMAP_CHUNKS(NR_VM_CALLS)
 
 /* not handled as a normal VM call, thus at the end of the reserved rage */
@@ -1086,7 +1151,8 @@
 /* Basic vm calls allowed to every process. */
 #define VM_BASIC_CALLS \
     VM_MMAP, VM_MUNMAP, VM_MUNMAP_TEXT, VM_MAP_PHYS, VM_UNMAP_PHYS, \
-    VM_FORGETBLOCKS, VM_FORGETBLOCK, VM_YIELDBLOCKGETBLOCK, VM_INFO
+    VM_FORGETBLOCKS, VM_FORGETBLOCK, VM_YIELDBLOCKGETBLOCK, VM_INFO, \
+    VM_MSYNC
 
 /*===========================================================================*
  *                Messages for IPC server				     *
@@ -1141,6 +1207,7 @@
 #	define SCHEDULING_ACNT_QUEUE		m9_l5
 #	define SCHEDULING_ACNT_CPU		m9_s1
 #	define SCHEDULING_ACNT_CPU_LOAD		m9_s2
+#	define SCHEDULING_ACNT_CPU_RUNQ		m9_s3
 /* These are used for SYS_SCHEDULE, a reply to SCHEDULING_NO_QUANTUM */
 #	define SCHEDULING_ENDPOINT	m9_l1
 #	define SCHEDULING_QUANTUM	m9_l2
@@ -11,6 +11,15 @@ int fs_lookup_credentials(vfs_ucred_t *credentials,
         uid_t *caller_uid, gid_t *caller_gid, cp_grant_id_t grant2, size_t cred_size);
 u32_t fs_bufs_heuristic(int minbufs, u32_t btotal, u32_t bfree,
 	int blocksize, dev_t majordev);
+void fs_sort_bufq(void **bufq, int bufqsize, size_t key_offset);
+int fs_build_run(dev_t dev, void **bufq, int bufqsize, int rw_flag,
+	size_t key_offset, void *(*filler)(dev_t, block_t), void **iobuf,
+	int max, int *nbufs);
+
+/* Holes of up to this many blocks between two blocks being written are
+ * bridged with clean cached copies, so that both end up in one request.
+ */
+#define FS_IOSCHED_MAX_GAP	4
 
 #endif /* _MINIX_FSLIB_H */
 
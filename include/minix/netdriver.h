@@ -5,9 +5,29 @@
 
 #include <minix/endpoint.h>
 #include <minix/ipc.h>
+#include <minix/type.h>
 
 /* Functions defined by netdriver.c: */
 void netdriver_announce(void);
 int netdriver_receive(endpoint_t src, message *m_ptr, int *status_ptr);
+int netdriver_copyin_packs(endpoint_t ep, cp_grant_id_t grant,
+	dl_pack_t *packs, int count);
+int netdriver_copyout_packs(endpoint_t ep, cp_grant_id_t grant,
+	dl_pack_t *packs, int count);
+size_t netdriver_copyto_pack(endpoint_t ep, dl_pack_t *pack, char *data,
+	size_t size);
+size_t netdriver_copyfrom_pack(endpoint_t ep, dl_pack_t *pack, char *data,
+	size_t max);
+
+/* Functions defined by pool.c: */
+void *netdriver_pool_init(int rx_slots, int tx_slots, size_t slot_size);
+int netdriver_pool_map(endpoint_t ep, vir_bytes *addr);
+int netdriver_pool_mapped(endpoint_t ep);
+int netdriver_pool_get(void);
+void netdriver_pool_give(int slot);
+int netdriver_pool_put(endpoint_t ep, int slot);
+int netdriver_pool_tx_slot(endpoint_t ep, int slot);
+char *netdriver_pool_addr(int slot);
+phys_bytes netdriver_pool_phys(int slot);
 
 #endif /* _MINIX_NETDRIVER_H */
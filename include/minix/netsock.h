@@ -31,6 +31,7 @@ struct sock_ops {
 	sock_op_io_t	ioctl;
 	sock_op_t	select;
 	sock_op_t	select_reply;
+	sock_op_t	cancel;		/* optional, cancels a pending operation */
 };
 
 struct recv_q {
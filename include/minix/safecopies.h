@@ -4,6 +4,7 @@
 
 #include <minix/sys_config.h>
 #include <minix/types.h>
+#include <minix/type.h>
 #include <minix/vm.h>
 #include <stdint.h>
 
@@ -33,7 +34,8 @@ typedef struct {
 			char		cp_reserved[8]; /* future use */
 		} cp_magic;
 	} cp_u;
-	char cp_reserved[8];				/* future use */
+	cp_grant_id_t cp_next;		/* next free slot (libsys only) */
+	char cp_reserved[4];				/* future use */
 } cp_grant_t;
 
 /* Vectored safecopy. */
@@ -70,6 +72,9 @@ cp_grant_id_t cpf_grant_indirect(endpoint_t, endpoint_t, cp_grant_id_t);
 cp_grant_id_t cpf_grant_magic(endpoint_t, endpoint_t, vir_bytes, size_t,
 	int);
 int cpf_revoke(cp_grant_id_t grant_id);
+int cpf_grant_vec(endpoint_t who_to, const iovec_t *vec, iovec_s_t *gvec,
+	int count, int access);
+void cpf_revoke_vec(const iovec_s_t *gvec, int count);
 int cpf_lookup(cp_grant_id_t g, endpoint_t *ep, endpoint_t *ep2);
 
 int cpf_getgrants(cp_grant_id_t *grant_ids, int n);
@@ -82,10 +87,5 @@ int cpf_setgrant_magic(cp_grant_id_t g, endpoint_t who_to, endpoint_t
 int cpf_setgrant_disable(cp_grant_id_t grant_id);
 void cpf_reload(void);
 
-/* Set a process' grant table location and size (in-kernel only). */
-#define _K_SET_GRANT_TABLE(rp, ptr, entries)	\
-	priv(rp)->s_grant_table= (ptr);		\
-	priv(rp)->s_grant_entries= (entries);
-
 #endif	/* _MINIX_SAFECOPIES_H */
 
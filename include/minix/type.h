@@ -86,6 +86,33 @@ typedef struct {
   vir_bytes iov_size;		/* sizeof an I/O buffer */
 } iovec_s_t;
 
+/* One packet of a batched data link layer request (DL_READV_M and
+ * DL_WRITEV_M). The fragments are the packet's buffer; for receive requests
+ * the driver sets dp_size to the size of the packet stored there. Packets
+ * may also live in a shared packet pool instead, see <minix/com.h>.
+ */
+#define DL_PACK_IOV	4	/* max. fragments per packet */
+
+typedef struct {
+  int dp_count;			/* number of fragments in use */
+  int dp_slot;			/* packet pool slot, if dp_count is 0 */
+  vir_bytes dp_size;		/* size of the packet */
+  iovec_s_t dp_iov[DL_PACK_IOV];	/* fragments of the packet buffer */
+} dl_pack_t;
+
+/* Header of a packet pool shared between a network driver and its client.
+ * Slot i starts at offset dpl_offset + i * dpl_slot_size. Receive slots come
+ * first, and are owned by the driver unless handed out; the transmit slots
+ * after them are the client's.
+ */
+typedef struct {
+  vir_bytes dpl_size;		/* size of the whole pool */
+  vir_bytes dpl_offset;		/* offset of the first slot */
+  vir_bytes dpl_slot_size;	/* size of each slot */
+  int dpl_rx_slots;		/* number of receive slots */
+  int dpl_tx_slots;		/* number of transmit slots */
+} dl_pool_t;
+
 /* PM passes the address of a structure of this type to KERNEL when
  * sys_sigsend() is invoked as part of the signal catching mechanism.
  * The structure contain all the information that KERNEL needs to build
@@ -42,18 +42,24 @@ int vm_yield_block_get_block(u64_t yieldid, u64_t getid, void *mem,
 #define VMPTYPE_SMAP		3
 #define VMPTYPE_SUNMAP		4
 
+#define VSI_ORDERS	11	/* free block sizes reported */
+
 struct vm_stats_info {
   unsigned int vsi_pagesize;	/* page size */
   unsigned long vsi_total;	/* total number of memory pages */
   unsigned long vsi_free;	/* number of free pages */
   unsigned long vsi_largest;	/* largest number of consecutive free pages */
   unsigned long vsi_cached;	/* number of pages cached for file systems */
+  unsigned long vsi_orders[VSI_ORDERS]; /* free blocks of 2^i pages */
 };
 
 struct vm_usage_info {
   vir_bytes vui_total;		/* total amount of process memory */
   vir_bytes vui_common;		/* part of memory mapped in more than once */
   vir_bytes vui_shared;		/* shared (non-COW) part of common memory */
+  u32_t vui_faults;		/* pagefaults handled */
+  u32_t vui_cow_faults;		/* of which copy-on-write */
+  u32_t vui_faultaround;	/* extra pages mapped around pagefaults */
 };
 
 struct vm_region_info {
@@ -67,6 +67,12 @@ typedef struct nwio_tcpopt
 #	define NWTO_BULK	0x00000010L
 #	define NWTO_NOBULK	0x00100000L
 
+typedef struct nwio_tcpbuf
+{
+	u32_t nwtb_rcvbuf;	/* receive buffer size, 0 leaves it alone */
+	u32_t nwtb_sndbuf;	/* send buffer size, 0 leaves it alone */
+} nwio_tcpbuf_t;
+
 #define TC_SECRET_SIZE	12
 
 typedef struct tcp_cookie
@@ -0,0 +1,62 @@
+#ifndef _SYS_EVENT_H_
+#define	_SYS_EVENT_H_
+
+/* Event queues.  This is a subset of the kqueue interface: read and write
+ * readiness of the file descriptors that select() supports, level-triggered
+ * or one-shot.  The event queue is bound to a file descriptor, and is
+ * released when that descriptor is closed.  It is not inherited by fork().
+ */
+
+#include <sys/cdefs.h>
+#include <sys/featuretest.h>
+#include <sys/types.h>
+#include <stdint.h>
+
+#define	EVFILT_READ		0	/* descriptor is ready for reading */
+#define	EVFILT_WRITE		1	/* descriptor is ready for writing */
+#define	EVFILT_SYSCOUNT		2	/* number of filters */
+
+#define	EV_SET(kevp, a, b, c, d, e, f)					\
+do {									\
+	struct kevent *__kevp = (kevp);					\
+									\
+	__kevp->ident = (a);						\
+	__kevp->filter = (b);						\
+	__kevp->flags = (c);						\
+	__kevp->fflags = (d);						\
+	__kevp->data = (e);						\
+	__kevp->udata = (f);						\
+} while (/* CONSTCOND */ 0)
+
+struct kevent {
+	uintptr_t	ident;		/* identifier for this event */
+	uint32_t	filter;		/* filter for event */
+	uint32_t	flags;		/* action flags for kqueue */
+	uint32_t	fflags;		/* filter flag value (unused) */
+	int64_t		data;		/* filter data value (unused) */
+	intptr_t	udata;		/* opaque user data identifier */
+};
+
+/* actions */
+#define	EV_ADD		0x0001		/* add event to kq (implies ENABLE) */
+#define	EV_DELETE	0x0002		/* delete event from kq */
+#define	EV_ENABLE	0x0004		/* enable event */
+#define	EV_DISABLE	0x0008		/* disable event (not reported) */
+
+/* flags */
+#define	EV_ONESHOT	0x0010		/* only report one occurrence */
+#define	EV_CLEAR	0x0020		/* clear event state after reporting;
+					 * not supported */
+
+/* returned values */
+#define	EV_EOF		0x8000		/* EOF or error detected */
+
+struct timespec;
+
+__BEGIN_DECLS
+int	kqueue(void);
+int	kevent(int, const struct kevent *, size_t, struct kevent *, size_t,
+		    const struct timespec *);
+__END_DECLS
+
+#endif /* !_SYS_EVENT_H_ */
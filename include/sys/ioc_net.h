@@ -62,6 +62,8 @@ struct msg_control
 #define NWIOGTCPCOOKIE	_IOR('n', 58, struct tcp_cookie)
 #define NWIOTCPACCEPTTO	_IOW('n', 59, struct tcp_cookie)
 #define NWIOTCPGERROR	_IOR('n', 60, int)
+#define NWIOSTCPBUF	_IOW('n', 61, struct nwio_tcpbuf)
+#define NWIOGTCPBUF	_IOR('n', 62, struct nwio_tcpbuf)
 
 #define NWIOSUDPOPT	_IOW('n', 64, struct nwio_udpopt)
 #define NWIOGUDPOPT	_IOR('n', 65, struct nwio_udpopt)
@@ -35,9 +35,7 @@ typedef	__off_t		off_t;		/* file offset */
  * Flags contain sharing type and options.
  * Sharing types; choose one.
  */
-#ifndef __minix
 #define	MAP_SHARED	0x0001	/* share changes */
-#endif
 #define	MAP_PRIVATE	0x0002	/* changes are private */
 
 /*
@@ -58,6 +56,13 @@ typedef	__off_t		off_t;		/* file offset */
 
 #define MAP_FIXED      0x0200  /* require mapping to happen at hint */
 
+/*
+ * Flags to msync
+ */
+#define	MS_ASYNC	0x01	/* perform asynchronous writes */
+#define	MS_INVALIDATE	0x02	/* invalidate cached data */
+#define	MS_SYNC		0x04	/* perform synchronous writes */
+
 /*
  * Error indicator returned by mmap(2)
  */
@@ -73,6 +78,7 @@ int	munmap(void *, size_t);
 void *	minix_mmap(void *, size_t, int, int, int, off_t);
 int	minix_munmap(void *, size_t);
 int 		minix_munmap_text(void *, size_t);
+int		msync(void *, size_t, int);
 void *		vm_remap(int d, int s, void *da, void *sa, size_t si);
 void *		vm_remap_ro(int d, int s, void *da, void *sa, size_t si);
 int 		vm_unmap(int endpt, void *addr);
@@ -527,6 +527,52 @@ static void ser_dump_queues(void)
 #endif
 }
 
+static void ser_dump_ipc_cpu(unsigned cpu)
+{
+	unsigned sendrec, fast, hits, misses;
+
+	sendrec = get_cpu_var(cpu, ipc_sendrec);
+	fast = get_cpu_var(cpu, ipc_fastpath);
+	printf("cpu %3d sendrec %u fast path %u (%lu%%) handoff %u\n", cpu,
+			sendrec, fast,
+			sendrec ? div64u(mul64u(fast, 100), sendrec) : 0,
+			get_cpu_var(cpu, ipc_handoff));
+
+	hits = get_cpu_var(cpu, grant_cache_hits);
+	misses = get_cpu_var(cpu, grant_cache_misses);
+	printf("cpu %3d grant cache hits %u misses %u (%lu%%)\n", cpu,
+			hits, misses, hits + misses ?
+			div64u(mul64u(hits, 100), hits + misses) : 0);
+}
+
+static void ser_dump_ipc(void)
+{
+	printf("--- SENDREC fast path, grant cache ---\n");
+#ifdef CONFIG_SMP
+	{
+		unsigned cpu;
+
+		for (cpu = 0; cpu < ncpus; cpu++)
+			ser_dump_ipc_cpu(cpu);
+	}
+#else
+	ser_dump_ipc_cpu(0);
+#endif
+}
+
+static void ser_reset_ipc(void)
+{
+	unsigned cpu;
+
+	for (cpu = 0; cpu < CONFIG_MAX_CPUS; cpu++) {
+		get_cpu_var(cpu, ipc_sendrec) = 0;
+		get_cpu_var(cpu, ipc_fastpath) = 0;
+		get_cpu_var(cpu, ipc_handoff) = 0;
+		get_cpu_var(cpu, grant_cache_hits) = 0;
+		get_cpu_var(cpu, grant_cache_misses) = 0;
+	}
+}
+
 static void ser_dump_segs(void)
 {
 	struct proc *pp;
@@ -594,6 +640,12 @@ static void ser_debug(const int c)
 	case '3':
 		ser_dump_segs();
 		break;
+	case 'F':
+		ser_dump_ipc();
+		break;
+	case 'f':
+		ser_reset_ipc();
+		break;
 #ifdef CONFIG_SMP
 	case '4':
 		ser_dump_proc_cpu();
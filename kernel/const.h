@@ -31,6 +31,9 @@
 #define INTS_ORIG	0	/* restore interrupts */
 #define INTS_MINIX	1	/* initialize interrupts for minix */
 
+/* per-cpu cache of verified grants, see do_safecopy.c; a power of two */
+#define GRANT_CACHE_SIZE	16
+
 /* for kputc() */
 #define END_OF_KMESS	0
 
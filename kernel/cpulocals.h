@@ -75,6 +75,17 @@ DECLARE_CPULOCAL(struct proc *, ptproc);
 DECLARE_CPULOCAL(struct proc *, run_q_head[NR_SCHED_QUEUES]); /* ptrs to ready list headers */
 DECLARE_CPULOCAL(struct proc *, run_q_tail[NR_SCHED_QUEUES]); /* ptrs to ready list tails */
 DECLARE_CPULOCAL(volatile int, cpu_is_idle); /* let the others know that you are idle */
+DECLARE_CPULOCAL(unsigned, run_q_len); /* number of processes on the run queues */
+
+/* SENDREC calls, those that took the fast path and those handed the cpu over */
+DECLARE_CPULOCAL(unsigned, ipc_sendrec);
+DECLARE_CPULOCAL(unsigned, ipc_fastpath);
+DECLARE_CPULOCAL(unsigned, ipc_handoff);
+
+/* verified grants, and how often safecopies could use them */
+DECLARE_CPULOCAL(struct grant_cache, grant_cache[GRANT_CACHE_SIZE]);
+DECLARE_CPULOCAL(unsigned, grant_cache_hits);
+DECLARE_CPULOCAL(unsigned, grant_cache_misses);
 
 DECLARE_CPULOCAL(volatile int, idle_interrupted); /* to interrupt busy-idle
 						     while profiling */
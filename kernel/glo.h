@@ -32,6 +32,7 @@ EXTERN unsigned lost_ticks;	/* clock ticks counted outside clock task */
 EXTERN char *ipc_call_names[IPCNO_HIGHEST+1]; /* human-readable call names */
 EXTERN struct proc *kbill_kcall; /* process that made kernel call */
 EXTERN struct proc *kbill_ipc; /* process that invoked ipc */
+EXTERN unsigned grant_gen;	/* last grant generation handed out */
 
 /* Interrupt related variables. */
 EXTERN irq_hook_t irq_hooks[NR_IRQ_HOOKS];	/* hooks for general use */
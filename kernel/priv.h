@@ -39,6 +39,7 @@ struct priv {
   endpoint_t s_bak_sig_mgr;	/* backup signal manager for system signals */
   sys_map_t s_notify_pending;  	/* bit map with pending notifications */
   sys_map_t s_asyn_pending;	/* bit map with pending asyn messages */
+  sys_id_t s_asyn_next;		/* round-robin start for async source scan */
   irq_id_t s_int_pending;	/* pending hardware interrupts */
   sigset_t s_sig_pending;	/* pending signals */
 
@@ -55,6 +56,8 @@ struct priv {
   int s_irq_tab[NR_IRQ];
   vir_bytes s_grant_table;	/* grant table address of process, or 0 */
   int s_grant_entries;		/* no. of entries, or 0 */
+  unsigned s_grant_gen;		/* changes whenever the process may have
+				 * changed its grant table */
 };
 
 /* Guard word for task stacks. */
@@ -77,6 +80,18 @@ struct priv {
 
 #define may_send_to(rp, nr) (get_sys_bit(priv(rp)->s_ipc_to, nr_to_id(nr)))
 
+/* Drop any grants of a process that the kernel has cached, by giving it a
+ * new grant generation. Generation 0 is never handed out.
+ */
+#define new_grant_gen(rp)	\
+	(priv(rp)->s_grant_gen= (++grant_gen ? grant_gen : ++grant_gen))
+
+/* Set a process' grant table location and size. */
+#define set_grant_table(rp, ptr, entries)	\
+	priv(rp)->s_grant_table= (ptr);		\
+	priv(rp)->s_grant_entries= (entries);	\
+	new_grant_gen(rp);
+
 /* The system structures table and pointers to individual table slots. The 
  * pointers allow faster access because now a process entry can be found by 
  * indexing the psys_addr array, while accessing an element i requires a 
@@ -54,6 +54,8 @@ static void idle(void);
 static int mini_send(struct proc *caller_ptr, endpoint_t dst_e, message
 	*m_ptr, int flags);
 */
+static int fast_sendrec(struct proc *caller_ptr, struct proc *dst_ptr,
+	message *m_ptr, int *result);
 static int mini_receive(struct proc *caller_ptr, endpoint_t src,
 	message *m_ptr, int flags);
 static int mini_senda(struct proc *caller_ptr, asynmsg_t *table, size_t
@@ -374,6 +376,11 @@ check_misc_flags:
 	p = arch_finish_switch_to_user();
 	assert(!is_zero64(p->p_cpu_time_left));
 
+	/* The process may change its grant table from now on, so grants the
+	 * kernel cached from it can no longer be trusted.
+	 */
+	new_grant_gen(p);
+
 	context_stop(proc_addr(KERNEL));
 
 	/* If the process isn't the owner of FPU, enable the FPU exception */
@@ -502,6 +509,9 @@ static int do_sync_ipc(struct proc * caller_ptr, /* who made the call */
   case SENDREC:
 	/* A flag is set so that notifications cannot interrupt SENDREC. */
 	caller_ptr->p_misc_flags |= MF_REPLY_PEND;
+	get_cpulocal_var(ipc_sendrec)++;
+	if (fast_sendrec(caller_ptr, proc_addr(src_dst_p), m_ptr, &result))
+		break;
 	/* fall through */
   case SEND:			
 	result = mini_send(caller_ptr, src_dst_e, m_ptr, 0);
@@ -879,6 +889,85 @@ int mini_send(
   return(OK);
 }
 
+/*===========================================================================*
+ *				fast_sendrec				     *
+ *===========================================================================*/
+static int fast_sendrec(
+  struct proc *caller_ptr,		/* who is doing the SENDREC? */
+  struct proc *dst_ptr,			/* to whom is the request sent? */
+  message *m_ptr,			/* pointer to message buffer */
+  int *result				/* result of the call, if handled */
+)
+{
+/* Handle the common case of SENDREC, a request to a server that is blocked
+ * in RECEIVE from ANY, without going through mini_send() and mini_receive().
+ * The request is delivered right away, so the caller can only wait for the
+ * reply: there is no deadlock to look for and the caller queue, pending
+ * notifications and asynchronous messages need not be looked at. If the
+ * server may run before anything else on this cpu, switch to it directly
+ * instead of picking it from the run queues. Return TRUE if the call was
+ * handled, FALSE if the regular path has to be taken.
+ */
+  if (iskernelp(dst_ptr) ||
+	(caller_ptr->p_misc_flags & (MF_SC_TRACE | MF_SC_ACTIVE | MF_SIG_DELAY)))
+	return(FALSE);
+
+  /* The destination must be waiting for anyone, and nothing else. The caller
+   * must not have an asynchronous message from the destination pending, it
+   * would have to be received first.
+   */
+  if (dst_ptr->p_rts_flags != RTS_RECEIVING || dst_ptr->p_getfrom_e != ANY ||
+	(dst_ptr->p_misc_flags & MF_DELIVERMSG) ||
+	has_pending_asend(caller_ptr, proc_nr(dst_ptr)) != NULL_PRIV_ID)
+	return(FALSE);
+  }
+
+  if (copy_msg_from_user(caller_ptr, m_ptr, &dst_ptr->p_delivermsg)) {
+	*result = EFAULT;
+	return(TRUE);
+  }
+
+  dst_ptr->p_delivermsg.m_source = caller_ptr->p_endpoint;
+  dst_ptr->p_misc_flags |= MF_DELIVERMSG;
+  dst_ptr->p_misc_flags &= ~MF_REPLY_PEND;
+  IPC_STATUS_ADD_CALL(dst_ptr, SENDREC);
+
+#if DEBUG_IPC_HOOK
+  hook_ipc_msgsend(&dst_ptr->p_delivermsg, caller_ptr, dst_ptr);
+  hook_ipc_msgrecv(&dst_ptr->p_delivermsg, caller_ptr, dst_ptr);
+#endif
+
+  /* The caller blocks for the reply, MF_REPLY_PEND stays set. */
+  caller_ptr->p_delivermsg_vir = (vir_bytes) m_ptr;
+  caller_ptr->p_getfrom_e = dst_ptr->p_endpoint;
+  RTS_SET(caller_ptr, RTS_RECEIVING);
+  RTS_UNSET(dst_ptr, RTS_RECEIVING);
+
+  /* enqueue() may have marked the caller preempted. It is not runnable, so
+   * there is nothing to put back, just as in switch_to_user().
+   */
+  caller_ptr->p_rts_flags &= ~RTS_PREEMPTED;
+
+  get_cpulocal_var(ipc_fastpath)++;
+
+  /* The caller was the process to run on this cpu. If the destination is at
+   * least as important, nothing else can be picked before it. A pending TLB
+   * flush is left to switch_to_user().
+   */
+  if (dst_ptr->p_cpu == cpuid &&
+	dst_ptr->p_priority <= caller_ptr->p_priority &&
+	!(dst_ptr->p_misc_flags & MF_FLUSH_TLB)) {
+	get_cpulocal_var(proc_ptr) = dst_ptr;
+	if (priv(dst_ptr)->s_flags & BILLABLE)
+		get_cpulocal_var(bill_ptr) = dst_ptr;
+	switch_address_space(dst_ptr);
+	get_cpulocal_var(ipc_handoff)++;
+  }
+
+  *result = OK;
+  return(TRUE);
+}
+
 /*===========================================================================*
  *				mini_receive				     * 
  *===========================================================================*/
@@ -1268,26 +1357,76 @@ static int mini_senda(struct proc *caller_ptr, asynmsg_t *table, size_t size)
 }
 
 
+/*===========================================================================*
+ *				next_sys_bit				     *
+ *===========================================================================*/
+static int next_sys_bit(sys_map_t *map, int from, int to)
+{
+/* Return the lowest id in the range [from, to) whose bit is set in 'map', or
+ * -1 if there is none. Whole chunks are skipped at a time and the lowest set
+ * bit within a chunk is found with a find-first-set, so the cost depends on
+ * the number of chunks and not on the number of ids in the range.
+ */
+  int id, bit;
+  bitchunk_t bits;
+
+  for (id = from; id < to; id = (id - CHUNK_OFFSET(id)) + BITCHUNK_BITS) {
+	bits = get_sys_bits(*map, id) >> CHUNK_OFFSET(id);
+	if (bits == 0)
+		continue;
+#ifdef __GNUC__
+	bit = __builtin_ffs(bits) - 1;
+#else
+	for (bit = 0; !(bits & 1); bits >>= 1, bit++)
+		;
+#endif
+	return (id + bit < to) ? id + bit : -1;
+  }
+
+  return(-1);
+}
+
 /*===========================================================================*
  *				try_async				     * 
  *===========================================================================*/
 static int try_async(caller_ptr)
 struct proc *caller_ptr;
 {
-  int r;
+/* Try to receive an asynchronous message from any of the sources that have
+ * their bit set in the caller's pending map. The scan starts where the
+ * previous successful one left off, so that a busy sender with a low
+ * privilege id cannot starve the others.
+ */
+  int r, id, start, end;
   struct priv *privp;
   struct proc *src_ptr;
   sys_map_t *map;
 
   map = &priv(caller_ptr)->s_asyn_pending;
+  start = priv(caller_ptr)->s_asyn_next;
+  if (start < 0 || start >= NR_SYS_PROCS)
+	start = 0;
 
-  /* Try all privilege structures */
-  for (privp = BEG_PRIV_ADDR; privp < END_PRIV_ADDR; ++privp)  {
-	if (privp->s_proc_nr == NONE)
+  /* Visit every pending source once: first [start, NR_SYS_PROCS), then
+   * wrap around to [0, start). try_one() may set the bit of the source it
+   * just handled again, but we never look back at ids we already passed.
+   */
+  id = start;
+  end = NR_SYS_PROCS;
+  for (;;) {
+	if ((id = next_sys_bit(map, id, end)) < 0) {
+		if (end == start || start == 0)
+			break;
+		id = 0;
+		end = start;
 		continue;
+	}
 
-	if (!get_sys_bit(*map, privp->s_id)) 
+	privp = priv_addr(id);
+	if (privp->s_proc_nr == NONE) {
+		id++;
 		continue;
+	}
 
 	src_ptr = proc_addr(privp->s_proc_nr);
 
@@ -1298,13 +1437,17 @@ struct proc *caller_ptr;
 	 */
 	if (RTS_ISSET(src_ptr, RTS_VMINHIBIT)) {
 		src_ptr->p_misc_flags |= MF_SENDA_VM_MISS;
+		id++;
 		continue;
 	}
 #endif
 
 	assert(!(caller_ptr->p_misc_flags & MF_DELIVERMSG));
-	if ((r = try_one(src_ptr, caller_ptr)) == OK)
+	if ((r = try_one(src_ptr, caller_ptr)) == OK) {
+		priv(caller_ptr)->s_asyn_next = (id + 1) % NR_SYS_PROCS;
 		return(r);
+	}
+	id++;
   }
 
   return(ESRCH);
@@ -1536,6 +1679,7 @@ void enqueue(
       rdy_tail[q] = rp;				/* set new queue tail */
       rp->p_nextready = NULL;		/* mark new end */
   }
+  get_cpu_var(rp->p_cpu, run_q_len)++;
 
   if (cpuid == rp->p_cpu) {
 	  /*
@@ -1608,6 +1752,7 @@ static void enqueue_head(struct proc *rp)
   else						/* add to head of queue */
       rp->p_nextready = rdy_head[q];		/* chain head of queue */
       rdy_head[q] = rp;				/* set new queue head */
+  get_cpu_var(rp->p_cpu, run_q_len)++;
 
   /* Make note of when this process was added to queue */
   read_tsc_64(&(get_cpulocal_var(proc_ptr->p_accounting.enter_queue)));
@@ -1662,6 +1807,7 @@ void dequeue(struct proc *rp)
           if (rp == rdy_tail[q]) {		/* queue tail removed */
               rdy_tail[q] = prev_xp;		/* set new tail */
 	  }
+	  get_cpu_var(rp->p_cpu, run_q_len)--;
 
           break;
       }
@@ -1794,6 +1940,7 @@ static void notify_scheduler(struct proc *p)
 	m_no_quantum.SCHEDULING_ACNT_PREEMPT   = p->p_accounting.preempted;
 	m_no_quantum.SCHEDULING_ACNT_CPU       = cpuid;
 	m_no_quantum.SCHEDULING_ACNT_CPU_LOAD  = cpu_load();
+	m_no_quantum.SCHEDULING_ACNT_CPU_RUNQ  = get_cpulocal_var(run_q_len);
 
 	/* Reset accounting */
 	reset_proc_accounting(p);
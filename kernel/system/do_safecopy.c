@@ -14,6 +14,7 @@
  *      VSCP_VEC_SIZE   number of significant elements in vector
  */
 
+#include <stddef.h>
 #include <minix/type.h>
 #include <minix/safecopies.h>
 
@@ -29,6 +30,69 @@ static int safecopy(struct proc *, endpoint_t, endpoint_t,
 #define HASGRANTTABLE(gr) \
 	(priv(gr) && priv(gr)->s_grant_table)
 
+/*===========================================================================*
+ *				grant_cache_slot			     *
+ *===========================================================================*/
+static struct grant_cache *grant_cache_slot(endpoint_t granter,
+	cp_grant_id_t grant)
+{
+	return get_cpulocal_var(grant_cache) +
+		((granter * 31 + grant) & (GRANT_CACHE_SIZE - 1));
+}
+
+/*===========================================================================*
+ *				grant_cache_get				     *
+ *===========================================================================*/
+static int grant_cache_get(const struct proc *granter_proc,
+	cp_grant_id_t grant, cp_grant_t *g)
+{
+/* Look for a grant that was copied in before and has not changed since,
+ * which saves copying it in from the granter again.
+ */
+	struct grant_cache *gc;
+
+	gc = grant_cache_slot(granter_proc->p_endpoint, grant);
+	if(gc->gc_granter == granter_proc->p_endpoint &&
+		gc->gc_grant == grant &&
+		gc->gc_gen == priv(granter_proc)->s_grant_gen) {
+		*g = gc->gc_g;
+		get_cpulocal_var(grant_cache_hits)++;
+		return TRUE;
+	}
+
+	get_cpulocal_var(grant_cache_misses)++;
+	return FALSE;
+}
+
+/*===========================================================================*
+ *				grant_cache_put				     *
+ *===========================================================================*/
+static void grant_cache_put(const struct proc *granter_proc,
+	cp_grant_id_t grant, unsigned gen, const cp_grant_t *g)
+{
+/* Remember a grant that was just copied in, using the grant generation the
+ * granter had before the copy. Writes to the grant table are invisible to
+ * us, but the granter can only change its grant table while it runs, and
+ * switch_to_user() gives it a new grant generation every time it does. So
+ * the grant is kept only if the granter is blocked and not running on any
+ * cpu right now; typically it is waiting for the reply to the request that
+ * carries the grant. Indirect grants depend on other tables and are not
+ * cached.
+ */
+	struct grant_cache *gc;
+
+	if(!(g->cp_flags & (CPF_DIRECT | CPF_MAGIC)) ||
+		proc_is_runnable(granter_proc) ||
+		get_cpu_var(granter_proc->p_cpu, proc_ptr) == granter_proc)
+		return;
+
+	gc = grant_cache_slot(granter_proc->p_endpoint, grant);
+	gc->gc_granter = granter_proc->p_endpoint;
+	gc->gc_grant = grant;
+	gc->gc_gen = gen;
+	gc->gc_g = *g;
+}
+
 /*===========================================================================*
  *				verify_grant				     *
  *===========================================================================*/
@@ -45,7 +109,8 @@ endpoint_t *e_granter;		/* new granter (magic grants) */
 	static cp_grant_t g;
 	static int proc_nr;
 	static const struct proc *granter_proc;
-	int depth = 0;
+	int depth = 0, cached;
+	unsigned gen = 0;
 
 	do {
 		/* Get granter process slot (if valid), and check range of
@@ -85,11 +150,16 @@ endpoint_t *e_granter;		/* new granter (magic grants) */
 		}
 
 		/* Copy the grant entry corresponding to this id to see what it
-		 * looks like. If it fails, hide the fact that granter has
-		 * (presumably) set an invalid grant table entry by returning
-		 * EPERM, just like with an invalid grant id.
+		 * looks like, unless it is in the grant cache. If it fails,
+		 * hide the fact that granter has (presumably) set an invalid
+		 * grant table entry by returning EPERM, just like with an
+		 * invalid grant id.
 		 */
-		if(data_copy(granter,
+		if(depth == 0)
+			gen = priv(granter_proc)->s_grant_gen;
+		cached = (depth == 0 &&
+			grant_cache_get(granter_proc, grant, &g));
+		if(!cached && data_copy(granter,
 			priv(granter_proc)->s_grant_table + sizeof(g)*grant,
 			KERNEL, (vir_bytes) &g, sizeof(g)) != OK) {
 			printf(
@@ -105,6 +175,8 @@ endpoint_t *e_granter;		/* new granter (magic grants) */
 				grant, g.cp_flags);
 			return EPERM;
 		}
+		if(!cached && depth == 0)
+			grant_cache_put(granter_proc, grant, gen, &g);
 
 		/* The given grant may be an indirect grant, that is, a grant
 		 * that provides permission to use a grant given to the
@@ -20,7 +20,7 @@ int do_setgrant(struct proc * caller, message * m_ptr)
 	if (RTS_ISSET(caller, RTS_NO_PRIV) || !(priv(caller))) {
 		r = EPERM;
 	} else {
-		_K_SET_GRANT_TABLE(caller,
+		set_grant_table(caller,
 			(vir_bytes) m_ptr->SG_ADDR,
 			m_ptr->SG_SIZE);
 		r = OK;
@@ -92,8 +92,9 @@ int do_vmctl(struct proc * caller, message * m_ptr)
 	case VMCTL_MEMREQ_REPLY:
 		assert(RTS_ISSET(p, RTS_VMREQUEST));
 		assert(p->p_vmrequest.vmresult == VMSUSPEND);
-  		okendpt(p->p_vmrequest.target, &proc_nr);
-		target = proc_addr(proc_nr);
+		/* VM may answer later, when the target may have gone away. */
+		target = isokendpt(p->p_vmrequest.target, &proc_nr) ?
+			proc_addr(proc_nr) : NULL;
 		p->p_vmrequest.vmresult = m_ptr->SVMCTL_VALUE;
 		assert(p->p_vmrequest.vmresult != VMSUSPEND);
 
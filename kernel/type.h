@@ -3,6 +3,7 @@
 
 #include <minix/com.h>
 #include <machine/interrupt.h>
+#include <minix/safecopies.h>
 
 /* Process table and system property related types. */ 
 typedef int proc_nr_t;			/* process table entry number */
@@ -46,4 +47,15 @@ typedef struct irq_hook {
 
 typedef int (*irq_handler_t)(struct irq_hook *);
 
+/* A direct or magic grant the kernel has copied in from a granter's table.
+ * It stays valid as long as the granter's grant generation is unchanged;
+ * generation 0 is never handed out, so a zeroed entry is unused.
+ */
+struct grant_cache {
+  endpoint_t gc_granter;		/* granter */
+  cp_grant_id_t gc_grant;		/* grant id in its table */
+  unsigned gc_gen;			/* s_grant_gen when copied in */
+  cp_grant_t gc_g;			/* the grant itself */
+};
+
 #endif /* TYPE_H */
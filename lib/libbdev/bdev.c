@@ -190,22 +190,13 @@ static int bdev_vrdwt_setup(int req, dev_t dev, u64_t pos, iovec_t *vec,
   access = (req == BDEV_GATHER) ? CPF_WRITE : CPF_READ;
   size = 0;
 
-  for (i = 0; i < count; i++) {
-	grant = cpf_grant_direct(endpt, vec[i].iov_addr, vec[i].iov_size,
-		access);
-
-	if (!GRANT_VALID(grant)) {
-		printf("bdev: unable to allocate grant!\n");
-
-		for (i--; i >= 0; i--)
-			cpf_revoke(gvec[i].iov_grant);
-
-		return EINVAL;
-	}
+  if (cpf_grant_vec(endpt, vec, gvec, count, access) != OK) {
+	printf("bdev: unable to allocate grant!\n");
 
-	gvec[i].iov_grant = grant;
-	gvec[i].iov_size = vec[i].iov_size;
+	return EINVAL;
+  }
 
+  for (i = 0; i < count; i++) {
 	assert((ssize_t) (size + vec[i].iov_size) > size);
 
 	size += vec[i].iov_size;
@@ -217,8 +208,7 @@ static int bdev_vrdwt_setup(int req, dev_t dev, u64_t pos, iovec_t *vec,
   if (!GRANT_VALID(grant)) {
 	printf("bdev: unable to allocate grant!\n");
 
-	for (i = count - 1; i >= 0; i--)
-		cpf_revoke(gvec[i].iov_grant);
+	cpf_revoke_vec(gvec, count);
 
 	return EINVAL;
   }
@@ -240,14 +230,12 @@ static void bdev_vrdwt_cleanup(const message *m, iovec_s_t *gvec)
 /* Clean up a vectored read/write request.
  */
   cp_grant_id_t grant;
-  int i;
 
   grant = m->BDEV_GRANT;
 
   cpf_revoke(grant);
 
-  for (i = m->BDEV_COUNT - 1; i >= 0; i--)
-	cpf_revoke(gvec[i].iov_grant);
+  cpf_revoke_vec(gvec, m->BDEV_COUNT);
 }
 
 static ssize_t bdev_vrdwt(int req, dev_t dev, u64_t pos, iovec_t *vec,
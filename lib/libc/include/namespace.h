@@ -924,6 +924,7 @@
 #define minix_mmap _minix_mmap
 #define minix_munmap _minix_munmap
 #define minix_munmap_text _minix_munmap_text
+#define msync _msync
 #define vfork _vfork
 #endif /* __minix */
 
@@ -99,6 +99,7 @@ static int _tcp_getsockopt(int sock, int level, int option_name,
 	void *__restrict option_value, socklen_t *__restrict option_len)
 {
 	int i, r, err;
+	nwio_tcpbuf_t tcpbuf;
 
 	if (level == SOL_SOCKET && option_name == SO_REUSEADDR)
 	{
@@ -121,17 +122,20 @@ static int _tcp_getsockopt(int sock, int level, int option_name,
 		getsockopt_copy(&err, sizeof(err), option_value, option_len);
 		return 0;
 	}
-	if (level == SOL_SOCKET && option_name == SO_RCVBUF)
-	{
-		i = 32 * 1024;	/* Receive buffer in the current 
-		              	 * implementation 
-				 */
-		getsockopt_copy(&i, sizeof(i), option_value, option_len);
-		return 0;
-	}
-	if (level == SOL_SOCKET && option_name == SO_SNDBUF)
+	if (level == SOL_SOCKET &&
+		(option_name == SO_RCVBUF || option_name == SO_SNDBUF))
 	{
-		i = 32 * 1024;	/* Send buffer in the current implementation */
+		r = ioctl(sock, NWIOGTCPBUF, &tcpbuf);
+		if (r == -1 && (errno == ENOTTY || errno == EBADIOCTL))
+		{
+			/* Fixed size buffers in inet */
+			tcpbuf.nwtb_rcvbuf = tcpbuf.nwtb_sndbuf = 32 * 1024;
+		}
+		else if (r != 0)
+			return r;
+
+		i = (option_name == SO_RCVBUF) ? tcpbuf.nwtb_rcvbuf :
+			tcpbuf.nwtb_sndbuf;
 		getsockopt_copy(&i, sizeof(i), option_value, option_len);
 		return 0;
 	}
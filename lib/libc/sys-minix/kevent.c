@@ -0,0 +1,22 @@
+#include <sys/cdefs.h>
+#include <lib.h>
+#include "namespace.h"
+
+#include <sys/event.h>
+#include <time.h>
+
+int kevent(int kq, const struct kevent *changelist, size_t nchanges,
+	struct kevent *eventlist, size_t nevents,
+	const struct timespec *timeout)
+{
+  message m;
+
+  m.KEV_KQ = kq;
+  m.KEV_NCHANGES = (int) nchanges;
+  m.KEV_NEVENTS = (int) nevents;
+  m.KEV_CHANGES = (char *) changelist;
+  m.KEV_EVENTS = (char *) eventlist;
+  m.KEV_TIMEOUT = (char *) timeout;
+
+  return (_syscall(VFS_PROC_NR, KEVENT, &m));
+}
@@ -0,0 +1,12 @@
+#include <sys/cdefs.h>
+#include <lib.h>
+#include "namespace.h"
+
+#include <sys/event.h>
+
+int kqueue(void)
+{
+  message m;
+
+  return(_syscall(VFS_PROC_NR, KQUEUE, &m));
+}
@@ -13,6 +13,7 @@ __weak_alias(vm_getrefcount, _vm_getrefcount)
 __weak_alias(minix_mmap, _minix_mmap)
 __weak_alias(minix_munmap, _minix_munmap)
 __weak_alias(minix_munmap_text, _minix_munmap_text)
+__weak_alias(msync, _msync)
 #endif
 
 
@@ -64,6 +65,17 @@ int minix_munmap_text(void *addr, size_t len)
 	return _syscall(VM_PROC_NR, VM_MUNMAP_TEXT, &m);
 }
 
+int msync(void *addr, size_t len, int flags)
+{
+	message m;
+
+	m.VMMS_ADDR = addr;
+	m.VMMS_LEN = len;
+	m.VMMS_FLAGS = flags;
+
+	return _syscall(VM_PROC_NR, VM_MSYNC, &m);
+}
+
 void *vm_remap(endpoint_t d,
 			endpoint_t s,
 			void *da,
@@ -20,6 +20,8 @@
 static int _tcp_setsockopt(int sock, int level, int option_name,
 	const void *option_value, socklen_t option_len);
 
+static int _tcp_setbufsize(int sock, u32_t rcvbuf, u32_t sndbuf);
+
 static int _udp_setsockopt(int sock, int level, int option_name,
 	const void *option_value, socklen_t option_len);
 
@@ -127,17 +129,12 @@ static int _tcp_setsockopt(int sock, int level, int option_name,
 			return -1;
 		}
 		i= *(const int *)option_value;
-		if (i > 32*1024)
+		if (i <= 0)
 		{
-			/* The receive buffer is limited to 32K at the moment.
-			 */
-			errno= ENOSYS;
+			errno= EINVAL;
 			return -1;
 		}
-		/* There is no way to reduce the receive buffer, do we have to
-		 * let this call fail for smaller buffers?
-		 */
-		return 0;
+		return _tcp_setbufsize(sock, i, 0);
 	}
 	if (level == SOL_SOCKET && option_name == SO_SNDBUF)
 	{
@@ -147,17 +144,12 @@ static int _tcp_setsockopt(int sock, int level, int option_name,
 			return -1;
 		}
 		i= *(const int *)option_value;
-		if (i > 32*1024)
+		if (i <= 0)
 		{
-			/* The send buffer is limited to 32K at the moment.
-			 */
-			errno= ENOSYS;
+			errno= EINVAL;
 			return -1;
 		}
-		/* There is no way to reduce the send buffer, do we have to
-		 * let this call fail for smaller buffers?
-		 */
-		return 0;
+		return _tcp_setbufsize(sock, 0, i);
 	}
 	if (level == IPPROTO_TCP && option_name == TCP_NODELAY)
 	{
@@ -186,6 +178,29 @@ static int _tcp_setsockopt(int sock, int level, int option_name,
 	return -1;
 }
 
+static int _tcp_setbufsize(int sock, u32_t rcvbuf, u32_t sndbuf)
+{
+	nwio_tcpbuf_t tcpbuf;
+	int r;
+
+	/* The network service may cap the sizes. A size of 0 leaves that
+	 * buffer alone.
+	 */
+	tcpbuf.nwtb_rcvbuf= rcvbuf;
+	tcpbuf.nwtb_sndbuf= sndbuf;
+	r= ioctl(sock, NWIOSTCPBUF, &tcpbuf);
+	if (r != -1 || (errno != ENOTTY && errno != EBADIOCTL))
+		return r;
+
+	/* The buffers of inet are limited to 32K and can't be resized. */
+	if (rcvbuf > 32*1024 || sndbuf > 32*1024)
+	{
+		errno= ENOSYS;
+		return -1;
+	}
+	return 0;
+}
+
 static int _udp_setsockopt(int sock, int level, int option_name,
 	const void *option_value, socklen_t option_len)
 {
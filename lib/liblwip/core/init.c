@@ -99,9 +99,15 @@
 #if (LWIP_TCP && (MEMP_NUM_TCP_PCB<=0))
   #error "If you want to use TCP, you have to define MEMP_NUM_TCP_PCB>=1 in your lwipopts.h"
 #endif
-#if (LWIP_TCP && (TCP_WND > 0xffff))
+#if (LWIP_TCP && !LWIP_WND_SCALE && (TCP_WND > 0xffff))
   #error "If you want to use TCP, TCP_WND must fit in an u16_t, so, you have to reduce it in your lwipopts.h"
 #endif
+#if (LWIP_TCP && !LWIP_WND_SCALE && (TCP_SND_BUF > 0xffff))
+  #error "If you want to use TCP, TCP_SND_BUF must fit in an u16_t, so, you have to reduce it in your lwipopts.h"
+#endif
+#if (LWIP_TCP && LWIP_WND_SCALE && ((TCP_RCV_SCALE > 14) || (TCP_WND > (0xffffUL << TCP_RCV_SCALE))))
+  #error "If you want to use TCP window scaling, TCP_RCV_SCALE must be at most 14 and TCP_WND must fit in (0xffff << TCP_RCV_SCALE), so, you have to change them in your lwipopts.h"
+#endif
 #if (LWIP_TCP && (TCP_SND_QUEUELEN > 0xffff))
   #error "If you want to use TCP, TCP_SND_QUEUELEN must fit in an u16_t, so, you have to reduce it in your lwipopts.h"
 #endif
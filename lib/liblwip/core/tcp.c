@@ -140,7 +140,7 @@ tcp_close_shutdown(struct tcp_pcb *pcb, u8_t rst_on_unacked_data)
   err_t err;
 
   if (rst_on_unacked_data && (pcb->state != LISTEN)) {
-    if ((pcb->refused_data != NULL) || (pcb->rcv_wnd != TCP_WND)) {
+    if ((pcb->refused_data != NULL) || (pcb->rcv_wnd != pcb->rcv_wnd_max)) {
       /* Not all data received by application, send RST to tell the remote
          side about this. */
       LWIP_ASSERT("pcb->flags & TF_RXCLOSED", pcb->flags & TF_RXCLOSED);
@@ -518,6 +518,8 @@ tcp_listen_with_backlog(struct tcp_pcb *pcb, u8_t backlog)
   lpcb->so_options |= SOF_ACCEPTCONN;
   lpcb->ttl = pcb->ttl;
   lpcb->tos = pcb->tos;
+  lpcb->rcv_wnd_max = pcb->rcv_wnd_max;
+  lpcb->snd_buf_max = pcb->snd_buf_max;
   ip_addr_copy(lpcb->local_ip, pcb->local_ip);
   TCP_RMV(&tcp_bound_pcbs, pcb);
   memp_free(MEMP_TCP_PCB, pcb);
@@ -542,7 +544,7 @@ u32_t tcp_update_rcv_ann_wnd(struct tcp_pcb *pcb)
 {
   u32_t new_right_edge = pcb->rcv_nxt + pcb->rcv_wnd;
 
-  if (TCP_SEQ_GEQ(new_right_edge, pcb->rcv_ann_right_edge + LWIP_MIN((TCP_WND / 2), pcb->mss))) {
+  if (TCP_SEQ_GEQ(new_right_edge, pcb->rcv_ann_right_edge + LWIP_MIN((pcb->rcv_wnd_max / 2), pcb->mss))) {
     /* we can advertise more window */
     pcb->rcv_ann_wnd = pcb->rcv_wnd;
     return new_right_edge - pcb->rcv_ann_right_edge;
@@ -554,8 +556,10 @@ u32_t tcp_update_rcv_ann_wnd(struct tcp_pcb *pcb)
     } else {
       /* keep the right edge of window constant */
       u32_t new_rcv_ann_wnd = pcb->rcv_ann_right_edge - pcb->rcv_nxt;
+#if !LWIP_WND_SCALE
       LWIP_ASSERT("new_rcv_ann_wnd <= 0xffff", new_rcv_ann_wnd <= 0xffff);
-      pcb->rcv_ann_wnd = (u16_t)new_rcv_ann_wnd;
+#endif /* !LWIP_WND_SCALE */
+      pcb->rcv_ann_wnd = (tcpwnd_size_t)new_rcv_ann_wnd;
     }
     return 0;
   }
@@ -575,26 +579,127 @@ tcp_recved(struct tcp_pcb *pcb, u16_t len)
   int wnd_inflation;
 
   LWIP_ASSERT("tcp_recved: len would wrap rcv_wnd\n",
-              len <= 0xffff - pcb->rcv_wnd );
+              (tcpwnd_size_t)(pcb->rcv_wnd + len) >= pcb->rcv_wnd);
 
   pcb->rcv_wnd += len;
-  if (pcb->rcv_wnd > TCP_WND) {
-    pcb->rcv_wnd = TCP_WND;
+  if (pcb->rcv_wnd > pcb->rcv_wnd_max) {
+    pcb->rcv_wnd = pcb->rcv_wnd_max;
   }
 
   wnd_inflation = tcp_update_rcv_ann_wnd(pcb);
 
   /* If the change in the right edge of window is significant (default
-   * watermark is TCP_WND/4), then send an explicit update now.
+   * watermark is TCP_WND/4, less for a shrunken receive buffer), then
+   * send an explicit update now.
    * Otherwise wait for a packet to be sent in the normal course of
    * events (or more window to be available later) */
-  if (wnd_inflation >= TCP_WND_UPDATE_THRESHOLD) {
+  if (wnd_inflation >= LWIP_MIN(TCP_WND_UPDATE_THRESHOLD,
+                                pcb->rcv_wnd_max / 4)) {
     tcp_ack_now(pcb);
     tcp_output(pcb);
   }
 
-  LWIP_DEBUGF(TCP_DEBUG, ("tcp_recved: recveived %"U16_F" bytes, wnd %"U16_F" (%"U16_F").\n",
-         len, pcb->rcv_wnd, TCP_WND - pcb->rcv_wnd));
+  LWIP_DEBUGF(TCP_DEBUG, ("tcp_recved: recveived %"U16_F" bytes, wnd %"U32_F" (%"U32_F").\n",
+         len, (u32_t)pcb->rcv_wnd, (u32_t)(pcb->rcv_wnd_max - pcb->rcv_wnd)));
+}
+
+/**
+ * Change the size of the send buffer of a pcb. Data that is already
+ * queued stays queued, so the buffer does not shrink below what is in
+ * use right now.
+ *
+ * @param pcb the tcp_pcb to change; for a listening pcb, the connections
+ *        it accepts get the new size
+ * @param size the new size of the send buffer in bytes
+ */
+void
+tcp_set_sndbuf(struct tcp_pcb *pcb, tcpwnd_size_t size)
+{
+  tcpwnd_size_t used;
+
+  if (size < TCP_MSS) {
+    size = TCP_MSS;
+  }
+
+  if (pcb->state == LISTEN) {
+    /* only for the connections it accepts */
+    ((struct tcp_pcb_listen *)pcb)->snd_buf_max = size;
+    return;
+  }
+
+  used = pcb->snd_buf_max - pcb->snd_buf;
+  if (size < used) {
+    size = used;
+  }
+  pcb->snd_buf_max = size;
+  pcb->snd_buf = size - used;
+
+  LWIP_DEBUGF(TCP_DEBUG, ("tcp_set_sndbuf: size %"U32_F", available %"U32_F"\n",
+         (u32_t)size, (u32_t)pcb->snd_buf));
+}
+
+/**
+ * Change the size of the receive buffer, and so of the largest window
+ * that will be announced, of a pcb. Without window scaling on the
+ * connection the window cannot exceed 64 KB. A window that was already
+ * announced is never taken back; a smaller buffer only stops the right
+ * edge from moving until the application has caught up.
+ *
+ * @param pcb the tcp_pcb to change; for a listening pcb, the connections
+ *        it accepts get the new size
+ * @param size the new size of the receive buffer in bytes
+ */
+void
+tcp_set_rcvbuf(struct tcp_pcb *pcb, tcpwnd_size_t size)
+{
+  tcpwnd_size_t old;
+  u32_t max;
+
+#if LWIP_WND_SCALE
+  /* Until the SYN exchange is over, we may still get to scale */
+  if (pcb->state == LISTEN || pcb->state == CLOSED ||
+      pcb->state == SYN_SENT || (pcb->flags & TF_WND_SCALE)) {
+    max = (u32_t)0xffff << TCP_RCV_SCALE;
+  } else
+#endif /* LWIP_WND_SCALE */
+  {
+    max = 0xffff;
+  }
+  if (size > max) {
+    size = (tcpwnd_size_t)max;
+  }
+  if (size < TCP_MSS) {
+    size = TCP_MSS;
+  }
+
+  if (pcb->state == LISTEN) {
+    /* only for the connections it accepts */
+    ((struct tcp_pcb_listen *)pcb)->rcv_wnd_max = size;
+    return;
+  }
+
+  old = pcb->rcv_wnd_max;
+  pcb->rcv_wnd_max = size;
+  if (size >= old) {
+    pcb->rcv_wnd += size - old;
+  } else if (pcb->rcv_wnd > old - size) {
+    pcb->rcv_wnd -= old - size;
+  } else {
+    pcb->rcv_wnd = 0;
+  }
+
+  if (pcb->state == CLOSED) {
+    pcb->rcv_ann_wnd = pcb->rcv_wnd;
+  } else if (size > old && pcb->state != SYN_SENT &&
+             tcp_update_rcv_ann_wnd(pcb) >= LWIP_MIN(TCP_WND_UPDATE_THRESHOLD,
+                                                     pcb->rcv_wnd_max / 4)) {
+    /* let the remote end know about the larger window right away */
+    tcp_ack_now(pcb);
+    tcp_output(pcb);
+  }
+
+  LWIP_DEBUGF(TCP_DEBUG, ("tcp_set_rcvbuf: size %"U32_F", wnd %"U32_F"\n",
+         (u32_t)size, (u32_t)pcb->rcv_wnd));
 }
 
 /**
@@ -699,8 +804,8 @@ tcp_connect(struct tcp_pcb *pcb, ip_addr_t *ipaddr, u16_t port,
   pcb->snd_nxt = iss;
   pcb->lastack = iss - 1;
   pcb->snd_lbb = iss - 1;
-  pcb->rcv_wnd = TCP_WND;
-  pcb->rcv_ann_wnd = TCP_WND;
+  pcb->rcv_wnd = pcb->rcv_wnd_max;
+  pcb->rcv_ann_wnd = pcb->rcv_wnd_max;
   pcb->rcv_ann_right_edge = pcb->rcv_nxt;
   pcb->snd_wnd = TCP_WND;
   /* As initial send MSS, we use TCP_MSS but limit it to 536.
@@ -742,7 +847,7 @@ void
 tcp_slowtmr(void)
 {
   struct tcp_pcb *pcb, *pcb2, *prev;
-  u16_t eff_wnd;
+  tcpwnd_size_t eff_wnd;
   u8_t pcb_remove;      /* flag if a PCB should be removed */
   u8_t pcb_reset;       /* flag if a RST should be sent when removing */
   err_t err;
@@ -1198,9 +1303,9 @@ tcp_alloc(u8_t prio)
   if (pcb != NULL) {
     memset(pcb, 0, sizeof(struct tcp_pcb));
     pcb->prio = prio;
-    pcb->snd_buf = TCP_SND_BUF;
+    pcb->snd_buf = pcb->snd_buf_max = TCP_SND_BUF;
     pcb->snd_queuelen = 0;
-    pcb->rcv_wnd = TCP_WND;
+    pcb->rcv_wnd = pcb->rcv_wnd_max = TCP_WND;
     pcb->rcv_ann_wnd = TCP_WND;
     pcb->tos = 0;
     pcb->ttl = TCP_TTL;
@@ -69,12 +69,25 @@ static u16_t tcplen;
 static u8_t recv_flags;
 static struct pbuf *recv_data;
 
+#if LWIP_TCP_SACK
+/* SACK blocks of the segment being processed, set by tcp_parseopt() */
+static u32_t sack_left[LWIP_TCP_MAX_SACK_BLOCKS];
+static u32_t sack_right[LWIP_TCP_MAX_SACK_BLOCKS];
+static u8_t sack_count;
+#endif /* LWIP_TCP_SACK */
+
 struct tcp_pcb *tcp_input_pcb;
 
 /* Forward declarations. */
 static err_t tcp_process(struct tcp_pcb *pcb);
 static void tcp_receive(struct tcp_pcb *pcb);
 static void tcp_parseopt(struct tcp_pcb *pcb);
+#if LWIP_WND_SCALE
+static void tcp_wnd_scale_done(struct tcp_pcb *pcb);
+#endif /* LWIP_WND_SCALE */
+#if LWIP_TCP_SACK
+static u32_t tcp_sack_mark(struct tcp_pcb *pcb);
+#endif /* LWIP_TCP_SACK */
 
 static err_t tcp_listen_input(struct tcp_pcb_listen *pcb);
 static err_t tcp_timewait_input(struct tcp_pcb *pcb);
@@ -338,8 +351,11 @@ tcp_input(struct pbuf *p, struct netif *inp)
         /* If the application has registered a "sent" function to be
            called when new send buffer space is available, we call it
            now. */
-        if (pcb->acked > 0) {
-          TCP_EVENT_SENT(pcb, pcb->acked, err);
+        while (pcb->acked > 0) {
+          /* the sent callback takes at most 64 KB at a time */
+          u16_t acked16 = (u16_t)LWIP_MIN(pcb->acked, 0xffffU);
+          pcb->acked -= acked16;
+          TCP_EVENT_SENT(pcb, acked16, err);
           if (err == ERR_ABRT) {
             goto aborted;
           }
@@ -375,7 +391,7 @@ tcp_input(struct pbuf *p, struct netif *inp)
         if (recv_flags & TF_GOT_FIN) {
           /* correct rcv_wnd as the application won't call tcp_recved()
              for the FIN's seqno */
-          if (pcb->rcv_wnd != TCP_WND) {
+          if (pcb->rcv_wnd != pcb->rcv_wnd_max) {
             pcb->rcv_wnd++;
           }
           TCP_EVENT_CLOSED(pcb, err);
@@ -478,6 +494,8 @@ tcp_listen_input(struct tcp_pcb_listen *pcb)
     ip_addr_copy(npcb->remote_ip, current_iphdr_src);
     npcb->remote_port = tcphdr->src;
     npcb->state = SYN_RCVD;
+    npcb->rcv_wnd = npcb->rcv_ann_wnd = npcb->rcv_wnd_max = pcb->rcv_wnd_max;
+    npcb->snd_buf = npcb->snd_buf_max = pcb->snd_buf_max;
     npcb->rcv_nxt = seqno + 1;
     npcb->rcv_ann_right_edge = npcb->rcv_nxt;
     npcb->snd_wnd = tcphdr->wnd;
@@ -495,6 +513,9 @@ tcp_listen_input(struct tcp_pcb_listen *pcb)
 
     /* Parse any options in the SYN. */
     tcp_parseopt(npcb);
+#if LWIP_WND_SCALE
+    tcp_wnd_scale_done(npcb);
+#endif /* LWIP_WND_SCALE */
 #if TCP_CALCULATE_EFF_SEND_MSS
     npcb->mss = tcp_eff_send_mss(npcb->mss, &(npcb->remote_ip));
 #endif /* TCP_CALCULATE_EFF_SEND_MSS */
@@ -634,6 +655,9 @@ tcp_process(struct tcp_pcb *pcb)
       pcb->snd_wnd = tcphdr->wnd;
       pcb->snd_wl1 = seqno - 1; /* initialise to seqno - 1 to force window update */
       pcb->state = ESTABLISHED;
+#if LWIP_WND_SCALE
+      tcp_wnd_scale_done(pcb);
+#endif /* LWIP_WND_SCALE */
 
 #if TCP_CALCULATE_EFF_SEND_MSS
       pcb->mss = tcp_eff_send_mss(pcb->mss, &(pcb->remote_ip));
@@ -680,7 +704,7 @@ tcp_process(struct tcp_pcb *pcb)
     if (flags & TCP_ACK) {
       /* expected ACK number? */
       if (TCP_SEQ_BETWEEN(ackno, pcb->lastack+1, pcb->snd_nxt)) {
-        u16_t old_cwnd;
+        tcpwnd_size_t old_cwnd;
         pcb->state = ESTABLISHED;
         LWIP_DEBUGF(TCP_DEBUG, ("TCP connection established %"U16_F" -> %"U16_F".\n", inseg.tcphdr->src, inseg.tcphdr->dest));
 #if LWIP_CALLBACK_API
@@ -852,15 +876,29 @@ tcp_receive(struct tcp_pcb *pcb)
   u32_t right_wnd_edge;
   u16_t new_tot_len;
   int found_dupack = 0;
+  tcpwnd_size_t wnd;
+#if LWIP_TCP_SACK
+  u32_t high_sacked = 0;
+#endif /* LWIP_TCP_SACK */
 
   if (flags & TCP_ACK) {
     right_wnd_edge = pcb->snd_wnd + pcb->snd_wl2;
 
+    /* The window in a SYN is never scaled */
+    wnd = (flags & TCP_SYN) ? tcphdr->wnd : SND_WND_SCALE(pcb, tcphdr->wnd);
+
+#if LWIP_TCP_SACK
+    /* Remember what the remote end already has beyond the hole */
+    if (sack_count > 0) {
+      high_sacked = tcp_sack_mark(pcb);
+    }
+#endif /* LWIP_TCP_SACK */
+
     /* Update window. */
     if (TCP_SEQ_LT(pcb->snd_wl1, seqno) ||
        (pcb->snd_wl1 == seqno && TCP_SEQ_LT(pcb->snd_wl2, ackno)) ||
-       (pcb->snd_wl2 == ackno && tcphdr->wnd > pcb->snd_wnd)) {
-      pcb->snd_wnd = tcphdr->wnd;
+       (pcb->snd_wl2 == ackno && wnd > pcb->snd_wnd)) {
+      pcb->snd_wnd = wnd;
       pcb->snd_wl1 = seqno;
       pcb->snd_wl2 = ackno;
       if (pcb->snd_wnd > 0 && pcb->persist_backoff > 0) {
@@ -869,7 +907,7 @@ tcp_receive(struct tcp_pcb *pcb)
       LWIP_DEBUGF(TCP_WND_DEBUG, ("tcp_receive: window update %"U16_F"\n", pcb->snd_wnd));
 #if TCP_WND_DEBUG
     } else {
-      if (pcb->snd_wnd != tcphdr->wnd) {
+      if (pcb->snd_wnd != wnd) {
         LWIP_DEBUGF(TCP_WND_DEBUG, 
                     ("tcp_receive: no window update lastack %"U32_F" ackno %"
                      U32_F" wl1 %"U32_F" seqno %"U32_F" wl2 %"U32_F"\n",
@@ -915,9 +953,15 @@ tcp_receive(struct tcp_pcb *pcb)
               if (pcb->dupacks > 3) {
                 /* Inflate the congestion window, but not if it means that
                    the value overflows. */
-                if ((u16_t)(pcb->cwnd + pcb->mss) > pcb->cwnd) {
+                if ((tcpwnd_size_t)(pcb->cwnd + pcb->mss) > pcb->cwnd) {
                   pcb->cwnd += pcb->mss;
                 }
+#if LWIP_TCP_SACK
+                /* Fill the next hole the remote end told us about */
+                if ((pcb->flags & TF_SACK) && high_sacked != 0) {
+                  tcp_rexmit_hole(pcb, high_sacked);
+                }
+#endif /* LWIP_TCP_SACK */
               } else if (pcb->dupacks == 3) {
                 /* Do fast retransmit */
                 tcp_rexmit_fast(pcb);
@@ -948,8 +992,9 @@ tcp_receive(struct tcp_pcb *pcb)
       /* Reset the retransmission time-out. */
       pcb->rto = (pcb->sa >> 3) + pcb->sv;
 
-      /* Update the send buffer space. Diff between the two can never exceed 64K? */
-      pcb->acked = (u16_t)(ackno - pcb->lastack);
+      /* Update the send buffer space. Diff between the two can only exceed
+         64K with window scaling. */
+      pcb->acked = (tcpwnd_size_t)(ackno - pcb->lastack);
 
       pcb->snd_buf += pcb->acked;
 
@@ -961,12 +1006,12 @@ tcp_receive(struct tcp_pcb *pcb)
          ssthresh). */
       if (pcb->state >= ESTABLISHED) {
         if (pcb->cwnd < pcb->ssthresh) {
-          if ((u16_t)(pcb->cwnd + pcb->mss) > pcb->cwnd) {
+          if ((tcpwnd_size_t)(pcb->cwnd + pcb->mss) > pcb->cwnd) {
             pcb->cwnd += pcb->mss;
           }
           LWIP_DEBUGF(TCP_CWND_DEBUG, ("tcp_receive: slow start cwnd %"U16_F"\n", pcb->cwnd));
         } else {
-          u16_t new_cwnd = (pcb->cwnd + pcb->mss * pcb->mss / pcb->cwnd);
+          tcpwnd_size_t new_cwnd = (pcb->cwnd + pcb->mss * pcb->mss / pcb->cwnd);
           if (new_cwnd > pcb->cwnd) {
             pcb->cwnd = new_cwnd;
           }
@@ -1484,7 +1529,7 @@ tcp_receive(struct tcp_pcb *pcb)
  * Parses the options contained in the incoming segment. 
  *
  * Called from tcp_listen_input() and tcp_process().
- * Currently, only the MSS option is supported!
+ * Supports the MSS, timestamp, window scale and SACK options.
  *
  * @param pcb the tcp_pcb for which a segment arrived
  */
@@ -1499,6 +1544,9 @@ tcp_parseopt(struct tcp_pcb *pcb)
 #endif
 
   opts = (u8_t *)tcphdr + TCP_HLEN;
+#if LWIP_TCP_SACK
+  sack_count = 0;
+#endif /* LWIP_TCP_SACK */
 
   /* Parse the TCP MSS option, if present. */
   if(TCPH_HDRLEN(tcphdr) > 0x5) {
@@ -1550,6 +1598,63 @@ tcp_parseopt(struct tcp_pcb *pcb)
         c += 0x0A;
         break;
 #endif
+#if LWIP_WND_SCALE
+      case 0x03:
+        LWIP_DEBUGF(TCP_INPUT_DEBUG, ("tcp_parseopt: WND_SCALE\n"));
+        if (opts[c + 1] != 0x03 || c + 0x03 > max_c) {
+          /* Bad length */
+          LWIP_DEBUGF(TCP_INPUT_DEBUG, ("tcp_parseopt: bad length\n"));
+          return;
+        }
+        /* Only valid in a SYN, and only while the connection is set up */
+        if ((flags & TCP_SYN) &&
+            (pcb->state == SYN_SENT || pcb->state == SYN_RCVD)) {
+          pcb->flags |= TF_WND_SCALE;
+          /* RFC 7323: a shift over 14 is taken as 14 */
+          pcb->snd_scale = LWIP_MIN(opts[c + 2], 14);
+          pcb->rcv_scale = TCP_RCV_SCALE;
+        }
+        /* Advance to next option */
+        c += 0x03;
+        break;
+#endif /* LWIP_WND_SCALE */
+#if LWIP_TCP_SACK
+      case 0x04:
+        LWIP_DEBUGF(TCP_INPUT_DEBUG, ("tcp_parseopt: SACK_PERM\n"));
+        if (opts[c + 1] != 0x02 || c + 0x02 > max_c) {
+          /* Bad length */
+          LWIP_DEBUGF(TCP_INPUT_DEBUG, ("tcp_parseopt: bad length\n"));
+          return;
+        }
+        if ((flags & TCP_SYN) &&
+            (pcb->state == SYN_SENT || pcb->state == SYN_RCVD)) {
+          pcb->flags |= TF_SACK;
+        }
+        /* Advance to next option */
+        c += 0x02;
+        break;
+      case 0x05:
+        LWIP_DEBUGF(TCP_INPUT_DEBUG, ("tcp_parseopt: SACK\n"));
+        if (opts[c + 1] < 0x0A || ((opts[c + 1] - 2) & 7) != 0 ||
+            c + opts[c + 1] > max_c) {
+          /* Bad length */
+          LWIP_DEBUGF(TCP_INPUT_DEBUG, ("tcp_parseopt: bad length\n"));
+          return;
+        }
+        for (opt = 2; opt < opts[c + 1] &&
+             sack_count < LWIP_TCP_MAX_SACK_BLOCKS; opt += 8) {
+          sack_left[sack_count] = ((u32_t)opts[c + opt] << 24) |
+            ((u32_t)opts[c + opt + 1] << 16) |
+            ((u32_t)opts[c + opt + 2] << 8) | opts[c + opt + 3];
+          sack_right[sack_count] = ((u32_t)opts[c + opt + 4] << 24) |
+            ((u32_t)opts[c + opt + 5] << 16) |
+            ((u32_t)opts[c + opt + 6] << 8) | opts[c + opt + 7];
+          sack_count++;
+        }
+        /* Advance to next option */
+        c += opts[c + 1];
+        break;
+#endif /* LWIP_TCP_SACK */
       default:
         LWIP_DEBUGF(TCP_INPUT_DEBUG, ("tcp_parseopt: other\n"));
         if (opts[c + 1] == 0) {
@@ -1566,4 +1671,71 @@ tcp_parseopt(struct tcp_pcb *pcb)
   }
 }
 
+#if LWIP_WND_SCALE
+/**
+ * Settle the window sizes once the SYNs have been exchanged. Without
+ * scaling on both ends, no window may exceed 64 KB.
+ *
+ * @param pcb the tcp_pcb that has seen the SYN of the remote end
+ */
+static void
+tcp_wnd_scale_done(struct tcp_pcb *pcb)
+{
+  if (pcb->flags & TF_WND_SCALE) {
+    return;
+  }
+  pcb->snd_scale = 0;
+  pcb->rcv_scale = 0;
+  if (pcb->rcv_wnd_max > 0xffff) {
+    pcb->rcv_wnd -= LWIP_MIN(pcb->rcv_wnd, pcb->rcv_wnd_max - 0xffff);
+    pcb->rcv_wnd_max = 0xffff;
+  }
+  if (pcb->rcv_ann_wnd > 0xffff) {
+    pcb->rcv_ann_wnd = 0xffff;
+  }
+}
+#endif /* LWIP_WND_SCALE */
+
+#if LWIP_TCP_SACK
+/**
+ * Mark the unacked segments that the SACK blocks of the incoming segment
+ * cover, so that they are not retransmitted to fill holes.
+ *
+ * @param pcb the tcp_pcb for which a segment arrived
+ * @return the highest sequence number selectively acknowledged, or 0
+ */
+static u32_t
+tcp_sack_mark(struct tcp_pcb *pcb)
+{
+  struct tcp_seg *seg;
+  u32_t seg_left, seg_right, high = 0;
+  u8_t i;
+
+  if (!(pcb->flags & TF_SACK)) {
+    return 0;
+  }
+
+  for (i = 0; i < sack_count; i++) {
+    /* ignore blocks that are old or make no sense */
+    if (!TCP_SEQ_LT(sack_left[i], sack_right[i]) ||
+        !TCP_SEQ_GT(sack_left[i], ackno) ||
+        TCP_SEQ_GT(sack_right[i], pcb->snd_nxt)) {
+      continue;
+    }
+    if (high == 0 || TCP_SEQ_GT(sack_right[i], high)) {
+      high = sack_right[i];
+    }
+    for (seg = pcb->unacked; seg != NULL; seg = seg->next) {
+      seg_left = ntohl(seg->tcphdr->seqno);
+      seg_right = seg_left + TCP_TCPLEN(seg);
+      if (TCP_SEQ_GEQ(seg_left, sack_left[i]) &&
+          TCP_SEQ_LEQ(seg_right, sack_right[i])) {
+        seg->flags |= TF_SEG_SACKED;
+      }
+    }
+  }
+  return high;
+}
+#endif /* LWIP_TCP_SACK */
+
 #endif /* LWIP_TCP */
@@ -103,7 +103,7 @@ tcp_output_alloc_header(struct tcp_pcb *pcb, u16_t optlen, u16_t datalen,
     tcphdr->seqno = seqno_be;
     tcphdr->ackno = htonl(pcb->rcv_nxt);
     TCPH_HDRLEN_FLAGS_SET(tcphdr, (5 + optlen / 4), TCP_ACK);
-    tcphdr->wnd = htons(pcb->rcv_ann_wnd);
+    tcphdr->wnd = htons(TCPWND16(RCV_WND_SCALE(pcb, pcb->rcv_ann_wnd)));
     tcphdr->chksum = 0;
     tcphdr->urgp = 0;
 
@@ -740,6 +740,18 @@ tcp_enqueue_flags(struct tcp_pcb *pcb, u8_t flags)
 
   if (flags & TCP_SYN) {
     optflags = TF_SEG_OPTS_MSS;
+    /* Offer scaling and SACK in a SYN, and only accept them in a
+       SYN|ACK if the remote end offered them first */
+#if LWIP_WND_SCALE
+    if (pcb->state != SYN_RCVD || (pcb->flags & TF_WND_SCALE)) {
+      optflags |= TF_SEG_OPTS_WND_SCALE;
+    }
+#endif /* LWIP_WND_SCALE */
+#if LWIP_TCP_SACK
+    if (pcb->state != SYN_RCVD || (pcb->flags & TF_SACK)) {
+      optflags |= TF_SEG_OPTS_SACK_PERM;
+    }
+#endif /* LWIP_TCP_SACK */
   }
 #if LWIP_TCP_TIMESTAMPS
   if ((pcb->flags & TF_TIMESTAMP)) {
@@ -832,6 +844,40 @@ tcp_build_timestamp_option(struct tcp_pcb *pcb, u32_t *opts)
 }
 #endif
 
+#if LWIP_TCP_SACK && TCP_QUEUE_OOSEQ
+/* Collect the blocks of out-of-sequence data we hold, for SACK options.
+ *
+ * @param pcb tcp_pcb
+ * @param left where to store the left edges of the blocks
+ * @param right where to store the right edges of the blocks
+ * @param max maximum number of blocks to collect
+ * @return number of blocks collected
+ */
+static u8_t
+tcp_sack_blocks(struct tcp_pcb *pcb, u32_t *left, u32_t *right, u8_t max)
+{
+  struct tcp_seg *seg;
+  u32_t seqno;
+  u8_t n = 0;
+
+  for (seg = pcb->ooseq; seg != NULL; seg = seg->next) {
+    seqno = ntohl(seg->tcphdr->seqno);
+    if (n > 0 && seqno == right[n - 1]) {
+      /* contiguous with the previous block */
+      right[n - 1] += TCP_TCPLEN(seg);
+      continue;
+    }
+    if (n == max) {
+      break;
+    }
+    left[n] = seqno;
+    right[n] = seqno + TCP_TCPLEN(seg);
+    n++;
+  }
+  return n;
+}
+#endif /* LWIP_TCP_SACK && TCP_QUEUE_OOSEQ */
+
 /** Send an ACK without data.
  *
  * @param pcb Protocol control block for the TCP connection to send the ACK
@@ -842,12 +888,28 @@ tcp_send_empty_ack(struct tcp_pcb *pcb)
   struct pbuf *p;
   struct tcp_hdr *tcphdr;
   u8_t optlen = 0;
+#if LWIP_TCP_SACK && TCP_QUEUE_OOSEQ
+  u32_t sack_left[LWIP_TCP_MAX_SACK_BLOCKS];
+  u32_t sack_right[LWIP_TCP_MAX_SACK_BLOCKS];
+  u8_t i, sacks = 0;
+  u32_t *opts;
+#endif
 
 #if LWIP_TCP_TIMESTAMPS
   if (pcb->flags & TF_TIMESTAMP) {
     optlen = LWIP_TCP_OPT_LENGTH(TF_SEG_OPTS_TS);
   }
 #endif
+#if LWIP_TCP_SACK && TCP_QUEUE_OOSEQ
+  /* Tell the remote end what we already have beyond the hole. The
+     options are at most 40 bytes, so there is room for one block less
+     next to timestamps. */
+  if ((pcb->flags & TF_SACK) && pcb->ooseq != NULL) {
+    sacks = tcp_sack_blocks(pcb, sack_left, sack_right,
+      optlen ? LWIP_TCP_MAX_SACK_BLOCKS - 1 : LWIP_TCP_MAX_SACK_BLOCKS);
+    optlen += LWIP_TCP_SACK_OPT_LENGTH(sacks);
+  }
+#endif
 
   p = tcp_output_alloc_header(pcb, optlen, 0, htonl(pcb->snd_nxt));
   if (p == NULL) {
@@ -869,6 +931,19 @@ tcp_send_empty_ack(struct tcp_pcb *pcb)
   }
 #endif 
 
+#if LWIP_TCP_SACK && TCP_QUEUE_OOSEQ
+  if (sacks > 0) {
+    opts = (u32_t *)(void *)(tcphdr + 1) +
+      (optlen - LWIP_TCP_SACK_OPT_LENGTH(sacks)) / 4;
+    /* NOP, NOP, then kind 5 and the length */
+    opts[0] = htonl(0x01010500 | (2 + 8 * sacks));
+    for (i = 0; i < sacks; i++) {
+      opts[1 + 2 * i] = htonl(sack_left[i]);
+      opts[2 + 2 * i] = htonl(sack_right[i]);
+    }
+  }
+#endif
+
 #if CHECKSUM_GEN_TCP
   tcphdr->chksum = inet_chksum_pseudo(p, &(pcb->local_ip), &(pcb->remote_ip),
         IP_PROTO_TCP, p->tot_len);
@@ -1060,10 +1135,15 @@ tcp_output_segment(struct tcp_seg *seg, struct tcp_pcb *pcb)
    wnd fields remain. */
   seg->tcphdr->ackno = htonl(pcb->rcv_nxt);
 
-  /* advertise our receive window size in this TCP segment */
-  seg->tcphdr->wnd = htons(pcb->rcv_ann_wnd);
-
-  pcb->rcv_ann_right_edge = pcb->rcv_nxt + pcb->rcv_ann_wnd;
+  /* advertise our receive window size in this TCP segment; the window
+     in a SYN is never scaled */
+  if (TCPH_FLAGS(seg->tcphdr) & TCP_SYN) {
+    seg->tcphdr->wnd = htons(TCPWND16(pcb->rcv_ann_wnd));
+    pcb->rcv_ann_right_edge = pcb->rcv_nxt + TCPWND16(pcb->rcv_ann_wnd);
+  } else {
+    seg->tcphdr->wnd = htons(TCPWND16(RCV_WND_SCALE(pcb, pcb->rcv_ann_wnd)));
+    pcb->rcv_ann_right_edge = pcb->rcv_nxt + pcb->rcv_ann_wnd;
+  }
 
   /* Add any requested options.  NB MSS option is only set on SYN
      packets, so ignore it here */
@@ -1081,6 +1161,20 @@ tcp_output_segment(struct tcp_seg *seg, struct tcp_pcb *pcb)
     opts += 3;
   }
 #endif
+#if LWIP_WND_SCALE
+  if (seg->flags & TF_SEG_OPTS_WND_SCALE) {
+    /* NOP, then kind 3, length 3 and our shift count */
+    *opts = PP_HTONL(0x01030300 | TCP_RCV_SCALE);
+    opts += 1;
+  }
+#endif /* LWIP_WND_SCALE */
+#if LWIP_TCP_SACK
+  if (seg->flags & TF_SEG_OPTS_SACK_PERM) {
+    /* NOP, NOP, then kind 4, length 2 */
+    *opts = PP_HTONL(0x01010402);
+    opts += 1;
+  }
+#endif /* LWIP_TCP_SACK */
 
   /* If we don't have a local IP address, we get one by
      calling ip_route(). */
@@ -1207,7 +1301,7 @@ tcp_rst(u32_t seqno, u32_t ackno,
   tcphdr->seqno = htonl(seqno);
   tcphdr->ackno = htonl(ackno);
   TCPH_HDRLEN_FLAGS_SET(tcphdr, TCP_HLEN/4, TCP_RST | TCP_ACK);
-  tcphdr->wnd = PP_HTONS(TCP_WND);
+  tcphdr->wnd = PP_HTONS(TCPWND16(TCP_WND));
   tcphdr->chksum = 0;
   tcphdr->urgp = 0;
 
@@ -1239,8 +1333,13 @@ tcp_rexmit_rto(struct tcp_pcb *pcb)
     return;
   }
 
-  /* Move all unacked segments to the head of the unsent queue */
-  for (seg = pcb->unacked; seg->next != NULL; seg = seg->next);
+  /* Move all unacked segments to the head of the unsent queue. The
+     remote end may have dropped what it selectively acknowledged, so
+     all of it goes out again. */
+  for (seg = pcb->unacked; seg->next != NULL; seg = seg->next) {
+    seg->flags &= ~(TF_SEG_SACKED | TF_SEG_REXMIT);
+  }
+  seg->flags &= ~(TF_SEG_SACKED | TF_SEG_REXMIT);
   /* concatenate unsent queue after unacked queue */
   seg->next = pcb->unsent;
   /* unsent queue is the concatenated queue (of unacked, unsent) */
@@ -1279,6 +1378,7 @@ tcp_rexmit(struct tcp_pcb *pcb)
   /* Keep the unsent queue sorted. */
   seg = pcb->unacked;
   pcb->unacked = seg->next;
+  seg->flags |= TF_SEG_REXMIT;
 
   cur_seg = &(pcb->unsent);
   while (*cur_seg &&
@@ -1339,6 +1439,61 @@ tcp_rexmit_fast(struct tcp_pcb *pcb)
   } 
 }
 
+#if LWIP_TCP_SACK
+/**
+ * Retransmit the next hole the remote end told us about with SACK
+ * blocks while in fast recovery, instead of waiting for the
+ * retransmission timer to resend everything after the first one.
+ *
+ * Called by tcp_receive() for each further duplicate ACK.
+ *
+ * @param pcb the tcp_pcb for which to retransmit
+ * @param high_sacked highest sequence number selectively acknowledged
+ */
+void
+tcp_rexmit_hole(struct tcp_pcb *pcb, u32_t high_sacked)
+{
+  struct tcp_seg *seg, **prev, **cur_seg;
+
+  if (!(pcb->flags & TF_INFR)) {
+    return;
+  }
+
+  /* Find the first segment below the highest SACKed data that was
+     neither SACKed nor retransmitted yet */
+  for (prev = &(pcb->unacked); (seg = *prev) != NULL; prev = &(seg->next)) {
+    if (!TCP_SEQ_LT(ntohl(seg->tcphdr->seqno), high_sacked)) {
+      return;
+    }
+    if (!(seg->flags & (TF_SEG_SACKED | TF_SEG_REXMIT))) {
+      break;
+    }
+  }
+  if (seg == NULL) {
+    return;
+  }
+
+  LWIP_DEBUGF(TCP_FR_DEBUG, ("tcp_rexmit_hole: retransmit %"U32_F"\n",
+                             ntohl(seg->tcphdr->seqno)));
+
+  /* Move it to the unsent queue, keeping that sorted */
+  *prev = seg->next;
+  seg->flags |= TF_SEG_REXMIT;
+  cur_seg = &(pcb->unsent);
+  while (*cur_seg &&
+    TCP_SEQ_LT(ntohl((*cur_seg)->tcphdr->seqno), ntohl(seg->tcphdr->seqno))) {
+      cur_seg = &((*cur_seg)->next );
+  }
+  seg->next = *cur_seg;
+  *cur_seg = seg;
+
+  /* Don't take any rtt measurements after retransmitting. */
+  pcb->rttest = 0;
+
+  snmp_inc_tcpretranssegs();
+}
+#endif /* LWIP_TCP_SACK */
+
 
 /**
  * Send keepalive packets to keep a connection active although
@@ -1016,6 +1016,26 @@
 #define LWIP_TCP_TIMESTAMPS             0
 #endif
 
+/**
+ * LWIP_WND_SCALE==1: support the TCP window scale option (RFC 7323).
+ * TCP_RCV_SCALE is the shift announced for our receive window, so with
+ * window scaling TCP_WND may be up to (0xffff << TCP_RCV_SCALE). It must
+ * be defined (0..14) when LWIP_WND_SCALE is enabled.
+ */
+#ifndef LWIP_WND_SCALE
+#define LWIP_WND_SCALE                  0
+#define TCP_RCV_SCALE                   0
+#endif
+
+/**
+ * LWIP_TCP_SACK==1: support selective acknowledgments (RFC 2018), both
+ * announcing out-of-sequence data we hold and retransmitting only what
+ * the remote end is missing.
+ */
+#ifndef LWIP_TCP_SACK
+#define LWIP_TCP_SACK                   0
+#endif
+
 /**
  * TCP_WND_UPDATE_THRESHOLD: difference in window to trigger an
  * explicit window update
@@ -49,6 +49,23 @@ extern "C" {
 
 struct tcp_pcb;
 
+/** Window sizes and the send buffer only exceed 16 bits with window
+ * scaling, see LWIP_WND_SCALE.
+ */
+#if LWIP_WND_SCALE
+typedef u32_t tcpwnd_size_t;
+#define RCV_WND_SCALE(pcb, wnd) (((wnd) >> (pcb)->rcv_scale))
+#define SND_WND_SCALE(pcb, wnd) (((tcpwnd_size_t)(wnd) << (pcb)->snd_scale))
+#define TCPWND16(x)             ((u16_t)LWIP_MIN((x), 0xFFFF))
+#else
+typedef u16_t tcpwnd_size_t;
+#define RCV_WND_SCALE(pcb, wnd) (wnd)
+#define SND_WND_SCALE(pcb, wnd) (wnd)
+#define TCPWND16(x)             (x)
+#endif
+
+typedef u16_t tcpflags_t;
+
 /** Function prototype for tcp accept callback functions. Called when a new
  * connection can be accepted on a listening pcb.
  *
@@ -175,7 +192,7 @@ struct tcp_pcb {
   /* ports are in host byte order */
   u16_t remote_port;
   
-  u8_t flags;
+  tcpflags_t flags;
 #define TF_ACK_DELAY   ((u8_t)0x01U)   /* Delayed ACK. */
 #define TF_ACK_NOW     ((u8_t)0x02U)   /* Immediate ACK. */
 #define TF_INFR        ((u8_t)0x04U)   /* In fast recovery. */
@@ -184,14 +201,17 @@ struct tcp_pcb {
 #define TF_FIN         ((u8_t)0x20U)   /* Connection was closed locally (FIN segment enqueued). */
 #define TF_NODELAY     ((u8_t)0x40U)   /* Disable Nagle algorithm */
 #define TF_NAGLEMEMERR ((u8_t)0x80U)   /* nagle enabled, memerr, try to output to prevent delayed ACK to happen */
+#define TF_WND_SCALE   ((tcpflags_t)0x0100U) /* Window scale option enabled */
+#define TF_SACK        ((tcpflags_t)0x0200U) /* Selective acknowledgments enabled */
 
   /* the rest of the fields are in host byte order
      as we have to do some math with them */
   /* receiver variables */
   u32_t rcv_nxt;   /* next seqno expected */
-  u16_t rcv_wnd;   /* receiver window available */
-  u16_t rcv_ann_wnd; /* receiver window to announce */
+  tcpwnd_size_t rcv_wnd;   /* receiver window available */
+  tcpwnd_size_t rcv_ann_wnd; /* receiver window to announce */
   u32_t rcv_ann_right_edge; /* announced right edge of window */
+  tcpwnd_size_t rcv_wnd_max; /* size of the receive window */
 
   /* Timers */
   u32_t tmr;
@@ -215,19 +235,20 @@ struct tcp_pcb {
   u8_t dupacks;
   
   /* congestion avoidance/control variables */
-  u16_t cwnd;  
-  u16_t ssthresh;
+  tcpwnd_size_t cwnd;  
+  tcpwnd_size_t ssthresh;
 
   /* sender variables */
   u32_t snd_nxt;   /* next new seqno to be sent */
-  u16_t snd_wnd;   /* sender window */
+  tcpwnd_size_t snd_wnd;   /* sender window */
   u32_t snd_wl1, snd_wl2; /* Sequence and acknowledgement numbers of last
                              window update. */
   u32_t snd_lbb;       /* Sequence number of next byte to be buffered. */
 
-  u16_t acked;
+  tcpwnd_size_t acked;
   
-  u16_t snd_buf;   /* Available buffer space for sending (in bytes). */
+  tcpwnd_size_t snd_buf;   /* Available buffer space for sending (in bytes). */
+  tcpwnd_size_t snd_buf_max; /* Size of the send buffer (in bytes). */
 #define TCP_SNDQUEUELEN_OVERFLOW (0xffff-3)
   u16_t snd_queuelen; /* Available buffer space for sending (in tcp_segs). */
 
@@ -263,6 +284,11 @@ struct tcp_pcb {
   u32_t ts_recent;
 #endif /* LWIP_TCP_TIMESTAMPS */
 
+#if LWIP_WND_SCALE
+  u8_t snd_scale;  /* shift of the windows the remote end announces */
+  u8_t rcv_scale;  /* shift of the windows we announce */
+#endif /* LWIP_WND_SCALE */
+
   /* idle time before KEEPALIVE is sent */
   u32_t keep_idle;
 #if LWIP_TCP_KEEPALIVE
@@ -285,6 +311,10 @@ struct tcp_pcb_listen {
 /* Protocol specific PCB members */
   TCP_PCB_COMMON(struct tcp_pcb_listen);
 
+  /* buffer sizes handed down to accepted connections */
+  tcpwnd_size_t rcv_wnd_max;
+  tcpwnd_size_t snd_buf_max;
+
 #if TCP_LISTEN_BACKLOG
   u8_t backlog;
   u8_t accepts_pending;
@@ -322,6 +352,8 @@ void             tcp_err     (struct tcp_pcb *pcb, tcp_err_fn err);
 
 #define          tcp_mss(pcb)             (((pcb)->flags & TF_TIMESTAMP) ? ((pcb)->mss - 12)  : (pcb)->mss)
 #define          tcp_sndbuf(pcb)          ((pcb)->snd_buf)
+#define          tcp_sndbuf_size(pcb)     ((pcb)->snd_buf_max)
+#define          tcp_rcvbuf_size(pcb)     ((pcb)->rcv_wnd_max)
 #define          tcp_sndqueuelen(pcb)     ((pcb)->snd_queuelen)
 #define          tcp_nagle_disable(pcb)   ((pcb)->flags |= TF_NODELAY)
 #define          tcp_nagle_enable(pcb)    ((pcb)->flags &= ~TF_NODELAY)
@@ -337,6 +369,8 @@ void             tcp_err     (struct tcp_pcb *pcb, tcp_err_fn err);
 #endif /* TCP_LISTEN_BACKLOG */
 
 void             tcp_recved  (struct tcp_pcb *pcb, u16_t len);
+void             tcp_set_sndbuf(struct tcp_pcb *pcb, tcpwnd_size_t size);
+void             tcp_set_rcvbuf(struct tcp_pcb *pcb, tcpwnd_size_t size);
 err_t            tcp_bind    (struct tcp_pcb *pcb, ip_addr_t *ipaddr,
                               u16_t port);
 err_t            tcp_connect (struct tcp_pcb *pcb, ip_addr_t *ipaddr,
@@ -70,6 +70,9 @@ err_t            tcp_send_empty_ack(struct tcp_pcb *pcb);
 void             tcp_rexmit  (struct tcp_pcb *pcb);
 void             tcp_rexmit_rto  (struct tcp_pcb *pcb);
 void             tcp_rexmit_fast (struct tcp_pcb *pcb);
+#if LWIP_TCP_SACK
+void             tcp_rexmit_hole (struct tcp_pcb *pcb, u32_t high_sacked);
+#endif /* LWIP_TCP_SACK */
 u32_t            tcp_update_rcv_ann_wnd(struct tcp_pcb *pcb);
 
 /**
@@ -294,12 +297,23 @@ struct tcp_seg {
 #define TF_SEG_OPTS_TS          (u8_t)0x02U /* Include timestamp option. */
 #define TF_SEG_DATA_CHECKSUMMED (u8_t)0x04U /* ALL data (not the header) is
                                                checksummed into 'chksum' */
+#define TF_SEG_OPTS_WND_SCALE   (u8_t)0x08U /* Include window scale option. */
+#define TF_SEG_OPTS_SACK_PERM   (u8_t)0x10U /* Include SACK permitted option. */
+#define TF_SEG_SACKED           (u8_t)0x20U /* Covered by a SACK block. */
+#define TF_SEG_REXMIT           (u8_t)0x40U /* Retransmitted to fill a hole. */
   struct tcp_hdr *tcphdr;  /* the TCP header */
 };
 
 #define LWIP_TCP_OPT_LENGTH(flags)              \
   (flags & TF_SEG_OPTS_MSS ? 4  : 0) +          \
-  (flags & TF_SEG_OPTS_TS  ? 12 : 0)
+  (flags & TF_SEG_OPTS_TS  ? 12 : 0) +          \
+  (flags & TF_SEG_OPTS_WND_SCALE ? 4 : 0) +     \
+  (flags & TF_SEG_OPTS_SACK_PERM ? 4 : 0)
+
+/** Space taken by a SACK option: NOP NOP kind len and 8 bytes per block */
+#define LWIP_TCP_SACK_OPT_LENGTH(n) ((n) ? 4 + 8 * (n) : 0)
+/** Most SACK blocks sent or taken from one segment */
+#define LWIP_TCP_MAX_SACK_BLOCKS    4
 
 /** This returns a TCP header option for MSS in an u32_t */
 #define TCP_BUILD_MSS_OPTION(x) (x) = PP_HTONL(((u32_t)2 << 24) |          \
@@ -71,7 +71,10 @@
 #define TCP_SND_BUF			(256 * TCP_MSS)
 #define TCP_SNDLOWAT			(256)
 #define TCP_SND_QUEUELEN		(512)
-#define TCP_WND				((1 << 16) - 1)	
+#define TCP_WND				(256 * 1024)
+#define LWIP_WND_SCALE			1
+#define TCP_RCV_SCALE			4
+#define LWIP_TCP_SACK			1
 #define PBUF_POOL_BUFSIZE		(2048)
 
 /*
@@ -277,8 +280,10 @@
  * IP_FRAG_USES_STATIC_BUF==1: Use a static MTU-sized buffer for IP
  * fragmentation. Otherwise pbufs are allocated and reference the original
     * packet data to be fragmented.
+ * Must be 0 for custom pbufs, which the lwip server uses to pass up packets
+ * in a driver's packet pool.
 */
-#define IP_FRAG_USES_STATIC_BUF         1
+#define IP_FRAG_USES_STATIC_BUF         0
 
 /**
  * IP_DEFAULT_TTL: Default value for Time-To-Live used by transport layers.
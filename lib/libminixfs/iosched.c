@@ -0,0 +1,178 @@
+/* I/O scheduling helpers for the file system servers' buffer caches.
+ *
+ * The entry points into this file are:
+ *   fs_sort_bufq:	sort an array of buffers on block number
+ *   fs_build_run:	collect a run of consecutive blocks for one request
+ *
+ * The file servers flush their dirty blocks (and issue their read-ahead) in
+ * batches through rw_scattered(), which turns runs of consecutive blocks into
+ * vectored requests.  To find the runs, the batch is sorted on block number
+ * first.  Batches can hold tens of thousands of buffers, so a radix sort is
+ * used, which is linear in the number of buffers.  Small batches and batches
+ * that are sorted already, which are both common, are dealt with cheaply.
+ */
+
+#include <minix/config.h>
+#include <minix/const.h>
+#include <minix/libminixfs.h>
+#include <minix/sysutil.h>
+#include <sys/types.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+
+#define RADIX_BITS	8
+#define RADIX_SIZE	(1 << RADIX_BITS)
+#define RADIX_MASK	(RADIX_SIZE - 1)
+#define INSERTION_MAX	32	/* insertion sort batches up to this size */
+
+/* The block number of a buffer, which lies at 'off' bytes into it. */
+#define KEY(bp, off)	(*(block_t *) ((char *) (bp) + (off)))
+
+static void insertion_sort(void **bufq, int bufqsize, size_t key_offset);
+
+/*===========================================================================*
+ *				fs_build_run				     *
+ *===========================================================================*/
+int fs_build_run(
+  dev_t dev,			/* device the buffers belong to */
+  void **bufq,			/* sorted buffers, the first one starts the run */
+  int bufqsize,			/* number of buffers */
+  int rw_flag,			/* READING or WRITING */
+  size_t key_offset,		/* offset of the block number in a buffer */
+  void *(*filler)(dev_t, block_t), /* idle clean copy of a block, or NULL */
+  void **iobuf,			/* buffer for each block of the run */
+  int max,			/* maximum length of the run */
+  int *nbufs			/* number of buffers of bufq in the run */
+)
+{
+/* Collect a run of consecutive blocks, starting with the first buffer in the
+ * queue, that can be transferred with one vectored request.  When writing, a
+ * hole of at most FS_IOSCHED_MAX_GAP blocks up to the next buffer is filled
+ * with the buffers 'filler' returns for the missing blocks, if it has all of
+ * them.  'filler' may only return buffers that are clean and not in use, as
+ * they are written out as they are.  Return the length of the run.
+ */
+  void *bp;
+  block_t first, gap;
+  int j, k, q;
+
+  first = KEY(bufq[0], key_offset);
+  for (j = 0, q = 0; j < max && q < bufqsize; ) {
+	bp = bufq[q];
+	if (KEY(bp, key_offset) != first + j) {
+		/* Try to bridge the hole up to the next buffer. */
+		gap = KEY(bp, key_offset) - (first + j);
+		if (rw_flag == READING || gap > FS_IOSCHED_MAX_GAP ||
+		    j + gap >= (block_t) max)
+			break;
+		for (k = 0; k < (int) gap; k++) {
+			iobuf[j + k] = filler(dev, first + j + k);
+			if (iobuf[j + k] == NULL) break;
+		}
+		if (k < (int) gap) break;
+		j += gap;
+	}
+	iobuf[j++] = bp;
+	q++;
+  }
+
+  *nbufs = q;
+  return(j);
+}
+
+/*===========================================================================*
+ *				fs_sort_bufq				     *
+ *===========================================================================*/
+void fs_sort_bufq(
+  void **bufq,			/* array of pointers to buffers */
+  int bufqsize,			/* number of buffers */
+  size_t key_offset		/* offset of the block number in a buffer */
+)
+{
+/* Sort an array of buffers on ascending block number. */
+  static void **tmp = NULL;
+  static int tmpsize = 0;
+  unsigned int count[RADIX_SIZE], pos, n;
+  void **src, **dst, **swap;
+  block_t key, all_or, all_and, diff;
+  int i, shift;
+
+  /* Batches often come in ascending order already. */
+  for (i = 1; i < bufqsize; i++)
+	if (KEY(bufq[i - 1], key_offset) > KEY(bufq[i], key_offset)) break;
+  if (i >= bufqsize) return;
+
+  if (bufqsize <= INSERTION_MAX) {
+	insertion_sort(bufq, bufqsize, key_offset);
+	return;
+  }
+
+  if (tmpsize < bufqsize) {
+	if (tmp != NULL) free(tmp);
+	if ((tmp = malloc(sizeof(tmp[0]) * bufqsize)) == NULL) {
+		tmpsize = 0;
+		insertion_sort(bufq, bufqsize, key_offset);
+		return;
+	}
+	tmpsize = bufqsize;
+  }
+
+  /* Only digits in which the keys differ need a pass.  Typically the high
+   * digits of all block numbers in a batch are the same.
+   */
+  all_or = 0;
+  all_and = ~((block_t) 0);
+  for (i = 0; i < bufqsize; i++) {
+	key = KEY(bufq[i], key_offset);
+	all_or |= key;
+	all_and &= key;
+  }
+  diff = all_or ^ all_and;
+
+  /* Least significant digit first; each pass is stable. */
+  src = bufq;
+  dst = tmp;
+  for (shift = 0; shift < (int) (sizeof(block_t) * CHAR_BIT);
+       shift += RADIX_BITS) {
+	if (((diff >> shift) & RADIX_MASK) == 0) continue;
+
+	memset(count, 0, sizeof(count));
+	for (i = 0; i < bufqsize; i++)
+		count[(KEY(src[i], key_offset) >> shift) & RADIX_MASK]++;
+	for (i = 0, pos = 0; i < RADIX_SIZE; i++) {
+		n = count[i];
+		count[i] = pos;
+		pos += n;
+	}
+	for (i = 0; i < bufqsize; i++)
+		dst[count[(KEY(src[i], key_offset) >> shift) & RADIX_MASK]++] =
+			src[i];
+
+	swap = src;
+	src = dst;
+	dst = swap;
+  }
+
+  if (src != bufq)
+	memcpy(bufq, src, sizeof(bufq[0]) * bufqsize);
+}
+
+/*===========================================================================*
+ *				insertion_sort				     *
+ *===========================================================================*/
+static void insertion_sort(void **bufq, int bufqsize, size_t key_offset)
+{
+/* Sort a small array of buffers on ascending block number. */
+  void *bp;
+  block_t key;
+  int i, j;
+
+  for (i = 1; i < bufqsize; i++) {
+	bp = bufq[i];
+	key = KEY(bp, key_offset);
+	for (j = i; j > 0 && KEY(bufq[j - 1], key_offset) > key; j--)
+		bufq[j] = bufq[j - 1];
+	bufq[j] = bp;
+  }
+}
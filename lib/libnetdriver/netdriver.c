@@ -7,6 +7,10 @@
  *
  *   netdriver_announce: called by a network driver to announce it is up
  *   netdriver_receive:	 receive() interface for network drivers
+ *   netdriver_copyin_packs:  fetch the packet descriptors of a batch request
+ *   netdriver_copyout_packs: return the packet descriptors to the client
+ *   netdriver_copyto_pack:   copy a received packet into a client's buffer
+ *   netdriver_copyfrom_pack: copy a packet to send from a client's buffer
  */
 
 #include <minix/drivers.h>
@@ -75,3 +79,111 @@ int *status_ptr;
   return OK;
 }
 
+
+/*===========================================================================*
+ *			   netdriver_copyin_packs			     *
+ *===========================================================================*/
+int netdriver_copyin_packs(ep, grant, packs, count)
+endpoint_t ep;
+cp_grant_id_t grant;
+dl_pack_t *packs;
+int count;
+{
+/* Copy in the packet descriptors of a DL_READV_M or DL_WRITEV_M request. */
+  int i, r;
+
+  if (count <= 0 || count > DL_BATCH_MAX)
+	return EINVAL;
+
+  if ((r = sys_safecopyfrom(ep, grant, 0, (vir_bytes) packs,
+	count * sizeof(packs[0]), D)) != OK)
+	return r;
+
+  /* A count of zero refers to a slot of the packet pool, see pool.c. */
+  for (i = 0; i < count; i++) {
+	if (packs[i].dp_count < 0 || packs[i].dp_count > DL_PACK_IOV)
+		return EINVAL;
+  }
+
+  return OK;
+}
+
+/*===========================================================================*
+ *			   netdriver_copyout_packs			     *
+ *===========================================================================*/
+int netdriver_copyout_packs(ep, grant, packs, count)
+endpoint_t ep;
+cp_grant_id_t grant;
+dl_pack_t *packs;
+int count;
+{
+/* Copy the first 'count' packet descriptors of a DL_READV_M request back to
+ * the client, so that it learns the sizes of the packets received.
+ */
+
+  return sys_safecopyto(ep, grant, 0, (vir_bytes) packs,
+	count * sizeof(packs[0]), D);
+}
+
+/*===========================================================================*
+ *			    netdriver_copyto_pack			     *
+ *===========================================================================*/
+size_t netdriver_copyto_pack(ep, pack, data, size)
+endpoint_t ep;
+dl_pack_t *pack;
+char *data;
+size_t size;
+{
+/* Copy a received packet into the fragments of a client's packet buffer.
+ * Return the number of bytes copied; the rest of the packet is dropped if
+ * the buffer is too small.
+ */
+  size_t bytes = 0, chunk;
+  int i, r;
+
+  for (i = 0; i < pack->dp_count && bytes < size; i++) {
+	chunk = pack->dp_iov[i].iov_size;
+	if (chunk > size - bytes)
+		chunk = size - bytes;
+
+	if ((r = sys_safecopyto(ep, pack->dp_iov[i].iov_grant, 0,
+		(vir_bytes) (data + bytes), chunk, D)) != OK)
+		panic("netdriver: sys_safecopyto failed: %d", r);
+
+	bytes += chunk;
+  }
+
+  pack->dp_size = bytes;
+
+  return bytes;
+}
+
+/*===========================================================================*
+ *			   netdriver_copyfrom_pack			     *
+ *===========================================================================*/
+size_t netdriver_copyfrom_pack(ep, pack, data, max)
+endpoint_t ep;
+dl_pack_t *pack;
+char *data;
+size_t max;
+{
+/* Copy a packet to be sent from the fragments of a client's packet buffer
+ * into a single buffer of 'max' bytes. Return the size of the packet.
+ */
+  size_t bytes = 0, chunk;
+  int i, r;
+
+  for (i = 0; i < pack->dp_count && bytes < max; i++) {
+	chunk = pack->dp_iov[i].iov_size;
+	if (chunk > max - bytes)
+		chunk = max - bytes;
+
+	if ((r = sys_safecopyfrom(ep, pack->dp_iov[i].iov_grant, 0,
+		(vir_bytes) (data + bytes), chunk, D)) != OK)
+		panic("netdriver: sys_safecopyfrom failed: %d", r);
+
+	bytes += chunk;
+  }
+
+  return bytes;
+}
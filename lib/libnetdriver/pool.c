@@ -0,0 +1,243 @@
+/* This file implements the packet pool a network driver can share with its
+ * client, so that packets are passed by slot number instead of being copied.
+ *
+ * The pool is a single contiguous, shared memory region (see dl_pool_t). Its
+ * receive slots are used as the driver's receive buffers; when a packet has
+ * been received in one, the slot is handed to the client, and the driver
+ * puts a free slot in the receive ring in its place. The client passes the
+ * slot back when it is done with the packet. The transmit slots belong to
+ * the client, and are only read by the driver.
+ *
+ * The file contains the following entry points:
+ *
+ *   netdriver_pool_init:    allocate the packet pool
+ *   netdriver_pool_map:     map the packet pool into the client
+ *   netdriver_pool_mapped:  check whether a client has the packet pool
+ *   netdriver_pool_get:     take a free receive slot
+ *   netdriver_pool_give:    hand a receive slot to the client
+ *   netdriver_pool_put:     take back a receive slot from the client
+ *   netdriver_pool_tx_slot: check whether a slot is a transmit slot
+ *   netdriver_pool_addr:    address of a slot
+ *   netdriver_pool_phys:    physical address of a slot
+ */
+
+#include <minix/drivers.h>
+#include <minix/endpoint.h>
+#include <minix/netdriver.h>
+#include <sys/mman.h>
+#include <assert.h>
+
+/* Receive slot states. */
+#define PS_FREE		0	/* on the free list */
+#define PS_DRIVER	1	/* in use by the driver */
+#define PS_CLIENT	2	/* handed to the client */
+
+static char *pool = NULL;		/* the pool, NULL if there is none */
+static phys_bytes pool_phys;
+static size_t pool_size;		/* private copies of the header, which */
+static size_t pool_slot_size;		/* the client can write to */
+static int pool_rx_slots;
+static int pool_tx_slots;
+static u8_t *slot_state;		/* state of each receive slot */
+static int *free_slots;			/* stack of free receive slots */
+static int nr_free;
+static endpoint_t pool_ep = NONE;	/* client the pool is mapped into */
+static vir_bytes pool_ep_addr;		/* address of the pool there */
+
+/*===========================================================================*
+ *			     netdriver_pool_init			     *
+ *===========================================================================*/
+void *netdriver_pool_init(rx_slots, tx_slots, slot_size)
+int rx_slots;
+int tx_slots;
+size_t slot_size;
+{
+/* Allocate a packet pool. Return its address, or NULL if the memory could
+ * not be had. All receive slots start out free.
+ */
+  dl_pool_t *pool_hdr;
+  size_t size;
+  int i;
+
+  assert(pool == NULL);
+  assert(slot_size >= sizeof(dl_pool_t));
+
+  size = slot_size * (1 + rx_slots + tx_slots);
+
+  if ((slot_state = malloc(rx_slots * sizeof(slot_state[0]))) == NULL)
+	return NULL;
+  if ((free_slots = malloc(rx_slots * sizeof(free_slots[0]))) == NULL) {
+	free(slot_state);
+	return NULL;
+  }
+
+  /* The memory has to be contiguous for DMA, and shared for vm_remap. */
+  pool = minix_mmap(0, size, PROT_READ | PROT_WRITE,
+	MAP_PREALLOC | MAP_CONTIG | MAP_ANON | MAP_IPC_SHARED, -1, 0);
+  if (pool == MAP_FAILED) {
+	pool = NULL;
+	free(free_slots);
+	free(slot_state);
+	return NULL;
+  }
+  pool_phys = vm_getphys(SELF, pool);
+
+  /* The header takes the place of slot -1. */
+  pool_hdr = (dl_pool_t *) pool;
+  memset(pool_hdr, 0, sizeof(*pool_hdr));
+  pool_hdr->dpl_size = size;
+  pool_hdr->dpl_offset = slot_size;
+  pool_hdr->dpl_slot_size = slot_size;
+  pool_hdr->dpl_rx_slots = rx_slots;
+  pool_hdr->dpl_tx_slots = tx_slots;
+
+  /* The client may scribble over the header; never look at it again. */
+  pool_size = size;
+  pool_slot_size = slot_size;
+  pool_rx_slots = rx_slots;
+  pool_tx_slots = tx_slots;
+
+  /* Hand out low slot numbers first. */
+  for (i = 0; i < rx_slots; i++) {
+	slot_state[i] = PS_FREE;
+	free_slots[i] = rx_slots - 1 - i;
+  }
+  nr_free = rx_slots;
+
+  return pool;
+}
+
+/*===========================================================================*
+ *			      netdriver_pool_map			     *
+ *===========================================================================*/
+int netdriver_pool_map(ep, addr)
+endpoint_t ep;
+vir_bytes *addr;
+{
+/* Map the packet pool into the address space of the given client, unless it
+ * is there already. A new client means that the old one is gone, so all
+ * slots the old client held are free again.
+ */
+  void *a;
+  int i;
+
+  if (pool == NULL)
+	return ENOSYS;
+
+  if (ep != pool_ep) {
+	if ((a = vm_remap(ep, SELF, NULL, pool, pool_size)) ==
+		MAP_FAILED)
+		return ENOMEM;
+
+	for (i = 0; i < pool_rx_slots; i++) {
+		if (slot_state[i] == PS_CLIENT) {
+			slot_state[i] = PS_FREE;
+			free_slots[nr_free++] = i;
+		}
+	}
+
+	pool_ep = ep;
+	pool_ep_addr = (vir_bytes) a;
+  }
+
+  *addr = pool_ep_addr;
+  return OK;
+}
+
+/*===========================================================================*
+ *			     netdriver_pool_mapped			     *
+ *===========================================================================*/
+int netdriver_pool_mapped(ep)
+endpoint_t ep;
+{
+/* Is the packet pool mapped into the given client? */
+
+  return pool != NULL && ep == pool_ep;
+}
+
+/*===========================================================================*
+ *			      netdriver_pool_get			     *
+ *===========================================================================*/
+int netdriver_pool_get(void)
+{
+/* Take a free receive slot. Return -1 if there is none. */
+  int slot;
+
+  if (nr_free == 0)
+	return -1;
+
+  slot = free_slots[--nr_free];
+  assert(slot_state[slot] == PS_FREE);
+  slot_state[slot] = PS_DRIVER;
+
+  return slot;
+}
+
+/*===========================================================================*
+ *			      netdriver_pool_give			     *
+ *===========================================================================*/
+void netdriver_pool_give(slot)
+int slot;
+{
+/* A packet received in this slot is handed to the client. */
+
+  assert(slot >= 0 && slot < pool_rx_slots);
+  assert(slot_state[slot] == PS_DRIVER);
+
+  slot_state[slot] = PS_CLIENT;
+}
+
+/*===========================================================================*
+ *			      netdriver_pool_put			     *
+ *===========================================================================*/
+int netdriver_pool_put(ep, slot)
+endpoint_t ep;
+int slot;
+{
+/* The client passes back a receive slot. Complain about slots it does not
+ * have.
+ */
+
+  if (!netdriver_pool_mapped(ep))
+	return EPERM;
+
+  if (slot < 0 || slot >= pool_rx_slots ||
+	slot_state[slot] != PS_CLIENT)
+	return EINVAL;
+
+  slot_state[slot] = PS_FREE;
+  free_slots[nr_free++] = slot;
+
+  return OK;
+}
+
+/*===========================================================================*
+ *			    netdriver_pool_tx_slot			     *
+ *===========================================================================*/
+int netdriver_pool_tx_slot(ep, slot)
+endpoint_t ep;
+int slot;
+{
+/* Is this one of the transmit slots of the given client? */
+
+  return netdriver_pool_mapped(ep) && slot >= pool_rx_slots &&
+	slot < pool_rx_slots + pool_tx_slots;
+}
+
+/*===========================================================================*
+ *			      netdriver_pool_addr			     *
+ *===========================================================================*/
+char *netdriver_pool_addr(slot)
+int slot;
+{
+  return pool + (slot + 1) * pool_slot_size;
+}
+
+/*===========================================================================*
+ *			      netdriver_pool_phys			     *
+ *===========================================================================*/
+phys_bytes netdriver_pool_phys(slot)
+int slot;
+{
+  return pool_phys + (slot + 1) * pool_slot_size;
+}
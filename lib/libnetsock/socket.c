@@ -407,6 +407,11 @@ void socket_request(message * m)
 			sock->flags &= ~SOCK_FLG_OP_PENDING;
 			send_reply(m, EINTR);
 			return;
+		/* ... or whatever else the component left pending */
+		} else if (sock->flags & SOCK_FLG_OP_PENDING &&
+				sock->ops && sock->ops->cancel) {
+			sock->ops->cancel(sock, m);
+			return;
 		} else
 			netsock_panic("no operation to cancel");
 
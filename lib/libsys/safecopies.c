@@ -48,6 +48,10 @@
 static cp_grant_t static_grants[NR_STATIC_GRANTS];
 static cp_grant_t *grants = NULL;
 static int ngrants = 0;
+static cp_grant_id_t free_grants = GRANT_INVALID; /* free slots, by cp_next */
+
+/* cp_next of a slot that is not on the free list. */
+#define GRANT_NOT_FREE	((cp_grant_id_t) -2)
 
 static void
 cpf_grow(void)
@@ -76,9 +80,14 @@ cpf_grow(void)
 	if(grants && ngrants > 0)
 		memcpy(new_grants, grants, ngrants * sizeof(grants[0]));
 
-	/* Make sure new slots are marked unused (CPF_USED is clear). */
-	for(g = ngrants; g < new_size; g++)
+	/* Make sure new slots are marked unused (CPF_USED is clear), and
+	 * put them on the free list, lowest first.
+	 */
+	for(g = new_size - 1; g >= ngrants; g--) {
 		new_grants[g].cp_flags = 0;
+		new_grants[g].cp_next = (g == new_size - 1) ?
+			free_grants : g + 1;
+	}
 
 	/* Inform kernel about new size (and possibly new location). */
 	if((sys_setgrant(new_grants, new_size))) {
@@ -89,9 +98,27 @@ cpf_grow(void)
 	/* Update internal data. */
 	if(grants && ngrants > 0 && grants != static_grants) free(grants);
 	grants = new_grants;
+	free_grants = ngrants;
 	ngrants = new_size;
 }
 
+static void
+cpf_free_grantslot(cp_grant_id_t g)
+{
+/* Put an unused grant slot back on the free list. The most recently freed
+ * slot is the first to be reused. A slot that was put to use with
+ * cpf_setgrant_*() without being allocated first may still be on the list;
+ * adding it again would make the list loop.
+ */
+	assert(!(grants[g].cp_flags & CPF_USED));
+
+	if(grants[g].cp_next != GRANT_NOT_FREE)
+		return;
+
+	grants[g].cp_next = free_grants;
+	free_grants = g;
+}
+
 static cp_grant_id_t
 cpf_new_grantslot(void)
 {
@@ -101,23 +128,30 @@ cpf_new_grantslot(void)
  */
 	cp_grant_id_t g;
 
-	/* Find free slot. */
-	for(g = 0; g < ngrants && (grants[g].cp_flags & CPF_USED); g++)
-		;
-
-	assert(g <= ngrants);
+	/* Take the first slot off the free list. Skip slots that were put to
+	 * use with cpf_setgrant_*() without being allocated first.
+	 */
+	while(free_grants != GRANT_INVALID &&
+		(grants[free_grants].cp_flags & CPF_USED)) {
+		g = free_grants;
+		free_grants = grants[g].cp_next;
+		grants[g].cp_next = GRANT_NOT_FREE;
+	}
 
 	/* No free slot found? */
-	if(g == ngrants) {
+	if(free_grants == GRANT_INVALID) {
 		cpf_grow();
-		assert(g <= ngrants); /* ngrants can't shrink. */
-		if(g == ngrants) {
+		if(free_grants == GRANT_INVALID) {
 			/* ngrants hasn't increased. */
 			errno = ENOSPC;
 			return -1;
 		}
 	}
 
+	g = free_grants;
+	free_grants = grants[g].cp_next;
+	grants[g].cp_next = GRANT_NOT_FREE;
+
 	/* Basic sanity checks - if we get this far, g must be a valid,
 	 * free slot.
 	 */
@@ -145,7 +179,7 @@ cpf_grant_direct(endpoint_t who_to, vir_bytes addr, size_t bytes, int access)
 	assert(!(grants[g].cp_flags & CPF_USED));
 
 	if((r=cpf_setgrant_direct(g, who_to, addr, bytes, access)) < 0) {
-		cpf_revoke(g);
+		cpf_free_grantslot(g);
 		return(GRANT_INVALID);
 	}
 
@@ -173,7 +207,7 @@ cpf_grant_indirect(endpoint_t who_to, endpoint_t who_from, cp_grant_id_t gr)
 
 	/* Fill in new slot data. */
 	if((r=cpf_setgrant_indirect(g, who_to, who_from, gr)) < 0) {
-		cpf_revoke(g);
+		cpf_free_grantslot(g);
 		return GRANT_INVALID;
 	}
 
@@ -202,7 +236,7 @@ cpf_grant_magic(endpoint_t who_to, endpoint_t who_from,
 
 	if((r=cpf_setgrant_magic(g, who_to, who_from, addr,
 		bytes, access)) < 0) {
-		cpf_revoke(g);
+		cpf_free_grantslot(g);
 		return -1;
 	}
 
@@ -227,10 +261,47 @@ cpf_revoke(cp_grant_id_t g)
 	 * This invalidates the grant.
 	 */
 	grants[g].cp_flags = 0;
+	cpf_free_grantslot(g);
+
+	return 0;
+}
+
+int
+cpf_grant_vec(endpoint_t who_to, const iovec_t *vec, iovec_s_t *gvec,
+	int count, int access)
+{
+/* Grant access to each element of an I/O vector, and fill in the vector of
+ * grants to pass on. Either all elements are granted, or none are.
+ */
+	int i;
+
+	ACCESS_CHECK(access);
+
+	for(i = 0; i < count; i++) {
+		gvec[i].iov_grant = cpf_grant_direct(who_to, vec[i].iov_addr,
+			vec[i].iov_size, access);
+		if(!GRANT_VALID(gvec[i].iov_grant)) {
+			cpf_revoke_vec(gvec, i);
+			return -1;
+		}
+		gvec[i].iov_size = vec[i].iov_size;
+	}
 
 	return 0;
 }
 
+void
+cpf_revoke_vec(const iovec_s_t *gvec, int count)
+{
+/* Revoke the grants made by cpf_grant_vec(). This goes backwards, so that
+ * the next vector gets the same slots, in the same order.
+ */
+	int i;
+
+	for(i = count - 1; i >= 0; i--)
+		cpf_revoke(gvec[i].iov_grant);
+}
+
 int
 cpf_lookup(cp_grant_id_t g, endpoint_t *granter, endpoint_t *grantee)
 {
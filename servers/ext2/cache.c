@@ -19,6 +19,7 @@
 #include <minix/u64.h>
 #include <minix/bdev.h>
 #include <minix/libminixfs.h>
+#include <stddef.h>
 #include <stdlib.h>
 #include <assert.h>
 #include "buf.h"
@@ -27,6 +28,7 @@
 
 static void rm_lru(struct buf *bp);
 static void rw_block(struct buf *, int);
+static void *find_clean_block(dev_t dev, block_t block);
 
 static int vmcache_avail = -1; /* 0 if not available, >0 if available. */
 
@@ -370,6 +372,25 @@ void flushall(
   rw_scattered(dev, dirty, ndirty, WRITING);
 }
 
+/*===========================================================================*
+ *				find_clean_block			     *
+ *===========================================================================*/
+static void *find_clean_block(dev_t dev, block_t block)
+{
+/* Return the cached copy of a block if it is valid, clean and not in use,
+ * without touching its LRU position, or NULL otherwise.  A block in use may
+ * be in the middle of being changed, so it must not be written out to fill a
+ * hole.
+ */
+  struct buf *bp;
+
+  for (bp = buf_hash[BUFHASH(block)]; bp != NULL; bp = bp->b_hash)
+	if (bp->b_blocknr == block && bp->b_dev == dev)
+		return(bp->b_dirt == CLEAN && bp->b_count == 0 ? bp : NULL);
+
+  return(NULL);
+}
+
 /*===========================================================================*
  *				rw_scattered				     *
  *===========================================================================*/
@@ -380,61 +401,54 @@ void rw_scattered(
   int rw_flag 			/* READING or WRITING */
 )
 {
-/* Read or write scattered data from a device. */
+/* Read or write scattered data from a device.  The buffers are sorted on
+ * block number, and runs of consecutive blocks are transferred with one
+ * vectored request each.  When writing, a hole of at most FS_IOSCHED_MAX_GAP
+ * blocks between two runs is filled with clean copies of the missing blocks
+ * from the cache, if they are all there, so that the runs are merged.
+ */
 
   register struct buf *bp;
-  int gap;
   register int i;
-  register iovec_t *iop;
   static iovec_t *iovec = NULL;
+  static struct buf **iobuf = NULL;	/* buffer behind each iovec entry */
+  block_t first;
   u64_t pos;
-  int j, r;
+  int j, q, r;
 
   STATICINIT(iovec, NR_IOREQS);
+  STATICINIT(iobuf, NR_IOREQS);
 
-  /* (Shell) sort buffers on b_blocknr. */
-  gap = 1;
-  do
-	gap = 3 * gap + 1;
-  while (gap <= bufqsize);
-  while (gap != 1) {
-	gap /= 3;
-	for (j = gap; j < bufqsize; j++) {
-		for (i = j - gap;
-		     i >= 0 && bufq[i]->b_blocknr > bufq[i + gap]->b_blocknr;
-		     i -= gap) {
-			bp = bufq[i];
-			bufq[i] = bufq[i + gap];
-			bufq[i + gap] = bp;
-		}
-	}
-  }
+  fs_sort_bufq((void **) bufq, bufqsize, offsetof(struct buf, b_blocknr));
 
   /* Set up I/O vector and do I/O.  The result of dev_io is OK if everything
    * went fine, otherwise the error code for the first failed transfer.
    */
   while (bufqsize > 0) {
-	for (j = 0, iop = iovec; j < NR_IOREQS && j < bufqsize; j++, iop++) {
-		bp = bufq[j];
-		if (bp->b_blocknr != (block_t) bufq[0]->b_blocknr + j) break;
-		iop->iov_addr = (vir_bytes) bp->b_data;
-		iop->iov_size = (vir_bytes) fs_block_size;
+	first = bufq[0]->b_blocknr;
+	j = fs_build_run(dev, (void **) bufq, bufqsize, rw_flag,
+		offsetof(struct buf, b_blocknr), find_clean_block,
+		(void **) iobuf, NR_IOREQS, &q);
+	for (i = 0; i < j; i++) {
+		iovec[i].iov_addr = (vir_bytes) iobuf[i]->b_data;
+		iovec[i].iov_size = (vir_bytes) fs_block_size;
 	}
-	pos = mul64u(bufq[0]->b_blocknr, fs_block_size);
+	pos = mul64u(first, fs_block_size);
 	if (rw_flag == READING)
 		r = bdev_gather(dev, pos, iovec, j, BDEV_NOFLAGS);
 	else
 		r = bdev_scatter(dev, pos, iovec, j, BDEV_NOFLAGS);
 
 	/* Harvest the results.  The driver may have returned an error, or it
-	 * may have done less than what we asked for.
+	 * may have done less than what we asked for.  Entries that merely
+	 * filled a hole need no further attention.
 	 */
 	if (r < 0) {
 		printf("ext2: I/O error %d on device %d/%d, block %u\n",
-			r, major(dev), minor(dev), bufq[0]->b_blocknr);
+			r, major(dev), minor(dev), first);
 	}
-	for (i = 0; i < j; i++) {
-		bp = bufq[i];
+	for (i = 0, q = 0; i < j; i++) {
+		bp = iobuf[i];
 		if (r < (ssize_t) fs_block_size) {
 			/* Transfer failed. */
 			if (i == 0) {
@@ -443,16 +457,18 @@ void rw_scattered(
 			}
 			break;
 		}
+		r -= fs_block_size;
+		if (bp != bufq[q]) continue;	/* hole filler */
 		if (rw_flag == READING) {
 			bp->b_dev = dev;	/* validate block */
 			put_block(bp, PARTIAL_DATA_BLOCK);
 		} else {
 			bp->b_dirt = CLEAN;
 		}
-		r -= fs_block_size;
+		q++;
 	}
-	bufq += i;
-	bufqsize -= i;
+	bufq += q;
+	bufqsize -= q;
 	if (rw_flag == READING) {
 		/* Don't bother reading more than the device is willing to
 		 * give at this time.  Don't forget to release those extras.
@@ -462,7 +478,7 @@ void rw_scattered(
 			bufqsize--;
 		}
 	}
-	if (rw_flag == WRITING && i == 0) {
+	if (rw_flag == WRITING && q == 0) {
 		/* We're not making progress, this means we might keep
 		 * looping. Buffers remain dirty if un-written. Buffers are
 		 * lost if invalidate()d or LRU-removed while dirty. This
@@ -169,7 +169,7 @@ int main(int argc, char *argv[])
 			}
 		}
 		else if (m_type == DL_CONF_REPLY || m_type == DL_TASK_REPLY ||
-			m_type == DL_STAT_REPLY)
+			m_type == DL_STAT_REPLY || m_type == DL_CONF_REPLY_M)
 		{
 			eth_rec(&mq->mq_mess);
 			mq_free(mq);
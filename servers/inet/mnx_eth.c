@@ -23,6 +23,8 @@ THIS_FILE
 
 static void setup_read(eth_port_t *eth_port);
 static void read_int(eth_port_t *eth_port, int count);
+static void setup_read_batch(eth_port_t *eth_port);
+static void read_int_batch(eth_port_t *eth_port, int count);
 static void eth_issue_send(eth_port_t *eth_port);
 static void write_int(eth_port_t *eth_port);
 static void eth_restart(eth_port_t *eth_port, endpoint_t endpoint);
@@ -46,6 +48,13 @@ void osdep_eth_init()
 		for (j= 0; j<RD_IOVEC; j++)
 			eth_port->etp_osdep.etp_rd_iovec[j].iov_grant= -1;
 		eth_port->etp_osdep.etp_rd_vec_grant= -1;
+		for (j= 0; j<RD_BATCH*RD_IOVEC; j++)
+		{
+			eth_port->etp_osdep.etp_rd_packs[j/RD_IOVEC].
+				dp_iov[j%RD_IOVEC].iov_grant= -1;
+		}
+		for (j= 0; j<RD_BATCH; j++)
+			eth_port->etp_osdep.etp_rd_batch[j]= NULL;
 
 		eth_port->etp_osdep.etp_state= OEPS_INIT;
 		eth_port->etp_osdep.etp_flags= OEPF_EMPTY;
@@ -90,6 +99,17 @@ void osdep_eth_init()
 				errno));
 		}
 		eth_port->etp_osdep.etp_rd_vec_grant= gid;
+		for (j= 0; j<RD_BATCH*RD_IOVEC; j++)
+		{
+			if (cpf_getgrants(&gid, 1) != 1)
+			{
+				ip_panic((
+			"osdep_eth_init: cpf_getgrants failed: %d\n",
+					errno));
+			}
+			eth_port->etp_osdep.etp_rd_packs[j/RD_IOVEC].
+				dp_iov[j%RD_IOVEC].iov_grant= gid;
+		}
 
 		eth_port->etp_osdep.etp_task= NONE;
 		eth_port->etp_osdep.etp_recvconf= 0;
@@ -183,7 +203,7 @@ void eth_rec(message *m)
 	m_type= m->m_type;
 
 	assert(m_type == DL_CONF_REPLY || m_type == DL_TASK_REPLY ||
-		m_type == DL_STAT_REPLY);
+		m_type == DL_STAT_REPLY || m_type == DL_CONF_REPLY_M);
 
 	for (i=0, loc_port= eth_port_table; i<eth_conf_nr; i++, loc_port++)
 	{
@@ -210,7 +230,7 @@ void eth_rec(message *m)
 			return;
 		}
 
-		if (m_type != DL_CONF_REPLY)
+		if (m_type != DL_CONF_REPLY && m_type != DL_CONF_REPLY_M)
 		{
 			printf(
 	"eth_rec: got bad message type 0x%x from %d in CONF state\n",
@@ -232,6 +252,14 @@ void eth_rec(message *m)
 		loc_port->etp_osdep.etp_state= OEPS_IDLE;
 		loc_port->etp_flags |= EPF_ENABLED;
 
+		/* A driver that replies with DL_CONF_REPLY_M can fill
+		 * several receive buffers per request.
+		 */
+		if (m_type == DL_CONF_REPLY_M)
+			loc_port->etp_osdep.etp_flags |= OEPF_BATCH;
+		else
+			loc_port->etp_osdep.etp_flags &= ~OEPF_BATCH;
+
 		loc_port->etp_ethaddr= *(ether_addr_t *)m->DL_HWADDR;
 		if (!(loc_port->etp_flags & EPF_GOT_ADDR))
 		{
@@ -607,6 +635,12 @@ int count;
 		return;
 	}
 
+	if (eth_port->etp_osdep.etp_flags & OEPF_BATCH)
+	{
+		read_int_batch(eth_port, count);
+		return;
+	}
+
 	pack= eth_port->etp_rd_pack;
 	eth_port->etp_rd_pack= NULL;
 
@@ -654,6 +688,67 @@ int count;
 	setup_read(eth_port);
 }
 
+static void read_int_batch(eth_port, count)
+eth_port_t *eth_port;
+int count;
+{
+	acc_t *pack, *cut_pack;
+	dl_pack_t *dl_pack;
+	int i, j, r, size;
+
+	if (count < 0 || count > RD_BATCH)
+	{
+		printf("mnx_eth`read_int_batch: bad packet count (%d)\n",
+			count);
+		count= 0;
+	}
+
+	/* Invalidate the grants of all buffers first. The ones that were
+	 * not filled are posted again by setup_read_batch.
+	 */
+	for (i= 0; i<RD_BATCH; i++)
+	{
+		dl_pack= &eth_port->etp_osdep.etp_rd_packs[i];
+		for (j= 0; j<dl_pack->dp_count; j++)
+		{
+			r= cpf_setgrant_disable(dl_pack->dp_iov[j].iov_grant);
+			if (r != 0)
+			{
+				ip_panic((
+		"mnx_eth`read_int_batch: cpf_setgrant_disable failed: %d\n",
+					errno));
+			}
+		}
+	}
+
+	for (i= 0; i<count; i++)
+	{
+		pack= eth_port->etp_osdep.etp_rd_batch[i];
+		eth_port->etp_osdep.etp_rd_batch[i]= NULL;
+		size= eth_port->etp_osdep.etp_rd_packs[i].dp_size;
+
+		if (size < ETH_MIN_PACK_SIZE || size > ETH_MAX_PACK_SIZE_TAGGED)
+		{
+			printf("mnx_eth`read_int_batch: bad packet size (%d)\n",
+				size);
+			bf_afree(pack);
+			continue;
+		}
+
+		cut_pack= bf_cut(pack, 0, size);
+		bf_afree(pack);
+
+		assert(!no_ethWritePort);
+		no_ethWritePort= 1;
+		eth_arrive(eth_port, cut_pack, size);
+		assert(no_ethWritePort);
+		no_ethWritePort= 0;
+	}
+
+	eth_port->etp_flags &= ~(EPF_READ_IP|EPF_READ_SP);
+	setup_read(eth_port);
+}
+
 static void setup_read(eth_port)
 eth_port_t *eth_port;
 {
@@ -672,6 +767,12 @@ eth_port_t *eth_port;
 		return;
 	}
 
+	if (eth_port->etp_osdep.etp_flags & OEPF_BATCH)
+	{
+		setup_read_batch(eth_port);
+		return;
+	}
+
 	assert (!eth_port->etp_rd_pack);
 
 	iovec= eth_port->etp_osdep.etp_rd_iovec;
@@ -727,9 +828,84 @@ eth_port_t *eth_port;
 	eth_port->etp_flags |= EPF_READ_SP;
 }
 
+static void setup_read_batch(eth_port)
+eth_port_t *eth_port;
+{
+	acc_t *pack, *pack_ptr;
+	dl_pack_t *dl_pack;
+	message mess;
+	int i, j, r;
+
+	assert(eth_port->etp_osdep.etp_state == OEPS_IDLE);
+
+	/* Give the driver RD_BATCH buffers at once. Buffers left over from
+	 * the previous request are reused.
+	 */
+	for (i= 0; i<RD_BATCH; i++)
+	{
+		pack= eth_port->etp_osdep.etp_rd_batch[i];
+		if (!pack)
+		{
+			pack= bf_memreq (ETH_MAX_PACK_SIZE_TAGGED);
+			eth_port->etp_osdep.etp_rd_batch[i]= pack;
+		}
+
+		dl_pack= &eth_port->etp_osdep.etp_rd_packs[i];
+		for (j=0, pack_ptr= pack; j<RD_IOVEC && pack_ptr;
+			j++, pack_ptr= pack_ptr->acc_next)
+		{
+			r= cpf_setgrant_direct(dl_pack->dp_iov[j].iov_grant,
+				eth_port->etp_osdep.etp_task,
+				(vir_bytes)ptr2acc_data(pack_ptr),
+				(vir_bytes)pack_ptr->acc_length,
+				CPF_WRITE);
+			if (r != 0)
+			{
+				ip_panic((
+		"mnx_eth`setup_read_batch: cpf_setgrant_direct failed: %d\n",
+					errno));
+			}
+			dl_pack->dp_iov[j].iov_size=
+				(vir_bytes)pack_ptr->acc_length;
+		}
+		assert (!pack_ptr);
+		dl_pack->dp_count= j;
+		dl_pack->dp_size= 0;
+	}
+
+	/* The driver writes the packet sizes back. */
+	r= cpf_setgrant_direct(eth_port->etp_osdep.etp_rd_vec_grant,
+		eth_port->etp_osdep.etp_task,
+		(vir_bytes)eth_port->etp_osdep.etp_rd_packs,
+		(vir_bytes)sizeof(eth_port->etp_osdep.etp_rd_packs),
+		CPF_READ | CPF_WRITE);
+	if (r != 0)
+	{
+		ip_panic((
+	"mnx_eth`setup_read_batch: cpf_setgrant_direct failed: %d\n",
+			errno));
+	}
+
+	mess.m_type= DL_READV_M;
+	mess.DL_COUNT= RD_BATCH;
+	mess.DL_GRANT= eth_port->etp_osdep.etp_rd_vec_grant;
+
+	r= asynsend(eth_port->etp_osdep.etp_task, &mess);
+	eth_port->etp_osdep.etp_state= OEPS_RECV_SENT;
+
+	if (r < 0)
+	{
+		printf(
+		"mnx_eth`setup_read_batch: asynsend to %d failed: %d\n",
+			eth_port->etp_osdep.etp_task, r);
+	}
+	eth_port->etp_flags |= EPF_READ_IP;
+	eth_port->etp_flags |= EPF_READ_SP;
+}
+
 static void eth_restart(eth_port_t *eth_port, endpoint_t endpoint)
 {
-	int r;
+	int i, r;
 	unsigned flags, dl_flags;
 	cp_grant_id_t gid;
 	message mess;
@@ -809,7 +985,16 @@ static void eth_restart(eth_port_t *eth_port, endpoint_t endpoint)
 		eth_port->etp_rd_pack= NULL;
 		eth_port->etp_flags &= ~(EPF_READ_IP|EPF_READ_SP);
 	}
-
+	for (i= 0; i<RD_BATCH; i++)
+	{
+		if (!eth_port->etp_osdep.etp_rd_batch[i])
+			continue;
+		bf_afree(eth_port->etp_osdep.etp_rd_batch[i]);
+		eth_port->etp_osdep.etp_rd_batch[i]= NULL;
+		eth_port->etp_flags &= ~(EPF_READ_IP|EPF_READ_SP);
+	}
+	/* The new driver says in its DL_CONF reply what it supports. */
+	eth_port->etp_osdep.etp_flags &= ~OEPF_BATCH;
 }
 
 static void send_getstat(eth_port)
@@ -13,6 +13,11 @@ Copyright 1995 Philip Homburg
 
 #define IOVEC_NR	16
 #define RD_IOVEC	((ETH_MAX_PACK_SIZE + BUF_S -1)/BUF_S)
+#define RD_BATCH	8	/* Receive buffers for a batching driver */
+
+#if RD_IOVEC > DL_PACK_IOV
+#error RD_IOVEC too large for batched receive requests
+#endif
 
 typedef struct osdep_eth_port
 {
@@ -24,6 +29,8 @@ typedef struct osdep_eth_port
 	cp_grant_id_t etp_wr_vec_grant;
 	iovec_s_t etp_rd_iovec[RD_IOVEC];
 	cp_grant_id_t etp_rd_vec_grant;
+	dl_pack_t etp_rd_packs[RD_BATCH];
+	struct acc *etp_rd_batch[RD_BATCH];
 	event_t etp_recvev;
 	cp_grant_id_t etp_stat_gid;
 	eth_stat_t *etp_stat_buf;
@@ -49,6 +56,7 @@ typedef struct osdep_eth_port
 #define OEPF_NEED_STAT	8	/* Issue getstat request when the state becomes
 				 * idle
 				 */
+#define OEPF_BATCH	16	/* Driver accepts DL_READV_M requests */
 
 #endif /* INET__OSDEP_ETH_H */
 
@@ -12,6 +12,7 @@
 #include "kernel/type.h"
 #include "kernel/proc.h"
 #include "kernel/ipc.h"
+#include <minix/safecopies.h>
 
 #define LINES 22
 
@@ -265,6 +266,29 @@ static char *s_traps_str(int flags)
 	return str;
 }
 
+/*===========================================================================*
+ *				grants_used				     *
+ *===========================================================================*/
+static int grants_used(endpoint_t ep, vir_bytes table, int entries)
+{
+/* Count the grants in use in a process' grant table, or return -1 if the
+ * table cannot be copied.
+ */
+  static cp_grant_t grants[64];
+  int i, n, used = 0;
+
+  for (; entries > 0; entries -= n, table += n * sizeof(grants[0])) {
+	n = MIN(entries, sizeof(grants) / sizeof(grants[0]));
+	if (sys_datacopy(ep, table, SELF, (vir_bytes) grants,
+		n * sizeof(grants[0])) != OK)
+		return -1;
+	for (i = 0; i < n; i++)
+		if (grants[i].cp_flags & CPF_USED) used++;
+  }
+
+  return used;
+}
+
 /*===========================================================================*
  *				privileges_dmp 				     *
  *===========================================================================*/
@@ -285,7 +309,7 @@ void privileges_dmp()
       return;
   }
 
-  printf("-nr- -id- -name-- -flags- traps grants -ipc_to--"
+  printf("-nr- -id- -name-- -flags- traps -grants-- -ipc_to--"
     "          -kernel calls-\n");
 
   PROCLOOP(rp, oldrp)
@@ -295,10 +319,14 @@ void privileges_dmp()
         if (r == -1 && !isemptyp(rp)) {
 	    sp = &priv[USER_PRIV_ID];
         }
-	printf("(%02u) %-7.7s %s %s %6d",
+	printf("(%02u) %-7.7s %s %s",
 	       sp->s_id, rp->p_name,
-	       s_flags_str(sp->s_flags), s_traps_str(sp->s_trap_mask),
-		sp->s_grant_entries);
+	       s_flags_str(sp->s_flags), s_traps_str(sp->s_trap_mask));
+	if (r == -1 || !sp->s_grant_table)
+	    printf("           ");
+	else
+	    printf(" %4d/%-5d", grants_used(rp->p_endpoint,
+		sp->s_grant_table, sp->s_grant_entries), sp->s_grant_entries);
         for (i=0; i < NR_SYS_PROCS; i += BITCHUNK_BITS) {
 	    printf(" %08x", get_sys_bits(sp->s_ipc_to, i));
        	}
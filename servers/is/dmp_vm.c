@@ -83,6 +83,13 @@ void vm_dmp()
 		vsi.vsi_largest * (vsi.vsi_pagesize / 1024),
 		vsi.vsi_cached * (vsi.vsi_pagesize / 1024));
 	n++;
+	printf("Free blocks:");
+	for (i = 0; i < VSI_ORDERS; i++)
+		printf(" %lukB:%lu",
+			(unsigned long) (vsi.vsi_pagesize / 1024) << i,
+			vsi.vsi_orders[i]);
+	printf("\n");
+	n++;
 	printf("\n");
 	n++;
 
@@ -124,10 +131,12 @@ void vm_dmp()
 		}
 
 		printf("Process %d (%s): total %lu kB, common %lu kB, "
-			"shared %lu kB\n",
+			"shared %lu kB, faults %lu (cow %lu, around %lu)\n",
 			proc[i].p_endpoint, proc[i].p_name,
 			vui.vui_total / 1024L, vui.vui_common / 1024L,
-			vui.vui_shared / 1024L);
+			vui.vui_shared / 1024L, (unsigned long) vui.vui_faults,
+			(unsigned long) vui.vui_cow_faults,
+			(unsigned long) vui.vui_faultaround);
 		n++;
 	}
 
@@ -36,6 +36,17 @@
 
 static struct nic devices[MAX_DEVS];
 
+/* A received packet passed up in the packet pool slot it arrived in */
+struct pool_pbuf {
+	struct pbuf_custom	pc;
+	struct nic *		nic;
+	dl_pool_t *		pool;
+	int			slot;
+};
+
+#define POOL_SLOT(pool, slot) \
+	((char *) (pool) + (pool)->dpl_offset + (slot) * (pool)->dpl_slot_size)
+
 static ip_addr_t ip_addr_none = { IPADDR_NONE };
 extern endpoint_t lwip_ep;
 
@@ -123,15 +134,90 @@ void nic_init_all(void)
 			if (cpf_getgrants(gid, 1) != 1)
 				panic("Cannot initialize grants");
 		}
+		for (g = 0; g < RX_BATCH_NUM; g++) {
+			cp_grant_id_t * gid =
+				&devices[i].rx_packs[g].dp_iov[0].iov_grant;
+			if (cpf_getgrants(gid, 1) != 1)
+				panic("Cannot initialize grants");
+			devices[i].rx_pbufs[g] = NULL;
+		}
+		devices[i].pool = NULL;
 		devices[i].raw_socket = NULL;
 	}
 }
 
+/*
+ * Post all RX_BATCH_NUM receive buffers to a batching driver in one request.
+ * Buffers which were not filled by the previous request are posted again.
+ */
+static void driver_setup_read_batch(struct nic * nic)
+{
+	message m;
+	unsigned i;
+
+	for (i = 0; i < RX_BATCH_NUM; i++) {
+		struct pbuf * p;
+		dl_pack_t * pack = &nic->rx_packs[i];
+
+		if (nic->pool) {
+			/*
+			 * The driver fills a slot of its packet pool. Give
+			 * back slots we are done with on the way.
+			 */
+			pack->dp_count = 0;
+			pack->dp_size = 0;
+			if (nic->pool_ret_nr > 0) {
+				pack->dp_slot =
+					nic->pool_ret[--nic->pool_ret_nr];
+				nic->pool_held--;
+			} else
+				pack->dp_slot = -1;
+			continue;
+		}
+
+		if (nic->rx_pbufs[i] == NULL && !(nic->rx_pbufs[i] =
+				pbuf_alloc(PBUF_RAW,
+					ETH_MAX_PACK_SIZE + ETH_CRC_SIZE,
+					PBUF_RAM)))
+			panic("Cannot allocate rx pbuf");
+		p = nic->rx_pbufs[i];
+
+		if (cpf_setgrant_direct(pack->dp_iov[0].iov_grant,
+					nic->drv_ep, (vir_bytes) p->payload,
+					p->len, CPF_WRITE) != OK)
+			panic("Failed to set grant");
+		pack->dp_iov[0].iov_size = p->len;
+		pack->dp_count = 1;
+		pack->dp_slot = -1;
+		pack->dp_size = 0;
+	}
+
+	/* the driver writes the packet sizes back */
+	if (cpf_setgrant_direct(nic->rx_iogrant, nic->drv_ep,
+				(vir_bytes) nic->rx_packs,
+				sizeof(nic->rx_packs),
+				CPF_READ | CPF_WRITE) != OK)
+		panic("Failed to set grant");
+
+	m.m_type = DL_READV_M;
+	m.DL_COUNT = RX_BATCH_NUM;
+	m.DL_GRANT = nic->rx_iogrant;
+
+	if (asynsend(nic->drv_ep, &m) != OK)
+		panic("asynsend to the driver failed!");
+}
+
 static void driver_setup_read(struct nic * nic)
 {
 	message m;
 
 	debug_print("device /dev/%s", nic->name);
+
+	if (nic->batch) {
+		driver_setup_read_batch(nic);
+		return;
+	}
+
 	//assert(nic->rx_pbuf == NULL);
 	if (!(nic->rx_pbuf == NULL)) {
 		panic("device /dev/%s rx_pbuf %p", nic->name, nic->rx_pbuf);
@@ -154,9 +240,72 @@ static void driver_setup_read(struct nic * nic)
 		panic("asynsend to the driver failed!");
 }
 
+/*
+ * Start using the packet pool the driver has mapped into our address space.
+ */
+static void nic_pool_setup(struct nic * nic, dl_pool_t * pool)
+{
+	struct packet_q * pkt, ** pp;
+	int i;
+
+	if (pool == nic->pool)
+		return;
+
+	/*
+	 * A new pool means a new driver instance. Queued packets in the old
+	 * pool's tx slots are dropped. The old pool stays mapped, as pbufs
+	 * may still point into it.
+	 */
+	if (nic->pool) {
+		free(nic->pool_ret);
+		free(nic->pool_tx_free);
+		nic->pool = NULL;
+
+		nic->tx_tail = NULL;
+		for (pp = &nic->tx_head; (pkt = *pp) != NULL; ) {
+			if (pkt->slot >= 0) {
+				*pp = pkt->next;
+				debug_free(pkt);
+			} else {
+				nic->tx_tail = pkt;
+				pp = &pkt->next;
+			}
+		}
+	}
+
+	if (!pool)
+		return;
+
+	nic->pool_ret = malloc(pool->dpl_rx_slots * sizeof(int));
+	nic->pool_tx_free = malloc(pool->dpl_tx_slots * sizeof(int));
+	if (!nic->pool_ret || !nic->pool_tx_free) {
+		printf("LWIP : no memory for packet pool of /dev/%s\n",
+				nic->name);
+		free(nic->pool_ret);
+		free(nic->pool_tx_free);
+		return;
+	}
+
+	nic->pool_held = 0;
+	nic->pool_ret_nr = 0;
+	for (i = 0; i < pool->dpl_tx_slots; i++)
+		nic->pool_tx_free[i] = pool->dpl_rx_slots + i;
+	nic->pool_tx_free_nr = pool->dpl_tx_slots;
+	nic->pool = pool;
+
+	debug_print("device /dev/%s shares a pool of %d+%d slots", nic->name,
+			pool->dpl_rx_slots, pool->dpl_tx_slots);
+}
+
 static void nic_up(struct nic * nic, message * m)
 {
 	memcpy(nic->netif.hwaddr, m->DL_HWADDR, NETIF_MAX_HWADDR_LEN);
+	nic->batch = (m->m_type == DL_CONF_REPLY_M);
+
+	if (nic->batch && (m->DL_CAPS & DL_CAP_POOL))
+		nic_pool_setup(nic, (dl_pool_t *) m->DL_POOL);
+	else
+		nic_pool_setup(nic, NULL);
 
 	debug_print("device %s is up MAC : %02x:%02x:%02x:%02x:%02x:%02x",
 			nic->name,
@@ -173,6 +322,67 @@ static void nic_up(struct nic * nic, message * m)
 	netif_set_up(&nic->netif);
 }
 
+/*
+ * Hand up to TX_IOVEC_NUM enqueued packets to a batching driver at once. They
+ * stay in the queue until the driver reports them all sent.
+ */
+static int driver_tx_batch(struct nic * nic)
+{
+	struct packet_q * pkt;
+	unsigned len;
+	message m;
+	int n;
+
+	for (pkt = driver_tx_head(nic), n = 0; pkt && n < TX_IOVEC_NUM;
+						pkt = pkt->next, n++) {
+		assert(pkt->buf_len <= nic->max_pkt_sz);
+
+		if ((len = pkt->buf_len) < nic->min_pkt_sz)
+			len = nic->min_pkt_sz;
+
+		if (pkt->slot >= 0) {
+			/* already in the packet pool, no grant needed */
+			nic->tx_packs[n].dp_count = 0;
+			nic->tx_packs[n].dp_slot = pkt->slot;
+			nic->tx_packs[n].dp_size = len;
+			continue;
+		}
+		if (cpf_setgrant_direct(nic->tx_iovec[n].iov_grant,
+				nic->drv_ep, (vir_bytes) pkt->buf,
+				len, CPF_READ) != OK)
+			panic("Failed to set grant");
+		nic->tx_iovec[n].iov_size = len;
+
+		nic->tx_packs[n].dp_count = 1;
+		nic->tx_packs[n].dp_slot = -1;
+		nic->tx_packs[n].dp_size = 0;
+		nic->tx_packs[n].dp_iov[0] = nic->tx_iovec[n];
+	}
+
+	if (n == 0) {
+		debug_print("no packets enqueued");
+		return 0;
+	}
+
+	if (cpf_setgrant_direct(nic->tx_iogrant, nic->drv_ep,
+			(vir_bytes) nic->tx_packs,
+			n * sizeof(dl_pack_t), CPF_READ) != OK)
+		panic("Failed to set grant");
+
+	m.m_type = DL_WRITEV_M;
+	m.DL_COUNT = n;
+	m.DL_GRANT = nic->tx_iogrant;
+
+	if (asynsend(nic->drv_ep, &m) != OK)
+		panic("asynsend to the driver failed!");
+	nic->state = DRV_SENDING;
+	nic->tx_batch = n;
+
+	debug_print("%d packets sent to driver", n);
+
+	return 1;
+}
+
 int driver_tx(struct nic * nic)
 {
 	struct packet_q * pkt;
@@ -184,6 +394,9 @@ int driver_tx(struct nic * nic)
 	debug_print("device /dev/%s", nic->name);
 	assert(nic->tx_buffer);
 
+	if (nic->batch)
+		return driver_tx_batch(nic);
+
 	pkt = driver_tx_head(nic);
 	if (pkt == NULL) {
 		debug_print("no packets enqueued");
@@ -214,6 +427,7 @@ int driver_tx(struct nic * nic)
 	if (asynsend(nic->drv_ep, &m) != OK)
 		panic("asynsend to the driver failed!");
 	nic->state = DRV_SENDING;
+	nic->tx_batch = 1;
 	
 	debug_print("packet sent to driver");
 
@@ -226,7 +440,10 @@ static void nic_pkt_sent(struct nic * nic)
 	assert(nic->state != DRV_IDLE);
 
 	/* packet has been sent, we are not intereted anymore */
-	driver_tx_dequeue(nic);
+	while (nic->tx_batch > 0) {
+		driver_tx_dequeue(nic);
+		nic->tx_batch--;
+	}
 	/*
 	 * Try to transmit the next packet. Failure means that no packet is
 	 * enqueued and thus the device is entering idle state
@@ -359,6 +576,86 @@ static void nic_pkt_received(struct nic * nic, unsigned size)
 	driver_setup_read(nic);
 }
 
+static void pool_pbuf_free(struct pbuf * p)
+{
+	struct pool_pbuf * pp = (struct pool_pbuf *) p;
+	struct nic * nic = pp->nic;
+
+	/* the slot goes back to the driver with the next read request */
+	if (pp->pool == nic->pool)
+		nic->pool_ret[nic->pool_ret_nr++] = pp->slot;
+
+	free(pp);
+}
+
+/*
+ * Pass up a packet which the driver left in a slot of its packet pool. While
+ * we do not hold too many slots, the pbuf points into the slot. Otherwise the
+ * packet is copied, so that the driver never runs out of slots.
+ */
+static void nic_pool_received(struct nic * nic, dl_pack_t * pack)
+{
+	struct pool_pbuf * pp = NULL;
+	struct pbuf * p = NULL;
+	dl_pool_t * pool = nic->pool;
+	unsigned size;
+
+	if (pack->dp_slot < 0 || pack->dp_slot >= pool->dpl_rx_slots) {
+		printf("LWIP : bad rx slot %d from driver of /dev/%s\n",
+				pack->dp_slot, nic->name);
+		return;
+	}
+	nic->pool_held++;
+	size = pack->dp_size - ETH_CRC_SIZE;
+
+	if (nic->pool_held <= POOL_HOLD_MAX &&
+			(pp = malloc(sizeof(struct pool_pbuf)))) {
+		pp->nic = nic;
+		pp->pool = pool;
+		pp->slot = pack->dp_slot;
+		pp->pc.custom_free_function = pool_pbuf_free;
+		p = pbuf_alloced_custom(PBUF_RAW, size, PBUF_REF, &pp->pc,
+				POOL_SLOT(pool, pack->dp_slot),
+				pool->dpl_slot_size);
+	}
+	if (!p) {
+		free(pp);
+		if ((p = pbuf_alloc(PBUF_RAW, size, PBUF_RAM)))
+			memcpy(p->payload, POOL_SLOT(pool, pack->dp_slot),
+					size);
+		nic->pool_ret[nic->pool_ret_nr++] = pack->dp_slot;
+		if (!p)
+			return;
+	}
+
+	nic->netif.input(p, &nic->netif);
+}
+
+static void nic_pkts_received(struct nic * nic, int count)
+{
+	int i;
+
+	assert(nic->netif.input);
+	assert(count <= RX_BATCH_NUM);
+
+	for (i = 0; i < count; i++) {
+		struct pbuf * p = nic->rx_pbufs[i];
+
+		if (nic->pool) {
+			nic_pool_received(nic, &nic->rx_packs[i]);
+			continue;
+		}
+
+		assert(p->tot_len == p->len);
+		p->tot_len = p->len = nic->rx_packs[i].dp_size - ETH_CRC_SIZE;
+
+		nic->rx_pbufs[i] = NULL;
+		nic->netif.input(p, &nic->netif);
+	}
+
+	driver_setup_read(nic);
+}
+
 void driver_request(message * m)
 {
 	struct nic * nic;
@@ -370,6 +667,7 @@ void driver_request(message * m)
 
 	switch (m->m_type) {
 	case DL_CONF_REPLY:
+	case DL_CONF_REPLY_M:
 		if (m->DL_STAT == OK)
 			nic_up(nic, m);
 		break;
@@ -382,8 +680,12 @@ void driver_request(message * m)
 		*/
 		if (m->DL_FLAGS & DL_PACK_SEND)
 			nic_pkt_sent(nic);
-		if (m->DL_FLAGS & DL_PACK_RECV)
-			nic_pkt_received(nic, m->DL_COUNT);
+		if (m->DL_FLAGS & DL_PACK_RECV) {
+			if (nic->batch)
+				nic_pkts_received(nic, m->DL_COUNT);
+			else
+				nic_pkt_received(nic, m->DL_COUNT);
+		}
 		break;
 	case DL_STAT_REPLY:
 		break;
@@ -754,21 +1056,29 @@ void nic_open(message *m)
 	send_reply_open(m, get_sock_num(sock));
 }
 
+/*
+ * Enqueue a copy of the packet. If slot_buf is not NULL, the data goes there
+ * instead of to a buffer of the queue entry.
+ */
 static int driver_pkt_enqueue(struct packet_q ** head,
 				struct packet_q ** tail,
-				struct pbuf * pbuf)
+				struct pbuf * pbuf,
+				char * slot_buf,
+				int slot)
 {
 	struct packet_q * pkt;
 	char * b;
 
-	pkt = (struct packet_q *) malloc(sizeof(struct packet_q) + pbuf->tot_len);
+	pkt = (struct packet_q *) malloc(sizeof(struct packet_q) +
+					(slot_buf ? 0 : pbuf->tot_len));
 	if (!pkt)
 		return ENOMEM;
 
 	pkt->next = NULL;
 	pkt->buf_len = pbuf->tot_len;
+	pkt->slot = slot_buf ? slot : -1;
 	
-	for (b = pkt->buf; pbuf; pbuf = pbuf->next) {
+	for (b = slot_buf ? slot_buf : pkt->buf; pbuf; pbuf = pbuf->next) {
 		memcpy(b, pbuf->payload, pbuf->len);
 		b += pbuf->len;
 	}
@@ -785,8 +1095,22 @@ static int driver_pkt_enqueue(struct packet_q ** head,
 
 int driver_tx_enqueue(struct nic * nic, struct pbuf * pbuf)
 {
+	int slot, r;
+
 	debug_print("device /dev/%s", nic->name);
-	return driver_pkt_enqueue(&nic->tx_head, &nic->tx_tail, pbuf);
+
+	/* write the packet straight into a tx slot of the packet pool */
+	if (nic->pool && nic->pool_tx_free_nr > 0 &&
+			pbuf->tot_len <= nic->pool->dpl_slot_size) {
+		slot = nic->pool_tx_free[--nic->pool_tx_free_nr];
+		r = driver_pkt_enqueue(&nic->tx_head, &nic->tx_tail, pbuf,
+					POOL_SLOT(nic->pool, slot), slot);
+		if (r != OK)
+			nic->pool_tx_free[nic->pool_tx_free_nr++] = slot;
+		return r;
+	}
+
+	return driver_pkt_enqueue(&nic->tx_head, &nic->tx_tail, pbuf, NULL, -1);
 }
 
 static void driver_pkt_dequeue(struct packet_q ** head,
@@ -808,6 +1132,11 @@ static void driver_pkt_dequeue(struct packet_q ** head,
 void driver_tx_dequeue(struct nic * nic)
 {
 	debug_print("device /dev/%s", nic->name);
+
+	assert(nic->tx_head);
+	if (nic->tx_head->slot >= 0)
+		nic->pool_tx_free[nic->pool_tx_free_nr++] = nic->tx_head->slot;
+
 	driver_pkt_dequeue(&nic->tx_head, &nic->tx_tail);
 }
 
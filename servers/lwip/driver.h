@@ -10,10 +10,13 @@
 #define DRV_NAME_LEN	DS_MAX_KEYLEN
 
 #define TX_IOVEC_NUM	16 /* something the drivers assume */
+#define RX_BATCH_NUM	8  /* rx buffers posted to a batching driver */
+#define POOL_HOLD_MAX	32 /* packet pool rx slots we keep in pbufs at most */
 
 struct packet_q {
 	struct packet_q *	next;
 	unsigned		buf_len;
+	int			slot; /* packet pool tx slot with data or -1 */
 	char			buf[];
 };
 
@@ -33,6 +36,17 @@ struct nic {
 	struct pbuf *		rx_pbuf;
 	cp_grant_id_t		tx_iogrant;
 	iovec_s_t		tx_iovec[TX_IOVEC_NUM];
+	int			batch; /* driver takes DL_READV_M/DL_WRITEV_M */
+	dl_pack_t		rx_packs[RX_BATCH_NUM];
+	struct pbuf *		rx_pbufs[RX_BATCH_NUM];
+	dl_pack_t		tx_packs[TX_IOVEC_NUM];
+	int			tx_batch; /* packets of the batch being sent */
+	dl_pool_t *		pool; /* packet pool shared with the driver */
+	int			pool_held; /* rx slots not given back yet */
+	int *			pool_ret; /* rx slots to give back */
+	int			pool_ret_nr;
+	int *			pool_tx_free; /* unused tx slots */
+	int			pool_tx_free_nr;
 	struct packet_q	*	tx_head;
 	struct packet_q	*	tx_tail;
 	void *			tx_buffer;
@@ -109,6 +109,8 @@ static void low_level_init(struct netif *netif)
                 m.DL_MODE |= DL_MULTI_REQ;
         if (nic->flags & NWEO_EN_PROMISC)
                 m.DL_MODE |= DL_PROMISC_REQ;
+	/* share the driver's packet pool if it has one */
+	m.DL_MODE |= DL_POOL_REQ;
 
         m.m_type = DL_CONF;
 
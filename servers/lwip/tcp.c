@@ -15,6 +15,14 @@
 #include "proto.h"
 
 #define TCP_BUF_SIZE	(32 << 10)
+/* tcp_write() takes a u16_t length, the send buffer may be larger */
+#define TCP_WRITE_MAX	0xffff
+/*
+ * Blocking writes at least this large are not staged in TCP_BUF_SIZE
+ * buffers. The write is held and its data is copied from the user straight
+ * into what lwip sends, as lwip's send buffer makes room for it.
+ */
+#define TCP_HOLD_MIN	(16 << 10)
 
 #define sock_alloc_buf(s)	debug_malloc(s)
 #define sock_free_buf(x)	debug_free(x)
@@ -43,6 +51,8 @@ struct wbuf_chain {
 	struct wbuf * unsent; /* points to the first buffer that contains unsent
 				 data. It may point anywhere between head and
 				 tail */
+	unsigned held_len;	/* size of the held write, 0 if none */
+	unsigned held_off;	/* how much of it lwip has already */
 };
 
 static void tcp_error_callback(void *arg, err_t err)
@@ -66,6 +76,9 @@ static void tcp_error_callback(void *arg, err_t err)
 		perr = EIO;
 	}
 	
+	if (sock->buf)
+		((struct wbuf_chain *) sock->buf)->held_len = 0;
+
 	if (sock->flags & SOCK_FLG_OP_PENDING) {
 		sock_reply(sock, perr);
 		sock->flags &= ~SOCK_FLG_OP_PENDING;
@@ -87,6 +100,7 @@ static int tcp_fill_new_socket(struct socket * sock, struct tcp_pcb * pcb)
 		return ENOMEM;
 	
 	wc-> head = wc->tail = wc->unsent = NULL;
+	wc->held_len = wc->held_off = 0;
 	sock->buf = wc;
 	sock->buf_size = 0;
 	
@@ -193,10 +207,71 @@ __unused static void print_tcp_payload(unsigned char * buf, int len)
 	kputc('\n');
 }
 
+/*
+ * Open the receive window by len bytes, which may be more than what
+ * tcp_recved() takes at once
+ */
+static void tcp_recved_len(struct tcp_pcb * pcb, unsigned len)
+{
+	for (; len > 0xffff; len -= 0xffff)
+		tcp_recved(pcb, 0xffff);
+	tcp_recved(pcb, len);
+}
+
+/*
+ * Drop the first len bytes of received data, which have been copied to the
+ * user already
+ */
+static void tcp_recv_consume(struct socket * sock, unsigned len)
+{
+	struct pbuf * p;
+
+	sock->recv_data_size -= len;
+
+	while (len) {
+		assert(sock->recv_head);
+		p = (struct pbuf *)sock->recv_head->data;
+
+		if (len < p->len) {
+			/*
+			 * The whole pbuf hasn't been copied out, we only shift
+			 * the payload pointer to remember where to continue
+			 * next time
+			 */
+			if (pbuf_header(p, -(s16_t)len))
+				panic("LWIP : cannot shift pbuf payload");
+			debug_tcp_print("partial pbuf copied (%d bytes)", len);
+			break;
+		}
+
+		debug_tcp_print("whole pbuf copied (%d bytes)", p->len);
+		len -= p->len;
+
+		if (p->next) {
+			struct pbuf * np = p->next;
+
+			pbuf_ref(np);
+			if (pbuf_free(p) != 1)
+				panic("LWIP : pbuf_free != 1");
+			sock->recv_head->data = np;
+		} else {
+			sock_dequeue_data(sock);
+			pbuf_free(p);
+		}
+	}
+}
+
+/*
+ * Copy received data to the user. The pbufs of all queued chains are copied
+ * with as few kernel calls as possible, up to SCPVEC_NR of them at once.
+ */
 static int read_from_tcp(struct socket * sock, message * m)
 {
-	unsigned rem_buf, written = 0;
+	static struct vscp_vec vec[SCPVEC_NR];
+	unsigned rem_buf, written = 0, batch, len;
+	struct recv_q * rq;
 	struct pbuf * p;
+	int i, err;
 
 	assert(!(sock->flags & SOCK_FLG_OP_LISTENING) && sock->recv_head);
 
@@ -204,87 +279,58 @@ static int read_from_tcp(struct socket * sock, message * m)
 
 	debug_tcp_print("socket num %ld recv buff sz %d", get_sock_num(sock), rem_buf);
 
-	p = (struct pbuf *)sock->recv_head->data;
-	while (rem_buf) {
-		int err;
-
-		if (rem_buf >= p->len) {
-			struct pbuf * np;
-
-			/*
-			 * FIXME perhaps copy this to a local buffer and do a
-			 * single copy to user then
-			 */
-#if 0
-			print_tcp_payload(p->payload, p->len);
-#endif
-			err = copy_to_user(m->m_source, p->payload, p->len,
-					(cp_grant_id_t) m->IO_GRANT, written);
-			if (err != OK)
-				goto cp_error;
-			sock->recv_data_size -= p->len;
-
-			debug_tcp_print("whole pbuf copied (%d bytes)", p->len);
-			rem_buf -= p->len;
-			written += p->len;
-
-			if ((np = p->next)) {
-				pbuf_ref(np);
-				if (pbuf_free(p) != 1)
-					panic("LWIP : pbuf_free != 1");
-				/*
-				 * Mark where we are going to continue if an
-				 * error occurs
-				 */
-				sock->recv_head->data = np;
-				p = np;
-			} else {
-				sock_dequeue_data(sock);
-				pbuf_free(p);
-				if (sock->recv_head)
-					p = (struct pbuf *)sock->recv_head->data;
-				else
-					break;
+	while (rem_buf && sock->recv_head) {
+		rq = sock->recv_head;
+		p = (struct pbuf *)rq->data;
+		batch = 0;
+
+		for (i = 0; i < SCPVEC_NR && rem_buf > 0; ) {
+			len = (rem_buf < p->len ? rem_buf : p->len);
+			if (len > 0) {
+				vec[i].v_from = SELF;
+				vec[i].v_to = m->m_source;
+				vec[i].v_gid = (cp_grant_id_t) m->IO_GRANT;
+				vec[i].v_offset = written + batch;
+				vec[i].v_addr = (vir_bytes) p->payload;
+				vec[i].v_bytes = len;
+				i++;
 			}
-
-			if (rem_buf == 0)
+			batch += len;
+			rem_buf -= len;
+
+			if (p->next)
+				p = p->next;
+			else if ((rq = rq->next))
+				p = (struct pbuf *)rq->data;
+			else
 				break;
-		} else {
-			/*
-			 * It must be PBUF_RAM for us to be able to shift the
-			 * payload pointer
-			 */
-			assert(p->type == PBUF_RAM);
-			
-#if 0
-			print_tcp_payload(p->payload, rem_buf);
-#endif
-			err = copy_to_user(m->m_source, p->payload, rem_buf,
-					(cp_grant_id_t) m->IO_GRANT, written);
-			if (err != OK)
-				goto cp_error;
-			sock->recv_data_size -= rem_buf;
-
-			debug_tcp_print("partial pbuf copied (%d bytes)", rem_buf);
-			/*
-			 * The whole pbuf hasn't been copied out, we only shift
-			 * the payload pointer to remember where to continue
-			 * next time
-			 */
-			pbuf_header(p, -rem_buf);
-			written += rem_buf;
-			break;
 		}
+
+		if (i == 1)
+			err = copy_to_user(m->m_source, (void *) vec[0].v_addr,
+					vec[0].v_bytes, vec[0].v_gid,
+					vec[0].v_offset);
+		else if (i > 1)
+			err = sys_vsafecopy(vec, i);
+		else
+			err = OK;
+		if (err != OK)
+			goto cp_error;
+
+		debug_tcp_print("%d bytes in %d pieces copied", batch, i);
+		tcp_recv_consume(sock, batch);
+		written += batch;
 	}
 
 	debug_tcp_print("%d bytes written to userspace", written);
 	//printf("%d wr, queue %d\n", written, sock->recv_data_size);
-	tcp_recved((struct tcp_pcb *) sock->pcb, written);
+	tcp_recved_len((struct tcp_pcb *) sock->pcb, written);
 	return written;
 
 cp_error:
 	if (written) {
 		debug_tcp_print("%d bytes written to userspace", written);
+		tcp_recved_len((struct tcp_pcb *) sock->pcb, written);
 		return written;
 	} else
 		return EFAULT;
@@ -324,19 +370,12 @@ static void tcp_op_read(struct socket * sock, message * m, int blk)
 	}
 }
 
-static struct wbuf * wbuf_add(struct socket * sock, unsigned sz)
+static void wbuf_append(struct socket * sock, struct wbuf * wbuf)
 {
-	struct wbuf * wbuf;
 	struct wbuf_chain * wc = (struct wbuf_chain *)sock->buf;
 
 	assert(wc);
 
-	wbuf = debug_malloc(sizeof(struct wbuf) + sz);
-	if (!wbuf)
-		return NULL;
-	
-	wbuf->len = sz;
-	wbuf->written = wbuf->unacked = 0;
 	wbuf->next = NULL;
 
 	if (wc->head == NULL)
@@ -346,8 +385,21 @@ static struct wbuf * wbuf_add(struct socket * sock, unsigned sz)
 		wc->tail = wbuf;
 	}
 
-	sock->buf_size += sz;
+	sock->buf_size += wbuf->len;
 	debug_tcp_print("buffer %p size %d\n", wbuf, sock->buf_size);
+}
+
+static struct wbuf * wbuf_add(struct socket * sock, unsigned sz)
+{
+	struct wbuf * wbuf;
+
+	wbuf = debug_malloc(sizeof(struct wbuf) + sz);
+	if (!wbuf)
+		return NULL;
+	
+	wbuf->len = sz;
+	wbuf->written = wbuf->unacked = 0;
+	wbuf_append(sock, wbuf);
 
 	return wbuf;
 }
@@ -387,7 +439,104 @@ static struct wbuf * wbuf_ack_sent(struct socket * sock, unsigned sz)
 	return wc->head;
 }
 
-static void tcp_op_write(struct socket * sock, message * m, __unused int blk)
+/*
+ * Finish the held write, either because lwip has all of it or because of an
+ * error
+ */
+static void tcp_held_done(struct socket * sock, int status)
+{
+	struct wbuf_chain * wc = (struct wbuf_chain *) sock->buf;
+
+	debug_tcp_print("held write done (%d)", status);
+
+	wc->held_len = wc->held_off = 0;
+	sock_reply(sock, status);
+	sock->flags &= ~SOCK_FLG_OP_PENDING;
+	if (wc->head == NULL)
+		sock->flags &= ~SOCK_FLG_OP_WRITING;
+}
+
+/*
+ * Copy as much of the held write from the user as lwip's send buffer takes,
+ * right into buffers that lwip sends from until they are acknowledged. Data
+ * staged by earlier writes goes first. Each buffer is handed to tcp_write()
+ * in one go, so none is larger than TCP_WRITE_MAX.
+ */
+static void tcp_pull_held(struct socket * sock)
+{
+	struct wbuf_chain * wc = (struct wbuf_chain *) sock->buf;
+	struct tcp_pcb * pcb = (struct tcp_pcb *) sock->pcb;
+	struct wbuf * wbuf;
+	unsigned len, rem;
+	err_t err;
+	int ret;
+
+	while ((rem = wc->held_len - wc->held_off) > 0 && wc->unsent == NULL &&
+			(len = tcp_sndbuf(pcb)) > 0) {
+		if (len > rem)
+			len = rem;
+		if (len > TCP_WRITE_MAX)
+			len = TCP_WRITE_MAX;
+
+		if (!(wbuf = debug_malloc(sizeof(struct wbuf) + len))) {
+			/* try again once some data is acknowledged */
+			if (wc->head == NULL)
+				tcp_held_done(sock, wc->held_off ?
+						(int) wc->held_off : ENOMEM);
+			return;
+		}
+
+		if ((ret = copy_from_user(sock->mess.m_source, wbuf->data, len,
+				(cp_grant_id_t) sock->mess.IO_GRANT,
+				wc->held_off)) != OK) {
+			debug_free(wbuf);
+			tcp_held_done(sock, wc->held_off ?
+						(int) wc->held_off : ret);
+			return;
+		}
+
+		err = tcp_write(pcb, wbuf->data, len,
+				len < rem ? TCP_WRITE_FLAG_MORE : 0);
+		if (err != ERR_OK) {
+			debug_free(wbuf);
+			/* out of segments, try again once some are acknowledged */
+			if (err == ERR_MEM && wc->head != NULL)
+				return;
+			tcp_held_done(sock, wc->held_off ?
+						(int) wc->held_off : EIO);
+			return;
+		}
+		debug_tcp_print("%d bytes of held write to tcp", len);
+
+		wbuf->len = wbuf->unacked = len;
+		wbuf->written = wbuf->rem_len = 0;
+		wbuf_append(sock, wbuf);
+		wc->held_off += len;
+	}
+
+	if (wc->held_len && wc->held_off == wc->held_len)
+		tcp_held_done(sock, wc->held_len);
+}
+
+/*
+ * Hold a blocking write until lwip has all of its data, instead of staging it
+ * in TCP_BUF_SIZE buffers first
+ */
+static void tcp_hold_write(struct socket * sock, unsigned len)
+{
+	struct wbuf_chain * wc = (struct wbuf_chain *) sock->buf;
+
+	debug_tcp_print("holding write of %d bytes", len);
+
+	wc->held_len = len;
+	wc->held_off = 0;
+	sock->flags |= SOCK_FLG_OP_PENDING | SOCK_FLG_OP_WRITING;
+
+	tcp_pull_held(sock);
+	tcp_output((struct tcp_pcb *)sock->pcb);
+}
+
+static void tcp_op_write(struct socket * sock, message * m, int blk)
 {
 	int ret;
 	struct wbuf * wbuf;
@@ -404,6 +553,17 @@ static void tcp_op_write(struct socket * sock, message * m, __unused int blk)
 	debug_tcp_print("socket num %ld data size %d",
 			get_sock_num(sock), usr_buf_len);
 
+	/*
+	 * Large writes and writes that would not fit in the buffers anymore
+	 * are held if the caller can block. Small writes are copied and
+	 * replied to right away.
+	 */
+	if (blk && usr_buf_len > 0 && (usr_buf_len >= TCP_HOLD_MIN ||
+				sock->buf_size >= TCP_BUF_SIZE)) {
+		tcp_hold_write(sock, usr_buf_len);
+		return;
+	}
+
 	/*
 	 * Let at most one buffer grow beyond TCP_BUF_SIZE. This is to minimize
 	 * small writes from userspace if only a few bytes were sent before
@@ -695,6 +855,11 @@ static err_t tcp_sent_callback(void *arg, struct tcp_pcb *tpcb, u16_t len)
 
 	wbuf = wbuf_ack_sent(sock, len);
 
+	if (wbuf == NULL && wc->held_len) {
+		tcp_pull_held(sock);
+		return ERR_OK;
+	}
+
 	if (wbuf == NULL) {
 		debug_tcp_print("all data acked, nothing more to send");
 		sock->flags &= ~SOCK_FLG_OP_WRITING;
@@ -707,7 +872,8 @@ static err_t tcp_sent_callback(void *arg, struct tcp_pcb *tpcb, u16_t len)
 	}
 
 	/* we have just freed some space, write will be accepted */
-	if (sock->buf_size < TCP_BUF_SIZE && sock_select_rw_set(sock)) {
+	if (!wc->held_len && sock->buf_size < TCP_BUF_SIZE &&
+					sock_select_rw_set(sock)) {
 		if (!(sock->flags & SOCK_FLG_OP_READING)) {
 			sock->flags &= ~SOCK_FLG_OP_PENDING;
 			sock_select_notify(sock);
@@ -725,6 +891,8 @@ static err_t tcp_sent_callback(void *arg, struct tcp_pcb *tpcb, u16_t len)
 
 	if (!wc->unsent) {
 		debug_tcp_print("nothing to send");
+		if (wc->held_len)
+			tcp_pull_held(sock);
 		return ERR_OK;
 	}
 
@@ -749,6 +917,9 @@ static err_t tcp_sent_callback(void *arg, struct tcp_pcb *tpcb, u16_t len)
 		if (ret != ERR_OK) {
 			debug_print("tcp_write() failed (%d), written %d"
 					, ret, wbuf->written);
+			if (wc->held_len)
+				tcp_held_done(sock, wc->held_off ?
+						(int) wc->held_off : EIO);
 			sock->flags &= ~(SOCK_FLG_OP_PENDING | SOCK_FLG_OP_WRITING);
 			/* no reviving, we must notify. Write and read possible */
 			if (sock_select_rw_set(sock))
@@ -774,6 +945,9 @@ static err_t tcp_sent_callback(void *arg, struct tcp_pcb *tpcb, u16_t len)
 			break;
 	}
 
+	if (wc->held_len)
+		tcp_pull_held(sock);
+
 	return ERR_OK;
 }
 
@@ -1014,8 +1188,10 @@ static void tcp_get_opt(struct socket * sock, message * m)
 	err = copy_to_user(m->m_source, &tcpopt, sizeof(tcpopt),
 				(cp_grant_id_t) m->IO_GRANT, 0);
 
-	if (err != OK)
+	if (err != OK) {
 		sock_reply(sock, err);
+		return;
+	}
 
 	sock_reply(sock, OK);
 }
@@ -1033,14 +1209,81 @@ static void tcp_set_opt(struct socket * sock, message * m)
 	err = copy_from_user(m->m_source, &tcpopt, sizeof(tcpopt),
 				(cp_grant_id_t) m->IO_GRANT, 0);
 
-	if (err != OK)
+	if (err != OK) {
 		sock_reply(sock, err);
+		return;
+	}
 
 	/* FIXME : The userspace library does not use this */
 
 	sock_reply(sock, OK);
 }
 
+static void tcp_get_buf(struct socket * sock, message * m)
+{
+	int err;
+	nwio_tcpbuf_t tcpbuf;
+	struct tcp_pcb * pcb = (struct tcp_pcb *) sock->pcb;
+
+	debug_tcp_print("socket num %ld", get_sock_num(sock));
+
+	assert(pcb);
+
+	if ((unsigned) m->COUNT < sizeof(tcpbuf)) {
+		sock_reply(sock, EINVAL);
+		return;
+	}
+
+	if (sock->flags & SOCK_FLG_OP_LISTENING) {
+		struct tcp_pcb_listen * lpcb = (struct tcp_pcb_listen *) pcb;
+		tcpbuf.nwtb_rcvbuf = lpcb->rcv_wnd_max;
+		tcpbuf.nwtb_sndbuf = lpcb->snd_buf_max;
+	} else {
+		tcpbuf.nwtb_rcvbuf = tcp_rcvbuf_size(pcb);
+		tcpbuf.nwtb_sndbuf = tcp_sndbuf_size(pcb);
+	}
+
+	err = copy_to_user(m->m_source, &tcpbuf, sizeof(tcpbuf),
+				(cp_grant_id_t) m->IO_GRANT, 0);
+
+	if (err != OK) {
+		sock_reply(sock, err);
+		return;
+	}
+
+	sock_reply(sock, OK);
+}
+
+static void tcp_set_buf(struct socket * sock, message * m)
+{
+	int err;
+	nwio_tcpbuf_t tcpbuf;
+	struct tcp_pcb * pcb = (struct tcp_pcb *) sock->pcb;
+
+	debug_tcp_print("socket num %ld", get_sock_num(sock));
+
+	assert(pcb);
+
+	err = copy_from_user(m->m_source, &tcpbuf, sizeof(tcpbuf),
+				(cp_grant_id_t) m->IO_GRANT, 0);
+
+	if (err != OK) {
+		sock_reply(sock, err);
+		return;
+	}
+
+	/*
+	 * lwip clamps the sizes to what the connection can use. A listening
+	 * socket passes them on to the connections it accepts.
+	 */
+	if (tcpbuf.nwtb_rcvbuf)
+		tcp_set_rcvbuf(pcb, tcpbuf.nwtb_rcvbuf);
+	if (tcpbuf.nwtb_sndbuf)
+		tcp_set_sndbuf(pcb, tcpbuf.nwtb_sndbuf);
+
+	sock_reply(sock, OK);
+}
+
 static void tcp_op_ioctl(struct socket * sock, message * m, __unused int blk)
 {
 	if (!sock->pcb) {
@@ -1082,6 +1325,12 @@ static void tcp_op_ioctl(struct socket * sock, message * m, __unused int blk)
 	case NWIOSTCPOPT:
 		tcp_set_opt(sock, m);
 		break;
+	case NWIOGTCPBUF:
+		tcp_get_buf(sock, m);
+		break;
+	case NWIOSTCPBUF:
+		tcp_set_buf(sock, m);
+		break;
 	default:
 		sock_reply(sock, EBADIOCTL);
 		return;
@@ -1194,6 +1443,26 @@ static void tcp_op_select_reply(struct socket * sock, message * m)
 							SOCK_FLG_SEL_ERROR);
 }
 
+static void tcp_op_cancel(struct socket * sock, message * m)
+{
+	struct wbuf_chain * wc = (struct wbuf_chain *) sock->buf;
+
+	debug_tcp_print("socket num %ld", get_sock_num(sock));
+
+	/*
+	 * Only a held write can be canceled. Whatever is in lwip already stays
+	 * there and is reported as written.
+	 */
+	if (wc == NULL || !wc->held_len)
+		panic("LWIP : no operation to cancel");
+
+	send_reply(m, wc->held_off ? (int) wc->held_off : EINTR);
+	wc->held_len = wc->held_off = 0;
+	sock->flags &= ~SOCK_FLG_OP_PENDING;
+	if (wc->head == NULL)
+		sock->flags &= ~SOCK_FLG_OP_WRITING;
+}
+
 struct sock_ops sock_tcp_ops = {
 	.open		= tcp_op_open,
 	.close		= tcp_op_close,
@@ -1201,6 +1470,7 @@ struct sock_ops sock_tcp_ops = {
 	.write		= tcp_op_write,
 	.ioctl		= tcp_op_ioctl,
 	.select		= tcp_op_select,
-	.select_reply	= tcp_op_select_reply
+	.select_reply	= tcp_op_select_reply,
+	.cancel		= tcp_op_cancel
 };
 
@@ -6,17 +6,28 @@
 /* Buffer (block) cache.  To acquire a block, a routine calls get_block(),
  * telling which block it wants.  The block is then regarded as "in use"
  * and has its 'b_count' field incremented.  All the blocks that are not
- * in use are chained together in an LRU list, with 'front' pointing
- * to the least recently used block, and 'rear' to the most recently used
- * block.  A reverse chain, using the field b_prev is also maintained.
- * Usage for LRU is measured by the time the put_block() is done.  The second
+ * in use are chained together on one of two queues, following the 2Q
+ * replacement policy.  Blocks that have been referenced only once since they
+ * entered the cache live on the A1in queue; blocks that have been referenced
+ * again after being evicted from A1in live on the Am queue.  Each queue has
+ * 'q_front' pointing to the least recently used block and 'q_rear' to the
+ * most recently used block, and a reverse chain using the field b_prev.
+ * Usage is measured by the time the put_block() is done.  The second
  * parameter to put_block() can violate the LRU order and put a block on the
- * front of the list, if it will probably not be needed soon.  If a block
- * is modified, the modifying routine must set b_dirt to DIRTY, so the block
- * will eventually be rewritten to the disk.
+ * front of its queue, if it will probably not be needed soon.
+ *
+ * The identities of blocks evicted from A1in are remembered on the ghost
+ * queue A1out.  A miss on a block found there means the block is being
+ * reused over a longer period, so it is brought in on Am.  Blocks touched
+ * once by a large sequential scan therefore only ever cycle through A1in
+ * and cannot push the hot inode, directory and indirect blocks out of Am.
+ *
+ * If a block is modified, the modifying routine must set b_dirt to DIRTY, so
+ * the block will eventually be rewritten to the disk.
  */
 
 #include <dirent.h>
+#include <minix/bdev.h>
 
 union fsdata_u {
     char b__data[_MAX_BLOCK_SIZE];		     /* ordinary user data */
@@ -46,12 +57,55 @@ union fsdata_u {
 #define b_v2_ino bp->b__v2_ino
 #define b_bitmap bp->b__bitmap
 
-#define BUFHASH(b) ((b) % nr_bufs)
+/* The hash tables have a power of two number of slots, at least nr_bufs.
+ * Only the block number is hashed, as b_dev is cleared on invalidation while
+ * the block stays on its hash chain.
+ */
+#define BUFHASH(b) ((b) & buf_hash_mask)
+
+#define BQ_A1IN		0	/* blocks referenced once (FIFO) */
+#define BQ_AM		1	/* blocks referenced repeatedly (LRU) */
+#define NR_BQUEUES	2
 
-EXTERN struct buf *front;	/* points to least recently used free block */
-EXTERN struct buf *rear;	/* points to most recently used free block */
+struct bqueue {
+  struct buf *q_front;		/* least recently used free block */
+  struct buf *q_rear;		/* most recently used free block */
+  unsigned int q_size;		/* # bufs belonging to queue, free or in use */
+};
+
+EXTERN struct bqueue bqueue[NR_BQUEUES];
 EXTERN unsigned int bufs_in_use;/* # bufs currently in use (not on free list)*/
 
+/* Ghost entry on A1out: a block recently evicted from A1in. */
+struct ghost {
+  struct ghost *g_hash;		/* next ghost on hash chain */
+  block_t g_blocknr;		/* block number, NO_BLOCK if unused */
+  dev_t g_dev;			/* device of the block */
+};
+
+/* Cache statistics, dumped on SIGUSR1. */
+EXTERN struct cache_stats {
+  unsigned long cs_hits[NR_BQUEUES];	/* lookups found on A1in, Am */
+  unsigned long cs_misses;		/* lookups that had to evict */
+  unsigned long cs_ghost_hits;		/* misses found on A1out */
+  unsigned long cs_evictions[NR_BQUEUES];/* blocks evicted from A1in, Am */
+} cache_stats;
+
+/* An asynchronous transfer of a run of blocks.  Blocks being read are held
+ * by the request until it completes, like any other block in use.  Blocks
+ * being written are not, so that they keep their place on the LRU chains;
+ * instead, a block is not evicted while b_io is set.  Blocks that were only
+ * added to bridge a hole in a write (see rw_scattered()) are marked in
+ * io_fill.
+ */
+struct ioreq {
+  bdev_id_t io_id;		/* libbdev request ID, if in use */
+  int io_rw;			/* READING or WRITING */
+  int io_count;			/* number of blocks, 0 if free */
+  struct buf *io_buf[NR_IOREQS];/* the blocks, in order */
+  char io_fill[NR_IOREQS];	/* TRUE for hole fillers */
+};
+
 /* When a block is released, the type of usage is passed to put_block(). */
 #define ONE_SHOT      0200 /* set if block not likely to be needed soon */
 
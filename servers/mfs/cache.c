@@ -9,15 +9,29 @@
  *   alloc_zone:  allocate a new zone (to increase the length of a file)
  *   free_zone:	  release a zone (when a file is removed)
  *   invalidate:  remove all the cache blocks on some device
+ *   cache_dump_stats: print the buffer cache statistics
+ *   wb_start:    start periodic write-back of dirty blocks
+ *   wb_timeout:  write back blocks that have been dirty for a while
+ *   wb_throttle: write back blocks if too many of them are dirty
+ *   flush_io:    wait for all asynchronous block I/O to complete
  *
  * Private functions:
  *   read_block:    read or write a block from the disk itself
+ *   lru_victim:    select the block to evict according to the 2Q policy
+ *   ghost_add:     remember a block evicted from A1in
+ *   ghost_remove:  look up and forget a block on A1out
+ *   writeback:     write back dirty blocks of a minimum age
+ *   io_start:      start an asynchronous transfer
+ *   io_done:       finish an asynchronous transfer
+ *   io_wait:       wait for the asynchronous transfer of a block
+ *   io_wait_req:   wait for an asynchronous transfer to complete
  */
 
 #include "fs.h"
 #include <minix/u64.h>
 #include <minix/bdev.h>
 #include <sys/param.h>
+#include <stddef.h>
 #include <stdlib.h>
 #include <assert.h>
 #include <minix/libminixfs.h>
@@ -28,11 +42,36 @@
 
 static void rm_lru(struct buf *bp);
 static void read_block(struct buf *);
+static struct buf *lru_victim(void);
+static void ghost_add(dev_t dev, block_t block);
+static int ghost_remove(dev_t dev, block_t block);
+static struct buf **dirty_list(void);
+static void writeback(unsigned int min_age, unsigned int max_blocks);
+static void *find_clean_block(dev_t dev, block_t block);
+static int io_start(dev_t dev, u64_t pos, iovec_t *iovec, struct buf **iobuf,
+	struct buf **bufq, int count, int rw_flag);
+static void io_done(dev_t dev, bdev_id_t id, bdev_param_t param, int r);
+static void io_wait(struct buf *bp);
+static void io_wait_req(struct ioreq *io);
 
 static int vmcache = 0; /* are we using vm's secondary cache? (initially not) */
 
 static block_t super_start = 0, super_end = 0; 
 
+/* The A1out ghost queue is a ring of nr_ghosts entries with its own hash. */
+static struct ghost *ghost = NULL, **ghost_hash = NULL;
+static unsigned int nr_ghosts = 0, ghost_next = 0;
+
+/* 2Q tuning: A1in is kept at a quarter of the cache, A1out remembers half of
+ * the cache size worth of evicted blocks.
+ */
+#define A1IN_SIZE(n)	((n) / 4)
+#define A1OUT_SIZE(n)	((n) / 2)
+
+/* Asynchronous transfers in flight. */
+static struct ioreq ioreq[NR_ASYNC_IO];
+static unsigned int nr_ioreqs = 0;
+
 /*===========================================================================*
  *				get_block				     *
  *===========================================================================*/
@@ -45,19 +84,19 @@ struct buf *get_block(
 /* Check to see if the requested block is in the block cache.  If so, return
  * a pointer to it.  If not, evict some other block and fetch it (unless
  * 'only_search' is 1).  All the blocks in the cache that are not in use
- * are linked together in a chain, with 'front' pointing to the least recently
- * used block and 'rear' to the most recently used block.  If 'only_search' is
+ * are linked together on the A1in and Am chains, see buf.h; the block to
+ * evict is taken from the front of one of them.  If 'only_search' is
  * 1, the block being requested will be overwritten in its entirety, so it is
  * only necessary to see if it is in the cache; if it is not, any free buffer
  * will do.  It is not necessary to actually read the block in from disk.
  * If 'only_search' is PREFETCH, the block need not be read from the disk,
  * and the device is not to be marked on the block, so callers can tell if
  * the block returned is valid.
- * In addition to the LRU chain, there is also a hash chain to link together
+ * In addition to the LRU chains, there is also a hash chain to link together
  * blocks whose block numbers end with the same bit strings, for fast lookup.
  */
 
-  int b;
+  int b, q;
   static struct buf *bp, *prev_ptr;
   u64_t yieldid = VM_BLOCKID_NONE, getid = make64(dev, block);
 
@@ -80,10 +119,25 @@ struct buf *get_block(
 			/* Block needed has been found. */
 			if (bp->b_count == 0) rm_lru(bp);
 			bp->b_count++;	/* record that block is in use */
+
+			/* A block still being read ahead has no contents
+			 * yet.  Unless prefetching, wait for it; if the read
+			 * failed, do it over.
+			 */
+			if (bp->b_io != NULL && bp->b_io->io_rw == READING &&
+			    only_search != PREFETCH) {
+				io_wait(bp);
+				if (bp->b_dev == NO_DEV) {
+					BP_SETDEV(bp, dev);
+					if (only_search == NORMAL)
+						read_block(bp);
+				}
+			}
 			ASSERT(bp->b_bytes == fs_block_size);
 			ASSERT(bp->b_dev == dev);
 			ASSERT(bp->b_dev != NO_DEV);
 			ASSERT(bp->bp);
+			cache_stats.cs_hits[(int) bp->b_queue]++;
 			return(bp);
 		} else {
 			/* This block is not the one sought. */
@@ -92,17 +146,21 @@ struct buf *get_block(
 	}
   }
 
-  /* Desired block is not on available chain.  Take oldest block ('front'). */
-  if ((bp = front) == NULL) panic("all buffers in use: %d", nr_bufs);
+  /* Desired block is not on available chain.  Take the block 2Q selects. */
+  if ((bp = lru_victim()) == NULL) panic("all buffers in use: %d", nr_bufs);
+  if (dev != NO_DEV) cache_stats.cs_misses++;
 
   if(bp->b_bytes < fs_block_size) {
 	ASSERT(!bp->bp);
 	ASSERT(bp->b_bytes == 0);
 	if(!(bp->bp = alloc_contig( (size_t) fs_block_size, 0, NULL))) {
 		printf("MFS: couldn't allocate a new block.\n");
-		for(bp = front;
-			bp && bp->b_bytes < fs_block_size; bp = bp->b_next)
-			;
+		for (q = 0, bp = NULL; q < NR_BQUEUES && bp == NULL; q++) {
+			for(bp = bqueue[q].q_front;
+				bp && bp->b_bytes < fs_block_size;
+				bp = bp->b_next)
+				;
+		}
 		if(!bp) {
 			panic("no buffer available");
 		}
@@ -116,6 +174,10 @@ struct buf *get_block(
   ASSERT(bp->b_bytes == fs_block_size);
   ASSERT(bp->b_count == 0);
 
+  /* Don't reuse a buffer that is still being written back. */
+  if (bp->b_io != NULL) io_wait(bp);
+  ASSERT(bp->b_count == 0);
+
   rm_lru(bp);
 
   /* Remove the block that was just taken from its hash chain. */
@@ -145,9 +207,25 @@ struct buf *get_block(
 	 */
 	yieldid = make64(bp->b_dev, bp->b_blocknr);
 	assert(bp->b_bytes == fs_block_size);
+
+	/* Remember blocks that got only one reference in their time. */
+	cache_stats.cs_evictions[(int) bp->b_queue]++;
+	if (bp->b_queue == BQ_A1IN) ghost_add(bp->b_dev, bp->b_blocknr);
 	BP_CLEARDEV(bp);
   }
 
+  /* Decide on which queue the block goes.  Blocks seen again shortly after
+   * their eviction from A1in are frequently used, and go on Am.
+   */
+  bqueue[(int) bp->b_queue].q_size--;
+  if (dev != NO_DEV && ghost_remove(dev, block)) {
+	cache_stats.cs_ghost_hits++;
+	bp->b_queue = BQ_AM;
+  } else {
+	bp->b_queue = BQ_A1IN;
+  }
+  bqueue[(int) bp->b_queue].q_size++;
+
   /* Fill in block's parameters and add it to the hash chain where it goes. */
   if(dev == NO_DEV) BP_CLEARDEV(bp);
   else BP_SETDEV(bp, dev);
@@ -218,6 +296,8 @@ int block_type;			/* INODE_BLOCK, DIRECTORY_BLOCK, or whatever */
  * the integrity of the file system (e.g., inode blocks) are written to
  * disk immediately if they are dirty.
  */
+  struct bqueue *q;
+
   if (bp == NULL) return;	/* it is easier to check here than in caller */
 
   bp->b_count--;		/* there is one use fewer now */
@@ -225,37 +305,139 @@ int block_type;			/* INODE_BLOCK, DIRECTORY_BLOCK, or whatever */
 
   bufs_in_use--;		/* one fewer block buffers in use */
 
-  /* Put this block back on the LRU chain.  If the ONE_SHOT bit is set in
-   * 'block_type', the block is not likely to be needed again shortly, so put
-   * it on the front of the LRU chain where it will be the first one to be
-   * taken when a free buffer is needed later.
+  /* Put this block back on the LRU chain of its queue.  If the ONE_SHOT bit
+   * is set in 'block_type', the block is not likely to be needed again
+   * shortly, so put it on the front of the chain where it will be the first
+   * one to be taken when a free buffer is needed later.  The same goes for
+   * blocks that no longer hold anything.
    */
-  if (bp->b_dev == DEV_RAM || (block_type & ONE_SHOT)) {
+  q = &bqueue[(int) bp->b_queue];
+  if (bp->b_dev == DEV_RAM || bp->b_dev == NO_DEV || (block_type & ONE_SHOT)) {
 	/* Block probably won't be needed quickly. Put it on front of chain.
   	 * It will be the next block to be evicted from the cache.
   	 */
 	bp->b_prev = NULL;
-	bp->b_next = front;
-	if (front == NULL)
-		rear = bp;	/* LRU chain was empty */
+	bp->b_next = q->q_front;
+	if (q->q_front == NULL)
+		q->q_rear = bp;	/* LRU chain was empty */
 	else
-		front->b_prev = bp;
-	front = bp;
+		q->q_front->b_prev = bp;
+	q->q_front = bp;
   } 
   else {
 	/* Block probably will be needed quickly.  Put it on rear of chain.
   	 * It will not be evicted from the cache for a long time.
   	 */
-	bp->b_prev = rear;
+	bp->b_prev = q->q_rear;
 	bp->b_next = NULL;
-	if (rear == NULL)
-		front = bp;
+	if (q->q_rear == NULL)
+		q->q_front = bp;
 	else
-		rear->b_next = bp;
-	rear = bp;
+		q->q_rear->b_next = bp;
+	q->q_rear = bp;
   }
 }
 
+/*===========================================================================*
+ *				lru_victim				     *
+ *===========================================================================*/
+static struct buf *lru_victim(void)
+{
+/* Select the free block to be reused for another block.  As long as A1in
+ * holds more than its share of the cache, its oldest block goes; otherwise
+ * the least recently used block of Am does.  Either queue is used if the
+ * other one has no free blocks.
+ */
+  struct buf *a1in, *am;
+
+  a1in = bqueue[BQ_A1IN].q_front;
+  am = bqueue[BQ_AM].q_front;
+
+  if (a1in == NULL) return(am);
+  if (am == NULL) return(a1in);
+
+  /* Reuse blocks that do not hold anything first. */
+  if (a1in->b_dev == NO_DEV) return(a1in);
+  if (am->b_dev == NO_DEV) return(am);
+
+  if (bqueue[BQ_A1IN].q_size > A1IN_SIZE(nr_bufs)) return(a1in);
+  return(am);
+}
+
+/*===========================================================================*
+ *				ghost_add				     *
+ *===========================================================================*/
+static void ghost_add(dev_t dev, block_t block)
+{
+/* Remember that a block was evicted from A1in.  The oldest ghost is
+ * overwritten, so A1out behaves as a FIFO.
+ */
+  struct ghost *gp, **gpp;
+
+  if (nr_ghosts == 0) return;
+
+  gp = &ghost[ghost_next];
+  ghost_next = (ghost_next + 1) % nr_ghosts;
+
+  /* Unhash the entry being recycled. */
+  if (gp->g_blocknr != NO_BLOCK) {
+	for (gpp = &ghost_hash[BUFHASH(gp->g_blocknr)]; *gpp != NULL;
+	     gpp = &(*gpp)->g_hash) {
+		if (*gpp == gp) {
+			*gpp = gp->g_hash;
+			break;
+		}
+	}
+  }
+
+  gp->g_dev = dev;
+  gp->g_blocknr = block;
+  gp->g_hash = ghost_hash[BUFHASH(block)];
+  ghost_hash[BUFHASH(block)] = gp;
+}
+
+/*===========================================================================*
+ *				ghost_remove				     *
+ *===========================================================================*/
+static int ghost_remove(dev_t dev, block_t block)
+{
+/* Check whether a block is on A1out.  If so, forget about it and return
+ * TRUE, otherwise return FALSE.
+ */
+  struct ghost *gp, **gpp;
+
+  if (nr_ghosts == 0) return(FALSE);
+
+  for (gpp = &ghost_hash[BUFHASH(block)]; (gp = *gpp) != NULL;
+       gpp = &gp->g_hash) {
+	if (gp->g_blocknr == block && gp->g_dev == dev) {
+		*gpp = gp->g_hash;
+		gp->g_hash = NULL;
+		gp->g_blocknr = NO_BLOCK;
+		gp->g_dev = NO_DEV;
+		return(TRUE);
+	}
+  }
+
+  return(FALSE);
+}
+
+/*===========================================================================*
+ *				cache_dump_stats			     *
+ *===========================================================================*/
+void cache_dump_stats(void)
+{
+/* Print the buffer cache statistics. */
+
+  printf("MFS(%d) cache: %u bufs, A1in %u Am %u, A1out %u\n", SELF_E,
+	nr_bufs, bqueue[BQ_A1IN].q_size, bqueue[BQ_AM].q_size, nr_ghosts);
+  printf("MFS(%d) cache: hits A1in %lu Am %lu, misses %lu (A1out %lu), "
+	"evictions A1in %lu Am %lu\n", SELF_E,
+	cache_stats.cs_hits[BQ_A1IN], cache_stats.cs_hits[BQ_AM],
+	cache_stats.cs_misses, cache_stats.cs_ghost_hits,
+	cache_stats.cs_evictions[BQ_A1IN], cache_stats.cs_evictions[BQ_AM]);
+}
+
 /*===========================================================================*
  *				alloc_zone				     *
  *===========================================================================*/
@@ -370,6 +552,8 @@ void invalidate(
 
   register struct buf *bp;
 
+  flush_io();
+
   for (bp = &buf[0]; bp < &buf[nr_bufs]; bp++)
 	if (bp->b_dev == device) BP_CLEARDEV(bp);
 
@@ -407,9 +591,39 @@ void flushall(
 /* Flush all dirty blocks for one device. */
 
   register struct buf *bp;
+  struct buf **dirty;
+  int ndirty;
+
+  /* Let write-back in progress finish first, so that it can't overtake the
+   * synchronous writes below.
+   */
+  flush_io();
+
+  dirty = dirty_list();
+
+  for (bp = &buf[0], ndirty = 0; bp < &buf[nr_bufs]; bp++) {
+       if (ISDIRTY(bp) && bp->b_dev == dev) {
+               if(!block_write_ok(bp)) {
+                       printf("MFS: LATE: ignoring changes in block %d\n", bp->b_blocknr);
+                       MARKCLEAN(bp);
+                       continue;
+               }
+               dirty[ndirty++] = bp;
+       }
+  }
+  rw_scattered(dev, dirty, ndirty, WRITING, FALSE);
+}
+
+/*===========================================================================*
+ *				dirty_list				     *
+ *===========================================================================*/
+static struct buf **dirty_list(void)
+{
+/* Return an array large enough to hold all the buffers, for collecting the
+ * dirty ones to be written back.
+ */
   static struct buf **dirty;	/* static so it isn't on stack */
   static unsigned int dirtylistsize = 0;
-  int ndirty;
 
   if(dirtylistsize != nr_bufs) {
 	if(dirtylistsize > 0) {
@@ -421,17 +635,134 @@ void flushall(
 	dirtylistsize = nr_bufs;
   }
 
-  for (bp = &buf[0], ndirty = 0; bp < &buf[nr_bufs]; bp++) {
-       if (ISDIRTY(bp) && bp->b_dev == dev) {
-               if(!block_write_ok(bp)) {
-                       printf("MFS: LATE: ignoring changes in block %d\n", bp->b_blocknr);
-                       MARKCLEAN(bp);
-                       continue;
-               }
-               dirty[ndirty++] = bp;
-       }
+  return(dirty);
+}
+
+/*===========================================================================*
+ *				writeback				     *
+ *===========================================================================*/
+static void writeback(
+  unsigned int min_age,		/* write-back periods the block is dirty */
+  unsigned int max_blocks	/* maximum number of blocks to write */
+)
+{
+/* Write back dirty blocks that have been dirty for at least 'min_age'
+ * write-back periods, but no more than 'max_blocks' of them.  The blocks are
+ * gathered one device at a time and written in one go by rw_scattered(), so
+ * that they end up sorted and coalesced.  The writes are asynchronous, so
+ * the disk gets them all at once and the caller doesn't wait for them.
+ * Blocks still being written from an earlier round are skipped.
+ */
+  struct buf *bp, **dirty;
+  unsigned int ndirty, total, before;
+  dev_t dev;
+
+  dirty = dirty_list();
+  total = 0;
+
+  while (total < max_blocks && nr_dirty > 0) {
+	dev = NO_DEV;
+	ndirty = 0;
+	for (bp = &buf[0]; bp < &buf[nr_bufs]; bp++) {
+		if (total + ndirty >= max_blocks) break;
+		if (!ISDIRTY(bp) || bp->b_dev == NO_DEV) continue;
+		if (bp->b_io != NULL) continue;
+		if (wb_epoch - bp->b_dirty_epoch < min_age) continue;
+		if (dev == NO_DEV) dev = bp->b_dev;
+		else if (bp->b_dev != dev) continue;
+		if (!block_write_ok(bp)) {
+			printf("MFS: LATE: ignoring changes in block %d\n",
+				bp->b_blocknr);
+			MARKCLEAN(bp);
+			continue;
+		}
+		dirty[ndirty++] = bp;
+	}
+	if (ndirty == 0) break;
+
+	before = nr_dirty;
+	rw_scattered(dev, dirty, ndirty, WRITING, TRUE);
+	total += ndirty;
+
+	/* Stop if the device refuses to take our blocks. */
+	if (nr_dirty >= before) break;
   }
-  rw_scattered(dev, dirty, ndirty, WRITING);
+}
+
+/*===========================================================================*
+ *				wb_start				     *
+ *===========================================================================*/
+void wb_start(void)
+{
+/* Arrange for wb_timeout() to be called after the next write-back period.
+ * The alarm shows up as a notification from CLOCK in get_work().
+ */
+  int r;
+
+  if ((r = sys_setalarm(WB_INTERVAL * sys_hz(), 0)) != OK)
+	printf("MFS: unable to set write-back alarm: %d\n", r);
+}
+
+/*===========================================================================*
+ *				wb_timeout				     *
+ *===========================================================================*/
+void wb_timeout(void)
+{
+/* A write-back period has passed.  Copy dirty inodes into their blocks, so
+ * they age like any other block, then write back the blocks that have been
+ * dirty long enough.  This way dirty blocks trickle to the disk in the
+ * background instead of all at once on sync, or by a request that happens
+ * to evict them.
+ */
+  struct inode *rip;
+
+  wb_epoch++;
+
+  for (rip = &inode[0]; rip < &inode[NR_INODES]; rip++)
+	if (rip->i_count > 0 && IN_ISDIRTY(rip)) rw_inode(rip, WRITING);
+
+  writeback(WB_AGE, nr_bufs);
+
+  if (!unmountdone) wb_start();
+}
+
+/*===========================================================================*
+ *				wb_throttle				     *
+ *===========================================================================*/
+void wb_throttle(void)
+{
+/* Called by writers before dirtying more blocks.  If too large a part of
+ * the cache is dirty, write back blocks right away until it is back to a
+ * reasonable amount, so that the cache never fills up with dirty blocks
+ * that readers would have to write back when evicting them.
+ */
+  unsigned int high, low;
+
+  high = nr_bufs * DIRTY_HIGH / 100;
+  if (nr_dirty <= high) return;
+
+  low = nr_bufs * DIRTY_LOW / 100;
+  writeback(0, nr_dirty - low);
+}
+
+/*===========================================================================*
+ *				find_clean_block			     *
+ *===========================================================================*/
+static void *find_clean_block(dev_t dev, block_t block)
+{
+/* Return the cached copy of a block if it is valid, clean and not in use,
+ * without touching its LRU position, or NULL otherwise.  A block with a
+ * transfer in progress doesn't qualify.  A block in use may be in the middle
+ * of being changed, so it must not be written out to fill a hole.
+ */
+  struct buf *bp;
+
+  for (bp = buf_hash[BUFHASH(block)]; bp != NULL; bp = bp->b_hash)
+	if (bp->b_blocknr == block && bp->b_dev == dev)
+		return(ISCLEAN(bp) && bp->b_io == NULL && bp->b_count == 0 ?
+			bp : NULL);
+
+  return(NULL);
 }
 
 /*===========================================================================*
@@ -441,64 +772,65 @@ void rw_scattered(
   dev_t dev,			/* major-minor device number */
   struct buf **bufq,		/* pointer to array of buffers */
   int bufqsize,			/* number of buffers */
-  int rw_flag			/* READING or WRITING */
+  int rw_flag,			/* READING or WRITING */
+  int async			/* TRUE: don't wait for the transfers */
 )
 {
-/* Read or write scattered data from a device. */
+/* Read or write scattered data from a device.  The buffers are sorted on
+ * block number, and runs of consecutive blocks are transferred with one
+ * vectored request each.  When writing, a hole of at most FS_IOSCHED_MAX_GAP
+ * blocks between two runs is filled with clean copies of the missing blocks
+ * from the cache, if they are all there, so that the runs are merged.
+ * If 'async' is set, all requests are sent off before any of them completes,
+ * and the results are processed by io_done() as the replies come in.
+ */
 
   register struct buf *bp;
-  int gap;
   register int i;
-  register iovec_t *iop;
   static iovec_t *iovec = NULL;
+  static struct buf **iobuf = NULL;	/* buffer behind each iovec entry */
+  block_t first;
   u64_t pos;
-  int j, r;
+  int j, q, r;
 
   STATICINIT(iovec, NR_IOREQS);
+  STATICINIT(iobuf, NR_IOREQS);
 
-  /* (Shell) sort buffers on b_blocknr. */
-  gap = 1;
-  do
-	gap = 3 * gap + 1;
-  while (gap <= bufqsize);
-  while (gap != 1) {
-	gap /= 3;
-	for (j = gap; j < bufqsize; j++) {
-		for (i = j - gap;
-		     i >= 0 && bufq[i]->b_blocknr > bufq[i + gap]->b_blocknr;
-		     i -= gap) {
-			bp = bufq[i];
-			bufq[i] = bufq[i + gap];
-			bufq[i + gap] = bp;
-		}
-	}
-  }
+  fs_sort_bufq((void **) bufq, bufqsize, offsetof(struct buf, b_blocknr));
 
   /* Set up I/O vector and do I/O.  The result of bdev I/O is OK if everything
    * went fine, otherwise the error code for the first failed transfer.
    */
   while (bufqsize > 0) {
-	for (j = 0, iop = iovec; j < NR_IOREQS && j < bufqsize; j++, iop++) {
-		bp = bufq[j];
-		if (bp->b_blocknr != (block_t) bufq[0]->b_blocknr + j) break;
-		iop->iov_addr = (vir_bytes) bp->b_data;
-		iop->iov_size = (vir_bytes) fs_block_size;
+	first = bufq[0]->b_blocknr;
+	j = fs_build_run(dev, (void **) bufq, bufqsize, rw_flag,
+		offsetof(struct buf, b_blocknr), find_clean_block,
+		(void **) iobuf, NR_IOREQS, &q);
+	for (i = 0; i < j; i++) {
+		iovec[i].iov_addr = (vir_bytes) iobuf[i]->b_data;
+		iovec[i].iov_size = (vir_bytes) fs_block_size;
+	}
+	pos = mul64u(first, fs_block_size);
+	if (async && io_start(dev, pos, iovec, iobuf, bufq, j, rw_flag) == OK) {
+		bufq += q;
+		bufqsize -= q;
+		continue;
 	}
-	pos = mul64u(bufq[0]->b_blocknr, fs_block_size);
 	if (rw_flag == READING)
 		r = bdev_gather(dev, pos, iovec, j, BDEV_NOFLAGS);
 	else
 		r = bdev_scatter(dev, pos, iovec, j, BDEV_NOFLAGS);
 
 	/* Harvest the results.  The driver may have returned an error, or it
-	 * may have done less than what we asked for.
+	 * may have done less than what we asked for.  Entries that merely
+	 * filled a hole need no further attention.
 	 */
 	if (r < 0) {
 		printf("MFS: I/O error %d on device %d/%d, block %u\n",
-			r, major(dev), minor(dev), bufq[0]->b_blocknr);
+			r, major(dev), minor(dev), first);
 	}
-	for (i = 0; i < j; i++) {
-		bp = bufq[i];
+	for (i = 0, q = 0; i < j; i++) {
+		bp = iobuf[i];
 		if (r < (ssize_t) fs_block_size) {
 			/* Transfer failed. */
 			if (i == 0) {
@@ -507,16 +839,18 @@ void rw_scattered(
 			}
 			break;
 		}
+		r -= fs_block_size;
+		if (bp != bufq[q]) continue;	/* hole filler */
 		if (rw_flag == READING) {
 			BP_SETDEV(bp, dev);	/* validate block */
 			put_block(bp, PARTIAL_DATA_BLOCK);
 		} else {
 			MARKCLEAN(bp);
 		}
-		r -= fs_block_size;
+		q++;
 	}
-	bufq += i;
-	bufqsize -= i;
+	bufq += q;
+	bufqsize -= q;
 	if (rw_flag == READING) {
 		/* Don't bother reading more than the device is willing to
 		 * give at this time.  Don't forget to release those extras.
@@ -526,7 +860,7 @@ void rw_scattered(
 			bufqsize--;
 		}
 	}
-	if (rw_flag == WRITING && i == 0) {
+	if (rw_flag == WRITING && q == 0) {
 		/* We're not making progress, this means we might keep
 		 * looping. Buffers remain dirty if un-written. Buffers are
 		 * lost if invalidate()d or LRU-removed while dirty. This
@@ -537,27 +871,179 @@ void rw_scattered(
   }
 }
 
+/*===========================================================================*
+ *				io_start				     *
+ *===========================================================================*/
+static int io_start(
+  dev_t dev,			/* major-minor device number */
+  u64_t pos,			/* position of the first block */
+  iovec_t *iovec,		/* I/O vector for the run */
+  struct buf **iobuf,		/* buffer behind each iovec entry */
+  struct buf **bufq,		/* the buffers asked for, including these */
+  int count,			/* number of iovec entries */
+  int rw_flag			/* READING or WRITING */
+)
+{
+/* Send off an asynchronous transfer of a run of blocks, prepared by
+ * rw_scattered().  If as many transfers as we allow are already in flight,
+ * wait for one of them to complete first.  Blocks being read become valid
+ * right away, so that lookups find them and wait for the data.  Blocks being
+ * written are clean from now on; if they are changed again before the write
+ * completes, they are simply written again later.
+ */
+  struct ioreq *io;
+  struct buf *bp;
+  bdev_id_t id;
+  int i, q;
+
+  while (nr_ioreqs >= NR_ASYNC_IO) {
+	for (io = &ioreq[0]; io->io_count == 0; io++)
+		;
+	io_wait_req(io);
+  }
+  for (io = &ioreq[0]; io->io_count != 0; io++)
+	;
+
+  if (rw_flag == READING)
+	id = bdev_gather_asyn(dev, pos, iovec, count, BDEV_NOFLAGS, io_done,
+		(bdev_param_t) io);
+  else
+	id = bdev_scatter_asyn(dev, pos, iovec, count, BDEV_NOFLAGS, io_done,
+		(bdev_param_t) io);
+  if (id < 0) return(id);
+
+  io->io_id = id;
+  io->io_rw = rw_flag;
+  io->io_count = count;
+  nr_ioreqs++;
+
+  for (i = 0, q = 0; i < count; i++) {
+	bp = iobuf[i];
+	io->io_buf[i] = bp;
+	io->io_fill[i] = (bp != bufq[q]);
+	if (!io->io_fill[i]) {
+		if (rw_flag == READING) BP_SETDEV(bp, dev);
+		else MARKCLEAN(bp);
+		q++;
+	}
+	bp->b_io = io;
+  }
+
+  return(OK);
+}
+
+/*===========================================================================*
+ *				io_done					     *
+ *===========================================================================*/
+static void io_done(
+  dev_t dev,			/* major-minor device number */
+  bdev_id_t UNUSED(id),		/* libbdev request ID */
+  bdev_param_t param,		/* the request */
+  int r				/* number of bytes transferred, or error */
+)
+{
+/* An asynchronous transfer has completed.  As in rw_scattered(), the
+ * driver may have done less than we asked for.  Blocks that were not read
+ * are invalidated; blocks that were not written become dirty again.  The
+ * blocks read are released, as read-ahead is done for no particular caller.
+ */
+  struct ioreq *io;
+  struct buf *bp;
+  int i, ok;
+
+  io = (struct ioreq *) param;
+  assert(io->io_count > 0);
+
+  if (r < 0) {
+	printf("MFS: I/O error %d on device %d/%d, block %u\n",
+		r, major(dev), minor(dev), io->io_buf[0]->b_blocknr);
+  }
+
+  for (i = 0; i < io->io_count; i++) {
+	bp = io->io_buf[i];
+	assert(bp->b_io == io);
+	bp->b_io = NULL;
+
+	ok = (r >= (int) fs_block_size);
+	if (ok) r -= fs_block_size;
+
+	if (io->io_rw == READING) {
+		if (!ok) BP_CLEARDEV(bp);	/* invalidate block */
+		put_block(bp, PARTIAL_DATA_BLOCK);
+	} else if (!ok && !io->io_fill[i]) {
+		MARKDIRTY(bp);
+	}
+  }
+
+  io->io_count = 0;
+  nr_ioreqs--;
+}
+
+/*===========================================================================*
+ *				io_wait_req				     *
+ *===========================================================================*/
+static void io_wait_req(struct ioreq *io)
+{
+/* Block until an asynchronous transfer completes.  Replies to other
+ * transfers that come in meanwhile are processed as well.
+ */
+  int r;
+
+  assert(io->io_count > 0);
+
+  if ((r = bdev_wait_asyn(io->io_id)) != OK)
+	panic("MFS: waiting for block I/O failed: %d", r);
+  assert(io->io_count == 0);
+}
+
+/*===========================================================================*
+ *				io_wait					     *
+ *===========================================================================*/
+static void io_wait(struct buf *bp)
+{
+/* Wait until the block is no longer being transferred. */
+
+  while (bp->b_io != NULL)
+	io_wait_req(bp->b_io);
+}
+
+/*===========================================================================*
+ *				flush_io				     *
+ *===========================================================================*/
+void flush_io(void)
+{
+/* Wait for all asynchronous transfers to complete. */
+  struct ioreq *io;
+
+  for (io = &ioreq[0]; io < &ioreq[NR_ASYNC_IO]; io++)
+	if (io->io_count > 0) io_wait_req(io);
+
+  assert(nr_ioreqs == 0);
+}
+
 /*===========================================================================*
  *				rm_lru					     *
  *===========================================================================*/
 static void rm_lru(bp)
 struct buf *bp;
 {
-/* Remove a block from its LRU chain. */
+/* Remove a block from the LRU chain of its queue. */
   struct buf *next_ptr, *prev_ptr;
+  struct bqueue *q;
 
   bufs_in_use++;
+  q = &bqueue[(int) bp->b_queue];
   next_ptr = bp->b_next;	/* successor on LRU chain */
   prev_ptr = bp->b_prev;	/* predecessor on LRU chain */
   if (prev_ptr != NULL)
 	prev_ptr->b_next = next_ptr;
   else
-	front = next_ptr;	/* this block was at front of chain */
+	q->q_front = next_ptr;	/* this block was at front of chain */
 
   if (next_ptr != NULL)
 	next_ptr->b_prev = prev_ptr;
   else
-	rear = prev_ptr;	/* this block was at rear of chain */
+	q->q_rear = prev_ptr;	/* this block was at rear of chain */
 }
 
 /*===========================================================================*
@@ -572,6 +1058,8 @@ static void cache_resize(unsigned int blocksize, unsigned int bufs)
   assert(blocksize > 0);
   assert(bufs >= MINBUFS);
 
+  flush_io();
+
   for (bp = &buf[0]; bp < &buf[nr_bufs]; bp++)
 	if(bp->b_count != 0) panic("change blocksize with buffer in use");
 
@@ -630,6 +1118,7 @@ void buf_pool(int new_nr_bufs)
 {
 /* Initialize the buffer pool. */
   register struct buf *bp;
+  unsigned int hash_size;
 
   assert(new_nr_bufs >= MINBUFS);
 
@@ -650,30 +1139,51 @@ void buf_pool(int new_nr_bufs)
   if(!(buf = calloc(sizeof(buf[0]), new_nr_bufs)))
 	panic("couldn't allocate buf list (%d)", new_nr_bufs);
 
+  /* The hash tables grow along with the pool, at a power of two size. */
+  for (hash_size = 1; hash_size < (unsigned int) new_nr_bufs; hash_size <<= 1)
+	;
+
   if(buf_hash)
 	free(buf_hash);
-  if(!(buf_hash = calloc(sizeof(buf_hash[0]), new_nr_bufs)))
-	panic("couldn't allocate buf hash list (%d)", new_nr_bufs);
+  if(!(buf_hash = calloc(sizeof(buf_hash[0]), hash_size)))
+	panic("couldn't allocate buf hash list (%d)", hash_size);
+  buf_hash_mask = hash_size - 1;
 
   nr_bufs = new_nr_bufs;
 
+  if(ghost)
+	free(ghost);
+  if(ghost_hash)
+	free(ghost_hash);
+  nr_ghosts = A1OUT_SIZE(nr_bufs);
+  ghost_next = 0;
+  if(!(ghost = calloc(sizeof(ghost[0]), nr_ghosts)) ||
+     !(ghost_hash = calloc(sizeof(ghost_hash[0]), hash_size)))
+	panic("couldn't allocate ghost list (%d)", nr_ghosts);
+
+  /* All buffers start out free and clean on A1in. */
   bufs_in_use = 0;
-  front = &buf[0];
-  rear = &buf[nr_bufs - 1];
+  nr_dirty = 0;
+  bqueue[BQ_A1IN].q_front = &buf[0];
+  bqueue[BQ_A1IN].q_rear = &buf[nr_bufs - 1];
+  bqueue[BQ_A1IN].q_size = nr_bufs;
+  bqueue[BQ_AM].q_front = bqueue[BQ_AM].q_rear = NULL;
+  bqueue[BQ_AM].q_size = 0;
 
   for (bp = &buf[0]; bp < &buf[nr_bufs]; bp++) {
         bp->b_blocknr = NO_BLOCK;
 	BP_CLEARDEV(bp);
         bp->b_next = bp + 1;
         bp->b_prev = bp - 1;
+        bp->b_queue = BQ_A1IN;
         bp->bp = NULL;
         bp->b_bytes = 0;
   }
-  front->b_prev = NULL;
-  rear->b_next = NULL;
+  bqueue[BQ_A1IN].q_front->b_prev = NULL;
+  bqueue[BQ_A1IN].q_rear->b_next = NULL;
 
   for (bp = &buf[0]; bp < &buf[nr_bufs]; bp++) bp->b_hash = bp->b_next;
-  buf_hash[0] = front;
+  buf_hash[0] = bqueue[BQ_A1IN].q_front;
 
   vm_forgetblocks();
 }
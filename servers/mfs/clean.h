@@ -2,8 +2,11 @@
 #ifndef _MFS_CLEAN_H
 #define _MFS_CLEAN_H 1
 
-#define MARKDIRTY(b) do { if(superblock.s_dev == (b)->b_dev && superblock.s_rd_only) { printf("%s:%d: dirty block on rofs! ", __FILE__, __LINE__); util_stacktrace(); } else { (b)->b_dirt = BP_DIRTY; } } while(0)
-#define MARKCLEAN(b) ((b)->b_dirt = BP_CLEAN)
+/* Blocks remember the write-back period in which they became dirty, and the
+ * number of dirty blocks is kept in nr_dirty, for the write-back code.
+ */
+#define MARKDIRTY(b) do { if(superblock.s_dev == (b)->b_dev && superblock.s_rd_only) { printf("%s:%d: dirty block on rofs! ", __FILE__, __LINE__); util_stacktrace(); } else { if(ISCLEAN(b)) { nr_dirty++; (b)->b_dirty_epoch = wb_epoch; } (b)->b_dirt = BP_DIRTY; } } while(0)
+#define MARKCLEAN(b) do { if(ISDIRTY(b)) nr_dirty--; (b)->b_dirt = BP_CLEAN; } while(0)
 
 #define ISDIRTY(b)	((b)->b_dirt == BP_DIRTY)
 #define ISCLEAN(b)	((b)->b_dirt == BP_CLEAN)
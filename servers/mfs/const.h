@@ -67,6 +67,45 @@
 
 #define BYTE_SWAP          0	/* tells conv2/conv4 to swap bytes */
 
+/* Write-back of dirty blocks.  Every WB_INTERVAL seconds, blocks that have
+ * been dirty for at least WB_AGE periods are written back.  Writers are
+ * throttled when more than DIRTY_HIGH percent of the cache is dirty, until
+ * it is back to DIRTY_LOW percent.
+ */
+#define WB_INTERVAL        5	/* seconds between write-back runs */
+#define WB_AGE             1	/* write-back periods before a block is due */
+#define DIRTY_HIGH        40	/* percentage of dirty bufs to throttle at */
+#define DIRTY_LOW         20	/* percentage of dirty bufs to throttle to */
+
+/* Sequential read-ahead.  A file read sequentially gets a read-ahead window
+ * of RA_MIN_WINDOW blocks that doubles with every further sequential read,
+ * up to RA_MAX_WINDOW.  A read anywhere else closes the window again.
+ */
+#define RA_MIN_WINDOW      4	/* initial window of a new stream in blocks */
+#define RA_MAX_WINDOW NR_IOREQS	/* largest window in blocks */
+
+/* Read-ahead and write-back are done asynchronously, with up to NR_ASYNC_IO
+ * vectored requests in flight at once.  Requests for the current client are
+ * synchronous.
+ */
+#define NR_ASYNC_IO       16	/* max. asynchronous requests in flight */
+
+/* Hash indexes of large directories.  A directory of at least
+ * DIRHASH_MIN_BLOCKS blocks gets an in-memory index when it is searched.  At
+ * most NR_DIRHASH directories are indexed at once, with DIRHASH_MAX_ENTRIES
+ * entries in all; the least recently used index is dropped to make room.
+ */
+#define NR_DIRHASH        64	/* max. # indexed directories */
+#define DIRHASH_MIN_BLOCKS 4	/* smallest directory to index, in blocks */
+#define DIRHASH_MAX_ENTRIES 262144	/* max. # index entries in total */
+
+/* When a regular file needs a new zone, up to PREALLOC_ZONES contiguous zones
+ * are reserved for it, so that files written at the same time do not get
+ * their zones interleaved.  Unused zones are given back when the file is
+ * closed or truncated.
+ */
+#define PREALLOC_ZONES     8	/* size of a file's preallocation window */
+
 #define END_OF_FILE   (-104)	/* eof detected */
 
 #define ROOT_INODE    ((ino_t) 1)	/* inode number for root directory */
@@ -0,0 +1,360 @@
+/* This file maintains in-memory hash indexes of large directories, so that a
+ * name can be looked up or deleted without scanning the whole directory.  An
+ * index is built the first time a large directory is searched and is kept
+ * with the directory's in-core inode until that inode is freed or its slot is
+ * reused.  The on-disk directory format is not changed.
+ *
+ * The entry points into this file are
+ *   dirhash_lookup: find the position of a name in a directory
+ *   dirhash_add:    record a new entry in the index of a directory
+ *   dirhash_remove: remove an entry from the index of a directory
+ *   dirhash_free:   drop the index of a directory
+ */
+
+#include "fs.h"
+#include <stdlib.h>
+#include <string.h>
+#include "buf.h"
+#include "inode.h"
+#include "super.h"
+
+#define DH_NONE		(-1)		/* end of a chain */
+#define DH_FREE		((u32_t) -1)	/* de_slot of an unused entry */
+
+struct dh_entry {
+  u32_t de_hash;		/* hash of the name */
+  u32_t de_slot;		/* entry number in the directory, or DH_FREE */
+  int de_next;			/* next entry in bucket or free list */
+};
+
+static struct dirhash {
+  struct inode *dh_ip;		/* indexed directory, NULL if slot is free */
+  int *dh_bucket;		/* first entry of each bucket */
+  unsigned int dh_nbuckets;	/* # buckets, a power of two */
+  struct dh_entry *dh_ent;	/* entries */
+  unsigned int dh_nent;		/* # entries in use */
+  unsigned int dh_top;		/* # entries ever used */
+  unsigned int dh_maxent;	/* # entries allocated */
+  int dh_free;			/* first free entry below dh_top */
+  unsigned long dh_used;	/* dh_clock when last used */
+} dirhash[NR_DIRHASH];
+
+static unsigned long dh_clock;	/* bumped on every use of an index */
+static unsigned int dh_total;	/* # entries allocated in all indexes */
+
+static struct dirhash *dh_build(struct inode *ip);
+static u32_t dh_hashname(char *string);
+static int dh_insert(struct dirhash *dh, u32_t hash, u32_t slot);
+static int dh_rehash(struct dirhash *dh, unsigned int nbuckets);
+
+
+/*===========================================================================*
+ *				dh_hashname				     *
+ *===========================================================================*/
+static u32_t dh_hashname(char *string)
+{
+/* FNV-1a hash of a name of at most MFS_NAME_MAX characters. */
+  u32_t hash;
+  int i;
+
+  hash = 2166136261UL;
+  for (i = 0; i < MFS_NAME_MAX && string[i] != '\0'; i++) {
+	hash ^= (unsigned char) string[i];
+	hash *= 16777619UL;
+  }
+
+  return(hash);
+}
+
+
+/*===========================================================================*
+ *				dh_rehash				     *
+ *===========================================================================*/
+static int dh_rehash(struct dirhash *dh, unsigned int nbuckets)
+{
+/* Give an index 'nbuckets' buckets and put all its entries in them. */
+  int *bucket;
+  struct dh_entry *de;
+  unsigned int i;
+
+  if ((bucket = malloc(nbuckets * sizeof(bucket[0]))) == NULL)
+	return(ENOMEM);
+
+  for (i = 0; i < nbuckets; i++) bucket[i] = DH_NONE;
+
+  for (i = 0; i < dh->dh_top; i++) {
+	de = &dh->dh_ent[i];
+	if (de->de_slot == DH_FREE) continue;
+	de->de_next = bucket[de->de_hash & (nbuckets - 1)];
+	bucket[de->de_hash & (nbuckets - 1)] = (int) i;
+  }
+
+  free(dh->dh_bucket);
+  dh->dh_bucket = bucket;
+  dh->dh_nbuckets = nbuckets;
+  return(OK);
+}
+
+
+/*===========================================================================*
+ *				dh_insert				     *
+ *===========================================================================*/
+static int dh_insert(struct dirhash *dh, u32_t hash, u32_t slot)
+{
+/* Add an entry for directory slot 'slot' to an index, growing it if needed. */
+  struct dh_entry *ent;
+  unsigned int maxent;
+  int i, r;
+
+  if (dh->dh_free != DH_NONE) {
+	i = dh->dh_free;
+	dh->dh_free = dh->dh_ent[i].de_next;
+  } else {
+	if (dh->dh_top == dh->dh_maxent) {
+		maxent = dh->dh_maxent * 2;
+		if (dh_total - dh->dh_maxent + maxent > DIRHASH_MAX_ENTRIES)
+			return(ENOMEM);
+		ent = realloc(dh->dh_ent, maxent * sizeof(ent[0]));
+		if (ent == NULL) return(ENOMEM);
+		dh_total += maxent - dh->dh_maxent;
+		dh->dh_ent = ent;
+		dh->dh_maxent = maxent;
+	}
+	i = (int) dh->dh_top++;
+  }
+
+  /* Keep the chains short: at most two entries per bucket on average. */
+  if (dh->dh_nent + 1 > dh->dh_nbuckets * 2) {
+	dh->dh_ent[i].de_slot = DH_FREE;	/* not linked yet */
+	if ((r = dh_rehash(dh, dh->dh_nbuckets * 2)) != OK) {
+		dh->dh_ent[i].de_next = dh->dh_free;
+		dh->dh_free = i;
+		return(r);
+	}
+  }
+
+  dh->dh_ent[i].de_hash = hash;
+  dh->dh_ent[i].de_slot = slot;
+  dh->dh_ent[i].de_next = dh->dh_bucket[hash & (dh->dh_nbuckets - 1)];
+  dh->dh_bucket[hash & (dh->dh_nbuckets - 1)] = i;
+  dh->dh_nent++;
+
+  return(OK);
+}
+
+
+/*===========================================================================*
+ *				dh_build				     *
+ *===========================================================================*/
+static struct dirhash *dh_build(struct inode *ip)
+{
+/* Build the index of a directory by reading it once.  Make room by dropping
+ * the least recently used index if all are in use.  Return NULL if the
+ * directory cannot be indexed.
+ */
+  struct dirhash *dh, *victim;
+  struct buf *bp;
+  struct direct *dp;
+  unsigned int nslots, nent, slot;
+  unsigned int block_size;
+  off_t pos;
+
+  block_size = ip->i_sp->s_block_size;
+  nslots = (unsigned int) (ip->i_size / DIR_ENTRY_SIZE);
+  if (nslots > DIRHASH_MAX_ENTRIES) return(NULL);
+
+  victim = NULL;
+  for (dh = &dirhash[0]; dh < &dirhash[NR_DIRHASH]; dh++) {
+	if (dh->dh_ip == NULL) break;
+	if (victim == NULL || dh->dh_used < victim->dh_used) victim = dh;
+  }
+  if (dh == &dirhash[NR_DIRHASH]) {
+	dh = victim;
+	dirhash_free(dh->dh_ip);
+  }
+
+  /* Size the index for the directory, plus room to grow. */
+  for (nent = 64; nent < nslots + nslots / 4; nent *= 2)
+	;
+  if (nent > DIRHASH_MAX_ENTRIES) nent = DIRHASH_MAX_ENTRIES;
+  while (dh_total + nent > DIRHASH_MAX_ENTRIES) {
+	/* Drop other indexes until this one fits. */
+	victim = NULL;
+	for (dh = &dirhash[0]; dh < &dirhash[NR_DIRHASH]; dh++) {
+		if (dh->dh_ip == NULL) continue;
+		if (victim == NULL || dh->dh_used < victim->dh_used)
+			victim = dh;
+	}
+	if (victim == NULL) return(NULL);
+	dh = victim;
+	dirhash_free(dh->dh_ip);
+  }
+
+  memset(dh, 0, sizeof(*dh));
+  dh->dh_free = DH_NONE;
+  if ((dh->dh_ent = malloc(nent * sizeof(dh->dh_ent[0]))) == NULL)
+	return(NULL);
+  dh->dh_maxent = nent;
+  if (dh_rehash(dh, nent / 2) != OK) {
+	free(dh->dh_ent);
+	return(NULL);
+  }
+  dh_total += nent;
+  dh->dh_ip = ip;
+  ip->i_dirhash = dh;
+
+  slot = 0;
+  for (pos = 0; pos < ip->i_size; pos += block_size) {
+	bp = get_block(ip->i_dev, read_map(ip, pos), NORMAL);
+
+	for (dp = &bp->b_dir[0];
+	     dp < &bp->b_dir[NR_DIR_ENTRIES(block_size)] && slot < nslots;
+	     dp++, slot++) {
+		if (dp->mfs_d_ino == NO_ENTRY) continue;
+		if (dh_insert(dh, dh_hashname(dp->mfs_d_name), slot) != OK) {
+			put_block(bp, DIRECTORY_BLOCK);
+			dirhash_free(ip);
+			return(NULL);
+		}
+	}
+
+	put_block(bp, DIRECTORY_BLOCK);
+  }
+
+  return(dh);
+}
+
+
+/*===========================================================================*
+ *				dirhash_lookup				     *
+ *===========================================================================*/
+int dirhash_lookup(
+  struct inode *ip,		/* directory to search */
+  char *string,			/* name to search for */
+  off_t *posp			/* position of the entry */
+)
+{
+/* Look up a name using the index of a directory, and build the index if the
+ * directory is large enough to have one.  Return OK with the position of the
+ * entry in '*posp', ENOENT if the name is not in the directory, or EAGAIN if
+ * the directory has no index and has to be searched.
+ */
+  struct dirhash *dh;
+  struct dh_entry *de;
+  struct buf *bp;
+  struct direct *dp;
+  unsigned int block_size;
+  u32_t hash;
+  off_t pos;
+  int i, match;
+
+  block_size = ip->i_sp->s_block_size;
+
+  if ((dh = ip->i_dirhash) == NULL) {
+	if (ip->i_size < (off_t) (DIRHASH_MIN_BLOCKS * block_size))
+		return(EAGAIN);
+	if ((dh = dh_build(ip)) == NULL)
+		return(EAGAIN);
+  }
+  dh->dh_used = ++dh_clock;
+
+  /* Names with the same hash have to be compared with the directory entry. */
+  hash = dh_hashname(string);
+  for (i = dh->dh_bucket[hash & (dh->dh_nbuckets - 1)]; i != DH_NONE;
+       i = de->de_next) {
+	de = &dh->dh_ent[i];
+	if (de->de_hash != hash) continue;
+
+	pos = (off_t) de->de_slot * DIR_ENTRY_SIZE;
+	bp = get_block(ip->i_dev, read_map(ip, pos), NORMAL);
+	dp = &bp->b_dir[(pos % block_size) / DIR_ENTRY_SIZE];
+	match = (dp->mfs_d_ino != NO_ENTRY &&
+		 strncmp(dp->mfs_d_name, string, MFS_NAME_MAX) == 0);
+	put_block(bp, DIRECTORY_BLOCK);
+
+	if (match) {
+		*posp = pos;
+		return(OK);
+	}
+  }
+
+  return(ENOENT);
+}
+
+
+/*===========================================================================*
+ *				dirhash_add				     *
+ *===========================================================================*/
+void dirhash_add(
+  struct inode *ip,		/* directory */
+  char *string,			/* name entered */
+  off_t pos			/* position of the new entry */
+)
+{
+/* A name has been entered in a directory.  If the index cannot hold it, drop
+ * the index; the directory is then searched until it is built again.
+ */
+  struct dirhash *dh;
+
+  if ((dh = ip->i_dirhash) == NULL) return;
+
+  if (dh_insert(dh, dh_hashname(string), (u32_t) (pos / DIR_ENTRY_SIZE)) != OK)
+	dirhash_free(ip);
+}
+
+
+/*===========================================================================*
+ *				dirhash_remove				     *
+ *===========================================================================*/
+void dirhash_remove(
+  struct inode *ip,		/* directory */
+  char *string,			/* name deleted */
+  off_t pos			/* position of the deleted entry */
+)
+{
+/* A name has been deleted from a directory. */
+  struct dirhash *dh;
+  struct dh_entry *de;
+  u32_t hash, slot;
+  int *nextp;
+
+  if ((dh = ip->i_dirhash) == NULL) return;
+
+  hash = dh_hashname(string);
+  slot = (u32_t) (pos / DIR_ENTRY_SIZE);
+
+  for (nextp = &dh->dh_bucket[hash & (dh->dh_nbuckets - 1)];
+       *nextp != DH_NONE; nextp = &de->de_next) {
+	de = &dh->dh_ent[*nextp];
+	if (de->de_slot != slot) continue;
+
+	/* Unlink the entry and put it on the free list. */
+	*nextp = de->de_next;
+	de->de_slot = DH_FREE;
+	de->de_next = dh->dh_free;
+	dh->dh_free = (int) (de - dh->dh_ent);
+	dh->dh_nent--;
+	return;
+  }
+
+  /* Not found; the index does not match the directory anymore. */
+  dirhash_free(ip);
+}
+
+
+/*===========================================================================*
+ *				dirhash_free				     *
+ *===========================================================================*/
+void dirhash_free(struct inode *ip)
+{
+/* Drop the index of a directory, if it has one. */
+  struct dirhash *dh;
+
+  if ((dh = ip->i_dirhash) == NULL) return;
+
+  free(dh->dh_bucket);
+  free(dh->dh_ent);
+  dh_total -= dh->dh_maxent;
+  memset(dh, 0, sizeof(*dh));
+  ip->i_dirhash = NULL;
+}
@@ -47,7 +47,12 @@ EXTERN unsigned int fs_block_size;
 /* Buffer cache. */
 EXTERN struct buf *buf;
 EXTERN struct buf **buf_hash;   /* the buffer hash table */
+EXTERN unsigned int buf_hash_mask;	/* hash table size - 1 */
 EXTERN unsigned int nr_bufs;
 EXTERN int may_use_vmcache;
 
+/* Write-back of dirty blocks. */
+EXTERN unsigned int nr_dirty;	/* number of dirty blocks in the cache */
+EXTERN unsigned int wb_epoch;	/* number of write-back periods so far */
+
 #endif
@@ -92,6 +92,7 @@ void init_inode_cache()
   /* add free inodes to unused/free list */
   for (rip = &inode[0]; rip < &inode[NR_INODES]; ++rip) {
       rip->i_num = NO_ENTRY;
+      rip->i_dirhash = NULL;
       TAILQ_INSERT_HEAD(&unused_inodes, rip, i_unused);
   }
 }
@@ -157,9 +158,10 @@ struct inode *get_inode(
   }
   rip = TAILQ_FIRST(&unused_inodes);
 
-  /* If not free unhash it */
+  /* If not free unhash it, and drop what was cached for it */
   if (rip->i_num != NO_ENTRY)
       unhash_inode(rip);
+  dirhash_free(rip);
   
   /* Inode is not unused any more */
   TAILQ_REMOVE(&unused_inodes, rip, i_unused);
@@ -173,6 +175,10 @@ struct inode *get_inode(
   rip->i_zsearch = NO_ZONE;	/* no zones searched for yet */
   rip->i_mountpoint= FALSE;
   rip->i_last_dpos = 0;		/* no dentries searched for yet */
+  rip->i_ra_pos = 0;		/* a read from the start is sequential */
+  rip->i_ra_end = 0;
+  rip->i_ra_window = 0;		/* no read-ahead stream yet */
+  rip->i_prealloc_count = 0;	/* no zones reserved yet */
 
   /* Add to hash */
   addhash_inode(rip);
@@ -224,6 +230,9 @@ register struct inode *rip;	/* pointer to inode to be released */
 	panic("put_inode: i_count already below 1: %d", rip->i_count);
 
   if (--rip->i_count == 0) {	/* i_count == 0 means no one is using it now */
+	/* Give back the zones reserved for writing the file. */
+	discard_prealloc(rip);
+
 	if (rip->i_nlinks == NO_LINK) {
 		/* i_nlinks == NO_LINK means free the inode. */
 		/* return all the disk blocks */
@@ -232,6 +241,7 @@ register struct inode *rip;	/* pointer to inode to be released */
 		 * special or character special file.
 		 */
 		(void) truncate_inode(rip, (off_t) 0); 
+		dirhash_free(rip);
 		rip->i_mode = I_NOT_ALLOC;     /* clear I_TYPE field */
 		IN_MARKDIRTY(rip);
 		free_inode(rip->i_dev, rip->i_num);
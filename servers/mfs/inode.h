@@ -45,6 +45,15 @@ EXTERN struct inode {
   char i_seek;			/* set on LSEEK, cleared on READ/WRITE */
   char i_update;		/* the ATIME, CTIME, and MTIME bits are here */
 
+  off_t i_ra_pos;		/* where a sequential read would continue */
+  off_t i_ra_end;		/* read ahead has been started up to here */
+  unsigned int i_ra_window;	/* read-ahead window in blocks, 0 if none */
+
+  struct dirhash *i_dirhash;	/* index of a large directory, or NULL */
+
+  zone_t i_prealloc;		/* first zone reserved for the file */
+  unsigned int i_prealloc_count;/* # zones reserved from i_prealloc on */
+
   LIST_ENTRY(inode) i_hash;     /* hash list */
   TAILQ_ENTRY(inode) i_unused;  /* free and unused list */
   
@@ -7,6 +7,7 @@
 #include <minix/dmap.h>
 #include <minix/endpoint.h>
 #include <minix/vfsif.h>
+#include <minix/bdev.h>
 #include "buf.h"
 #include "inode.h"
 
@@ -76,6 +77,9 @@ int main(int argc, char *argv[])
 		fs_m_out.m_type = TRNS_ADD_ID(fs_m_out.m_type, transid);
 	}
 	reply(src, &fs_m_out);
+
+	if (error == OK)
+		read_ahead(); /* do block read ahead */
   }
 
   return(OK);
@@ -121,6 +125,9 @@ static int sef_cb_init_fresh(int UNUSED(type), sef_init_info_t *UNUSED(info))
   buf_pool(DEFAULT_NR_BUFS);
   fs_block_size = _MIN_BLOCK_SIZE;
 
+  /* Start writing back dirty blocks periodically. */
+  wb_start();
+
   return(OK);
 }
 
@@ -129,6 +136,12 @@ static int sef_cb_init_fresh(int UNUSED(type), sef_init_info_t *UNUSED(info))
  *===========================================================================*/
 static void sef_cb_signal_handler(int signo)
 {
+  /* Dump the cache statistics on request. */
+  if (signo == SIGUSR1) {
+	cache_dump_stats();
+	return;
+  }
+
   /* Only check for termination signal, ignore anything else. */
   if (signo != SIGTERM) return;
 
@@ -147,14 +160,25 @@ static void sef_cb_signal_handler(int signo)
 static void get_work(m_in)
 message *m_in;				/* pointer to message */
 {
-  int r, srcok = 0;
+  int r, srcok = 0, ipc_status;
   endpoint_t src;
 
   do {
-	if ((r = sef_receive(ANY, m_in)) != OK) 	/* wait for message */
+	/* wait for message */
+	if ((r = sef_receive_status(ANY, m_in, &ipc_status)) != OK)
 		panic("sef_receive failed: %d", r);
 	src = m_in->m_source;
 
+	if (is_ipc_notify(ipc_status) && src == CLOCK) {
+		wb_timeout();		/* periodic write-back */
+		continue;
+	}
+
+	if (src != VFS_PROC_NR && m_in->m_type == BDEV_REPLY) {
+		bdev_reply_asyn(m_in);	/* asynchronous block I/O done */
+		continue;
+	}
+
 	if(src == VFS_PROC_NR) {
 		if(unmountdone) 
 			printf("MFS: unmounted: unexpected message from FS\n");
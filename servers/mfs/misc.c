@@ -25,7 +25,10 @@ int fs_sync()
   for(rip = &inode[0]; rip < &inode[NR_INODES]; rip++)
 	  if(rip->i_count > 0 && IN_ISDIRTY(rip)) rw_inode(rip, WRITING);
 
-  /* Write all the dirty blocks to the disk, one drive at a time. */
+  /* Wait for write-back in progress, then write all the dirty blocks to the
+   * disk, one drive at a time.
+   */
+  flush_io();
   for(bp = &buf[0]; bp < &buf[nr_bufs]; bp++)
 	  if(bp->b_dev != NO_DEV && ISDIRTY(bp)) 
 		  flushall(bp->b_dev);
@@ -7,6 +7,8 @@
  *   advance:	 parse one component of a path name
  *   search_dir: search a directory for a string and return its inode number
  *
+ * Large directories are searched through their hash index; see dirhash.c.
+ *
  */
  
 #include "fs.h"
@@ -29,6 +31,8 @@ static char *get_name(char *name, char string[MFS_NAME_MAX+1]);
 static int ltraverse(struct inode *rip, char *suffix);
 static int parse_path(ino_t dir_ino, ino_t root_ino, int flags, struct
 	inode **res_inop, size_t *offsetp, int *symlinkp);
+static int found_dir(struct inode *ldir_ptr, char *string, ino_t *numb, int
+	flag, struct buf *bp, struct direct *dp, off_t pos);
 
 
 /*===========================================================================*
@@ -481,9 +485,9 @@ int check_permissions;		 /* check permissions when flag is !IS_EMPTY */
 
   register struct direct *dp = NULL;
   register struct buf *bp = NULL;
-  int i, r, e_hit, t, match;
+  int i, r, e_hit, match;
   mode_t bits;
-  off_t pos;
+  off_t pos, epos;
   unsigned new_slots, old_slots;
   block_t b;
   struct super_block *sp;
@@ -510,6 +514,20 @@ int check_permissions;		 /* check permissions when flag is !IS_EMPTY */
 	}
   }
   if (r != OK) return(r);
+
+  /* Use the hash index to find the entry, if the directory has one. */
+  if (flag == LOOK_UP || flag == DELETE) {
+	r = dirhash_lookup(ldir_ptr, string, &epos);
+	if (r == ENOENT) return(ENOENT);
+	if (r == OK) {
+		pos = epos - epos % ldir_ptr->i_sp->s_block_size;
+		bp = get_block(ldir_ptr->i_dev, read_map(ldir_ptr, pos),
+			NORMAL);
+		assert(bp != NULL);
+		dp = &bp->b_dir[(epos - pos) / DIR_ENTRY_SIZE];
+		return(found_dir(ldir_ptr, string, numb, flag, bp, dp, pos));
+	}
+  }
   
   /* Step through the directory one block at a time. */
   old_slots = (unsigned) (ldir_ptr->i_size/DIR_ENTRY_SIZE);
@@ -555,26 +573,9 @@ int check_permissions;		 /* check permissions when flag is !IS_EMPTY */
 		}
 
 		if (match) {
-			/* LOOK_UP or DELETE found what it wanted. */
-			r = OK;
-			if (flag == IS_EMPTY) r = ENOTEMPTY;
-			else if (flag == DELETE) {
-				/* Save d_ino for recovery. */
-				t = MFS_NAME_MAX - sizeof(ino_t);
-				*((ino_t *) &dp->mfs_d_name[t]) = dp->mfs_d_ino;
-				dp->mfs_d_ino = NO_ENTRY;	/* erase entry */
-				MARKDIRTY(bp);
-				ldir_ptr->i_update |= CTIME | MTIME;
-				IN_MARKDIRTY(ldir_ptr);
-				if (pos < ldir_ptr->i_last_dpos)
-					ldir_ptr->i_last_dpos = pos;
-			} else {
-				sp = ldir_ptr->i_sp;	/* 'flag' is LOOK_UP */
-				*numb = (ino_t) conv4(sp->s_native,
-						      (int) dp->mfs_d_ino);
-			}
-			put_block(bp, DIRECTORY_BLOCK);
-			return(r);
+			/* LOOK_UP, DELETE or IS_EMPTY found what it wanted. */
+			return(found_dir(ldir_ptr, string, numb, flag, bp, dp,
+				pos));
 		}
 
 		/* Check for free slot for the benefit of ENTER. */
@@ -618,6 +619,7 @@ int check_permissions;		 /* check permissions when flag is !IS_EMPTY */
   dp->mfs_d_ino = conv4(sp->s_native, (int) *numb);
   MARKDIRTY(bp);
   put_block(bp, DIRECTORY_BLOCK);
+  dirhash_add(ldir_ptr, string, (off_t) (new_slots - 1) * DIR_ENTRY_SIZE);
   ldir_ptr->i_update |= CTIME | MTIME;	/* mark mtime for update later */
   IN_MARKDIRTY(ldir_ptr);
   if (new_slots > old_slots) {
@@ -628,3 +630,48 @@ int check_permissions;		 /* check permissions when flag is !IS_EMPTY */
   return(OK);
 }
 
+
+
+/*===========================================================================*
+ *				found_dir				     *
+ *===========================================================================*/
+static int found_dir(
+  struct inode *ldir_ptr,	/* directory searched */
+  char *string,			/* component searched for */
+  ino_t *numb,			/* pointer to inode number */
+  int flag,			/* LOOK_UP, DELETE or IS_EMPTY */
+  struct buf *bp,		/* directory block holding the entry */
+  struct direct *dp,		/* the entry found */
+  off_t pos			/* position of the block in the directory */
+)
+{
+/* search_dir found the entry it was looking for.  Finish the operation and
+ * release the directory block.
+ */
+  struct super_block *sp;
+  off_t epos;
+  int r, t;
+
+  r = OK;
+  if (flag == IS_EMPTY) r = ENOTEMPTY;
+  else if (flag == DELETE) {
+	epos = pos + (off_t) (dp - &bp->b_dir[0]) * DIR_ENTRY_SIZE;
+	dirhash_remove(ldir_ptr, string, epos);
+
+	/* Save d_ino for recovery. */
+	t = MFS_NAME_MAX - sizeof(ino_t);
+	*((ino_t *) &dp->mfs_d_name[t]) = dp->mfs_d_ino;
+	dp->mfs_d_ino = NO_ENTRY;	/* erase entry */
+	MARKDIRTY(bp);
+	ldir_ptr->i_update |= CTIME | MTIME;
+	IN_MARKDIRTY(ldir_ptr);
+	if (pos < ldir_ptr->i_last_dpos)
+		ldir_ptr->i_last_dpos = pos;
+  } else {
+	sp = ldir_ptr->i_sp;	/* 'flag' is LOOK_UP */
+	*numb = (ino_t) conv4(sp->s_native, (int) dp->mfs_d_ino);
+  }
+
+  put_block(bp, DIRECTORY_BLOCK);
+  return(r);
+}
@@ -13,16 +13,27 @@ struct super_block;
 /* cache.c */
 zone_t alloc_zone(dev_t dev, zone_t z);
 void buf_pool(int bufs);
+void cache_dump_stats(void);
 void flushall(dev_t dev);
 void free_zone(dev_t dev, zone_t numb);
 struct buf *get_block(dev_t dev, block_t block,int only_search);
 void invalidate(dev_t device);
 void put_block(struct buf *bp, int block_type);
 void set_blocksize(struct super_block *);
+void wb_start(void);
+void wb_throttle(void);
+void wb_timeout(void);
 void rw_scattered(dev_t dev, struct buf **bufq, int bufqsize, int
-	rw_flag);
+	rw_flag, int async);
+void flush_io(void);
 int block_write_ok(struct buf *bp);
 
+/* dirhash.c */
+int dirhash_lookup(struct inode *ip, char *string, off_t *posp);
+void dirhash_add(struct inode *ip, char *string, off_t pos);
+void dirhash_remove(struct inode *ip, char *string, off_t pos);
+void dirhash_free(struct inode *ip);
+
 /* inode.c */
 struct inode *alloc_inode(dev_t dev, mode_t bits);
 void dup_inode(struct inode *ip);
@@ -88,6 +99,7 @@ int fs_statvfs(void);
 
 /* super.c */
 bit_t alloc_bit(struct super_block *sp, int map, bit_t origin);
+int alloc_bit_run(struct super_block *sp, int map, bit_t first, int count);
 void free_bit(struct super_block *sp, int map, bit_t bit_returned);
 unsigned int get_block_size(dev_t dev);
 struct super_block *get_super(dev_t dev);
@@ -114,6 +126,7 @@ void sanitycheck(char *file, int line);
 
 /* write.c */
 void clear_zone(struct inode *rip, off_t pos, int flag);
+void discard_prealloc(struct inode *rip);
 struct buf *new_block(struct inode *rip, off_t position);
 void zero_block(struct buf *bp);
 int write_map(struct inode *, off_t, zone_t, int);
@@ -13,12 +13,21 @@
 
 static struct buf *rahead(struct inode *rip, block_t baseblock, u64_t
 	position, unsigned bytes_ahead);
+static void ra_stream(struct inode *rip, off_t position);
+static void ra_schedule(struct inode *rip, off_t position, unsigned int
+	block_size);
+static void alloc_read_q(void);
 static int rw_chunk(struct inode *rip, u64_t position, unsigned off,
 	size_t chunk, unsigned left, int rw_flag, cp_grant_id_t gid, unsigned
 	buf_off, unsigned int block_size, int *completed);
 
 static char getdents_buf[GETDENTS_BUFSIZ];
 
+static unsigned int readqsize = 0;
+static struct buf **read_q;
+
+static ino_t ra_ino = NO_ENTRY;	/* inode to read ahead for after the reply */
+
 /*===========================================================================*
  *				fs_readwrite				     *
  *===========================================================================*/
@@ -82,6 +91,9 @@ int fs_readwrite(void)
   	(dev_t) rip->i_zone[0] == superblock.s_dev && superblock.s_rd_only)
 		return EROFS;
 	      
+  /* Keep track of sequential readers. */
+  if (rw_flag == READING && mode_word == I_REGULAR) ra_stream(rip, position);
+
   cum_io = 0;
   /* Split the transfer into chunks that don't span two blocks. */
   while (nrbytes > 0) {
@@ -92,6 +104,8 @@ int fs_readwrite(void)
 		  bytes_left = f_size - position;
 		  if (position >= f_size) break;	/* we are beyond EOF */
 		  if (chunk > (unsigned int) bytes_left) chunk = bytes_left;
+	  } else {
+		  wb_throttle();	/* don't let dirty blocks pile up */
 	  }
 	  
 	  /* Read or write 'chunk' bytes. */
@@ -117,6 +131,10 @@ int fs_readwrite(void)
 	  }
   } 
 
+  /* Start reading the rest of the window once the reply has been sent. */
+  if (rw_flag == READING && mode_word == I_REGULAR)
+	ra_schedule(rip, position, block_size);
+
   rip->i_seek = NO_SEEK;
 
   if (rdwt_err != OK) r = rdwt_err;	/* check for disk error */
@@ -181,6 +199,9 @@ int fs_breadwrite(void)
 	  off = rem64u(position, block_size);	/* offset in blk*/
 	  chunk = min(nrbytes, block_size - off);
 
+	  if (rw_flag == WRITING)
+		  wb_throttle();	/* don't let dirty blocks pile up */
+
 	  /* Read or write 'chunk' bytes. */
 	  r = rw_chunk(&rip, position, off, chunk, nrbytes, rw_flag, gid,
 	  	       cum_io, block_size, &completed);
@@ -428,18 +449,8 @@ unsigned bytes_ahead;		/* bytes beyond position for immediate use */
   off_t ind1_pos;
   dev_t dev;
   struct buf *bp;
-  static unsigned int readqsize = 0;
-  static struct buf **read_q;
 
-  if(readqsize != nr_bufs) {
-	if(readqsize > 0) {
-		assert(read_q != NULL);
-		free(read_q);
-	}
-	if(!(read_q = malloc(sizeof(read_q[0])*nr_bufs)))
-		panic("couldn't allocate read_q");
-	readqsize = nr_bufs;
-  }
+  alloc_read_q();
 
   block_spec = (rip->i_mode & I_TYPE) == I_BLOCK_SPECIAL;
   if (block_spec) 
@@ -501,8 +512,11 @@ unsigned bytes_ahead;		/* bytes beyond position for immediate use */
   /* No more than the maximum request. */
   if (blocks_ahead > NR_IOREQS) blocks_ahead = NR_IOREQS;
 
-  /* Read at least the minimum number of blocks, but not after a seek. */
-  if (blocks_ahead < BLOCKS_MINIMUM && rip->i_seek == NO_SEEK)
+  /* Read at least the minimum number of blocks, but only for a sequential
+   * reader; random reads get no more than they asked for.
+   */
+  if (blocks_ahead < BLOCKS_MINIMUM && rip->i_seek == NO_SEEK &&
+      (block_spec || rip->i_ra_window > 0))
 	blocks_ahead = BLOCKS_MINIMUM;
 
   /* Can't go past end of file. */
@@ -528,11 +542,133 @@ unsigned bytes_ahead;		/* bytes beyond position for immediate use */
 		break;
 	}
   }
-  rw_scattered(dev, read_q, read_q_size, READING);
+  rw_scattered(dev, read_q, read_q_size, READING, FALSE);
   return(get_block(dev, baseblock, NORMAL));
 }
 
 
+/*===========================================================================*
+ *				ra_stream				     *
+ *===========================================================================*/
+static void ra_stream(rip, position)
+struct inode *rip;		/* inode of the file being read */
+off_t position;			/* where this read starts */
+{
+/* A read that starts where the previous one ended continues a sequential
+ * stream, and doubles its read-ahead window.  Any other read, or a read after
+ * a seek, is random access and closes the window.
+ */
+  if (position == rip->i_ra_pos && rip->i_seek == NO_SEEK) {
+	if (rip->i_ra_window == 0)
+		rip->i_ra_window = RA_MIN_WINDOW;
+	else if (rip->i_ra_window < RA_MAX_WINDOW / 2)
+		rip->i_ra_window *= 2;
+	else
+		rip->i_ra_window = RA_MAX_WINDOW;
+  } else {
+	rip->i_ra_window = 0;
+	rip->i_ra_end = position;
+  }
+}
+
+
+/*===========================================================================*
+ *				ra_schedule				     *
+ *===========================================================================*/
+static void ra_schedule(rip, position, block_size)
+struct inode *rip;		/* inode of the file being read */
+off_t position;			/* where the next sequential read starts */
+unsigned int block_size;	/* block size of the file system */
+{
+/* Remember where the stream continues.  If less than half of the window
+ * ahead of the reader has been read ahead, have read_ahead() read the next
+ * part of it after the reply to this request has been sent, so that the
+ * reader can go on with its data while the disk is busy.
+ */
+  off_t half;
+
+  rip->i_ra_pos = position;
+  if (rip->i_ra_end < position) rip->i_ra_end = position;
+
+  if (rip->i_ra_window == 0 || position >= rip->i_size) return;
+
+  half = (off_t) (rip->i_ra_window / 2) * block_size;
+  if (rip->i_ra_end - position < half) ra_ino = rip->i_num;
+}
+
+
+/*===========================================================================*
+ *				read_ahead				     *
+ *===========================================================================*/
+void read_ahead(void)
+{
+/* Fill the read-ahead window of the stream scheduled by ra_schedule().  This
+ * is called from the main loop after the reply has been sent.  The window is
+ * mapped through the inode, so unlike rahead() it follows the file across
+ * fragmented zones and indirect blocks.  The blocks are read asynchronously,
+ * so that the next request can be served while the disk is busy.
+ */
+  struct inode *rip;
+  struct buf *bp;
+  block_t b;
+  off_t pos, end;
+  unsigned int block_size;
+  int read_q_size;
+
+  if (ra_ino == NO_ENTRY) return;
+  rip = find_inode(fs_dev, ra_ino);
+  ra_ino = NO_ENTRY;
+  if (rip == NULL || rip->i_ra_window == 0) return;
+
+  alloc_read_q();
+
+  block_size = rip->i_sp->s_block_size;
+  pos = rip->i_ra_end - (rip->i_ra_end % block_size);
+  end = rip->i_ra_pos + (off_t) rip->i_ra_window * block_size;
+  if (end > rip->i_size) end = rip->i_size;
+
+  read_q_size = 0;
+  while (pos < end && read_q_size < NR_IOREQS) {
+	/* Don't trash the cache, leave 4 free. */
+	if (bufs_in_use >= nr_bufs - 4) break;
+
+	b = read_map(rip, pos);
+	pos += block_size;
+	if (b == NO_BLOCK) continue;	/* a hole reads as zeros */
+
+	bp = get_block(rip->i_dev, b, PREFETCH);
+	if (bp->b_dev != NO_DEV) {
+		/* Already in the cache. */
+		put_block(bp, FULL_DATA_BLOCK);
+		continue;
+	}
+	read_q[read_q_size++] = bp;
+  }
+  rip->i_ra_end = pos;
+
+  if (read_q_size > 0)
+	rw_scattered(rip->i_dev, read_q, read_q_size, READING, TRUE);
+}
+
+
+/*===========================================================================*
+ *				alloc_read_q				     *
+ *===========================================================================*/
+static void alloc_read_q(void)
+{
+/* Make sure the read queue can hold every buffer in the cache. */
+  if(readqsize != nr_bufs) {
+	if(readqsize > 0) {
+		assert(read_q != NULL);
+		free(read_q);
+	}
+	if(!(read_q = malloc(sizeof(read_q[0])*nr_bufs)))
+		panic("couldn't allocate read_q");
+	readqsize = nr_bufs;
+  }
+}
+
+
 /*===========================================================================*
  *				fs_getdents				     *
  *===========================================================================*/
@@ -5,6 +5,7 @@
  *
  * The entry points into this file are
  *   alloc_bit:       somebody wants to allocate a zone or inode; find one
+ *   alloc_bit_run:   allocate the free bits that follow an allocated one
  *   free_bit:        indicate that a zone or inode is available for allocation
  *   get_super:       search the 'superblock' table for a device
  *   mounted:         tells if file inode is on mounted (or ROOT) file system
@@ -22,6 +23,8 @@
 #include "super.h"
 #include "const.h"
 
+static unsigned int first_zero(bitchunk_t k);
+
 
 /*===========================================================================*
  *				alloc_bit				     *
@@ -76,7 +79,7 @@ bit_t origin;			/* number of bit to start searching at */
 
 		/* Find and allocate the free bit. */
 		k = (bitchunk_t) conv4(sp->s_native, (int) *wptr);
-		for (i = 0; (k & (1 << i)) != 0; ++i) {}
+		i = first_zero(k);
 
 		/* Bit number from the start of the bit map. */
 		b = ((bit_t) block * FS_BITS_PER_BLOCK(sp->s_block_size))
@@ -101,6 +104,100 @@ bit_t origin;			/* number of bit to start searching at */
   return(NO_BIT);		/* no bit could be allocated */
 }
 
+/*===========================================================================*
+ *				first_zero				     *
+ *===========================================================================*/
+static unsigned int first_zero(bitchunk_t k)
+{
+/* Return the number of the lowest clear bit in a word that is not all ones,
+ * halving the part of the word that is looked at in each step.
+ */
+  unsigned int i;
+
+  k = ~k;
+  i = 0;
+  if ((k & 0xFFFF) == 0) { k >>= 16; i += 16; }
+  if ((k & 0xFF) == 0) { k >>= 8; i += 8; }
+  if ((k & 0xF) == 0) { k >>= 4; i += 4; }
+  if ((k & 0x3) == 0) { k >>= 2; i += 2; }
+  if ((k & 0x1) == 0) i += 1;
+
+  return(i);
+}
+
+/*===========================================================================*
+ *				alloc_bit_run				     *
+ *===========================================================================*/
+int alloc_bit_run(
+  struct super_block *sp,	/* the filesystem to allocate from */
+  int map,			/* IMAP (inode map) or ZMAP (zone map) */
+  bit_t first,			/* allocated bit the run should follow */
+  int count			/* max. number of bits to allocate */
+)
+{
+/* Allocate up to 'count' bits directly following bit 'first', stopping at the
+ * first bit that is in use.  Return how many bits were allocated.  Whole free
+ * words are taken at once.
+ */
+  block_t start_block;
+  bit_t map_bits, b;
+  struct buf *bp;
+  unsigned int block, word, bit, n;
+  bitchunk_t k, mask;
+  int done;
+
+  if (sp->s_rd_only)
+	panic("can't allocate bit on read-only filesys");
+
+  if (map == IMAP) {
+	start_block = START_BLOCK;
+	map_bits = (bit_t) (sp->s_ninodes + 1);
+  } else {
+	start_block = START_BLOCK + sp->s_imap_blocks;
+	map_bits = (bit_t) (sp->s_zones - (sp->s_firstdatazone - 1));
+  }
+
+  done = 0;
+  bp = NULL;
+  b = first + 1;
+  while (done < count && b < map_bits) {
+	block = b / FS_BITS_PER_BLOCK(sp->s_block_size);
+	word = (b % FS_BITS_PER_BLOCK(sp->s_block_size)) / FS_BITCHUNK_BITS;
+	bit = b % FS_BITCHUNK_BITS;
+
+	if (bp == NULL || bp->b_blocknr != start_block + block) {
+		if (bp != NULL) put_block(bp, MAP_BLOCK);
+		bp = get_block(sp->s_dev, start_block + block, NORMAL);
+	}
+
+	/* Take as many of the bits from 'bit' on in this word as we can. */
+	k = (bitchunk_t) conv4(sp->s_native, (int) bp->b_bitmap[word]);
+	n = FS_BITCHUNK_BITS - bit;
+	if (n > (unsigned int) (count - done)) n = count - done;
+	if (n > map_bits - b) n = map_bits - b;
+	mask = (n == FS_BITCHUNK_BITS) ? (bitchunk_t) ~0 :
+		(((bitchunk_t) 1 << n) - 1) << bit;
+
+	if ((k & mask) != 0) {
+		/* Stop at the first bit in use. */
+		n = first_zero(~(k >> bit));
+		mask = (n == 0) ? 0 : (((bitchunk_t) 1 << n) - 1) << bit;
+		count = done + n;	/* this ends the run */
+	}
+
+	if (mask != 0) {
+		k |= mask;
+		bp->b_bitmap[word] = (bitchunk_t) conv4(sp->s_native, (int) k);
+		MARKDIRTY(bp);
+	}
+	done += n;
+	b += n;
+  }
+
+  if (bp != NULL) put_block(bp, MAP_BLOCK);
+  return(done);
+}
+
 /*===========================================================================*
  *				free_bit				     *
  *===========================================================================*/
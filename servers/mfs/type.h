@@ -37,7 +37,10 @@ struct buf {
   dev_t b_dev;                  /* major | minor device where block resides */
   char b_dirt;                  /* BP_CLEAN or BP_DIRTY */
   char b_count;                 /* number of users of this buffer */
+  char b_queue;                 /* BQ_A1IN or BQ_AM, see buf.h */
+  unsigned int b_dirty_epoch;   /* write-back period in which it got dirty */
   unsigned int b_bytes;         /* Number of bytes allocated in bp */
+  struct ioreq *b_io;           /* asynchronous I/O in progress, or NULL */
 };
 
 #endif
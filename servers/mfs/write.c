@@ -6,6 +6,7 @@
  *   clear_zone:   erase a zone in the middle of a file
  *   new_block:    acquire a new block
  *   zero_block:   overwrite a block with zeroes
+ *   discard_prealloc: give back the zones preallocated for a file
  *
  */
 
@@ -18,6 +19,7 @@
 
 static void wr_indir(struct buf *bp, int index, zone_t zone);
 static int empty_indir(struct buf *, struct super_block *);
+static zone_t alloc_data_zone(struct inode *rip, zone_t z);
 
 
 /*===========================================================================*
@@ -300,7 +302,7 @@ off_t position;			/* file pointer */
 		/* searched before, start from last find */
 		z = rip->i_zsearch;
 	}
-	if ( (z = alloc_zone(rip->i_dev, z)) == NO_ZONE) return(NULL);
+	if ( (z = alloc_data_zone(rip, z)) == NO_ZONE) return(NULL);
 	rip->i_zsearch = z;	/* store for next lookup */
 	if ( (r = write_map(rip, position, z, 0)) != OK) {
 		free_zone(rip->i_dev, z);
@@ -322,6 +324,68 @@ off_t position;			/* file pointer */
 }
 
 
+/*===========================================================================*
+ *				alloc_data_zone				     *
+ *===========================================================================*/
+static zone_t alloc_data_zone(rip, z)
+register struct inode *rip;	/* pointer to inode */
+zone_t z;			/* try to allocate new zone near this one */
+{
+/* Allocate a data zone for a file.  Files that are written concurrently
+ * would get interleaved zones if each took the next free zone.  Instead, a
+ * regular file reserves a window of up to PREALLOC_ZONES contiguous zones
+ * when it needs a new zone, and takes its next zones from that window.
+ */
+  struct inode *xp;
+  int n;
+
+  if (rip->i_prealloc_count > 0) {
+	z = rip->i_prealloc++;
+	rip->i_prealloc_count--;
+	return(z);
+  }
+
+  if ( (z = alloc_zone(rip->i_dev, z)) == NO_ZONE) {
+	/* Zones may be held in the windows of other files; try again. */
+	n = 0;
+	for (xp = &inode[0]; xp < &inode[NR_INODES]; xp++) {
+		if (xp->i_count > 0 && xp->i_dev == rip->i_dev &&
+		    xp->i_prealloc_count > 0) {
+			discard_prealloc(xp);
+			n++;
+		}
+	}
+	if (n == 0 || (z = alloc_zone(rip->i_dev, z)) == NO_ZONE)
+		return(NO_ZONE);
+  }
+
+  if ((rip->i_mode & I_TYPE) == I_REGULAR && PREALLOC_ZONES > 1) {
+	n = alloc_bit_run(rip->i_sp, ZMAP,
+		(bit_t) (z - (rip->i_sp->s_firstdatazone - 1)),
+		PREALLOC_ZONES - 1);
+	rip->i_prealloc = z + 1;
+	rip->i_prealloc_count = n;
+  }
+
+  return(z);
+}
+
+
+/*===========================================================================*
+ *				discard_prealloc			     *
+ *===========================================================================*/
+void discard_prealloc(rip)
+register struct inode *rip;	/* pointer to inode */
+{
+/* Free the zones that are reserved for a file but not used by it. */
+
+  while (rip->i_prealloc_count > 0) {
+	free_zone(rip->i_dev, rip->i_prealloc++);
+	rip->i_prealloc_count--;
+  }
+}
+
+
 /*===========================================================================*
  *				zero_block				     *
  *===========================================================================*/
@@ -33,6 +33,8 @@ EXTERN struct schedproc {
 	bitchunk_t cpu_mask[BITMAP_CHUNKS(CONFIG_MAX_CPUS)]; /* what CPUs is hte
 								process allowed
 								to run on */
+	unsigned noquantum;	/* quanta used up since the last cpu balancing */
+	unsigned last_migrate;	/* balancing round of the last migration */
 } schedproc[NR_PROCS];
 
 /* Flag values */
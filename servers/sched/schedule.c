@@ -46,24 +46,40 @@ static void balance_queues(struct timer *tp);
 /* processes created by RS are sysytem processes */
 #define is_system_proc(p)	((p)->parent == RS_PROC_NR)
 
-static unsigned cpu_proc[CONFIG_MAX_CPUS];
+static int cpu_proc[CONFIG_MAX_CPUS];	/* processes placed on each cpu */
 
-static void pick_cpu(struct schedproc * proc)
-{
 #ifdef CONFIG_SMP
-	unsigned cpu, c;
-	unsigned cpu_load = (unsigned) -1;
-	
-	if (machine.processors_count == 1) {
-		proc->cpu = machine.bsp_id;
-		return;
-	}
+static timer_t migrate_timer;
+static unsigned migrate_timeout;
 
-	/* schedule sysytem processes only on the boot cpu */
-	if (is_system_proc(proc)) {
-		proc->cpu = machine.bsp_id;
-		return;
-	}
+#define MIGRATE_FREQ	4 /* how often to balance cpus per second */
+#define AFFINITY_ROUNDS	8 /* rounds a migrated process stays put */
+
+static void balance_cpus(struct timer *tp);
+
+/* Load of each cpu, as reported by the kernel when a process on it runs out
+ * of quantum.  A cpu that does not report is idle or runs processes that
+ * block before their quantum is over, so its load decays every round.
+ */
+static unsigned cpu_load[CONFIG_MAX_CPUS];	/* utilization in percent */
+static unsigned cpu_runq[CONFIG_MAX_CPUS];	/* runnable processes */
+static int cpu_seen[CONFIG_MAX_CPUS];		/* reported this round */
+static unsigned balance_round;
+
+/* Place system processes on all cpus rather than on the BSP only. */
+static long spread_sys = 0;
+
+#define cpu_weight(c)	(cpu_runq[c] * 100 + cpu_load[c] + cpu_proc[c])
+#define NO_CPU		((unsigned) -1)
+#define may_migrate(p)	(!is_system_proc(p) || spread_sys)
+
+/*===========================================================================*
+ *				least_loaded_cpu			     *
+ *===========================================================================*/
+static unsigned least_loaded_cpu(int use_bsp)
+{
+	unsigned cpu, c;
+	unsigned load = (unsigned) -1;
 
 	/* if no other cpu available, try BSP */
 	cpu = machine.bsp_id;
@@ -71,13 +87,36 @@ static void pick_cpu(struct schedproc * proc)
 		/* skip dead cpus */
 		if (!cpu_is_available(c))
 			continue;
-		if (c != machine.bsp_id && cpu_load > cpu_proc[c]) {
-			cpu_load = cpu_proc[c];
+		if (c == machine.bsp_id && !use_bsp)
+			continue;
+		if (load > cpu_weight(c)) {
+			load = cpu_weight(c);
 			cpu = c;
 		}
 	}
-	proc->cpu = cpu;
-	cpu_proc[cpu]++;
+	return cpu;
+}
+#endif
+
+/*===========================================================================*
+ *				pick_cpu				     *
+ *===========================================================================*/
+static void pick_cpu(struct schedproc * proc)
+{
+#ifdef CONFIG_SMP
+	if (machine.processors_count == 1) {
+		proc->cpu = machine.bsp_id;
+	} else if (!may_migrate(proc)) {
+		/* schedule sysytem processes only on the boot cpu */
+		proc->cpu = machine.bsp_id;
+	} else {
+		/* leave the BSP to the system processes unless they are
+		 * spread over all cpus as well
+		 */
+		proc->cpu = least_loaded_cpu(spread_sys);
+	}
+	cpu_proc[proc->cpu]++;
+	cpu_runq[proc->cpu]++;	/* until the kernel tells us better */
 #else
 	proc->cpu = 0;
 #endif
@@ -91,6 +130,9 @@ int do_noquantum(message *m_ptr)
 {
 	register struct schedproc *rmp;
 	int rv, proc_nr_n;
+#ifdef CONFIG_SMP
+	unsigned cpu;
+#endif
 
 	if (sched_isokendpt(m_ptr->m_source, &proc_nr_n) != OK) {
 		printf("SCHED: WARNING: got an invalid endpoint in OOQ msg %u.\n",
@@ -103,6 +145,17 @@ int do_noquantum(message *m_ptr)
 		rmp->priority += 1; /* lower priority */
 	}
 
+#ifdef CONFIG_SMP
+	/* Keep the load report of the cpu the process ran on. */
+	cpu = (unsigned) m_ptr->SCHEDULING_ACNT_CPU;
+	if (cpu < machine.processors_count) {
+		cpu_load[cpu] = (unsigned) m_ptr->SCHEDULING_ACNT_CPU_LOAD;
+		cpu_runq[cpu] = (unsigned) m_ptr->SCHEDULING_ACNT_CPU_RUNQ;
+		cpu_seen[cpu] = TRUE;
+	}
+	rmp->noquantum++;
+#endif
+
 	if ((rv = schedule_process_local(rmp)) != OK) {
 		return rv;
 	}
@@ -129,7 +182,8 @@ int do_stop_scheduling(message *m_ptr)
 
 	rmp = &schedproc[proc_nr_n];
 #ifdef CONFIG_SMP
-	cpu_proc[rmp->cpu]--;
+	if (cpu_is_available(rmp->cpu))
+		cpu_proc[rmp->cpu]--;
 #endif
 	rmp->flags = 0; /*&= ~IN_USE;*/
 
@@ -162,6 +216,8 @@ int do_start_scheduling(message *m_ptr)
 	/* Populate process slot */
 	rmp->endpoint     = m_ptr->SCHEDULING_ENDPOINT;
 	rmp->parent       = m_ptr->SCHEDULING_PARENT;
+	rmp->noquantum    = 0;
+	rmp->last_migrate = 0;
 	rmp->max_priority = (unsigned) m_ptr->SCHEDULING_MAXPRIO;
 	if (rmp->max_priority >= NR_SCHED_QUEUES) {
 		return EINVAL;
@@ -301,8 +357,6 @@ static int schedule_process(struct schedproc * rmp, unsigned flags)
 	int err;
 	int new_prio, new_quantum, new_cpu;
 
-	pick_cpu(rmp);
-
 	if (flags & SCHEDULE_CHANGE_PRIO)
 		new_prio = rmp->priority;
 	else
@@ -337,6 +391,18 @@ void init_scheduling(void)
 	balance_timeout = BALANCE_TIMEOUT * sys_hz();
 	init_timer(&sched_timer);
 	set_timer(&sched_timer, balance_timeout, balance_queues, 0);
+
+#ifdef CONFIG_SMP
+	env_parse("sched_spread", "d", 0, &spread_sys, 0, 1);
+
+	if (machine.processors_count > 1) {
+		migrate_timeout = sys_hz() / MIGRATE_FREQ;
+		if (migrate_timeout == 0)
+			migrate_timeout = 1;
+		init_timer(&migrate_timer);
+		set_timer(&migrate_timer, migrate_timeout, balance_cpus, 0);
+	}
+#endif
 }
 
 /*===========================================================================*
@@ -364,3 +430,82 @@ static void balance_queues(struct timer *tp)
 
 	set_timer(&sched_timer, balance_timeout, balance_queues, 0);
 }
+
+#ifdef CONFIG_SMP
+/*===========================================================================*
+ *				balance_cpus				     *
+ *===========================================================================*/
+
+/* This function is called MIGRATE_FREQ times a second to even out the load of
+ * the cpus.  If the busiest cpu has at least two runnable processes more than
+ * the least loaded one, one process that keeps running out of quantum is
+ * moved over.  A process that has been moved recently is left alone so that
+ * it can make use of its cache.
+ */
+static void balance_cpus(struct timer *tp)
+{
+	struct schedproc *rmp, *victim;
+	unsigned c, busiest, idlest, old_cpu;
+	int proc_nr;
+
+	balance_round++;
+
+	busiest = machine.bsp_id;
+	idlest = NO_CPU;
+	for (c = 0; c < machine.processors_count; c++) {
+		if (!cpu_seen[c]) {
+			cpu_load[c] /= 2;
+			cpu_runq[c] /= 2;
+		}
+		cpu_seen[c] = FALSE;
+
+		if (!cpu_is_available(c))
+			continue;
+		if (cpu_weight(c) > cpu_weight(busiest))
+			busiest = c;
+		/* as in pick_cpu(), leave the BSP to the system processes
+		 * unless they are spread over all cpus as well
+		 */
+		if (c == machine.bsp_id && !spread_sys)
+			continue;
+		if (idlest == NO_CPU || cpu_weight(c) < cpu_weight(idlest))
+			idlest = c;
+	}
+
+	victim = NULL;
+	if (idlest != NO_CPU && busiest != idlest &&
+			cpu_runq[busiest] >= cpu_runq[idlest] + 2) {
+		for (proc_nr=0, rmp=schedproc; proc_nr < NR_PROCS;
+						proc_nr++, rmp++) {
+			if (!(rmp->flags & IN_USE) || rmp->cpu != busiest)
+				continue;
+			if (!may_migrate(rmp) || rmp->noquantum == 0)
+				continue;
+			if (rmp->last_migrate != 0 &&
+				balance_round - rmp->last_migrate < AFFINITY_ROUNDS)
+				continue;
+			if (victim == NULL || rmp->noquantum > victim->noquantum)
+				victim = rmp;
+		}
+	}
+
+	if (victim != NULL) {
+		old_cpu = victim->cpu;
+		victim->cpu = idlest;
+		if (schedule_process_migrate(victim) == OK) {
+			victim->last_migrate = balance_round;
+			cpu_proc[old_cpu]--;
+			cpu_proc[idlest]++;
+			cpu_runq[old_cpu]--;
+			cpu_runq[idlest]++;
+		} else {
+			victim->cpu = old_cpu;
+		}
+	}
+
+	for (proc_nr=0, rmp=schedproc; proc_nr < NR_PROCS; proc_nr++, rmp++)
+		rmp->noquantum = 0;
+
+	set_timer(&migrate_timer, migrate_timeout, balance_cpus, 0);
+}
+#endif
@@ -2,14 +2,28 @@
 #define __VFS_CONST_H__
 
 /* Tables sizes */
-#define NR_FILPS         512	/* # slots in filp table */
+#define NR_FILPS         512	/* # slots in filp table, unless set at boot */
+#define NR_FILPS_MIN	  64	/* least # filps settable at boot */
+#define NR_FILPS_MAX	8192	/* most # filps settable at boot */
 #define NR_LOCKS           8	/* # slots in the file locking table */
 #define NR_MNTS           16 	/* # slots in mount table */
-#define NR_VNODES        512	/* # slots in vnode table */
-#define NR_WTHREADS	   8	/* # slots in worker thread table */
+#define NR_VNODES        512	/* # slots in vnode table, unless set at boot */
+#define NR_VNODES_MIN	  64	/* least # vnodes settable at boot */
+#define NR_VNODES_MAX	8192	/* most # vnodes settable at boot */
+#define NR_WTHREADS	  32	/* # slots in worker thread table */
+#define WTHREADS_MIN	   8	/* # worker threads that always exist */
+#define WTHREADS_SPARE	   2	/* # idle worker threads kept above minimum */
 
 #define NR_NONEDEVS	NR_MNTS	/* # slots in nonedev bitmap */
 
+#define PIPE_SIZE	65536	/* # bytes a pipe holds, unless set at boot */
+#define PIPE_SIZE_MAX	(1024 * 1024)	/* most # bytes settable at boot */
+#define PIPE_SIZE_INIT	4096	/* size of a pipe buffer when first used */
+
+#define NR_DCACHE	1024	/* # slots in name lookup cache */
+#define DC_HASH_SIZE	 256	/* # hash chains in name lookup cache */
+#define DC_NAME_MAX	  28	/* longest name kept in name lookup cache */
+
 /* Miscellaneous constants */
 #define SU_UID 	 ((uid_t) 0)	/* super_user's uid_t */
 #define SYS_UID  ((uid_t) 0)	/* uid_t for system processes and INIT */
@@ -0,0 +1,297 @@
+/* This file contains the name lookup cache. For every file system, it
+ * remembers which inode a name in a directory refers to, or that there is no
+ * such name, so that path lookups need not go to the file system for each
+ * component. Only file systems on real devices are cached; all changes to
+ * those go through VFS, which purges the affected entries.
+ *
+ * The entry points are:
+ *
+ *  init_dcache - initialize the cache
+ *  dc_enabled - tell whether names on a file system are cached
+ *  dc_generation - get the generation to pass to dc_enter
+ *  dc_lookup - find the entry for a name in a directory
+ *  dc_enter - remember a name, or that it does not exist
+ *  dc_purge - forget a name in a directory
+ *  dc_purge_dir - forget a name that may refer to a removed directory
+ *  dc_purge_ino - forget all names of an inode
+ *  dc_purge_fs - forget all names on a file system
+ */
+
+#include "fs.h"
+#include <string.h>
+#include <assert.h>
+#include <sys/stat.h>
+#include "vmnt.h"
+#include "dcache.h"
+
+static struct dcache dcache[NR_DCACHE];
+static struct dcache *dc_hash[DC_HASH_SIZE];
+static struct dcache dc_lru;	/* dc_next is most, dc_prev least recently
+				 * used */
+static unsigned int dc_gen;	/* bumped by every purge */
+
+static unsigned int dc_hashval(endpoint_t fs_e, ino_t dir_ino, char *name,
+	size_t len);
+static void dc_unlink(struct dcache *dc);
+static void dc_use(struct dcache *dc);
+static void dc_drop(struct dcache *dc);
+
+/*===========================================================================*
+ *				init_dcache				     *
+ *===========================================================================*/
+void init_dcache(void)
+{
+  struct dcache *dc;
+
+  memset(dc_hash, 0, sizeof(dc_hash));
+  dc_lru.dc_next = dc_lru.dc_prev = &dc_lru;
+
+  for (dc = &dcache[0]; dc < &dcache[NR_DCACHE]; ++dc) {
+	dc->dc_fs_e = NONE;
+	dc->dc_hnext = NULL;
+	dc->dc_next = &dc_lru;
+	dc->dc_prev = dc_lru.dc_prev;
+	dc_lru.dc_prev->dc_next = dc;
+	dc_lru.dc_prev = dc;
+  }
+
+  dc_gen = 0;
+}
+
+/*===========================================================================*
+ *				dc_enabled				     *
+ *===========================================================================*/
+int dc_enabled(endpoint_t fs_e)
+{
+/* Names are only cached for file systems that live on a device. Pseudo file
+ * systems (e.g., procfs) change their contents behind VFS' back.
+ */
+  struct vmnt *vmp;
+
+  if ((vmp = find_vmnt(fs_e)) == NULL) return(0);
+
+  return(vmp->m_dev != NO_DEV && !is_nonedev(vmp->m_dev) &&
+	 !(vmp->m_flags & VMNT_MOUNTING));
+}
+
+/*===========================================================================*
+ *				dc_generation				     *
+ *===========================================================================*/
+unsigned int dc_generation(void)
+{
+/* A lookup at the file system can race with a request that changes the
+ * directory. Get the generation before sending the lookup and pass it to
+ * dc_enter, so that a result that may be stale is not entered.
+ */
+  return(dc_gen);
+}
+
+/*===========================================================================*
+ *				dc_hashval				     *
+ *===========================================================================*/
+static unsigned int dc_hashval(endpoint_t fs_e, ino_t dir_ino, char *name,
+	size_t len)
+{
+  unsigned int h;
+
+  h = (unsigned int) fs_e * 31 + (unsigned int) dir_ino;
+  while (len-- > 0)
+	h = h * 33 + (unsigned char) *name++;
+
+  return(h % DC_HASH_SIZE);
+}
+
+/*===========================================================================*
+ *				dc_unlink				     *
+ *===========================================================================*/
+static void dc_unlink(struct dcache *dc)
+{
+/* Remove an entry from its hash chain. */
+  struct dcache **dcp;
+
+  dcp = &dc_hash[dc_hashval(dc->dc_fs_e, dc->dc_dir, dc->dc_name,
+	dc->dc_len)];
+  while (*dcp != dc) {
+	assert(*dcp != NULL);
+	dcp = &(*dcp)->dc_hnext;
+  }
+  *dcp = dc->dc_hnext;
+  dc->dc_hnext = NULL;
+}
+
+/*===========================================================================*
+ *				dc_use					     *
+ *===========================================================================*/
+static void dc_use(struct dcache *dc)
+{
+/* Make an entry the most recently used one. */
+  dc->dc_prev->dc_next = dc->dc_next;
+  dc->dc_next->dc_prev = dc->dc_prev;
+
+  dc->dc_prev = &dc_lru;
+  dc->dc_next = dc_lru.dc_next;
+  dc_lru.dc_next->dc_prev = dc;
+  dc_lru.dc_next = dc;
+}
+
+/*===========================================================================*
+ *				dc_drop					     *
+ *===========================================================================*/
+static void dc_drop(struct dcache *dc)
+{
+/* Free an entry and make it the first one to be reused. */
+  dc_unlink(dc);
+  dc->dc_fs_e = NONE;
+
+  dc->dc_prev->dc_next = dc->dc_next;
+  dc->dc_next->dc_prev = dc->dc_prev;
+
+  dc->dc_next = &dc_lru;
+  dc->dc_prev = dc_lru.dc_prev;
+  dc_lru.dc_prev->dc_next = dc;
+  dc_lru.dc_prev = dc;
+}
+
+/*===========================================================================*
+ *				dc_lookup				     *
+ *===========================================================================*/
+struct dcache *dc_lookup(endpoint_t fs_e, ino_t dir_ino, char *name,
+	size_t len)
+{
+/* Find the entry for the first 'len' characters of 'name' in directory
+ * 'dir_ino'. The result is only valid until the calling thread blocks.
+ */
+  struct dcache *dc;
+
+  if (len > DC_NAME_MAX) return(NULL);
+
+  dc = dc_hash[dc_hashval(fs_e, dir_ino, name, len)];
+  for (; dc != NULL; dc = dc->dc_hnext) {
+	if (dc->dc_fs_e == fs_e && dc->dc_dir == dir_ino &&
+	    dc->dc_len == len && memcmp(dc->dc_name, name, len) == 0) {
+		dc_use(dc);
+		return(dc);
+	}
+  }
+
+  return(NULL);
+}
+
+/*===========================================================================*
+ *				dc_enter				     *
+ *===========================================================================*/
+void dc_enter(unsigned int gen, endpoint_t fs_e, ino_t dir_ino, char *name,
+	size_t len, lookup_res_t *res)
+{
+/* Remember what the name refers to, or that it does not exist if 'res' is
+ * NULL. 'gen' is what dc_generation returned before the lookup was sent.
+ */
+  struct dcache *dc;
+
+  if (gen != dc_gen || len > DC_NAME_MAX || !dc_enabled(fs_e)) return;
+
+  if ((dc = dc_lookup(fs_e, dir_ino, name, len)) == NULL) {
+	/* Reuse the least recently used entry */
+	dc = dc_lru.dc_prev;
+	if (dc->dc_fs_e != NONE) dc_unlink(dc);
+	dc_use(dc);
+
+	dc->dc_fs_e = fs_e;
+	dc->dc_dir = dir_ino;
+	dc->dc_len = len;
+	memcpy(dc->dc_name, name, len);
+
+	dc->dc_hnext = dc_hash[dc_hashval(fs_e, dir_ino, name, len)];
+	dc_hash[dc_hashval(fs_e, dir_ino, name, len)] = dc;
+  }
+
+  if (res != NULL) {
+	dc->dc_ino = res->inode_nr;
+	dc->dc_mode = res->fmode;
+	dc->dc_uid = res->uid;
+	dc->dc_gid = res->gid;
+  } else {
+	dc->dc_ino = 0;
+	dc->dc_mode = 0;
+	dc->dc_uid = (uid_t) -1;
+	dc->dc_gid = (gid_t) -1;
+  }
+}
+
+/*===========================================================================*
+ *				dc_purge				     *
+ *===========================================================================*/
+void dc_purge(endpoint_t fs_e, ino_t dir_ino, char *name)
+{
+/* A name in a directory was created or removed. */
+  struct dcache *dc;
+
+  dc_gen++;
+
+  if ((dc = dc_lookup(fs_e, dir_ino, name, strlen(name))) != NULL)
+	dc_drop(dc);
+}
+
+/*===========================================================================*
+ *				dc_purge_dir				     *
+ *===========================================================================*/
+void dc_purge_dir(endpoint_t fs_e, ino_t dir_ino, char *name)
+{
+/* A name in a directory was removed or replaced, and it may have been a
+ * directory. Its inode number can be reused for a new directory, so the
+ * names cached in it have to go as well. If we do not know what the name
+ * referred to, forget about the whole file system.
+ */
+  struct dcache *dc;
+  ino_t ino;
+
+  dc_gen++;
+
+  if ((dc = dc_lookup(fs_e, dir_ino, name, strlen(name))) == NULL) {
+	dc_purge_fs(fs_e);
+	return;
+  }
+
+  ino = dc->dc_ino;
+  if (ino != 0 && S_ISDIR(dc->dc_mode)) {
+	for (dc = &dcache[0]; dc < &dcache[NR_DCACHE]; ++dc) {
+		if (dc->dc_fs_e == fs_e &&
+		    (dc->dc_dir == ino || dc->dc_ino == ino))
+			dc_drop(dc);
+	}
+  } else {
+	dc_drop(dc);
+  }
+}
+
+/*===========================================================================*
+ *				dc_purge_ino				     *
+ *===========================================================================*/
+void dc_purge_ino(endpoint_t fs_e, ino_t ino)
+{
+/* The mode or owner of an inode changed. */
+  struct dcache *dc;
+
+  dc_gen++;
+
+  for (dc = &dcache[0]; dc < &dcache[NR_DCACHE]; ++dc)
+	if (dc->dc_fs_e == fs_e && dc->dc_ino == ino)
+		dc_drop(dc);
+}
+
+/*===========================================================================*
+ *				dc_purge_fs				     *
+ *===========================================================================*/
+void dc_purge_fs(endpoint_t fs_e)
+{
+/* Forget all names on a file system, or on all file systems if 'fs_e' is
+ * NONE.
+ */
+  struct dcache *dc;
+
+  dc_gen++;
+
+  for (dc = &dcache[0]; dc < &dcache[NR_DCACHE]; ++dc)
+	if (dc->dc_fs_e != NONE && (fs_e == NONE || dc->dc_fs_e == fs_e))
+		dc_drop(dc);
+}
@@ -0,0 +1,21 @@
+#ifndef __VFS_DCACHE_H__
+#define __VFS_DCACHE_H__
+
+/* Name lookup cache entry. An entry with dc_ino == 0 records that the name
+ * does not exist in the directory.
+ */
+struct dcache {
+  endpoint_t dc_fs_e;		/* FS process' endpoint number, or NONE */
+  ino_t dc_dir;			/* inode number of the directory */
+  ino_t dc_ino;			/* inode number the name refers to, or 0 */
+  mode_t dc_mode;		/* file type and protection of dc_ino */
+  uid_t dc_uid;			/* owner of dc_ino */
+  gid_t dc_gid;			/* group of dc_ino */
+  struct dcache *dc_hnext;	/* next entry in the hash chain */
+  struct dcache *dc_next;	/* next entry in LRU order */
+  struct dcache *dc_prev;	/* previous entry in LRU order */
+  unsigned char dc_len;		/* length of dc_name */
+  char dc_name[DC_NAME_MAX];	/* name, not null terminated */
+};
+
+#endif
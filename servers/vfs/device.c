@@ -916,11 +916,12 @@ int clone_opcl(
                 vp->v_dev = NO_DEV;
 		vp->v_fs_e = res.fs_e;
                 vp->v_inode_nr = res.inode_nr;
+		hash_vnode(vp);
                 vp->v_mode = res.fmode;
                 vp->v_sdev = dev;
                 vp->v_fs_count = 1;
                 vp->v_ref_count = 1;
-		fp->fp_filp[scratch(fp).file.fd_nr]->filp_vno = vp;
+		set_filp_vno(fp->fp_filp[scratch(fp).file.fd_nr], vp);
 	}
 	dev_mess.REP_STATUS = OK;
   }
@@ -961,7 +962,7 @@ void bdev_up(int maj)
    * device, we need to reopen it on the new driver.
    */
   found = 0;
-  for (rfilp = filp; rfilp < &filp[NR_FILPS]; rfilp++) {
+  for (rfilp = filp; rfilp < &filp[nr_filps]; rfilp++) {
 	if (rfilp->filp_count < 1 || !(vp = rfilp->filp_vno)) continue;
 	if (major(vp->v_sdev) != maj) continue;
 	if (!S_ISBLK(vp->v_mode)) continue;
@@ -1020,7 +1021,7 @@ void cdev_up(int maj)
   }
 
   needs_reopen= FALSE;
-  for (rfilp = filp; rfilp < &filp[NR_FILPS]; rfilp++) {
+  for (rfilp = filp; rfilp < &filp[nr_filps]; rfilp++) {
 	if (rfilp->filp_count < 1 || !(vp = rfilp->filp_vno)) continue;
 	if (major(vp->v_sdev) != maj) continue;
 	if (!S_ISCHR(vp->v_mode)) continue;
@@ -1063,7 +1064,7 @@ int maj;
   struct fproc *rfp;
 
   if (maj < 0 || maj >= NR_DEVICES) panic("VFS: out-of-bound major");
-  for (rfilp = filp; rfilp < &filp[NR_FILPS]; rfilp++) {
+  for (rfilp = filp; rfilp < &filp[nr_filps]; rfilp++) {
 	if (rfilp->filp_count < 1 || !(vp = rfilp->filp_vno)) continue;
 	if (rfilp->filp_state != FS_NEEDS_REOPEN) continue;
 	if ((vp->v_mode & I_TYPE) != I_CHAR_SPECIAL) continue;
@@ -1155,7 +1156,7 @@ void reopen_reply()
   filp_no = job_m_in.REP_ENDPT;
   status = job_m_in.REP_STATUS;
 
-  if (filp_no < 0 || filp_no >= NR_FILPS) {
+  if (filp_no < 0 || filp_no >= nr_filps) {
 	printf("VFS: reopen_reply: bad filp number %d from driver %d\n",
 		filp_no, driver_e);
 	return;
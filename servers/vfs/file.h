@@ -26,7 +26,16 @@ EXTERN struct filp {
 
   /* following are for fd-type-specific select() */
   int filp_pipe_select_ops;
-} filp[NR_FILPS];
+
+  struct knote *filp_knotes;	/* event queue registrations on this filp */
+
+  struct filp *filp_nextfree;	/* next filp on the free list */
+  char filp_onfree;		/* set if on the free list */
+  struct filp *filp_vnext;	/* next filp on filp_vno's list */
+  struct filp **filp_vprev;	/* pointer to us in that list, or NULL */
+} *filp;
+
+EXTERN int nr_filps;		/* # slots in filp table */
 
 #define FILP_CLOSED	0	/* filp_mode: associated device closed */
 
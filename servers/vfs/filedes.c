@@ -2,8 +2,10 @@
  *
  * The entry points into this file are
  *   get_fd:	    look for free file descriptor and free filp slots
+ *   free_filp:	    put a filp slot that is not used anymore on the free list
  *   get_filp:	    look up the filp entry for a given file descriptor
  *   find_filp:	    find a filp slot that points to a given vnode
+ *   set_filp_vno:  set the vnode a filp slot refers to
  *   inval_filp:    invalidate a filp and associated fd's, only let close()
  *                  happen on it
  *   do_verify_fd:  verify whether the given file descriptor is valid for
@@ -19,6 +21,7 @@
 #include <minix/callnr.h>
 #include <minix/u64.h>
 #include <assert.h>
+#include <stdlib.h>
 #include "fs.h"
 #include "file.h"
 #include "fproc.h"
@@ -27,6 +30,8 @@
 
 static filp_id_t verify_fd(endpoint_t ep, int fd);
 
+static struct filp *free_filps;	/* filps that may be free */
+
 #if LOCK_DEBUG
 /*===========================================================================*
  *				check_filp_locks			     *
@@ -37,7 +42,7 @@ void check_filp_locks_by_me(void)
   struct filp *f;
   int r;
 
-  for (f = &filp[0]; f < &filp[NR_FILPS]; f++) {
+  for (f = &filp[0]; f < &filp[nr_filps]; f++) {
 	r = mutex_trylock(&f->filp_lock);
 	if (r == -EDEADLK)
 		panic("Thread %d still holds filp lock on filp %p call_nr=%d\n",
@@ -58,7 +63,7 @@ void check_filp_locks(void)
   struct filp *f;
   int r, count = 0;
 
-  for (f = &filp[0]; f < &filp[NR_FILPS]; f++) {
+  for (f = &filp[0]; f < &filp[nr_filps]; f++) {
 	r = mutex_trylock(&f->filp_lock);
 	if (r == -EBUSY) {
 		/* Mutex is still locked */
@@ -80,11 +85,22 @@ void check_filp_locks(void)
  *===========================================================================*/
 void init_filps(void)
 {
-/* Initialize filps */
+/* Allocate and initialize filps. The size of the table can be set with a boot
+ * parameter. */
   struct filp *f;
+  long nr;
+
+  nr = NR_FILPS;
+  (void) env_parse("vfs_filps", "d", 0, &nr, NR_FILPS_MIN, NR_FILPS_MAX);
+  nr_filps = (int) nr;
+
+  if ((filp = calloc(nr_filps, sizeof(struct filp))) == NULL)
+	panic("VFS: unable to allocate %d filps", nr_filps);
 
-  for (f = &filp[0]; f < &filp[NR_FILPS]; f++) {
+  free_filps = NULL;
+  for (f = &filp[nr_filps - 1]; f >= &filp[0]; f--) {
 	mutex_init(&f->filp_lock, NULL);
+	free_filp(f);
   }
 
 }
@@ -101,6 +117,7 @@ int get_fd(int start, mode_t bits, int *k, struct filp **fpt)
 
   register struct filp *f;
   register int i;
+  int pass;
 
   /* Search the fproc fp_filp table for a free file descriptor. */
   for (i = start; i < OPEN_MAX; i++) {
@@ -117,28 +134,57 @@ int get_fd(int start, mode_t bits, int *k, struct filp **fpt)
   /* If we don't care about a filp, return now */
   if (fpt == NULL) return(OK);
 
-  /* Now that a file descriptor has been found, look for a free filp slot. */
-  for (f = &filp[0]; f < &filp[NR_FILPS]; f++) {
-	assert(f->filp_count >= 0);
-	if (f->filp_count == 0 && mutex_trylock(&f->filp_lock) == 0) {
-		f->filp_mode = bits;
-		f->filp_pos = cvu64(0);
-		f->filp_selectors = 0;
-		f->filp_select_ops = 0;
-		f->filp_pipe_select_ops = 0;
-		f->filp_flags = 0;
-		f->filp_state = FS_NORMAL;
-		f->filp_select_flags = 0;
-		f->filp_softlock = NULL;
-		*fpt = f;
-		return(OK);
+  /* Now that a file descriptor has been found, look for a free filp slot on
+   * the free list. The slot stays at the head of the list until it turns out
+   * to be in use, as the open() may still fail. If the list runs dry, rebuild
+   * it from the table once.
+   */
+  for (pass = 0; pass < 2; pass++) {
+	while ((f = free_filps) != NULL) {
+		assert(f->filp_count >= 0);
+		if (f->filp_count == 0 && mutex_trylock(&f->filp_lock) == 0) {
+			f->filp_mode = bits;
+			f->filp_pos = cvu64(0);
+			f->filp_selectors = 0;
+			f->filp_select_ops = 0;
+			f->filp_pipe_select_ops = 0;
+			f->filp_flags = 0;
+			f->filp_state = FS_NORMAL;
+			f->filp_select_flags = 0;
+			f->filp_softlock = NULL;
+			*fpt = f;
+			return(OK);
+		}
+
+		/* In use after all */
+		free_filps = f->filp_nextfree;
+		f->filp_onfree = FALSE;
 	}
+
+	if (pass > 0) break;
+
+	for (f = &filp[0]; f < &filp[nr_filps]; f++)
+		if (f->filp_count == 0) free_filp(f);
   }
 
   /* If control passes here, the filp table must be full.  Report that back. */
   return(ENFILE);
 }
 
+/*===========================================================================*
+ *				free_filp				     *
+ *===========================================================================*/
+void free_filp(struct filp *f)
+{
+/* Put a filp slot that is not used anymore on the free list. */
+
+  if (f->filp_onfree) return;
+
+  f->filp_onfree = TRUE;
+  f->filp_nextfree = free_filps;
+  free_filps = f;
+}
+
 
 /*===========================================================================*
  *				get_filp				     *
@@ -184,12 +230,12 @@ struct filp *find_filp(struct vnode *vp, mode_t bits)
  * by the mode bit 'bits'. Used for determining whether somebody is still
  * interested in either end of a pipe.  Also used when opening a FIFO to
  * find partners to share a filp field with (to shared the file position).
- * Like 'get_fd' it performs its job by linear search through the filp table.
+ * Only the filps on the vnode's own list are searched.
  */
 
   struct filp *f;
 
-  for (f = &filp[0]; f < &filp[NR_FILPS]; f++) {
+  for (f = vp->v_filps; f != NULL; f = f->filp_vnext) {
 	if (f->filp_count != 0 && f->filp_vno == vp && (f->filp_mode & bits)) {
 		return(f);
 	}
@@ -199,6 +245,29 @@ struct filp *find_filp(struct vnode *vp, mode_t bits)
   return(NULL);
 }
 
+/*===========================================================================*
+ *				set_filp_vno				     *
+ *===========================================================================*/
+void set_filp_vno(struct filp *f, struct vnode *vp)
+{
+/* Make filp 'f' refer to vnode 'vp', which may be NULL, and move it to that
+ * vnode's list of filps. */
+
+  if (f->filp_vprev != NULL) {
+	*f->filp_vprev = f->filp_vnext;
+	if (f->filp_vnext != NULL) f->filp_vnext->filp_vprev = f->filp_vprev;
+	f->filp_vprev = NULL;
+  }
+
+  f->filp_vno = vp;
+  if (vp == NULL) return;
+
+  f->filp_vnext = vp->v_filps;
+  if (f->filp_vnext != NULL) f->filp_vnext->filp_vprev = &f->filp_vnext;
+  f->filp_vprev = &vp->v_filps;
+  vp->v_filps = f;
+}
+
 /*===========================================================================*
  *				invalidate_filp				     *
  *===========================================================================*/
@@ -228,7 +297,7 @@ void invalidate_filp_by_endpt(endpoint_t proc_e)
 {
   struct filp *f;
 
-  for (f = &filp[0]; f < &filp[NR_FILPS]; f++) {
+  for (f = &filp[0]; f < &filp[nr_filps]; f++) {
 	if (f->filp_count != 0 && f->filp_vno != NULL) {
 		if (f->filp_vno->v_fs_e == proc_e)
 			(void) invalidate_filp(f);
@@ -586,8 +655,9 @@ struct filp *f;
 
 	unlock_vnode(f->filp_vno);
 	put_vnode(f->filp_vno);
-	f->filp_vno = NULL;
+	set_filp_vno(f, NULL);
 	f->filp_mode = FILP_CLOSED;
+	free_filp(f);
   } else if (f->filp_count < 0) {
 	panic("VFS: invalid filp count: %d ino %d/%d", f->filp_count,
 	      vp->v_dev, vp->v_inode_nr);
@@ -3,6 +3,7 @@
 
 #include "threads.h"
 
+#include <sys/queue.h>
 #include <sys/select.h>
 #include <minix/safecopies.h>
 
@@ -45,6 +46,7 @@ EXTERN struct fproc {
   message *fp_sendrec;		/* request/reply to/from FS/driver */
   mutex_t fp_lock;		/* mutex to lock fproc object */
   struct job fp_job;		/* pending job */
+  TAILQ_ENTRY(fproc) fp_pending;	/* queue of processes with pending job */
   thread_t fp_wtid;		/* Thread ID of worker */
   char fp_name[PROC_NAME_LEN];	/* Last exec() */
 #if LOCK_DEBUG
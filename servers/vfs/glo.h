@@ -10,6 +10,7 @@
 /* File System global variables */
 EXTERN struct fproc *fp;	/* pointer to caller's fproc struct */
 EXTERN int susp_count;		/* number of procs suspended on pipe */
+EXTERN size_t pipe_size;	/* max. number of bytes held by a pipe */
 EXTERN int nr_locks;		/* number of locks currently in place */
 EXTERN int reviving;		/* number of pipe processes to be revived */
 EXTERN int pending;
@@ -39,6 +40,8 @@ EXTERN int deadlock_resolving;
 EXTERN mutex_t exec_lock;
 EXTERN mutex_t bsf_lock;/* Global lock for access to block special files */
 EXTERN struct worker_thread workers[NR_WTHREADS];
+EXTERN int wthreads_min;	/* # worker threads that always exist */
+EXTERN int wthreads_max;	/* # worker threads that may exist */
 EXTERN struct worker_thread sys_worker;
 EXTERN struct worker_thread dl_worker;
 EXTERN thread_t invalid_thread_id;
@@ -77,7 +77,8 @@ int main(void)
   /* SEF local startup. */
   sef_local_startup();
 
-  printf("Started VFS: %d worker thread(s)\n", NR_WTHREADS);
+  printf("Started VFS: %d to %d worker thread(s)\n", wthreads_min,
+	wthreads_max);
 
   /* This is the main loop that gets work, processes it, and sends replies. */
   while (TRUE) {
@@ -141,13 +142,15 @@ int main(void)
 static void handle_work(void *(*func)(void *arg))
 {
 /* Handle asynchronous device replies and new system calls. If the originating
- * endpoint is an FS endpoint, take extra care not to get in deadlock. */
+ * endpoint is an FS endpoint, take extra care not to get in deadlock. VM never
+ * waits for us (its calls are answered asynchronously), so its calls can
+ * always wait for a worker thread. */
   struct vmnt *vmp = NULL;
   endpoint_t proc_e;
 
   proc_e = m_in.m_source;
 
-  if (fp->fp_flags & FP_SYS_PROC) {
+  if ((fp->fp_flags & FP_SYS_PROC) && proc_e != VM_PROC_NR) {
 	if (worker_available() == 0) {
 		if (!deadlock_resolving) {
 			if ((vmp = find_vmnt(proc_e)) != NULL) {
@@ -414,6 +417,8 @@ static void *do_work(void *arg)
 	error = do_mapdriver();
   } else if (job_call_nr == COMMON_GETSYSINFO) {
 	error = do_getsysinfo();
+  } else if (job_call_nr == VFS_VMCALL) {
+	error = do_vm_call();
   } else if (IS_PFS_VFS_RQ(job_call_nr)) {
 	if (who_e != PFS_PROC_NR) {
 		printf("VFS: only PFS is allowed to make nested VFS calls\n");
@@ -555,9 +560,7 @@ static int sef_cb_init_fresh(int UNUSED(type), sef_init_info_t *info)
   if (s != OK) panic("VFS: can't subscribe to driver events (%d)", s);
 
   /* Initialize worker threads */
-  for (i = 0; i < NR_WTHREADS; i++)  {
-	worker_init(&workers[i]);
-  }
+  worker_init_pool();
   worker_init(&sys_worker); /* exclusive system worker thread */
   worker_init(&dl_worker); /* exclusive worker thread to resolve deadlocks */
 
@@ -580,9 +583,11 @@ static int sef_cb_init_fresh(int UNUSED(type), sef_init_info_t *info)
   }
 
   init_vnodes();		/* init vnodes */
+  init_dcache();		/* init name lookup cache */
   init_vmnts();			/* init vmnt structures */
-  init_select();		/* init select() structures */
   init_filps();			/* Init filp structures */
+  init_select();		/* init select() structures, sized by filps */
+  init_pipes();			/* Init pipe buffer size */
   mount_pfs();			/* mount Pipe File Server */
   worker_start(do_init_root);	/* mount initial ramdisk as file system root */
   yield();			/* force do_init_root to start */
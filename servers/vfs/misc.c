@@ -15,6 +15,7 @@
  *   do_revive:	  revive a process that was waiting for something (e.g. TTY)
  *   do_svrctl:	  file system control
  *   do_getsysinfo:	request copy of FS data structure
+ *   do_vm_call:  perform a file request on behalf of VM (file mmap)
  *   pm_dumpcore: create a core dump
  */
 
@@ -101,6 +102,125 @@ int do_getsysinfo()
   return sys_datacopy(SELF, src_addr, who_e, dst_addr, len);
 }
 
+/*===========================================================================*
+ *				do_vm_call				     *
+ *===========================================================================*/
+int do_vm_call()
+{
+/* VM needs a file operation to back a file mapping. VM cannot block on us
+ * (we may need VM ourselves), so it sends its requests asynchronously and we
+ * answer the same way, with a VM_VFS_REPLY message.
+ */
+  int req, fild, req_id, r, slot, nfd;
+  endpoint_t ep;
+  struct fproc *rfp;
+  struct filp *f;
+  struct vnode *vp;
+  off_t offset;
+  size_t len;
+  vir_bytes buf;
+  mode_t bits;
+  tll_access_t locktype;
+  u64_t new_pos;
+  unsigned int cum_io;
+  message m;
+
+  if (who_e != VM_PROC_NR) return(EPERM);
+
+  req = job_m_in.VFS_VMCALL_REQ;
+  fild = job_m_in.VFS_VMCALL_FD;
+  req_id = job_m_in.VFS_VMCALL_REQID;
+
+  memset(&m, 0, sizeof(m));
+  m.VMV_FD = fild;
+
+  switch (req) {
+  case VMVFSREQ_FDLOOKUP:
+	/* Give VM its own descriptor for the given descriptor of process 'ep', so
+	 * that the file stays open as long as it is mapped.
+	 */
+	ep = job_m_in.VFS_VMCALL_ENDPOINT;
+	bits = (mode_t) job_m_in.VFS_VMCALL_MODE;
+	if (isokendpt(ep, &slot) != OK) {
+		r = EINVAL;
+		break;
+	}
+	rfp = &fproc[slot];
+	if ((f = get_filp2(rfp, fild, VNODE_READ)) == NULL) {
+		r = err_code;
+		break;
+	}
+	vp = f->filp_vno;
+	if (!S_ISREG(vp->v_mode)) {
+		r = ENODEV;
+	} else if ((f->filp_mode & bits) != bits) {
+		r = EACCES;
+	} else if ((r = get_fd(0, 0, &nfd, NULL)) == OK) {
+		f->filp_count++;
+		fp->fp_filp[nfd] = f;
+		FD_SET(nfd, &fp->fp_filp_inuse);
+		m.VMV_FD = nfd;
+		m.VMV_DEV = vp->v_dev;
+		m.VMV_INO = vp->v_inode_nr;
+		m.VMV_SIZE = vp->v_size;
+		m.VMV_FS = vp->v_fs_e;
+	}
+	unlock_filp(f);
+	break;
+
+  case VMVFSREQ_FDCLOSE:
+	r = close_fd(fp, fild);
+	break;
+
+  case VMVFSREQ_FDREAD:
+  case VMVFSREQ_FDWRITE:
+	offset = (off_t) job_m_in.VFS_VMCALL_OFFSET;
+	len = (size_t) job_m_in.VFS_VMCALL_LENGTH;
+	buf = (vir_bytes) job_m_in.VFS_VMCALL_ADDR;
+	locktype = (req == VMVFSREQ_FDREAD) ? VNODE_READ : VNODE_WRITE;
+
+	if ((f = get_filp2(fp, fild, locktype)) == NULL) {
+		r = err_code;
+		break;
+	}
+	vp = f->filp_vno;
+
+	/* Reads past the end simply come up short. Writes never extend the
+	 * file: a mapping cannot change the file size.
+	 */
+	r = OK;
+	cum_io = 0;
+	if (offset < 0) {
+		r = EINVAL;
+	} else if (req == VMVFSREQ_FDWRITE) {
+		if (offset >= vp->v_size) len = 0;
+		else if (len > (size_t) (vp->v_size - offset))
+			len = (size_t) (vp->v_size - offset);
+	}
+	if (r == OK && len > 0) {
+		r = req_readwrite(vp->v_fs_e, vp->v_inode_nr, cvul64(offset),
+			(req == VMVFSREQ_FDREAD) ? READING : WRITING,
+			VM_PROC_NR, (char *) buf, len, &new_pos, &cum_io);
+	}
+	if (r == OK) r = (int) cum_io;
+	unlock_filp(f);
+	break;
+
+  default:
+	r = ENOSYS;
+	break;
+  }
+
+  m.m_type = VM_VFS_REPLY;
+  m.VMV_RESULT = r;
+  m.VMV_REQID = req_id;
+  if ((r = asynsend3(VM_PROC_NR, &m, AMF_NOREPLY)) != OK)
+	panic("VFS: asynsend to VM failed: %d", r);
+
+  return(SUSPEND);		/* the reply has been sent already */
+}
+
+
 /*===========================================================================*
  *				do_dup					     *
  *===========================================================================*/
@@ -510,7 +630,7 @@ static void free_proc(struct fproc *exiter, int flags)
   /* Exit done. Mark slot as free. */
   exiter->fp_pid = PID_FREE;
   if (exiter->fp_flags & FP_PENDING)
-	pending--;	/* No longer pending job, not going to do it */
+	worker_forget(exiter);	/* No longer pending job, not going to do it */
   exiter->fp_flags = FP_NOFLAGS;
 }
 
@@ -660,7 +780,7 @@ int do_svrctl()
 				sysgetenv.vallen = 0;
 				r = OK;
 			} else if (!strcmp(search_key, "active_threads")) {
-				int active = NR_WTHREADS - worker_available();
+				int active = worker_busy();
 				sprintf(small_buf, "%d", active);
 				sysgetenv.vallen = strlen(small_buf);
 				r = OK;
@@ -57,7 +57,7 @@ static void update_bspec(dev_t dev, endpoint_t fs_e, int send_drv_e)
   struct dmap *dp;
   int r, major;
 
-  for (vp = &vnode[0]; vp < &vnode[NR_VNODES]; ++vp)
+  for (vp = &vnode[0]; vp < &vnode[nr_vnodes]; ++vp)
 	if (vp->v_ref_count > 0 && S_ISBLK(vp->v_mode) && vp->v_sdev == dev) {
 		vp->v_bfs_e = fs_e;
 		if (send_drv_e) {
@@ -296,6 +296,7 @@ char mount_label[LABEL_MAX] )
   /* Fill in root node's fields */
   root_node->v_fs_e = res.fs_e;
   root_node->v_inode_nr = res.inode_nr;
+  hash_vnode(root_node);
   root_node->v_mode = res.fmode;
   root_node->v_uid = res.uid;
   root_node->v_gid = res.gid;
@@ -369,6 +370,10 @@ char mount_label[LABEL_MAX] )
   new_vmp->m_root_node = root_node;
   strcpy(new_vmp->m_label, mount_label);
 
+  /* Cached names may lead into the mount point now */
+  dc_purge_fs(vp->v_fs_e);
+  dc_purge_fs(fs_e);
+
   /* Allocate the pseudo device that was found, if not using a real device. */
   if (is_nonedev(dev)) alloc_nonedev(dev);
 
@@ -483,7 +488,7 @@ int unmount(
   /* See if the mounted device is busy.  Only 1 vnode using it should be
    * open -- the root vnode -- and that inode only 1 time. */
   locks = count = 0;
-  for (vp = &vnode[0]; vp < &vnode[NR_VNODES]; vp++)
+  for (vp = &vnode[0]; vp < &vnode[nr_vnodes]; vp++)
 	  if (vp->v_ref_count > 0 && vp->v_dev == dev) {
 		count += vp->v_ref_count;
 		if (is_vnode_locked(vp)) locks++;
@@ -494,6 +499,9 @@ int unmount(
 	return(EBUSY);    /* can't umount a busy file system */
   }
 
+  /* Forget about the names on it; the endpoint may be reused */
+  dc_purge_fs(vmp->m_fs_e);
+
   /* Tell FS to drop all inode references for root inode except 1. */
   vnode_clean_refs(vmp->m_root_node);
 
@@ -158,7 +158,7 @@ int common_open(char path[PATH_MAX], int oflags, mode_t omode)
   fp->fp_filp[scratch(fp).file.fd_nr] = filp;
   FD_SET(scratch(fp).file.fd_nr, &fp->fp_filp_inuse);
   filp->filp_count = 1;
-  filp->filp_vno = vp;
+  set_filp_vno(filp, vp);
   filp->filp_flags = oflags;
 
   /* Only do the normal open code if we didn't just create the file. */
@@ -247,7 +247,8 @@ int common_open(char path[PATH_MAX], int oflags, mode_t omode)
 			r = map_vnode(vp, PFS_PROC_NR);
 			if (r == OK) {
 				vp->v_pipe = I_PIPE;
-				if (vp->v_ref_count == 1) {
+				if (vp->v_pipe_buf == NULL) {
+					/* Nothing buffered: start empty */
 					vp->v_pipe_rd_pos = 0;
 					vp->v_pipe_wr_pos = 0;
 					if (vp->v_size != 0)
@@ -270,8 +271,10 @@ int common_open(char path[PATH_MAX], int oflags, mode_t omode)
 				    /* Co-reader or writer found. Use it.*/
 				    fp->fp_filp[scratch(fp).file.fd_nr] = filp2;
 				    filp2->filp_count++;
-				    filp2->filp_vno = vp;
+				    set_filp_vno(filp2, vp);
 				    filp2->filp_flags = oflags;
+				    set_filp_vno(filp, NULL);
+				    free_filp(filp);
 
 				    /* v_count was incremented after the vnode
 				     * has been found. i_count was incremented
@@ -299,7 +302,8 @@ int common_open(char path[PATH_MAX], int oflags, mode_t omode)
 		fp->fp_filp[scratch(fp).file.fd_nr] = NULL;
 		FD_CLR(scratch(fp).file.fd_nr, &fp->fp_filp_inuse);
 		filp->filp_count = 0;
-		filp->filp_vno = NULL;
+		set_filp_vno(filp, NULL);
+		free_filp(filp);
 		put_vnode(vp);
 	}
   } else {
@@ -455,6 +459,7 @@ static struct vnode *new_node(struct lookup *resolve, int oflags, mode_t bits)
 
 	vp->v_fs_e = res.fs_e;
 	vp->v_inode_nr = res.inode_nr;
+	hash_vnode(vp);
 	vp->v_mode = res.fmode;
 	vp->v_size = res.fsize;
 	vp->v_uid = res.uid;
@@ -764,6 +769,9 @@ int fd_nr;
   FD_CLR(fd_nr, &rfp->fp_cloexec_set);
   FD_CLR(fd_nr, &rfp->fp_filp_inuse);
 
+  /* Drop event queue registrations for this file descriptor. */
+  kqueue_close_fd(rfp, fd_nr);
+
   /* Check to see if the file is locked.  If so, release all locks. */
   if (nr_locks > 0) {
 	lock_count = nr_locks;	/* save count of locks */
@@ -22,6 +22,7 @@
 #include "path.h"
 #include "fproc.h"
 #include "param.h"
+#include "dcache.h"
 
 /* Set to following define to 1 if you really want to use the POSIX definition
  * (IEEE Std 1003.1, 2004) of pathname resolution. POSIX requires pathnames
@@ -34,7 +35,15 @@
 #define DO_POSIX_PATHNAME_RES	0
 
 static int lookup(struct vnode *dirp, struct lookup *resolve,
-	node_details_t *node, struct fproc *rfp);
+	node_details_t *node, struct vnode **cached_vp, struct fproc *rfp);
+static int lookup_cached(struct vnode *start_node, struct lookup *resolve,
+	ino_t *dir_ino, ino_t root_ino, uid_t uid, gid_t gid, struct vnode
+	**vpp, struct fproc *rfp);
+static int lookup_step(endpoint_t fs_e, ino_t dir_ino, ino_t root_ino,
+	uid_t uid, gid_t gid, char *comp, size_t len, lookup_res_t *res, struct
+	fproc *rfp);
+static void lookup_putnode(endpoint_t fs_e, ino_t ino);
+static int is_mountpoint(endpoint_t fs_e, ino_t ino);
 static int check_perms(endpoint_t ep, cp_grant_id_t io_gr, size_t
 	pathlen);
 
@@ -49,7 +58,7 @@ struct fproc *rfp;
 /* Resolve a path name starting at dirp to a vnode. */
   int r;
   int do_downgrade = 1;
-  struct vnode *new_vp, *vp;
+  struct vnode *new_vp, *vp, *cached_vp;
   struct vmnt *vmp;
   struct node_details res = {0,0,0,0,0,0,0};
   tll_access_t initial_locktype;
@@ -68,14 +77,41 @@ struct fproc *rfp;
   lock_vnode(new_vp, initial_locktype);
 
   /* Lookup vnode belonging to the file. */
-  if ((r = lookup(dirp, resolve, &res, rfp)) != OK) {
+  if ((r = lookup(dirp, resolve, &res, &cached_vp, rfp)) != OK) {
 	err_code = r;
 	unlock_vnode(new_vp);
 	return(NULL);
   }
 
-  /* Check whether we already have a vnode for that file */
-  if ((vp = find_vnode(res.fs_e, res.inode_nr)) != NULL) {
+  if (cached_vp != NULL) {
+	/* Resolved through the name cache. lookup already took a reference to
+	 * the vnode, and the FS was not involved. */
+	do_downgrade = (lock_vnode(cached_vp, initial_locktype) != EBUSY);
+
+	/* Make sure a put_vnode did not get rid of the vnode, reference and
+	 * all, while we were waiting for the lock. If it did, ask the FS after
+	 * all. */
+	if (cached_vp->v_ref_count == 0) {
+		if (do_downgrade) unlock_vnode(cached_vp);
+		do_downgrade = 1;
+		cached_vp = NULL;
+		if (*(resolve->l_vmp) != NULL) {
+			unlock_vmnt(*(resolve->l_vmp));
+			*(resolve->l_vmp) = NULL;
+		}
+		if ((r = lookup(dirp, resolve, &res, NULL, rfp)) != OK) {
+			err_code = r;
+			unlock_vnode(new_vp);
+			return(NULL);
+		}
+	}
+  }
+
+  if (cached_vp != NULL) {
+	unlock_vnode(new_vp);
+	vp = cached_vp;
+  } else if ((vp = find_vnode(res.fs_e, res.inode_nr)) != NULL) {
+	/* We already have a vnode for that file */
 	unlock_vnode(new_vp);	/* Don't need this anymore */
 	do_downgrade = (lock_vnode(vp, initial_locktype) != EBUSY);
 
@@ -100,6 +136,7 @@ struct fproc *rfp;
 
 	new_vp->v_fs_e = res.fs_e;
 	new_vp->v_inode_nr = res.inode_nr;
+	hash_vnode(new_vp);
 	new_vp->v_mode = res.fmode;
 	new_vp->v_size = res.fsize;
 	new_vp->v_uid = res.uid;
@@ -116,7 +153,7 @@ struct fproc *rfp;
 	vp = new_vp;
   }
 
-  dup_vnode(vp);
+  if (cached_vp == NULL) dup_vnode(vp);
   if (do_downgrade) {
 	/* Only downgrade a lock if we managed to lock it in the first place */
 	*(resolve->l_vnode) = vp;
@@ -334,28 +371,37 @@ struct fproc *rfp;
 /*===========================================================================*
  *				lookup					     *
  *===========================================================================*/
-static int lookup(start_node, resolve, result_node, rfp)
+static int lookup(start_node, resolve, result_node, cached_vp, rfp)
 struct vnode *start_node;
 struct lookup *resolve;
 node_details_t *result_node;
+struct vnode **cached_vp;
 struct fproc *rfp;
 {
-/* Resolve a path name relative to start_node. */
+/* Resolve a path name relative to start_node. If the name cache resolved all
+ * of it, the resulting vnode is returned in 'cached_vp', with a reference
+ * taken already. If 'cached_vp' is NULL, the name cache is not used to find
+ * vnodes.
+ */
 
-  int r, symloop;
+  int r, symloop, flags, cache_it;
   endpoint_t fs_e;
-  size_t path_off, path_left_len;
+  size_t path_off, path_left_len, name_len;
   ino_t dir_ino, root_ino;
   uid_t uid;
   gid_t gid;
+  unsigned int gen;
+  char comp[DC_NAME_MAX + 1];
   struct vnode *dir_vp;
   struct vmnt *vmp, *vmpres;
+  struct dcache *dc;
   struct lookup_res res;
 
   assert(resolve->l_vmp);
   assert(resolve->l_vnode);
 
   *(resolve->l_vmp) = vmpres = NULL; /* No vmnt found nor locked yet */
+  if (cached_vp != NULL) *cached_vp = NULL;
 
   /* Empty (start) path? */
   if (resolve->l_path[0] == '\0') {
@@ -396,9 +442,57 @@ struct fproc *rfp;
   }
   *(resolve->l_vmp) = vmpres;
 
+  /* Resolve as much as possible through the name cache */
+  if (cached_vp != NULL)
+	r = lookup_cached(start_node, resolve, &dir_ino, root_ino, uid, gid,
+			  cached_vp, rfp);
+  else
+	r = OK;
+  if (r != OK || (cached_vp != NULL && *cached_vp != NULL)) {
+	if (r != OK) {
+		if (vmpres) unlock_vmnt(vmpres);
+		*(resolve->l_vmp) = NULL;
+	}
+	return(r);
+  }
+
+  /* If a single name is left, cache what it refers to. That only works if
+   * the FS does not follow the name when it is a symlink, so ask it not to,
+   * unless we know it is one. */
+  flags = resolve->l_flags;
+  name_len = strlen(resolve->l_path);
+  cache_it = (name_len > 0 && name_len <= DC_NAME_MAX && dc_enabled(fs_e) &&
+	      strchr(resolve->l_path, '/') == NULL &&
+	      strcmp(resolve->l_path, ".") != 0 &&
+	      strcmp(resolve->l_path, "..") != 0);
+  if (cache_it) {
+	strcpy(comp, resolve->l_path);
+	if (!(flags & PATH_RET_SYMLINK)) {
+		dc = dc_lookup(fs_e, dir_ino, comp, name_len);
+		if (dc != NULL && S_ISLNK(dc->dc_mode))
+			cache_it = 0;
+		else
+			resolve->l_flags |= PATH_RET_SYMLINK;
+	}
+  }
+
   /* Issue the request */
+  gen = dc_generation();
   r = req_lookup(fs_e, dir_ino, root_ino, uid, gid, resolve, &res, rfp);
 
+  if (cache_it && (r == OK || r == ENOENT))
+	dc_enter(gen, fs_e, dir_ino, comp, name_len, (r == OK ? &res : NULL));
+
+  if (resolve->l_flags != flags) {
+	resolve->l_flags = flags;
+	if (r == OK && S_ISLNK(res.fmode)) {
+		/* It is a symlink after all; let the FS follow it */
+		lookup_putnode(res.fs_e, res.inode_nr);
+		r = req_lookup(fs_e, dir_ino, root_ino, uid, gid, resolve,
+			       &res, rfp);
+	}
+  }
+
   if (r != OK && r != EENTERMOUNT && r != ELEAVEMOUNT && r != ESYMLINK) {
 	if (vmpres) unlock_vmnt(vmpres);
 	*(resolve->l_vmp) = NULL;
@@ -514,6 +608,196 @@ struct fproc *rfp;
   return(r);
 }
 
+/*===========================================================================*
+ *				lookup_cached				     *
+ *===========================================================================*/
+static int lookup_cached(start_node, resolve, dir_ino, root_ino, uid, gid, vpp,
+			 rfp)
+struct vnode *start_node;
+struct lookup *resolve;
+ino_t *dir_ino;
+ino_t root_ino;
+uid_t uid;
+gid_t gid;
+struct vnode **vpp;
+struct fproc *rfp;
+{
+/* Walk the path through the name cache. Either the whole path resolves to a
+ * vnode that is in use already, which is returned in 'vpp' with a reference
+ * taken, or the part of the path that is left is moved to the start of the
+ * path buffer and 'dir_ino' is set to the directory it is relative to. Names
+ * missing from the cache are looked up at the FS one at a time, except for
+ * the last one. "..", symlinks and mount points are left to the FS.
+ */
+  endpoint_t fs_e;
+  ino_t ino, next_ino;
+  mode_t dir_mode, next_mode;
+  uid_t o_uid, next_uid;
+  gid_t o_gid, next_gid;
+  char *cp, *rest;
+  size_t len;
+  int r, last;
+  struct dcache *dc;
+  struct vnode *vp;
+  lookup_res_t res;
+
+  fs_e = start_node->v_fs_e;
+  if (!dc_enabled(fs_e)) return(OK);
+  if (start_node->v_uid == (uid_t) -1 || start_node->v_gid == (gid_t) -1)
+	return(OK);
+
+  ino = start_node->v_inode_nr;
+  dir_mode = start_node->v_mode;
+  o_uid = start_node->v_uid;
+  o_gid = start_node->v_gid;
+
+  for (cp = resolve->l_path; ; cp += len) {
+	while (*cp == '/') cp++;
+	rest = cp;		/* left for the FS if we stop here */
+
+	len = strcspn(cp, "/");
+	if (len == 0 || len > DC_NAME_MAX) break;
+	if (len == 2 && cp[0] == '.' && cp[1] == '.') break;
+
+	last = (cp[len] == '\0');
+	if (!last && cp[len + strspn(&cp[len], "/")] == '\0')
+		break;		/* trailing slash */
+
+	if (!S_ISDIR(dir_mode)) return(ENOTDIR);
+	if (forbidden_attr(rfp, dir_mode, o_uid, o_gid, X_BIT) != OK)
+		return(EACCES);
+
+	if (len == 1 && cp[0] == '.') {
+		next_ino = ino;
+		next_mode = dir_mode;
+		next_uid = o_uid;
+		next_gid = o_gid;
+	} else if ((dc = dc_lookup(fs_e, ino, cp, len)) != NULL) {
+		if (dc->dc_ino == 0) return(ENOENT);
+		next_ino = dc->dc_ino;
+		next_mode = dc->dc_mode;
+		next_uid = dc->dc_uid;
+		next_gid = dc->dc_gid;
+	} else {
+		if (last) break;	/* that lookup is done anyway */
+
+		r = lookup_step(fs_e, ino, root_ino, uid, gid, cp, len, &res,
+				rfp);
+		if (r == EENTERMOUNT) break;
+		if (r != OK) return(r);
+		next_ino = res.inode_nr;
+		next_mode = res.fmode;
+		next_uid = res.uid;
+		next_gid = res.gid;
+	}
+
+	if (S_ISLNK(next_mode) || is_mountpoint(fs_e, next_ino)) break;
+
+	if (last) {
+		/* A locked vnode may be in the middle of a put_vnode, which
+		 * would throw away the reference we take. */
+		if ((vp = find_vnode(fs_e, next_ino)) == NULL ||
+		    is_vnode_locked(vp))
+			break;
+		dup_vnode(vp);
+		*vpp = vp;
+		return(OK);
+	}
+
+	ino = next_ino;
+	dir_mode = next_mode;
+	o_uid = next_uid;
+	o_gid = next_gid;
+  }
+
+  /* Nothing resolved at all? Leave the path alone. */
+  if (ino == *dir_ino) return(OK);
+
+  memmove(resolve->l_path, rest, strlen(rest) + 1);
+  *dir_ino = ino;
+
+  return(OK);
+}
+
+/*===========================================================================*
+ *				lookup_step				     *
+ *===========================================================================*/
+static int lookup_step(fs_e, dir_ino, root_ino, uid, gid, comp, len, res, rfp)
+endpoint_t fs_e;
+ino_t dir_ino;
+ino_t root_ino;
+uid_t uid;
+gid_t gid;
+char *comp;
+size_t len;
+lookup_res_t *res;
+struct fproc *rfp;
+{
+/* Look up a single comp at the FS and cache the result. Symlinks are not
+ * followed. The reference the FS takes on the inode is handed back. */
+  char step_path[PATH_MAX];
+  struct lookup step;
+  unsigned int gen;
+  int r;
+
+  memcpy(step_path, comp, len);
+  step_path[len] = '\0';
+  step.l_path = step_path;
+  step.l_flags = PATH_RET_SYMLINK;
+
+  gen = dc_generation();
+  r = req_lookup(fs_e, dir_ino, root_ino, uid, gid, &step, res, rfp);
+
+  if (r == ENOENT) dc_enter(gen, fs_e, dir_ino, comp, len, NULL);
+  if (r != OK) return(r);
+
+  dc_enter(gen, fs_e, dir_ino, comp, len, res);
+  lookup_putnode(fs_e, res->inode_nr);
+
+  return(OK);
+}
+
+/*===========================================================================*
+ *				lookup_putnode				     *
+ *===========================================================================*/
+static void lookup_putnode(fs_e, ino)
+endpoint_t fs_e;
+ino_t ino;
+{
+/* Give back a reference obtained by a lookup that we do not need. If there is
+ * a vnode for the inode, just let it account for the reference, unless it is
+ * locked: a put_vnode in progress would lose the count. */
+  struct vnode *vp;
+  int r;
+
+  if ((vp = find_vnode(fs_e, ino)) != NULL && !is_vnode_locked(vp)) {
+	vp->v_fs_count++;
+	return;
+  }
+
+  if ((r = req_putnode(fs_e, ino, 1)) != OK)
+	printf("VFS: putnode failed: %d\n", r);
+}
+
+/*===========================================================================*
+ *				is_mountpoint				     *
+ *===========================================================================*/
+static int is_mountpoint(fs_e, ino)
+endpoint_t fs_e;
+ino_t ino;
+{
+  struct vmnt *vmp;
+
+  for (vmp = &vmnt[0]; vmp < &vmnt[NR_MNTS]; ++vmp) {
+	if (vmp->m_dev != NO_DEV && vmp->m_mounted_on != NULL &&
+	    vmp->m_mounted_on->v_fs_e == fs_e &&
+	    vmp->m_mounted_on->v_inode_nr == ino)
+		return(1);
+  }
+
+  return(0);
+}
+
 /*===========================================================================*
  *				lookup_init				     *
  *===========================================================================*/
@@ -4,8 +4,15 @@
  * process can't continue it is suspended, and revived later when it is able
  * to continue.
  *
+ * The data in a pipe is kept by VFS itself, in a buffer that grows as needed
+ * up to 'pipe_size' bytes.  PFS only provides the inodes.
+ *
  * The entry points into this file are
  *   do_pipe:	  perform the PIPE system call
+ *   init_pipes:  set the maximum size of pipe buffers
+ *   pipe_grow:	  make the buffer of a pipe large enough
+ *   pipe_free:	  free the buffer of a pipe
+ *   pipe_handoff: copy written data straight to a suspended reader
  *   pipe_check:  check to see that a read or write on a pipe is feasible now
  *   suspend:	  suspend a process that cannot do a requested read or write
  *   release:	  check to see if a suspended process can be released and do
@@ -18,7 +25,9 @@
 #include "fs.h"
 #include <fcntl.h>
 #include <signal.h>
+#include <stdlib.h>
 #include <assert.h>
+#include <sys/param.h>
 #include <minix/callnr.h>
 #include <minix/endpoint.h>
 #include <minix/com.h>
@@ -72,6 +81,7 @@ int do_pipe()
 	rfp->fp_filp[fil_des[0]] = NULL;
 	FD_CLR(fil_des[0], &rfp->fp_filp_inuse);
 	fil_ptr0->filp_count = 0;	/* mark filp free */
+	free_filp(fil_ptr0);
 	unlock_filp(fil_ptr0);
 	unlock_vnode(vp);
 	unlock_vmnt(vmp);
@@ -92,6 +102,8 @@ int do_pipe()
 	rfp->fp_filp[fil_des[1]] = NULL;
 	FD_CLR(fil_des[1], &rfp->fp_filp_inuse);
 	fil_ptr1->filp_count = 0;
+	free_filp(fil_ptr0);
+	free_filp(fil_ptr1);
 	unlock_filp(fil_ptr1);
 	unlock_filp(fil_ptr0);
 	unlock_vnode(vp);
@@ -104,10 +116,13 @@ int do_pipe()
   vp->v_mapfs_e = res.fs_e;
   vp->v_inode_nr = res.inode_nr;
   vp->v_mapinode_nr = res.inode_nr;
+  hash_vnode(vp);
   vp->v_mode = res.fmode;
   vp->v_pipe = I_PIPE;
   vp->v_pipe_rd_pos= 0;
   vp->v_pipe_wr_pos= 0;
+  vp->v_pipe_buf = NULL;
+  vp->v_pipe_bufsize = 0;
   vp->v_fs_count = 1;
   vp->v_mapfs_count = 1;
   vp->v_ref_count = 1;
@@ -116,9 +131,9 @@ int do_pipe()
   vp->v_dev = NO_DEV;
 
   /* Fill in filp objects */
-  fil_ptr0->filp_vno = vp;
+  set_filp_vno(fil_ptr0, vp);
   dup_vnode(vp);
-  fil_ptr1->filp_vno = vp;
+  set_filp_vno(fil_ptr1, vp);
   fil_ptr0->filp_flags = O_RDONLY;
   fil_ptr1->filp_flags = O_WRONLY;
 
@@ -170,6 +185,108 @@ endpoint_t map_to_fs_e;
   return(r);
 }
 
+/*===========================================================================*
+ *				init_pipes				     *
+ *===========================================================================*/
+void init_pipes(void)
+{
+/* Set how much data a pipe can hold. It can be set with a boot parameter. */
+  long size;
+
+  size = PIPE_SIZE;
+  (void) env_parse("vfs_pipe_size", "d", 0, &size, PIPE_BUF, PIPE_SIZE_MAX);
+  pipe_size = (size_t) size;
+}
+
+
+/*===========================================================================*
+ *				pipe_grow				     *
+ *===========================================================================*/
+int pipe_grow(struct vnode *vp, size_t size)
+{
+/* Make sure the buffer of a pipe can hold 'size' bytes. Buffers start small
+ * and double as needed, so that pipes that carry little data stay cheap.
+ */
+  size_t newsize;
+  char *buf;
+
+  if (size <= vp->v_pipe_bufsize) return(OK);
+  assert(size <= pipe_size);
+
+  newsize = (vp->v_pipe_bufsize > 0 ? vp->v_pipe_bufsize : PIPE_SIZE_INIT);
+  while (newsize < size) newsize *= 2;
+  if (newsize > pipe_size) newsize = pipe_size;
+
+  if ((buf = realloc(vp->v_pipe_buf, newsize)) == NULL) return(ENOSPC);
+
+  vp->v_pipe_buf = buf;
+  vp->v_pipe_bufsize = newsize;
+  return(OK);
+}
+
+
+/*===========================================================================*
+ *				pipe_free				     *
+ *===========================================================================*/
+void pipe_free(struct vnode *vp)
+{
+/* The pipe is not used anymore. Drop its data. */
+
+  if (vp->v_pipe_buf != NULL) free(vp->v_pipe_buf);
+  vp->v_pipe_buf = NULL;
+  vp->v_pipe_bufsize = 0;
+}
+
+
+/*===========================================================================*
+ *				pipe_handoff				     *
+ *===========================================================================*/
+size_t pipe_handoff(vp, usr_e, buf, size)
+struct vnode *vp;		/* the empty pipe written to */
+endpoint_t usr_e;		/* the writer */
+char *buf;			/* the writer's data */
+size_t size;			/* # bytes to be written */
+{
+/* A process writes to an empty pipe. If a reader is suspended on the pipe,
+ * copy the data into the reader's buffer right away and let it return,
+ * instead of buffering the data and restarting the reader. Return how many
+ * bytes have been handed off.
+ */
+  struct fproc *rp;
+  size_t n;
+
+  assert(vp->v_size == 0);
+
+  for (rp = &fproc[0]; rp < &fproc[NR_PROCS]; rp++) {
+	if (rp->fp_pid == PID_FREE ||
+	    rp->fp_blocked_on != FP_BLOCKED_ON_PIPE ||
+	    (rp->fp_flags & FP_REVIVED) || rp->fp_block_callnr != READ)
+		continue;
+	if (scratch(rp).file.filp == NULL ||
+	    scratch(rp).file.filp->filp_vno != vp)
+		continue;
+
+	n = MIN(size, scratch(rp).io.io_nbytes);
+	if (n == 0) continue;
+
+	if (sys_datacopy(usr_e, (vir_bytes) buf, rp->fp_endpoint,
+			 (vir_bytes) scratch(rp).io.io_buffer, n) != OK)
+		return(0);	/* let the reader try for itself */
+
+	/* The reader's call is done. */
+	rp->fp_blocked_on = FP_BLOCKED_ON_NONE;
+	scratch(rp).file.filp = NULL;
+	susp_count--;
+	if (susp_count < 0)
+		panic("susp_count now negative: %d", susp_count);
+	reply(rp->fp_endpoint, (int) n);
+	return(n);
+  }
+
+  return(0);
+}
+
+
 /*===========================================================================*
  *				pipe_check				     *
  *===========================================================================*/
@@ -223,7 +340,7 @@ int notouch;			/* check only */
   }
 
   /* Calculate how many bytes can be written. */
-  if (pos + bytes > PIPE_BUF) {
+  if (pos + bytes > (off_t) pipe_size) {
 	if (oflags & O_NONBLOCK) {
 		if (bytes <= PIPE_BUF) {
 			/* Write has to be atomic */
@@ -231,7 +348,7 @@ int notouch;			/* check only */
 		}
 
 		/* Compute available space */
-		bytes = PIPE_BUF - pos;
+		bytes = pipe_size - pos;
 
 		if (bytes > 0)  {
 			/* Do a partial write. Need to wakeup reader */
@@ -246,7 +363,7 @@ int notouch;			/* check only */
 
 	if (bytes > PIPE_BUF) {
 		/* Compute available space */
-		bytes = PIPE_BUF - pos;
+		bytes = pipe_size - pos;
 
 		if (bytes > 0) {
 			/* Do a partial write. Need to wakeup reader
@@ -374,7 +491,7 @@ int count;			/* max number of processes to release */
 	else
 		selop = SEL_WR;
 
-	for (f = &filp[0]; f < &filp[NR_FILPS]; f++) {
+	for (f = &filp[0]; f < &filp[nr_filps]; f++) {
 		if (f->filp_count < 1 || !(f->filp_pipe_select_ops & selop) ||
 		    f->filp_vno != vp)
 			continue;
@@ -463,7 +580,8 @@ void revive(endpoint_t proc_e, int returned)
 		fil_ptr->filp_count = 0;
 		unlock_filp(fil_ptr);
 		put_vnode(fil_ptr->filp_vno);
-		fil_ptr->filp_vno = NULL;
+		set_filp_vno(fil_ptr, NULL);
+		free_filp(fil_ptr);
 		reply(proc_e, returned);
 	} else {
 		reply(proc_e, fd_nr);
@@ -250,16 +250,38 @@ int forbidden(struct fproc *rfp, struct vnode *vp, mode_t access_desired)
  * caller's uid in the 'fproc' table.  If access is allowed, OK is returned
  * if it is forbidden, EACCES is returned.
  */
+  int r;
+
+  r = forbidden_attr(rfp, vp->v_mode, vp->v_uid, vp->v_gid, access_desired);
+
+  /* Check to see if someone is trying to write on a file system that is
+   * mounted read-only.
+   */
+  if (r == OK)
+	if (access_desired & W_BIT)
+		r = read_only(vp);
+
+  return(r);
+}
 
-  register mode_t bits, perm_bits;
+/*===========================================================================*
+ *				forbidden_attr				     *
+ *===========================================================================*/
+int forbidden_attr(struct fproc *rfp, mode_t bits, uid_t o_uid, gid_t o_gid,
+	mode_t access_desired)
+{
+/* Like forbidden(), but for a file of which only the mode and owner are
+ * known, such as a directory in the name cache. Read-only file systems are
+ * not checked for.
+ */
+  register mode_t perm_bits;
   uid_t uid;
   gid_t gid;
-  int r, shift;
+  int shift;
 
-  if (vp->v_uid == (uid_t) -1 || vp->v_gid == (gid_t) -1) return(EACCES);
+  if (o_uid == (uid_t) -1 || o_gid == (gid_t) -1) return(EACCES);
 
   /* Isolate the relevant rwx bits from the mode. */
-  bits = vp->v_mode;
   uid = (job_call_nr == ACCESS ? rfp->fp_realuid : rfp->fp_effuid);
   gid = (job_call_nr == ACCESS ? rfp->fp_realgid : rfp->fp_effgid);
 
@@ -274,25 +296,17 @@ int forbidden(struct fproc *rfp, struct vnode *vp, mode_t access_desired)
 	else
 		perm_bits = R_BIT | W_BIT;
   } else {
-	if (uid == vp->v_uid) shift = 6;		/* owner */
-	else if (gid == vp->v_gid) shift = 3;		/* group */
-	else if (in_group(fp, vp->v_gid) == OK) shift = 3; /* suppl. groups */
+	if (uid == o_uid) shift = 6;			/* owner */
+	else if (gid == o_gid) shift = 3;		/* group */
+	else if (in_group(rfp, o_gid) == OK) shift = 3;	/* suppl. groups */
 	else shift = 0;					/* other */
 	perm_bits = (bits >> shift) & (R_BIT | W_BIT | X_BIT);
   }
 
   /* If access desired is not a subset of what is allowed, it is refused. */
-  r = OK;
-  if ((perm_bits | access_desired) != perm_bits) r = EACCES;
-
-  /* Check to see if someone is trying to write on a file system that is
-   * mounted read-only.
-   */
-  if (r == OK)
-	if (access_desired & W_BIT)
-		r = read_only(vp);
+  if ((perm_bits | access_desired) != perm_bits) return(EACCES);
 
-  return(r);
+  return(OK);
 }
 
 /*===========================================================================*
@@ -26,6 +26,19 @@ int fs_sendrec(endpoint_t fs_e, message *reqm);
 void fs_sendmore(struct vmnt *vmp);
 void send_work(void);
 
+/* dcache.c */
+void init_dcache(void);
+int dc_enabled(endpoint_t fs_e);
+unsigned int dc_generation(void);
+struct dcache *dc_lookup(endpoint_t fs_e, ino_t dir_ino, char *name, size_t
+	len);
+void dc_enter(unsigned int gen, endpoint_t fs_e, ino_t dir_ino, char *name,
+	size_t len, lookup_res_t *res);
+void dc_purge(endpoint_t fs_e, ino_t dir_ino, char *name);
+void dc_purge_dir(endpoint_t fs_e, ino_t dir_ino, char *name);
+void dc_purge_ino(endpoint_t fs_e, ino_t ino);
+void dc_purge_fs(endpoint_t fs_e);
+
 /* device.c */
 int dev_open(dev_t dev, endpoint_t proc_e, int flags);
 int dev_reopen(dev_t dev, int filp_no, int flags);
@@ -83,6 +96,8 @@ void check_filp_locks_by_me(void);
 void init_filps(void);
 struct filp *find_filp(struct vnode *vp, mode_t bits);
 int get_fd(int start, mode_t bits, int *k, struct filp **fpt);
+void free_filp(struct filp *f);
+void set_filp_vno(struct filp *f, struct vnode *vp);
 struct filp *get_filp(int fild, tll_access_t locktype);
 struct filp *get_filp2(struct fproc *rfp, int fild, tll_access_t
 	locktype);
@@ -138,6 +153,7 @@ int do_fsync(void);
 void pm_reboot(void);
 int do_svrctl(void);
 int do_getsysinfo(void);
+int do_vm_call(void);
 int pm_dumpcore(endpoint_t proc_e, int sig, vir_bytes exe_name);
 void ds_event(void);
 
@@ -180,6 +196,11 @@ int do_check_perms(void);
 
 /* pipe.c */
 int do_pipe(void);
+void init_pipes(void);
+int pipe_grow(struct vnode *vp, size_t size);
+void pipe_free(struct vnode *vp);
+size_t pipe_handoff(struct vnode *vp, endpoint_t usr_e, char *buf, size_t
+	size);
 int map_vnode(struct vnode *vp, endpoint_t fs_e);
 void unpause(endpoint_t proc_e);
 int pipe_check(struct vnode *vp, int rw_flag, int oflags, int bytes,
@@ -198,6 +219,8 @@ int do_chown(void);
 int do_umask(void);
 int forbidden(struct fproc *rfp, struct vnode *vp, mode_t
 	access_desired);
+int forbidden_attr(struct fproc *rfp, mode_t bits, uid_t o_uid, gid_t
+	o_gid, mode_t access_desired);
 int read_only(struct vnode *vp);
 
 /* read.c */
@@ -316,6 +339,7 @@ void check_vnode_locks(void);
 void check_vnode_locks_by_me(struct fproc *rfp);
 struct vnode *get_free_vnode(void);
 struct vnode *find_vnode(int fs_e, ino_t inode);
+void hash_vnode(struct vnode *vp);
 void init_vnodes(void);
 int is_vnode_locked(struct vnode *vp);
 int lock_vnode(struct vnode *vp, tll_access_t locktype);
@@ -335,7 +359,10 @@ int do_gcov_flush(void);
 
 /* select.c */
 int do_select(void);
+int do_kevent(void);
+int do_kqueue(void);
 void init_select(void);
+void kqueue_close_fd(struct fproc *rfp, int fd);
 void select_callback(struct filp *, int ops);
 void select_forget(endpoint_t proc_e);
 void select_reply1(endpoint_t driver_e, int minor, int status);
@@ -345,9 +372,12 @@ void select_unsuspend_by_endpt(endpoint_t proc);
 
 /* worker.c */
 int worker_available(void);
+int worker_busy(void);
+void worker_forget(struct fproc *rfp);
 struct worker_thread *worker_get(thread_t worker_tid);
 struct job *worker_getjob(thread_t worker_tid);
 void worker_init(struct worker_thread *worker);
+void worker_init_pool(void);
 void worker_signal(struct worker_thread *worker);
 void worker_start(void *(*func)(void *arg));
 void worker_stop(struct worker_thread *worker);
@@ -252,10 +252,14 @@ struct filp *f;
 char *buf;
 size_t req_size;
 {
+/* Pipe data is kept in a buffer in VFS and copied to and from the user
+ * directly, without a round trip to PFS.
+ */
   int r, oflags, partial_pipe = 0;
-  size_t size, cum_io, cum_io_incr;
+  size_t size, cum_io, handed = 0;
   struct vnode *vp;
-  u64_t position, new_pos;
+  u64_t position;
+  off_t pos;
 
   /* Must make sure we're operating on locked filp and vnode */
   assert(tll_islocked(&f->filp_vno->v_lock));
@@ -263,14 +267,42 @@ size_t req_size;
 
   oflags = f->filp_flags;
   vp = f->filp_vno;
+
+  /* Without a buffer the pipe is empty, whatever the size says; a FIFO may
+   * come with a size from its inode on disk. */
+  if (vp->v_pipe_buf == NULL && vp->v_size != 0) {
+	vp->v_size = 0;
+	vp->v_pipe_rd_pos = 0;
+	vp->v_pipe_wr_pos = 0;
+  }
+
   position = cvu64((rw_flag == READING) ? vp->v_pipe_rd_pos :
 							vp->v_pipe_wr_pos);
   /* fp->fp_cum_io_partial is only nonzero when doing partial writes */
   cum_io = fp->fp_cum_io_partial;
 
+  /* If a reader is waiting for data, give it what is written right away. */
+  if (rw_flag == WRITING && vp->v_size == 0 && susp_count > 0 &&
+      (handed = pipe_handoff(vp, usr_e, buf, req_size)) > 0) {
+	cum_io += handed;
+	buf += handed;
+	req_size -= handed;
+	if (req_size == 0) {
+		fp->fp_cum_io_partial = 0;
+		return(cum_io);
+	}
+	fp->fp_cum_io_partial = cum_io;
+  }
+
   r = pipe_check(vp, rw_flag, oflags, req_size, position, 0);
   if (r <= 0) {
-	if (r == SUSPEND) pipe_suspend(f, buf, req_size);
+	if (r == SUSPEND) {
+		pipe_suspend(f, buf, req_size);
+	} else if (handed > 0) {
+		/* Report the bytes that did get written */
+		fp->fp_cum_io_partial = 0;
+		return(cum_io);
+	}
 	return(r);
   }
 
@@ -293,17 +325,20 @@ size_t req_size;
   if (vp->v_mapfs_e == 0)
 	panic("unmapped pipe");
 
-  r = req_readwrite(vp->v_mapfs_e, vp->v_mapinode_nr, position, rw_flag, usr_e,
-		    buf, size, &new_pos, &cum_io_incr);
-
-  if (r >= 0) {
-	if (ex64hi(new_pos))
-		panic("rw_pipe: bad new pos");
+  pos = ex64lo(position);
+  if (rw_flag == READING) {
+	r = sys_datacopy(SELF, (vir_bytes) (vp->v_pipe_buf + pos), usr_e,
+		(vir_bytes) buf, size);
+  } else if ((r = pipe_grow(vp, pos + size)) == OK) {
+	r = sys_datacopy(usr_e, (vir_bytes) buf, SELF,
+		(vir_bytes) (vp->v_pipe_buf + pos), size);
+  }
 
-	position = new_pos;
-	cum_io += cum_io_incr;
-	buf += cum_io_incr;
-	req_size -= cum_io_incr;
+  if (r == OK) {
+	position = add64ul(position, size);
+	cum_io += size;
+	buf += size;
+	req_size -= size;
   }
 
   /* On write, update file size and access time. */
@@ -346,5 +381,11 @@ size_t req_size;
 	return(cum_io);
   }
 
+  if (handed > 0) {
+	/* Report the bytes that did get written */
+	fp->fp_cum_io_partial = 0;
+	return(cum_io);
+  }
+
   return(r);
 }
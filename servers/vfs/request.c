@@ -3,6 +3,8 @@
  * Each function builds a request message according to the request
  * parameter, calls the most low-level fs_sendrec, and copies
  * back the response.
+ * Requests that change a directory or the attributes of an inode
+ * purge the affected entries from the name lookup cache.
  */
 
 #include "fs.h"
@@ -90,6 +92,7 @@ int req_chmod(
 
   /* Send/rec request */
   r = fs_sendrec(fs_e, &m);
+  dc_purge_ino(fs_e, inode_nr);
 
   /* Copy back actual mode. */
   *new_modep = m.RES_MODE;
@@ -120,6 +123,7 @@ int req_chown(
 
   /* Send/rec request */
   r = fs_sendrec(fs_e, &m);
+  dc_purge_ino(fs_e, inode_nr);
 
   /* Return new mode to caller. */
   *new_modep = m.RES_MODE;
@@ -166,6 +170,7 @@ int req_create(
   /* Send/rec request */
   r = fs_sendrec(fs_e, &m);
   cpf_revoke(grant_id);
+  dc_purge(fs_e, inode_nr, path);
   if (r != OK) return(r);
 
   /* Fill in response structure */
@@ -361,6 +366,7 @@ int req_link(
   /* Send/rec request */
   r = fs_sendrec(fs_e, &m);
   cpf_revoke(grant_id);
+  dc_purge(fs_e, link_parent, lastc);
 
   return(r);
 }
@@ -502,6 +508,7 @@ int req_mkdir(
   /* Send/rec request */
   r = fs_sendrec(fs_e, &m);
   cpf_revoke(grant_id);
+  dc_purge(fs_e, inode_nr, lastc);
 
   return(r);
 }
@@ -543,6 +550,7 @@ int req_mknod(
   /* Send/rec request */
   r = fs_sendrec(fs_e, &m);
   cpf_revoke(grant_id);
+  dc_purge(fs_e, inode_nr, lastc);
 
   return(r);
 }
@@ -833,6 +841,8 @@ char *new_name;
   r = fs_sendrec(fs_e, &m);
   cpf_revoke(gid_old);
   cpf_revoke(gid_new);
+  dc_purge(fs_e, old_dir, old_name);
+  dc_purge_dir(fs_e, new_dir, new_name);
 
   return(r);
 }
@@ -865,6 +875,7 @@ char *lastc;
   /* Send/rec request */
   r = fs_sendrec(fs_e, &m);
   cpf_revoke(grant_id);
+  dc_purge_dir(fs_e, inode_nr, lastc);
 
   return(r);
 }
@@ -914,6 +925,7 @@ int req_slink(
   r = fs_sendrec(fs_e, &m);
   cpf_revoke(gid_name);
   cpf_revoke(gid_buf);
+  dc_purge(fs_e, inode_nr, lastc);
 
   return(r);
 }
@@ -1043,6 +1055,7 @@ char *lastc;
   /* Send/rec request */
   r = fs_sendrec(fs_e, &m);
   cpf_revoke(grant_id);
+  dc_purge(fs_e, inode_nr, lastc);
 
   return(r);
 }
@@ -2,22 +2,29 @@
  *
  * The entry points into this file are
  *   do_select:	       perform the SELECT system call
+ *   do_kqueue:	       perform the KQUEUE system call
+ *   do_kevent:	       perform the KEVENT system call
  *   select_callback:  notify select system of possible fd operation
  *   select_unsuspend_by_endpt: cancel a blocking select on exiting driver
+ *   kqueue_close_fd:  drop event queue state for a closed file descriptor
  */
 
 #include "fs.h"
 #include <sys/time.h>
 #include <sys/select.h>
+#include <sys/event.h>
+#include <fcntl.h>
 #include <minix/com.h>
 #include <minix/u64.h>
 #include <string.h>
+#include <stdlib.h>
 #include <assert.h>
 
 #include "file.h"
 #include "fproc.h"
 #include "dmap.h"
 #include "vnode.h"
+#include "vmnt.h"
 
 /* max. number of simultaneously pending select() calls */
 #define MAXSELECTS 25
@@ -39,6 +46,64 @@ static struct selectentry {
   timer_t timer;	/* if expiry > 0 */
 } selecttab[MAXSELECTS];
 
+/* Event queues. An event queue is bound to one of the owner's file
+ * descriptors and holds a knote for every file descriptor and filter the
+ * owner registered with kevent(). Unlike the select table, registrations
+ * persist across calls. Each knote asks for the notifications a blocking
+ * select() would ask for. When select_callback() or a driver reply reports
+ * an operation as ready, the knotes on that filp are put on the ready list of
+ * their queue. Nothing else is looked at. Events are level-triggered: a
+ * reported knote is armed again by the next kevent() call on its queue, which
+ * queues it right away if the operation is still ready.
+ */
+#define MAXKQUEUES	32		/* max. number of event queues */
+#define KNOTES_PER_FILP	2		/* registrations per filp slot */
+#define KN_HASH_SIZE	32		/* hash chains of knotes on devices */
+#define KN_HASH(dev)	((unsigned int) (dev) % KN_HASH_SIZE)
+#define KEV_BATCH	8		/* kevents copied in or out at once */
+
+static struct knote {
+  struct kqentry *kn_kq;	/* slot is free iff this is NULL */
+  struct filp *kn_filp;		/* filp the file descriptor refers to */
+  int kn_fd;			/* file descriptor of the owner */
+  int kn_filter;		/* EVFILT_READ or EVFILT_WRITE */
+  int kn_type;			/* index in fdtypes[] */
+  int kn_ops;			/* SEL_RD or SEL_WR */
+  int kn_ready;			/* SEL_* operations found to be ready */
+  int kn_flags;			/* KN_* flags */
+  dev_t kn_dev;			/* device of a character special, or NO_DEV */
+  intptr_t kn_udata;		/* passed back to the owner */
+  struct knote *kn_fnext;	/* next knote on the same filp */
+  struct knote *kn_dnext;	/* next knote on the same hash chain */
+  struct knote *kn_qnext;	/* next knote on the ready or free list */
+} *knotetab;
+static int nr_knotes;		/* size of knotetab, set at boot */
+
+#define KN_QUEUED	001	/* knote is on the ready list of its queue */
+#define KN_DISABLED	002	/* knote is not to be reported */
+#define KN_ONESHOT	004	/* delete knote once it has been reported */
+#define KN_DEFERRED	010	/* select request still has to be sent */
+#define KN_REARM	020	/* knote is on the rearm list of its queue */
+
+static struct kqentry {
+  struct fproc *kq_owner;	/* slot is free iff this is NULL */
+  int kq_fd;			/* file descriptor bound to this queue */
+  struct knote *kq_knotes[OPEN_MAX][EVFILT_SYSCOUNT];
+  struct knote *kq_ready;	/* knotes to be reported */
+  struct knote *kq_ready_tail;
+  struct knote *kq_rearm;	/* reported knotes to be armed again */
+  char kq_block;		/* owner is blocked in kevent() */
+  struct kevent *kq_vir_events;	/* where the blocked call wants events */
+  int kq_nevents;		/* and how many of them */
+  clock_t kq_expiry;
+  timer_t kq_timer;		/* if kq_expiry > 0 */
+} kqtab[MAXKQUEUES];
+
+static struct knote *knote_free;		/* list of free knotes */
+static struct knote *knote_hash[KN_HASH_SIZE];	/* knotes on devices */
+static int nr_kqueues;				/* # event queues in use */
+static int nr_deferred_knotes;			/* # knotes with KN_DEFERRED */
+
 static int copy_fdsets(struct selectentry *se, int nfds, int
 	direction);
 static int do_select_request(struct selectentry *se, int fd, int *ops);
@@ -61,6 +126,18 @@ static void select_return(struct selectentry *);
 static void select_restart_filps(void);
 static int tab2ops(int fd, struct selectentry *e);
 static void wipe_select(struct selectentry *s);
+static int kevent_change(struct kqentry *kq, struct kevent *kev);
+static struct kqentry *kq_find(struct fproc *rfp, int fd);
+static void kq_free(struct kqentry *kq);
+static int kq_collect(struct kqentry *kq, struct kevent *vir_events, int
+	nevents);
+static void kq_timeout_check(timer_t *timer);
+static void kq_wakeup(void);
+static int knote_add(struct kqentry *kq, int fd, int filter);
+static int knote_arm(struct knote *kn);
+static void knote_drop(struct knote *kn);
+static void knote_fire(struct knote *kn, int status);
+static void knote_unqueue(struct knote *kn);
 
 static struct fdtype {
 	int (*select_request)(struct filp *, int *ops, int block);
@@ -661,6 +738,20 @@ void init_select(void)
 
   for (s = 0; s < MAXSELECTS; s++)
 	init_timer(&selecttab[s].timer);
+
+  for (s = 0; s < MAXKQUEUES; s++)
+	init_timer(&kqtab[s].kq_timer);
+
+  /* The filp table is sized at boot; size the registrations along with it. */
+  nr_knotes = KNOTES_PER_FILP * nr_filps;
+  if ((knotetab = calloc(nr_knotes, sizeof(knotetab[0]))) == NULL)
+	panic("VFS: unable to allocate %d knotes", nr_knotes);
+
+  knote_free = NULL;
+  for (s = nr_knotes - 1; s >= 0; s--) {
+	knotetab[s].kn_qnext = knote_free;
+	knote_free = &knotetab[s];
+  }
 }
 
 
@@ -674,6 +765,19 @@ void select_forget(endpoint_t proc_e)
 
   int slot;
   struct selectentry *se;
+  struct kqentry *kq;
+
+  /* A blocking kevent() call is just given up; its registrations remain. */
+  for (slot = 0; slot < MAXKQUEUES && nr_kqueues > 0; slot++) {
+	kq = &kqtab[slot];
+	if (kq->kq_owner == NULL || !kq->kq_block) continue;
+	if (kq->kq_owner->fp_endpoint != proc_e) continue;
+	kq->kq_block = FALSE;
+	if (kq->kq_expiry > 0) {
+		cancel_timer(&kq->kq_timer);
+		kq->kq_expiry = 0;
+	}
+  }
 
   for (slot = 0; slot < MAXSELECTS; slot++) {
 	se = &selecttab[slot];
@@ -747,6 +851,18 @@ void select_unsuspend_by_endpt(endpoint_t proc_e)
 	if (wakehim && !is_deferred(se))
 		select_return(se);
   }
+
+  /* Registrations on the driver's devices report an error */
+  if (nr_kqueues > 0) {
+	struct knote *kn;
+
+	for (kn = &knotetab[0]; kn < &knotetab[nr_knotes]; kn++) {
+		if (kn->kn_kq == NULL || kn->kn_dev == NO_DEV) continue;
+		if (dmap_driver_match(proc_e, major(kn->kn_dev)))
+			knote_fire(kn, EINTR);
+	}
+	kq_wakeup();
+  }
 }
 
 /*===========================================================================*
@@ -857,6 +973,7 @@ int status;
   struct dmap *dp;
   struct vnode *vp;
   struct selectentry *se;
+  struct knote *kn;
 
   if (status == 0) {
 	printf("VFS (%s:%d): weird status (%d) to report\n",
@@ -908,6 +1025,31 @@ int status;
 	}
   }
 
+  /* Find all event queue registrations for this device. The filp is not
+   * locked while its flags are updated: nothing here blocks, and locking
+   * might let another thread change the hash chain under us.
+   */
+  for (kn = knote_hash[KN_HASH(dev)]; kn != NULL; kn = kn->kn_dnext) {
+	if (kn->kn_dev != dev) continue;
+	f = kn->kn_filp;
+	if (f->filp_count < 1) continue;
+
+	if (status > 0) {
+		if (!(f->filp_select_flags & FSF_UPDATE))
+			f->filp_select_ops &= ~status;
+		if (status & SEL_RD)
+			f->filp_select_flags &= ~FSF_RD_BLOCK;
+		if (status & SEL_WR)
+			f->filp_select_flags &= ~FSF_WR_BLOCK;
+		if (status & SEL_ERR)
+			f->filp_select_flags &= ~FSF_ERR_BLOCK;
+	} else {
+		f->filp_select_flags &= ~FSF_BLOCKED;
+	}
+	knote_fire(kn, status);
+  }
+  kq_wakeup();
+
   select_restart_filps();
 }
 
@@ -951,6 +1093,23 @@ static void select_restart_filps()
 		if (wantops & ops) ops2tab(wantops, fd, se);
 	}
   }
+
+  /* Send the select requests that event queue registrations still owe */
+  if (nr_deferred_knotes > 0) {
+	struct knote *kn;
+
+	for (kn = &knotetab[0]; kn < &knotetab[nr_knotes]; kn++) {
+		if (kn->kn_kq == NULL || !(kn->kn_flags & KN_DEFERRED))
+			continue;
+		f = kn->kn_filp;
+		if (f->filp_select_flags & FSF_BUSY)
+			continue;
+		kn->kn_flags &= ~KN_DEFERRED;
+		nr_deferred_knotes--;
+		(void) knote_arm(kn);
+	}
+	kq_wakeup();
+  }
 }
 
 /*===========================================================================*
@@ -1004,6 +1163,15 @@ int status;
 		restart_proc(se);
 	}
   }
+
+  /* And the event queues that have this filp registered */
+  if (f->filp_knotes != NULL) {
+	struct knote *kn;
+
+	for (kn = f->filp_knotes; kn != NULL; kn = kn->kn_fnext)
+		knote_fire(kn, status);
+	kq_wakeup();
+  }
 }
 
 /*===========================================================================*
@@ -1054,3 +1222,593 @@ static void select_lock_filp(struct filp *f, int ops)
 
   lock_filp(f, locktype);
 }
+
+/*===========================================================================*
+ *				do_kqueue				     *
+ *===========================================================================*/
+int do_kqueue(void)
+{
+/* Create a new event queue and return a file descriptor bound to it. The
+ * descriptor refers to a nameless pipe on PFS that has no writer, so reading
+ * it returns end of file. Closing the descriptor or exiting releases the
+ * queue.
+ */
+  int s, r, kqfd;
+  struct filp *f;
+  struct kqentry *kq;
+  struct vnode *vp;
+  struct vmnt *vmp;
+  struct node_details res;
+
+  /* Find a slot to store this event queue */
+  for (s = 0; s < MAXKQUEUES; s++)
+	if (kqtab[s].kq_owner == NULL) /* Unused slot */
+		break;
+  if (s >= MAXKQUEUES) return(ENFILE);
+
+  /* Get a lock on PFS */
+  if ((vmp = find_vmnt(PFS_PROC_NR)) == NULL) panic("PFS gone");
+  if ((r = lock_vmnt(vmp, VMNT_WRITE)) != OK) return(r);
+
+  if ((vp = get_free_vnode()) == NULL) {
+	unlock_vmnt(vmp);
+	return(err_code);
+  }
+  lock_vnode(vp, VNODE_OPCL);
+
+  if ((r = get_fd(0, R_BIT, &kqfd, &f)) != OK) {
+	unlock_vnode(vp);
+	unlock_vmnt(vmp);
+	return(r);
+  }
+
+  r = req_newnode(PFS_PROC_NR, fp->fp_effuid, fp->fp_effgid, I_NAMED_PIPE,
+		  NO_DEV, &res);
+  if (r != OK) {
+	unlock_filp(f);
+	unlock_vnode(vp);
+	unlock_vmnt(vmp);
+	return(r);
+  }
+
+  /* Fill in vnode */
+  vp->v_fs_e = res.fs_e;
+  vp->v_mapfs_e = res.fs_e;
+  vp->v_inode_nr = res.inode_nr;
+  vp->v_mapinode_nr = res.inode_nr;
+  hash_vnode(vp);
+  vp->v_mode = res.fmode;
+  vp->v_pipe = I_PIPE;
+  vp->v_pipe_rd_pos= 0;
+  vp->v_pipe_wr_pos= 0;
+  vp->v_pipe_buf = NULL;
+  vp->v_pipe_bufsize = 0;
+  vp->v_fs_count = 1;
+  vp->v_mapfs_count = 1;
+  vp->v_ref_count = 1;
+  vp->v_size = 0;
+  vp->v_vmnt = NULL;
+  vp->v_dev = NO_DEV;
+
+  /* Claim the file descriptor and filp */
+  fp->fp_filp[kqfd] = f;
+  FD_SET(kqfd, &fp->fp_filp_inuse);
+  f->filp_count = 1;
+  set_filp_vno(f, vp);
+  f->filp_flags = O_RDONLY;
+
+  kq = &kqtab[s];
+  memset(kq->kq_knotes, 0, sizeof(kq->kq_knotes));
+  kq->kq_owner = fp;
+  kq->kq_fd = kqfd;
+  kq->kq_ready = kq->kq_ready_tail = NULL;
+  kq->kq_rearm = NULL;
+  kq->kq_block = FALSE;
+  kq->kq_expiry = 0;
+  nr_kqueues++;
+
+  unlock_filp(f);
+  unlock_vmnt(vmp);
+
+  return(kqfd);
+}
+
+/*===========================================================================*
+ *				do_kevent				     *
+ *===========================================================================*/
+int do_kevent(void)
+{
+/* Implement the kevent(kq, changelist, nchanges, eventlist, nevents, timeout)
+ * system call. First apply the changes to the registrations of the event
+ * queue, in order. Then report the events that are ready. If there are none,
+ * block until there are or until the timeout expires. */
+
+  int r, i, n, batch, nchanges, nevents, ticks;
+  struct kqentry *kq;
+  struct knote *kn;
+  struct kevent kev[KEV_BATCH];
+  struct timespec timeout;
+  vir_bytes vchanges, vevents, vtimeout;
+
+  nchanges = job_m_in.KEV_NCHANGES;
+  nevents = job_m_in.KEV_NEVENTS;
+  vchanges = (vir_bytes) job_m_in.KEV_CHANGES;
+  vevents = (vir_bytes) job_m_in.KEV_EVENTS;
+  vtimeout = (vir_bytes) job_m_in.KEV_TIMEOUT;
+
+  if ((kq = kq_find(fp, job_m_in.KEV_KQ)) == NULL) return(EBADF);
+  if (nchanges < 0 || nevents < 0) return(EINVAL);
+
+  /* Apply the changes */
+  for (i = 0; i < nchanges; i += batch) {
+	batch = nchanges - i;
+	if (batch > KEV_BATCH) batch = KEV_BATCH;
+	r = sys_vircopy(who_e, D, vchanges + i * sizeof(kev[0]), SELF, D,
+			(vir_bytes) kev, batch * sizeof(kev[0]));
+	if (r != OK) return(r);
+
+	for (n = 0; n < batch; n++)
+		if ((r = kevent_change(kq, &kev[n])) != OK) return(r);
+  }
+
+  /* Arm the knotes reported last time again */
+  while ((kn = kq->kq_rearm) != NULL) {
+	kq->kq_rearm = kn->kn_qnext;
+	kn->kn_qnext = NULL;
+	kn->kn_flags &= ~KN_REARM;
+	kn->kn_ready = 0;
+	(void) knote_arm(kn);
+  }
+
+  if (nevents == 0) return(0);
+
+  /* Report what is ready now */
+  if ((n = kq_collect(kq, (struct kevent *) vevents, nevents)) != 0)
+	return(n);
+
+  /* Nothing. Did the process set a timeout value? */
+  ticks = 0;
+  if (vtimeout != 0) {
+	r = sys_vircopy(who_e, D, vtimeout, SELF, D, (vir_bytes) &timeout,
+			sizeof(timeout));
+	if (r != OK) return(r);
+	if (timeout.tv_sec < 0 || timeout.tv_nsec < 0 ||
+	    timeout.tv_nsec >= 1000000000L)
+		return(EINVAL);
+	if (timeout.tv_sec == 0 && timeout.tv_nsec == 0)
+		return(0);	/* a poll */
+
+	/* Round up to the next tick, as select() does */
+	ticks = timeout.tv_sec * system_hz +
+		(timeout.tv_nsec / 1000 * system_hz + 999999) / 1000000;
+  }
+
+  kq->kq_block = TRUE;
+  kq->kq_vir_events = (struct kevent *) vevents;
+  kq->kq_nevents = nevents;
+  if (ticks > 0) {
+	kq->kq_expiry = ticks;
+	set_timer(&kq->kq_timer, ticks, kq_timeout_check, kq - kqtab);
+  }
+
+  /* process now blocked */
+  suspend(FP_BLOCKED_ON_SELECT);
+  return(SUSPEND);
+}
+
+/*===========================================================================*
+ *				kevent_change				     *
+ *===========================================================================*/
+static int kevent_change(struct kqentry *kq, struct kevent *kev)
+{
+/* Apply one change to the registrations of an event queue */
+  int r, fd, filter;
+  struct knote *kn;
+
+  fd = (int) kev->ident;
+  filter = (int) kev->filter;
+  if (fd < 0 || fd >= OPEN_MAX) return(EBADF);
+  if (filter < 0 || filter >= EVFILT_SYSCOUNT) return(EINVAL);
+  if (kev->flags & EV_CLEAR) return(EINVAL);
+
+  if (kev->flags & EV_DELETE) {
+	if ((kn = kq->kq_knotes[fd][filter]) == NULL) return(ENOENT);
+	knote_drop(kn);
+	return(OK);
+  }
+
+  if ((kn = kq->kq_knotes[fd][filter]) == NULL) {
+	if (!(kev->flags & EV_ADD)) return(ENOENT);
+	if ((r = knote_add(kq, fd, filter)) != OK) return(r);
+	kn = kq->kq_knotes[fd][filter];
+	kn->kn_udata = kev->udata;
+	if (kev->flags & EV_ONESHOT) kn->kn_flags |= KN_ONESHOT;
+	if (kev->flags & EV_DISABLE) kn->kn_flags |= KN_DISABLED;
+
+	r = knote_arm(kn);
+	if (r != OK && r != SUSPEND) {
+		knote_drop(kn);
+		return(r);
+	}
+	return(OK);
+  }
+
+  if (kev->flags & EV_ADD) {
+	kn->kn_udata = kev->udata;
+	if (kev->flags & EV_ONESHOT)
+		kn->kn_flags |= KN_ONESHOT;
+	else
+		kn->kn_flags &= ~KN_ONESHOT;
+  }
+
+  if (kev->flags & EV_DISABLE) {
+	kn->kn_flags |= KN_DISABLED;
+	if (kn->kn_flags & KN_QUEUED) knote_unqueue(kn);
+  } else if (kev->flags & (EV_ENABLE|EV_ADD)) {
+	kn->kn_flags &= ~KN_DISABLED;
+	if (kn->kn_ready) knote_fire(kn, 0);	/* Queue what came in */
+  }
+
+  return(OK);
+}
+
+/*===========================================================================*
+ *				kq_find					     *
+ *===========================================================================*/
+static struct kqentry *kq_find(struct fproc *rfp, int fd)
+{
+/* Find the event queue bound to a file descriptor of a process */
+  int s;
+
+  for (s = 0; s < MAXKQUEUES && nr_kqueues > 0; s++) {
+	if (kqtab[s].kq_owner == rfp && kqtab[s].kq_fd == fd)
+		return(&kqtab[s]);
+  }
+
+  return(NULL);
+}
+
+/*===========================================================================*
+ *				kq_free					     *
+ *===========================================================================*/
+static void kq_free(struct kqentry *kq)
+{
+/* Release an event queue and all its registrations */
+  int fd, filter;
+
+  for (fd = 0; fd < OPEN_MAX; fd++) {
+	for (filter = 0; filter < EVFILT_SYSCOUNT; filter++) {
+		if (kq->kq_knotes[fd][filter] != NULL)
+			knote_drop(kq->kq_knotes[fd][filter]);
+	}
+  }
+
+  if (kq->kq_expiry > 0) {
+	cancel_timer(&kq->kq_timer);
+	kq->kq_expiry = 0;
+  }
+
+  kq->kq_block = FALSE;
+  kq->kq_owner = NULL;
+  nr_kqueues--;
+}
+
+/*===========================================================================*
+ *				kqueue_close_fd				     *
+ *===========================================================================*/
+void kqueue_close_fd(struct fproc *rfp, int fd)
+{
+/* A file descriptor was closed. If an event queue is bound to it, release the
+ * queue. Otherwise forget what event queues had registered for it. */
+  int s, filter;
+  struct kqentry *kq;
+
+  for (s = 0; s < MAXKQUEUES && nr_kqueues > 0; s++) {
+	kq = &kqtab[s];
+	if (kq->kq_owner != rfp) continue;
+
+	if (kq->kq_fd == fd) {
+		kq_free(kq);
+		continue;
+	}
+
+	for (filter = 0; filter < EVFILT_SYSCOUNT; filter++) {
+		if (kq->kq_knotes[fd][filter] != NULL)
+			knote_drop(kq->kq_knotes[fd][filter]);
+	}
+  }
+}
+
+/*===========================================================================*
+ *				kq_collect				     *
+ *===========================================================================*/
+static int kq_collect(struct kqentry *kq, struct kevent *vir_events,
+	int nevents)
+{
+/* Copy up to nevents ready events to the owner of the event queue. Return the
+ * number of events copied, or an error. One-shot knotes are deleted, the
+ * others are put on the rearm list. */
+  int r, n, batch;
+  struct kevent kev[KEV_BATCH];
+  struct knote *kn;
+
+  r = OK;
+  n = batch = 0;
+
+  while (n + batch < nevents && (kn = kq->kq_ready) != NULL) {
+	knote_unqueue(kn);
+
+	kev[batch].ident = (uintptr_t) kn->kn_fd;
+	kev[batch].filter = (uint32_t) kn->kn_filter;
+	kev[batch].flags = (kn->kn_ready & SEL_ERR) ? EV_EOF : 0;
+	kev[batch].fflags = 0;
+	kev[batch].data = 0;
+	kev[batch].udata = kn->kn_udata;
+	batch++;
+
+	if (kn->kn_flags & KN_ONESHOT) {
+		knote_drop(kn);
+	} else {
+		kn->kn_flags |= KN_REARM;
+		kn->kn_qnext = kq->kq_rearm;
+		kq->kq_rearm = kn;
+	}
+
+	if (batch == KEV_BATCH) {
+		r = sys_vircopy(SELF, D, (vir_bytes) kev,
+			kq->kq_owner->fp_endpoint, D,
+			(vir_bytes) (vir_events + n), batch * sizeof(kev[0]));
+		if (r != OK) return(r);
+		n += batch;
+		batch = 0;
+	}
+  }
+
+  if (batch > 0) {
+	r = sys_vircopy(SELF, D, (vir_bytes) kev, kq->kq_owner->fp_endpoint,
+		D, (vir_bytes) (vir_events + n), batch * sizeof(kev[0]));
+	if (r != OK) return(r);
+	n += batch;
+  }
+
+  return(n);
+}
+
+/*===========================================================================*
+ *				kq_wakeup				     *
+ *===========================================================================*/
+static void kq_wakeup(void)
+{
+/* Revive the processes blocked in kevent() that have events now */
+  int s, r;
+  struct kqentry *kq;
+
+  for (s = 0; s < MAXKQUEUES && nr_kqueues > 0; s++) {
+	kq = &kqtab[s];
+	if (kq->kq_owner == NULL || !kq->kq_block || kq->kq_ready == NULL)
+		continue;
+
+	kq->kq_block = FALSE;
+	r = kq_collect(kq, kq->kq_vir_events, kq->kq_nevents);
+	if (r == 0) {
+		/* All disabled in the meantime; keep waiting */
+		kq->kq_block = TRUE;
+		continue;
+	}
+
+	if (kq->kq_expiry > 0) {
+		cancel_timer(&kq->kq_timer);
+		kq->kq_expiry = 0;
+	}
+	revive(kq->kq_owner->fp_endpoint, r);
+  }
+}
+
+/*===========================================================================*
+ *				kq_timeout_check			     *
+ *===========================================================================*/
+static void kq_timeout_check(timer_t *timer)
+{
+  int s;
+  struct kqentry *kq;
+
+  s = tmr_arg(timer)->ta_int;
+  if (s < 0 || s >= MAXKQUEUES) return;	/* Entry does not exist */
+
+  kq = &kqtab[s];
+  if (kq->kq_owner == NULL || !kq->kq_block) return;
+  if (kq->kq_expiry <= 0) return;
+  kq->kq_expiry = 0;
+  kq->kq_block = FALSE;
+  fp = kq->kq_owner;
+  revive(kq->kq_owner->fp_endpoint, 0);
+}
+
+/*===========================================================================*
+ *				knote_add				     *
+ *===========================================================================*/
+static int knote_add(struct kqentry *kq, int fd, int filter)
+{
+/* Register a file descriptor of the caller with an event queue */
+  unsigned int type;
+  struct filp *f;
+  struct knote *kn;
+
+  if ((kn = knote_free) == NULL) return(ENOSPC);
+
+  if ((f = get_filp(fd, VNODE_READ)) == NULL) return(err_code);
+  for (type = 0; type < SEL_FDS; type++)
+	if (fdtypes[type].type_match(f)) break;
+  if (type >= SEL_FDS) {
+	unlock_filp(f);
+	return(EBADF);
+  }
+  f->filp_selectors++;
+  unlock_filp(f);
+
+  knote_free = kn->kn_qnext;
+  kn->kn_kq = kq;
+  kn->kn_filp = f;
+  kn->kn_fd = fd;
+  kn->kn_filter = filter;
+  kn->kn_type = type;
+  kn->kn_ops = (filter == EVFILT_READ ? SEL_RD : SEL_WR);
+  kn->kn_ready = 0;
+  kn->kn_flags = 0;
+  kn->kn_udata = 0;
+  kn->kn_qnext = NULL;
+
+  kn->kn_fnext = f->filp_knotes;
+  f->filp_knotes = kn;
+
+  kn->kn_dev = NO_DEV;
+  kn->kn_dnext = NULL;
+  if ((f->filp_vno->v_mode & I_TYPE) == I_CHAR_SPECIAL) {
+	kn->kn_dev = f->filp_vno->v_sdev;
+	kn->kn_dnext = knote_hash[KN_HASH(kn->kn_dev)];
+	knote_hash[KN_HASH(kn->kn_dev)] = kn;
+  }
+
+  kq->kq_knotes[fd][filter] = kn;
+
+  return(OK);
+}
+
+/*===========================================================================*
+ *				knote_arm				     *
+ *===========================================================================*/
+static int knote_arm(struct knote *kn)
+{
+/* Ask for the operation of a knote the way a blocking select() would. If it
+ * is ready right away, put the knote on the ready list. */
+  int r, ops;
+  struct filp *f;
+
+  f = kn->kn_filp;
+  if (f->filp_count < 1) return(EBADF);
+
+  ops = kn->kn_ops;
+  select_lock_filp(f, ops);
+  f->filp_select_ops |= ops;
+  r = fdtypes[kn->kn_type].select_request(f, &ops, TRUE);
+  unlock_filp(f);
+  if (kn->kn_kq == NULL) return(EBADF);	/* Dropped while we were locking */
+
+  if (r == SUSPEND) {
+	/* Either the driver will reply, or the request could not be sent
+	 * yet because the driver is busy with another one. */
+	if ((f->filp_select_flags & FSF_UPDATE) &&
+	    !(kn->kn_flags & KN_DEFERRED)) {
+		kn->kn_flags |= KN_DEFERRED;
+		nr_deferred_knotes++;
+	}
+  } else if (r != OK) {
+	knote_fire(kn, r);
+  } else if (ops & kn->kn_ops) {
+	knote_fire(kn, ops);
+  }
+
+  return(r);
+}
+
+/*===========================================================================*
+ *				knote_fire				     *
+ *===========================================================================*/
+static void knote_fire(struct knote *kn, int status)
+{
+/* Record that operations of a knote are ready, or that an error occurred,
+ * and put the knote on the ready list of its queue. kq_wakeup() has to be
+ * called afterwards to tell a blocked owner. */
+  struct kqentry *kq;
+
+  if (status < 0)
+	kn->kn_ready |= kn->kn_ops | SEL_ERR;
+  else
+	kn->kn_ready |= status & (kn->kn_ops | SEL_ERR);
+
+  /* A knote to be armed again is reported, if still ready, once it is */
+  if (kn->kn_ready == 0) return;
+  if (kn->kn_flags & (KN_QUEUED|KN_DISABLED|KN_REARM)) return;
+
+  kq = kn->kn_kq;
+  kn->kn_qnext = NULL;
+  if (kq->kq_ready_tail != NULL)
+	kq->kq_ready_tail->kn_qnext = kn;
+  else
+	kq->kq_ready = kn;
+  kq->kq_ready_tail = kn;
+  kn->kn_flags |= KN_QUEUED;
+}
+
+/*===========================================================================*
+ *				knote_unqueue				     *
+ *===========================================================================*/
+static void knote_unqueue(struct knote *kn)
+{
+/* Take a knote off the ready list of its queue */
+  struct kqentry *kq;
+  struct knote **knp, *prev;
+
+  kq = kn->kn_kq;
+  prev = NULL;
+  for (knp = &kq->kq_ready; *knp != NULL; knp = &(*knp)->kn_qnext) {
+	if (*knp == kn) {
+		*knp = kn->kn_qnext;
+		if (kq->kq_ready_tail == kn) kq->kq_ready_tail = prev;
+		break;
+	}
+	prev = *knp;
+  }
+
+  kn->kn_qnext = NULL;
+  kn->kn_flags &= ~KN_QUEUED;
+}
+
+/*===========================================================================*
+ *				knote_drop				     *
+ *===========================================================================*/
+static void knote_drop(struct knote *kn)
+{
+/* Remove a registration from its event queue and return it to the pool */
+  struct filp *f;
+  struct knote **knp;
+
+  if (kn->kn_flags & KN_QUEUED) knote_unqueue(kn);
+  if (kn->kn_flags & KN_DEFERRED) nr_deferred_knotes--;
+  if (kn->kn_flags & KN_REARM) {
+	for (knp = &kn->kn_kq->kq_rearm; *knp != NULL;
+	     knp = &(*knp)->kn_qnext) {
+		if (*knp == kn) {
+			*knp = kn->kn_qnext;
+			break;
+		}
+	}
+  }
+
+  f = kn->kn_filp;
+  for (knp = &f->filp_knotes; *knp != NULL; knp = &(*knp)->kn_fnext) {
+	if (*knp == kn) {
+		*knp = kn->kn_fnext;
+		break;
+	}
+  }
+
+  if (kn->kn_dev != NO_DEV) {
+	for (knp = &knote_hash[KN_HASH(kn->kn_dev)]; *knp != NULL;
+	     knp = &(*knp)->kn_dnext) {
+		if (*knp == kn) {
+			*knp = kn->kn_dnext;
+			break;
+		}
+	}
+  }
+
+  kn->kn_kq->kq_knotes[kn->kn_fd][kn->kn_filter] = NULL;
+  kn->kn_kq = NULL;
+  kn->kn_filp = NULL;
+  kn->kn_flags = 0;
+  kn->kn_qnext = knote_free;
+  knote_free = kn;
+
+  select_cancel_filp(f);
+}
@@ -24,6 +24,7 @@
 #define cond_signal	mthread_cond_signal
 
 struct worker_thread {
+  int w_alive;			/* set if the thread of this slot exists */
   thread_t w_tid;
   mutex_t w_event_mutex;
   cond_t w_event;
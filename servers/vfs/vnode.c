@@ -4,6 +4,7 @@
  *  get_vnode - increase counter and get details of an inode
  *  get_free_vnode - get a pointer to a free vnode obj
  *  find_vnode - find a vnode according to the FS endpoint and the inode num.
+ *  hash_vnode - make a vnode findable after its FS endpoint and inode are set
  *  dup_vnode - duplicate vnode (i.e. increase counter)
  *  put_vnode - drop vnode (i.e. decrease counter)
  */
@@ -15,15 +16,25 @@
 #include "fproc.h"
 #include "file.h"
 #include <minix/vfsif.h>
+#include <stdlib.h>
 #include <assert.h>
 
+static struct vnode **vnode_hash;	/* hash chains by FS endpoint and inode */
+static struct vnode *free_vnodes;	/* vnodes that may be free */
+
+#define VNODE_HASH(fs_e, ino) \
+	((((unsigned int) (fs_e)) * 31 + (unsigned int) (ino)) % nr_vnodes)
+
+static void free_vnode(struct vnode *vp);
+static void unhash_vnode(struct vnode *vp);
+
 /* Is vnode pointer reasonable? */
 #if NDEBUG
 #define SANEVP(v)
 #define CHECKVN(v)
 #define ASSERTVP(v)
 #else
-#define SANEVP(v) ((((v) >= &vnode[0] && (v) < &vnode[NR_VNODES])))
+#define SANEVP(v) ((((v) >= &vnode[0] && (v) < &vnode[nr_vnodes])))
 
 #define BADVP(v, f, l) printf("%s:%d: bad vp %p\n", f, l, v)
 
@@ -47,7 +58,7 @@ void check_vnode_locks_by_me(struct fproc *rfp)
 /* Check whether this thread still has locks held on vnodes */
   struct vnode *vp;
 
-  for (vp = &vnode[0]; vp < &vnode[NR_VNODES]; vp++) {
+  for (vp = &vnode[0]; vp < &vnode[nr_vnodes]; vp++) {
 	if (tll_locked_by_me(&vp->v_lock)) {
 		panic("Thread %d still holds vnode lock on vp %x call_nr=%d\n",
 		      mthread_self(), vp, job_call_nr);
@@ -68,7 +79,7 @@ void check_vnode_locks()
   struct vnode *vp;
   int count = 0;
 
-  for (vp = &vnode[0]; vp < &vnode[NR_VNODES]; vp++)
+  for (vp = &vnode[0]; vp < &vnode[nr_vnodes]; vp++)
 	if (is_vnode_locked(vp)) {
 		count++;
 	}
@@ -84,26 +95,92 @@ void check_vnode_locks()
  *===========================================================================*/
 struct vnode *get_free_vnode()
 {
-/* Find a free vnode slot in the vnode table (it's not actually allocated) */
+/* Find a free vnode slot in the vnode table (it's not actually allocated).
+ * The slot is taken from the free list, but stays at its head until it turns
+ * out to be in use; callers may still decide not to use it. If the free list
+ * runs dry, rebuild it from the table once.
+ */
   struct vnode *vp;
-
-  for (vp = &vnode[0]; vp < &vnode[NR_VNODES]; ++vp) {
-	if (vp->v_ref_count == 0 && !is_vnode_locked(vp)) {
-		vp->v_pipe = NO_PIPE;
-		vp->v_uid  = -1;
-		vp->v_gid  = -1;
-		vp->v_sdev = NO_DEV;
-		vp->v_mapfs_e = NONE;
-		vp->v_mapfs_count = 0;
-		vp->v_mapinode_nr = 0;
-		return(vp);
+  int rebuilt = FALSE;
+
+  for (;;) {
+	while ((vp = free_vnodes) != NULL) {
+		if (vp->v_ref_count == 0 && !is_vnode_locked(vp)) {
+			unhash_vnode(vp);
+			vp->v_pipe = NO_PIPE;
+			vp->v_uid  = -1;
+			vp->v_gid  = -1;
+			vp->v_sdev = NO_DEV;
+			vp->v_mapfs_e = NONE;
+			vp->v_mapfs_count = 0;
+			vp->v_mapinode_nr = 0;
+			return(vp);
+		}
+
+		/* In use after all */
+		free_vnodes = vp->v_nextfree;
+		vp->v_onfree = FALSE;
 	}
+
+	if (rebuilt) break;
+
+	for (vp = &vnode[0]; vp < &vnode[nr_vnodes]; ++vp)
+		if (vp->v_ref_count == 0 && !is_vnode_locked(vp))
+			free_vnode(vp);
+	rebuilt = TRUE;
   }
 
   err_code = ENFILE;
   return(NULL);
 }
 
+/*===========================================================================*
+ *				free_vnode				     *
+ *===========================================================================*/
+static void free_vnode(struct vnode *vp)
+{
+/* Put a vnode that is not in use anymore on the free list. It stays findable
+ * in the hash table until the slot is reused, but find_vnode skips it. */
+
+  if (vp->v_onfree) return;
+
+  vp->v_onfree = TRUE;
+  vp->v_nextfree = free_vnodes;
+  free_vnodes = vp;
+}
+
+/*===========================================================================*
+ *				hash_vnode				     *
+ *===========================================================================*/
+void hash_vnode(struct vnode *vp)
+{
+/* The FS endpoint and inode number of a vnode have been set. Put it in the
+ * hash table, so that find_vnode can find it. */
+  struct vnode **vpp;
+
+  ASSERTVP(vp);
+
+  unhash_vnode(vp);
+
+  vpp = &vnode_hash[VNODE_HASH(vp->v_fs_e, vp->v_inode_nr)];
+  vp->v_hnext = *vpp;
+  if (vp->v_hnext != NULL) vp->v_hnext->v_hprev = &vp->v_hnext;
+  vp->v_hprev = vpp;
+  *vpp = vp;
+}
+
+
+/*===========================================================================*
+ *				unhash_vnode				     *
+ *===========================================================================*/
+static void unhash_vnode(struct vnode *vp)
+{
+  if (vp->v_hprev == NULL) return;
+
+  *vp->v_hprev = vp->v_hnext;
+  if (vp->v_hnext != NULL) vp->v_hnext->v_hprev = vp->v_hprev;
+  vp->v_hprev = NULL;
+}
 
 /*===========================================================================*
  *				find_vnode				     *
@@ -114,7 +191,7 @@ struct vnode *find_vnode(int fs_e, ino_t ino)
  * vnode table */
   struct vnode *vp;
 
-  for (vp = &vnode[0]; vp < &vnode[NR_VNODES]; ++vp)
+  for (vp = vnode_hash[VNODE_HASH(fs_e, ino)]; vp != NULL; vp = vp->v_hnext)
 	if (vp->v_ref_count > 0 && vp->v_inode_nr == ino && vp->v_fs_e == fs_e)
 		return(vp);
 
@@ -138,16 +215,31 @@ int is_vnode_locked(struct vnode *vp)
  *===========================================================================*/
 void init_vnodes(void)
 {
+/* Allocate the vnode table. Its size can be set with a boot parameter. */
   struct vnode *vp;
+  long nr;
+
+  nr = NR_VNODES;
+  (void) env_parse("vfs_vnodes", "d", 0, &nr, NR_VNODES_MIN, NR_VNODES_MAX);
+  nr_vnodes = (int) nr;
+
+  vnode = calloc(nr_vnodes, sizeof(struct vnode));
+  vnode_hash = calloc(nr_vnodes, sizeof(struct vnode *));
+  if (vnode == NULL || vnode_hash == NULL)
+	panic("VFS: unable to allocate %d vnodes", nr_vnodes);
 
-  for (vp = &vnode[0]; vp < &vnode[NR_VNODES]; ++vp) {
+  free_vnodes = NULL;
+  for (vp = &vnode[nr_vnodes - 1]; vp >= &vnode[0]; --vp) {
 	vp->v_fs_e = NONE;
 	vp->v_mapfs_e = NONE;
 	vp->v_inode_nr = 0;
 	vp->v_ref_count = 0;
 	vp->v_fs_count = 0;
 	vp->v_mapfs_count = 0;
+	vp->v_hprev = NULL;
+	vp->v_filps = NULL;
 	tll_init(&vp->v_lock);
+	free_vnode(vp);
   }
 }
 
@@ -191,7 +283,7 @@ void unlock_vnode(struct vnode *vp)
 	fp->fp_vp_rdlocks--;
   }
 
-  for (i = 0; i < NR_VNODES; i++) {
+  for (i = 0; i < nr_vnodes; i++) {
 	rvp = &vnode[i];
 
 	w = rvp->v_lock.t_write;
@@ -286,8 +378,10 @@ void put_vnode(struct vnode *vp)
   vp->v_fs_count = 0;
   vp->v_ref_count = 0;
   vp->v_mapfs_count = 0;
+  pipe_free(vp);		/* drop what was left in a pipe */
 
   unlock_vnode(vp);
+  free_vnode(vp);
 }
 
 
@@ -19,6 +19,8 @@ EXTERN struct vnode {
   char v_pipe;			/* set to I_PIPE if pipe */
   off_t v_pipe_rd_pos;
   off_t v_pipe_wr_pos;
+  char *v_pipe_buf;		/* data in the pipe, or NULL */
+  size_t v_pipe_bufsize;	/* allocated size of v_pipe_buf */
   endpoint_t v_bfs_e;		/* endpoint number for the FS proces in case
 				   of a block special file */
   dev_t v_dev;                  /* device number on which the corresponding
@@ -26,7 +28,14 @@ EXTERN struct vnode {
   dev_t v_sdev;                 /* device number for special files */
   struct vmnt *v_vmnt;          /* vmnt object of the partition */
   tll_t v_lock;			/* three-level-lock */
-} vnode[NR_VNODES];
+  struct vnode *v_hnext;	/* next vnode in the same hash chain */
+  struct vnode **v_hprev;	/* pointer to us in hash chain, or NULL */
+  struct vnode *v_nextfree;	/* next vnode on the free list */
+  char v_onfree;		/* set if on the free list */
+  struct filp *v_filps;		/* filps that refer to this vnode */
+} *vnode;
+
+EXTERN int nr_vnodes;		/* # slots in vnode table */
 
 
 /* Field values. */
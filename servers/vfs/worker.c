@@ -6,7 +6,9 @@
 #include <assert.h>
 
 static void append_job(struct job *job, void *(*func)(void *arg));
-static void get_work(struct worker_thread *worker);
+static int get_work(struct worker_thread *worker);
+static struct worker_thread *worker_spawn(void);
+static int worker_idle(struct worker_thread *worker);
 static void *worker_main(void *arg);
 static void worker_sleep(struct worker_thread *worker);
 static void worker_wake(struct worker_thread *worker);
@@ -14,6 +16,12 @@ static int worker_waiting_for(struct worker_thread *worker, endpoint_t
 	proc_e);
 static int init = 0;
 static mthread_attr_t tattr;
+static int nr_workers = 0;	/* # worker threads in workers[] */
+
+/* Processes that have a job for which no worker thread was available, in the
+ * order in which the jobs came in.
+ */
+static TAILQ_HEAD(pending_list, fproc) pending_procs;
 
 #ifdef MKCOVERAGE
 # define TH_STACKSIZE (10 * 1024)
@@ -40,12 +48,15 @@ void worker_init(struct worker_thread *wp)
 		panic("couldn't set default thread detach state");
 	invalid_thread_id = mthread_self(); /* Assuming we're the main thread*/
 	pending = 0;
+	TAILQ_INIT(&pending_procs);
 	init = 1;
   }
 
   ASSERTW(wp);
 
+  wp->w_alive = TRUE;
   wp->w_job.j_func = NULL;		/* Mark not in use */
+  wp->w_job.j_next = NULL;
   wp->w_next = NULL;
   if (mutex_init(&wp->w_event_mutex, NULL) != 0)
 	panic("failed to initialize mutex");
@@ -56,13 +67,92 @@ void worker_init(struct worker_thread *wp)
   yield();
 }
 
+/*===========================================================================*
+ *				worker_init_pool			     *
+ *===========================================================================*/
+void worker_init_pool(void)
+{
+/* Start the minimum number of worker threads. More are started when all of
+ * them are busy, up to the maximum. Both can be set with boot parameters. */
+  int i;
+  long min, max;
+
+  min = WTHREADS_MIN;
+  max = NR_WTHREADS;
+  (void) env_parse("vfs_threads_min", "d", 0, &min, 1, NR_WTHREADS);
+  (void) env_parse("vfs_threads_max", "d", 0, &max, 1, NR_WTHREADS);
+  wthreads_min = (int) min;
+  wthreads_max = (int) (max < min ? min : max);
+
+  for (i = 0; i < NR_WTHREADS; i++)
+	workers[i].w_alive = FALSE;
+
+  for (i = 0; i < wthreads_min; i++) {
+	worker_init(&workers[i]);
+	nr_workers++;
+  }
+}
+
+/*===========================================================================*
+ *				worker_spawn				     *
+ *===========================================================================*/
+static struct worker_thread *worker_spawn(void)
+{
+/* Start another worker thread, if the maximum has not been reached yet. */
+  int i;
+
+  if (nr_workers >= wthreads_max) return(NULL);
+
+  for (i = 0; i < NR_WTHREADS; i++) {
+	if (!workers[i].w_alive) {
+		worker_init(&workers[i]);
+		nr_workers++;
+		return(&workers[i]);
+	}
+  }
+
+  return(NULL);
+}
+
+/*===========================================================================*
+ *				worker_idle				     *
+ *===========================================================================*/
+static int worker_idle(struct worker_thread *worker)
+{
+/* A worker thread without work decides whether it is still needed. It is not
+ * if the pool is above its minimum size and enough other threads are idle
+ * already. In that case free its slot and let it exit. */
+  int i, idle;
+
+  if (worker == &sys_worker || worker == &dl_worker) return(FALSE);
+  if (nr_workers <= wthreads_min) return(FALSE);
+
+  idle = 0;
+  for (i = 0; i < NR_WTHREADS; i++) {
+	if (&workers[i] != worker && workers[i].w_alive &&
+	    workers[i].w_job.j_func == NULL)
+		idle++;
+  }
+  if (idle < WTHREADS_SPARE) return(FALSE);
+
+  worker->w_alive = FALSE;
+  nr_workers--;
+  if (mutex_destroy(&worker->w_event_mutex) != 0)
+	panic("failed to destroy mutex");
+  if (cond_destroy(&worker->w_event) != 0)
+	panic("failed to destroy conditional variable");
+
+  return(TRUE);
+}
+
 /*===========================================================================*
  *				get_work				     *
  *===========================================================================*/
-static void get_work(struct worker_thread *worker)
+static int get_work(struct worker_thread *worker)
 {
 /* Find new work to do. Work can be 'queued', 'pending', or absent. In the
- * latter case wait for new work to come in. */
+ * latter case wait for new work to come in, unless this thread is no longer
+ * needed. Return FALSE if the thread is to exit. */
 
   struct job *new_job;
   struct fproc *rfp;
@@ -74,40 +164,67 @@ static void get_work(struct worker_thread *worker)
   if ((new_job = worker->w_job.j_next) != NULL) {
 	worker->w_job = *new_job;
 	free(new_job);
-	return;
+	return(TRUE);
   } else if (worker != &sys_worker && worker != &dl_worker && pending > 0) {
-	/* Find pending work */
-	for (rfp = &fproc[0]; rfp < &fproc[NR_PROCS]; rfp++) {
-		if (rfp->fp_flags & FP_PENDING) {
-			worker->w_job = rfp->fp_job;
-			rfp->fp_job.j_func = NULL;
-			rfp->fp_flags &= ~FP_PENDING; /* No longer pending */
-			pending--;
-			assert(pending >= 0);
-			return;
-		}
-	}
-	panic("Pending work inconsistency");
+	/* Take the oldest pending work */
+	rfp = TAILQ_FIRST(&pending_procs);
+	if (rfp == NULL || !(rfp->fp_flags & FP_PENDING))
+		panic("Pending work inconsistency");
+	TAILQ_REMOVE(&pending_procs, rfp, fp_pending);
+	worker->w_job = rfp->fp_job;
+	rfp->fp_job.j_func = NULL;
+	rfp->fp_flags &= ~FP_PENDING; /* No longer pending */
+	pending--;
+	assert(pending >= 0);
+	return(TRUE);
   }
 
+  if (worker_idle(worker)) return(FALSE);
+
   /* Wait for work to come to us */
   worker_sleep(worker);
+  return(TRUE);
 }
 
 /*===========================================================================*
- *				worker_available				     *
+ *				worker_forget				     *
  *===========================================================================*/
-int worker_available(void)
+void worker_forget(struct fproc *rfp)
+{
+/* Forget about the pending job of a process */
+  assert(rfp->fp_flags & FP_PENDING);
+
+  TAILQ_REMOVE(&pending_procs, rfp, fp_pending);
+  rfp->fp_job.j_func = NULL;
+  rfp->fp_flags &= ~FP_PENDING;
+  pending--;
+  assert(pending >= 0);
+}
+
+/*===========================================================================*
+ *				worker_busy				     *
+ *===========================================================================*/
+int worker_busy(void)
 {
   int busy, i;
 
   busy = 0;
   for (i = 0; i < NR_WTHREADS; i++) {
-	if (workers[i].w_job.j_func != NULL)
+	if (workers[i].w_alive && workers[i].w_job.j_func != NULL)
 		busy++;
   }
 
-  return(NR_WTHREADS - busy);
+  return(busy);
+}
+
+/*===========================================================================*
+ *				worker_available				     *
+ *===========================================================================*/
+int worker_available(void)
+{
+/* Return the number of jobs that can be started right away, counting the
+ * worker threads that can still be added to the pool. */
+  return(wthreads_max - worker_busy());
 }
 
 /*===========================================================================*
@@ -121,8 +238,7 @@ static void *worker_main(void *arg)
   me = (struct worker_thread *) arg;
   ASSERTW(me);
 
-  while(TRUE) {
-	get_work(me);
+  while (get_work(me)) {
 
 	/* Register ourselves in fproc table if possible */
 	if (me->w_job.j_fp != NULL) {
@@ -142,7 +258,7 @@ static void *worker_main(void *arg)
 	me->w_job.j_fp = NULL;
   }
 
-  return(NULL);	/* Unreachable */
+  return(NULL);	/* Thread exits, its slot has been freed */
 }
 
 /*===========================================================================*
@@ -220,12 +336,15 @@ void worker_start(void *(*func)(void *arg))
 
   worker = NULL;
   for (i = 0; i < NR_WTHREADS; i++) {
-	if (workers[i].w_job.j_func == NULL) {
+	if (workers[i].w_alive && workers[i].w_job.j_func == NULL) {
 		worker = &workers[i];
 		break;
 	}
   }
 
+  /* All worker threads are busy, try to add one. */
+  if (worker == NULL && pending == 0) worker = worker_spawn();
+
   if (worker != NULL) {
 	worker->w_job.j_fp = fp;
 	worker->w_job.j_m_in = m_in;
@@ -250,6 +369,7 @@ void worker_start(void *(*func)(void *arg))
 	fp->fp_job.j_next = NULL;
 	fp->fp_job.j_err_code = OK;
 	fp->fp_flags |= FP_PENDING;
+	TAILQ_INSERT_TAIL(&pending_procs, fp, fp_pending);
 	pending++;
   }
 }
@@ -356,7 +476,7 @@ struct worker_thread *worker_get(thread_t worker_tid)
 	worker = &dl_worker;
   else {
 	for (i = 0; i < NR_WTHREADS; i++) {
-		if (workers[i].w_tid == worker_tid) {
+		if (workers[i].w_alive && workers[i].w_tid == worker_tid) {
 			worker = &workers[i];
 			break;
 		}
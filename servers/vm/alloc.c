@@ -8,6 +8,9 @@
  * kernel, and PM are "allocated" to mark them as not available and to
  * remove them from the hole list.
  *
+ * Free pages themselves are managed by a buddy allocator, with a small
+ * cache of single pages in front of it; see below.
+ *
  * The entry points into this file are:
  *   alloc_mem:	allocate a given sized chunk of memory
  *   free_mem:	release a previously allocated chunk of memory
@@ -43,7 +46,7 @@
 #include "sanitycheck.h"
 #include "memlist.h"
 
-/* AVL tree of free pages. */
+/* AVL tree of free blocks, by address. */
 addr_avl addravl;
 
 /* Used for sanity check. */
@@ -185,14 +188,15 @@ phys_clicks alloc_mem(phys_clicks clicks, u32_t memflags)
 CHECKHOLES;
 
   if(align_clicks) {
-  	phys_clicks o;
+  	phys_clicks o, e = 0;
   	o = mem % align_clicks;
   	if(o > 0) {
-  		phys_clicks e;
   		e = align_clicks - o;
 	  	free_mem(mem, e);
 	  	mem += e;
 	}
+	/* Give back the part of the slack not used for alignment. */
+	free_mem(mem + clicks - align_clicks, align_clicks - e);
   }
 CHECKHOLES;
 
@@ -357,6 +361,296 @@ struct memory *chunks;		/* list of free memory chunks */
   CHECKHOLES;
 }
 
+/* Free memory is kept in a binary buddy system. Every free block is
+ * 2^order pages long and aligned to its size; it is in the AVL tree, which
+ * is used to find a block's buddy when it is freed, and on the free list of
+ * its order and zone, which is used to find a block to allocate. Blocks never
+ * straddle a zone boundary, so PAF_LOWER16MB and PAF_LOWER1MB allocations
+ * only have to look at the lists of the low zones.
+ */
+#define ZONE_1MB	0	/* below 1MB */
+#define ZONE_16MB	1	/* between 1MB and 16MB */
+#define ZONE_HIGH	2	/* everything else */
+#define NR_ZONES	3
+
+#define BOUNDARY1	(1 * 1024 * 1024 / VM_PAGE_SIZE)
+#define BOUNDARY16	(16 * 1024 * 1024 / VM_PAGE_SIZE)
+
+static pagerange_t *freelist[NR_ZONES][BUDDY_ORDERS];
+
+/* Single free pages are the common case by far. Recently freed ones are
+ * kept on a stack and handed out again without touching the buddy lists.
+ * Only pages from ZONE_HIGH are kept here, so that low memory stays
+ * available for allocations that need it.
+ */
+static struct pagecache {
+	int pc_count;
+	phys_bytes pc_pages[PAGECACHE_SIZE];
+} pagecache;
+
+static void free_range(phys_bytes pageno, phys_bytes npages);
+
+/*===========================================================================*
+ *				page_zone				     *
+ *===========================================================================*/
+static int page_zone(phys_bytes pageno)
+{
+	if(pageno < BOUNDARY1)
+		return ZONE_1MB;
+	if(pageno < BOUNDARY16)
+		return ZONE_16MB;
+	return ZONE_HIGH;
+}
+
+/*===========================================================================*
+ *				max_zone				     *
+ *===========================================================================*/
+static int max_zone(int memflags)
+{
+/* Highest zone an allocation with these flags may come from. */
+	if(memflags & PAF_LOWER1MB)
+		return ZONE_1MB;
+	if(memflags & PAF_LOWER16MB)
+		return ZONE_16MB;
+	return ZONE_HIGH;
+}
+
+/*===========================================================================*
+ *				pages_order				     *
+ *===========================================================================*/
+static int pages_order(phys_bytes pages)
+{
+/* Smallest order whose blocks hold this many pages. */
+	int order = 0;
+
+	while(((phys_bytes) 1 << order) < pages)
+		order++;
+
+	return order;
+}
+
+/*===========================================================================*
+ *				block_insert				     *
+ *===========================================================================*/
+static void block_insert(pagerange_t *pr, phys_bytes pageno, int order)
+{
+	pagerange_t **head;
+
+	head = &freelist[page_zone(pageno)][order];
+
+	USE(pr, pr->addr = pageno;
+		pr->size = (phys_bytes) 1 << order;
+		pr->order = order;
+		pr->prev = NULL;
+		pr->next = *head;);
+	if(*head)
+		USE(*head, (*head)->prev = pr;);
+	*head = pr;
+	addr_insert(&addravl, pr);
+}
+
+/*===========================================================================*
+ *				block_remove				     *
+ *===========================================================================*/
+static void block_remove(pagerange_t *pr)
+{
+	pagerange_t *prr;
+
+	SLABSANE(pr);
+
+	if(pr->prev)
+		USE(pr->prev, pr->prev->next = pr->next;);
+	else
+		freelist[page_zone(pr->addr)][pr->order] = pr->next;
+	if(pr->next)
+		USE(pr->next, pr->next->prev = pr->prev;);
+
+	prr = addr_remove(&addravl, pr->addr);
+	assert(prr == pr);
+}
+
+/*===========================================================================*
+ *				free_block				     *
+ *===========================================================================*/
+static void free_block(phys_bytes pageno, int order)
+{
+/* Put a block back, merging it with its buddy as long as that is free too.
+ * A node of a merged buddy is reused for the result, so that freeing
+ * normally doesn't need to allocate.
+ */
+	pagerange_t *pr = NULL, *b;
+
+	assert(!(pageno % ((phys_bytes) 1 << order)));
+
+	while(order < BUDDY_ORDERS-1) {
+		phys_bytes buddy, merged;
+
+		buddy = pageno ^ ((phys_bytes) 1 << order);
+		merged = pageno & buddy;
+		if(page_zone(merged) !=
+		   page_zone(merged + ((phys_bytes) 2 << order) - 1))
+			break;
+		if(!(b = addr_search(&addravl, buddy, AVL_EQUAL)) ||
+		   b->order != order)
+			break;
+		block_remove(b);
+		if(pr)
+			SLABFREE(b);
+		else
+			pr = b;
+		pageno = merged;
+		order++;
+	}
+
+	if(!pr && !SLABALLOC(pr))
+		panic("free_block: can't alloc");
+
+	block_insert(pr, pageno, order);
+}
+
+/*===========================================================================*
+ *				free_range				     *
+ *===========================================================================*/
+static void free_range(phys_bytes pageno, phys_bytes npages)
+{
+/* Free an arbitrary range of pages as the largest aligned blocks that fit. */
+	while(npages > 0) {
+		int order = BUDDY_ORDERS-1;
+		phys_bytes n;
+
+		for(;;) {
+			n = (phys_bytes) 1 << order;
+			if(!(pageno % n) && n <= npages &&
+			   page_zone(pageno) == page_zone(pageno + n - 1))
+				break;
+			order--;
+		}
+
+		free_block(pageno, order);
+		pageno += n;
+		npages -= n;
+	}
+}
+
+/*===========================================================================*
+ *				take_block				     *
+ *===========================================================================*/
+static phys_bytes take_block(int want, int memflags, int *got)
+{
+/* Find the smallest free block of at least order 'want' in the highest
+ * zone allowed, and split it down to order 'want'. If there is none and the
+ * caller takes what it can get, return the largest block there is instead,
+ * and its order in *got.
+ */
+	pagerange_t *pr = NULL;
+	phys_bytes pageno;
+	int zone, order, best = -1;
+
+	for(zone = max_zone(memflags); zone >= 0 && !pr; zone--) {
+		for(order = want; order < BUDDY_ORDERS; order++) {
+			if((pr = freelist[zone][order]))
+				break;
+		}
+	}
+
+	if(!pr) {
+		if(!(memflags & PAF_FIRSTBLOCK))
+			return NO_MEM;
+		for(zone = max_zone(memflags); zone >= 0; zone--) {
+			for(order = want-1; order > best; order--) {
+				if(freelist[zone][order]) {
+					pr = freelist[zone][order];
+					best = order;
+					break;
+				}
+			}
+		}
+		if(!pr)
+			return NO_MEM;
+		want = best;
+	}
+
+	pageno = pr->addr;
+	order = pr->order;
+	block_remove(pr);
+	SLABFREE(pr);
+
+	/* Give back the upper halves until the block is small enough. */
+	while(order > want) {
+		order--;
+		if(!SLABALLOC(pr))
+			panic("take_block: can't alloc");
+		block_insert(pr, pageno + ((phys_bytes) 1 << order), order);
+	}
+
+	*got = order;
+	return pageno;
+}
+
+/*===========================================================================*
+ *				take_run				     *
+ *===========================================================================*/
+static phys_bytes take_run(phys_bytes pages, int memflags)
+{
+/* Find a run of adjacent free blocks of at least this many pages, for
+ * contiguous allocations that no single block can satisfy.
+ */
+	addr_iter iter;
+	pagerange_t *pr;
+	phys_bytes start = 0, len = 0, limit = 0, pageno;
+
+	if(memflags & PAF_LOWER1MB)
+		limit = BOUNDARY1;
+	else if(memflags & PAF_LOWER16MB)
+		limit = BOUNDARY16;
+
+	addr_start_iter_least(&addravl, &iter);
+	while((pr = addr_get_iter(&iter))) {
+		SLABSANE(pr);
+		if(limit && pr->addr + pr->size > limit)
+			break;
+		if(len > 0 && start + len == pr->addr) {
+			len += pr->size;
+		} else {
+			start = pr->addr;
+			len = pr->size;
+		}
+		if(len >= pages)
+			break;
+		addr_incr_iter(&iter);
+	}
+
+	if(!pr || len < pages)
+		return NO_MEM;
+
+	/* Take all blocks in the run, and give back what is left over. */
+	for(pageno = start; pageno < start + pages; ) {
+		pr = addr_search(&addravl, pageno, AVL_EQUAL);
+		assert(pr);
+		pageno += pr->size;
+		block_remove(pr);
+		SLABFREE(pr);
+	}
+	if(pageno > start + pages)
+		free_range(start + pages, pageno - (start + pages));
+
+	return start;
+}
+
+/*===========================================================================*
+ *				drain_pagecache				     *
+ *===========================================================================*/
+static int drain_pagecache(void)
+{
+/* Return all cached single pages to the buddy lists, so they can merge. */
+	int n = pagecache.pc_count;
+
+	while(pagecache.pc_count > 0)
+		free_block(pagecache.pc_pages[--pagecache.pc_count], 0);
+
+	return n;
+}
+
 #if SANITYCHECKS
 static void sanitycheck(void)
 {
@@ -366,23 +660,42 @@ static void sanitycheck(void)
 	while((p=addr_get_iter(&iter))) {
 		SLABSANE(p);
 		assert(p->size > 0);
+		assert(p->size == (phys_bytes) 1 << p->order);
+		assert(!(p->addr % p->size));
+		assert(page_zone(p->addr) == page_zone(p->addr + p->size - 1));
 		if(prevp) {
-			assert(prevp->addr < p->addr);
-			assert(prevp->addr + p->addr < p->addr);
+			assert(prevp->addr + prevp->size <= p->addr);
 		}
+		prevp = p;
 		addr_incr_iter(&iter);
 	}
 }
 #endif
 
-void memstats(int *nodes, int *pages, int *largest)
+/*===========================================================================*
+ *				memstats				     *
+ *===========================================================================*/
+void memstats(int *nodes, int *pages, int *largest, int *orders)
 {
+/* Report free memory: the number of free blocks, the number of free pages,
+ * the largest run of contiguous free pages and, if 'orders' is given, the
+ * number of free blocks of each order. Lots of small blocks and few big
+ * ones means physical memory is fragmented.
+ */
 	pagerange_t *p;
 	addr_iter iter;
+	phys_bytes runstart = 0, runlen = 0;
+	int i;
+
 	addr_start_iter_least(&addravl, &iter);
-	*nodes = 0;
-	*pages = 0;
-	*largest = 0;
+	*nodes = pagecache.pc_count;
+	*pages = pagecache.pc_count;
+	*largest = pagecache.pc_count > 0 ? 1 : 0;
+	if(orders) {
+		for(i = 0; i < BUDDY_ORDERS; i++)
+			orders[i] = 0;
+		orders[0] = pagecache.pc_count;
+	}
 #if SANITYCHECKS
 	sanitycheck();
 #endif
@@ -390,8 +703,16 @@ void memstats(int *nodes, int *pages, int *largest)
 		SLABSANE(p);
 		(*nodes)++;
 		(*pages)+= p->size;
-		if(p->size > *largest)
-			*largest = p->size;
+		if(orders)
+			orders[p->order]++;
+		if(runlen > 0 && runstart + runlen == p->addr) {
+			runlen += p->size;
+		} else {
+			runstart = p->addr;
+			runlen = p->size;
+		}
+		if(runlen > *largest)
+			*largest = runlen;
 		addr_incr_iter(&iter);
 	}
 }
@@ -401,16 +722,13 @@ void memstats(int *nodes, int *pages, int *largest)
  *===========================================================================*/
 static phys_bytes alloc_pages(int pages, int memflags, phys_bytes *len)
 {
-	addr_iter iter;
-	pagerange_t *pr;
-	int incr;
-	phys_bytes boundary16 = 16 * 1024 * 1024 / VM_PAGE_SIZE;
-	phys_bytes boundary1  =  1 * 1024 * 1024 / VM_PAGE_SIZE;
 	phys_bytes mem;
+	int order, got;
 #if SANITYCHECKS
-	int firstnodes, firstpages, wantnodes, wantpages;
-	int finalnodes, finalpages;
-	int largest;
+	int firstnodes, firstpages, finalnodes, finalpages, largest;
+
+	memstats(&firstnodes, &firstpages, &largest, NULL);
+#endif
 
 #if NONCONTIGUOUS
 	/* If NONCONTIGUOUS is on, allocate physical pages single
@@ -423,87 +741,45 @@ static phys_bytes alloc_pages(int pages, int memflags, phys_bytes *len)
 	}
 #endif
 
-	memstats(&firstnodes, &firstpages, &largest);
-	sanitycheck();
-	wantnodes = firstnodes;
-	wantpages = firstpages - pages;
-#endif
+	assert(pages > 0);
 
-	if(memflags & (PAF_LOWER16MB|PAF_LOWER1MB)) {
-		addr_start_iter_least(&addravl, &iter);
-		incr = 1;
+	if(pages == 1 && max_zone(memflags) == ZONE_HIGH &&
+	   pagecache.pc_count > 0) {
+		mem = pagecache.pc_pages[--pagecache.pc_count];
 	} else {
-		addr_start_iter_greatest(&addravl, &iter);
-		incr = 0;
-	}
-
-	while((pr = addr_get_iter(&iter))) {
-		SLABSANE(pr);
-		assert(pr->size > 0);
-		if(pr->size >= pages || (memflags & PAF_FIRSTBLOCK)) {
-			if(memflags & PAF_LOWER16MB) {
-				if(pr->addr + pages > boundary16)
-					return NO_MEM;
-			}
+		order = pages_order(pages);
+		if(order >= BUDDY_ORDERS && (memflags & PAF_FIRSTBLOCK)) {
+			/* Larger than any block; take the first block. */
+			order = BUDDY_ORDERS-1;
+			pages = 1 << order;
+		}
 
-			if(memflags & PAF_LOWER1MB) {
-				if(pr->addr + pages > boundary1)
-					return NO_MEM;
+		if(order < BUDDY_ORDERS &&
+		   (mem = take_block(order, memflags, &got)) != NO_MEM) {
+			if(got < order) {
+				/* PAF_FIRSTBLOCK: smaller block than asked. */
+				assert(memflags & PAF_FIRSTBLOCK);
+				pages = 1 << got;
+			} else if(pages < (1 << order)) {
+				free_range(mem + pages, (1 << order) - pages);
 			}
-
-			/* good block found! */
-			break;
+		} else {
+			mem = take_run(pages, memflags);
 		}
-		if(incr)
-			addr_incr_iter(&iter);
-		else
-			addr_decr_iter(&iter);
-	}
-
-	if(!pr) {
-		if(len)
-			*len = 0;
-#if SANITYCHECKS
-		assert(largest < pages);
-#endif
-	   return NO_MEM;
-	}
 
-	SLABSANE(pr);
-
-	if(memflags & PAF_FIRSTBLOCK) {
-		assert(len);
-		/* block doesn't have to as big as requested;
-		 * return its size though.
-		 */
-		if(pr->size < pages) {
-			pages = pr->size;
-#if SANITYCHECKS
-			wantpages = firstpages - pages;
-#endif
+		if(mem == NO_MEM) {
+			/* Cached pages may complete a larger block. */
+			if(drain_pagecache() > 0)
+				return alloc_pages(pages, memflags, len);
+			if(len)
+				*len = 0;
+			return NO_MEM;
 		}
 	}
 
 	if(len)
 		*len = pages;
 
-	/* Allocated chunk is off the end. */
-	mem = pr->addr + pr->size - pages;
-
-	assert(pr->size >= pages);
-	if(pr->size == pages) {
-		pagerange_t *prr;
-		prr = addr_remove(&addravl, pr->addr);
-		assert(prr);
-		assert(prr == pr);
-		SLABFREE(pr);
-#if SANITYCHECKS
-		wantnodes--;
-#endif
-	} else {
-		USE(pr, pr->size -= pages;);
-	}
-
 	if(memflags & PAF_CLEAR) {
 		int s;
 		if ((s= sys_memset(0, CLICK_SIZE*mem,
@@ -512,11 +788,10 @@ static phys_bytes alloc_pages(int pages, int memflags, phys_bytes *len)
 	}
 
 #if SANITYCHECKS
-	memstats(&finalnodes, &finalpages, &largest);
+	memstats(&finalnodes, &finalpages, &largest, NULL);
 	sanitycheck();
 
-	assert(finalnodes == wantnodes);
-	assert(finalpages == wantpages);
+	assert(finalpages == firstpages - pages);
 #endif
 
 	return mem;
@@ -527,19 +802,13 @@ static phys_bytes alloc_pages(int pages, int memflags, phys_bytes *len)
  *===========================================================================*/
 static void free_pages(phys_bytes pageno, int npages)
 {
-	pagerange_t *pr, *p;
-	addr_iter iter;
 #if SANITYCHECKS
-	int firstnodes, firstpages, wantnodes, wantpages;
-	int finalnodes, finalpages, largest;
+	int firstnodes, firstpages, finalnodes, finalpages, largest;
 
-	memstats(&firstnodes, &firstpages, &largest);
-	sanitycheck();
-
-	wantnodes = firstnodes;
-	wantpages = firstpages + npages;
+	memstats(&firstnodes, &firstpages, &largest, NULL);
 #endif
 
+	assert(npages > 0);
 	assert(!addr_search(&addravl, pageno, AVL_EQUAL));
 
 #if JUNKFREE
@@ -548,55 +817,18 @@ static void free_pages(phys_bytes pageno, int npages)
                        panic("free_pages: sys_memset failed");
 #endif
 
-	/* try to merge with higher neighbour */
-	if((pr=addr_search(&addravl, pageno+npages, AVL_EQUAL))) {
-		USE(pr, pr->addr -= npages;
-			pr->size += npages;);
+	if(npages == 1 && page_zone(pageno) == ZONE_HIGH &&
+	   pagecache.pc_count < PAGECACHE_SIZE) {
+		pagecache.pc_pages[pagecache.pc_count++] = pageno;
 	} else {
-		if(!SLABALLOC(pr))
-			panic("alloc_pages: can't alloc");
-#if SANITYCHECKS
-		memstats(&firstnodes, &firstpages, &largest);
-
-		wantnodes = firstnodes;
-		wantpages = firstpages + npages;
-
-		sanitycheck();
-#endif
-		assert(npages > 0);
-		USE(pr, pr->addr = pageno;
-			 pr->size = npages;);
-		addr_insert(&addravl, pr);
-#if SANITYCHECKS
-		wantnodes++;
-#endif
-	}
-
-	addr_start_iter(&addravl, &iter, pr->addr, AVL_EQUAL);
-	p = addr_get_iter(&iter);
-	assert(p);
-	assert(p == pr);
-
-	addr_decr_iter(&iter);
-	if((p = addr_get_iter(&iter))) {
-		SLABSANE(p);
-		if(p->addr + p->size == pr->addr) {
-			USE(p, p->size += pr->size;);
-			addr_remove(&addravl, pr->addr);
-			SLABFREE(pr);
-#if SANITYCHECKS
-			wantnodes--;
-#endif
-		}
+		free_range(pageno, npages);
 	}
 
-
 #if SANITYCHECKS
-	memstats(&finalnodes, &finalpages,  &largest);
+	memstats(&finalnodes, &finalpages, &largest, NULL);
 	sanitycheck();
 
-	assert(finalnodes == wantnodes);
-	assert(finalpages == wantpages);
+	assert(finalpages == firstpages + npages);
 #endif
 }
 
@@ -794,11 +1026,16 @@ void release_dma(struct vmproc *vmp)
  *===========================================================================*/
 void printmemstats(void)
 {
-	int nodes, pages, largest;
-        memstats(&nodes, &pages, &largest);
+	int nodes, pages, largest, orders[BUDDY_ORDERS], i;
+        memstats(&nodes, &pages, &largest, orders);
         printf("%d blocks, %d pages (%lukB) free, largest %d pages (%lukB)\n",
                 nodes, pages, (unsigned long) pages * (VM_PAGE_SIZE/1024),
 		largest, (unsigned long) largest * (VM_PAGE_SIZE/1024));
+	printf("free blocks by size:");
+	for(i = 0; i < BUDDY_ORDERS; i++)
+		printf(" %lukB:%d",
+			(unsigned long) (VM_PAGE_SIZE/1024) << i, orders[i]);
+	printf("\n");
 }
 
 
@@ -46,6 +46,7 @@ void clear_proc(struct vmproc *vmp)
 	vmp->vm_flags = 0;		/* Clear INUSE, so slot is free. */
 	vmp->vm_heap = NULL;
 	vmp->vm_yielded = 0;
+	pf_reset(vmp);
 #if VMSTATS
 	vmp->vm_bytecopies = 0;
 #endif
@@ -0,0 +1,697 @@
+/* This file implements mapping files into memory. A file region is an
+ * anonymous region (VR_ANON|VR_FILE) whose pages are read from the file
+ * through VFS when they are first touched. MAP_SHARED mappings (VR_SHARED
+ * as well) share their pages with the other shared mappings of the same
+ * file, and pages that have been written to go back to the file on msync()
+ * and when the last mapping of them disappears.
+ *
+ * The entry points into this file are:
+ *   filemap_mmap:	mmap() of a file
+ *   filemap_pagefault:	pagefault on a page of a file region not yet there
+ *   filemap_memreq:	kernel copy to or from file region pages not yet there
+ *   filemap_writeback:	write out a dirty page that is no longer mapped
+ *   filemap_link:	new region refers to a file
+ *   filemap_unlink:	region no longer refers to a file
+ *   fdref_put:		drop a reference to a file
+ *   do_msync:		msync() system call
+ */
+
+#define _SYSTEM 1
+
+#include <minix/callnr.h>
+#include <minix/com.h>
+#include <minix/config.h>
+#include <minix/const.h>
+#include <minix/ds.h>
+#include <minix/endpoint.h>
+#include <minix/keymap.h>
+#include <minix/minlib.h>
+#include <minix/type.h>
+#include <minix/ipc.h>
+#include <minix/sysutil.h>
+#include <minix/syslib.h>
+
+#include <sys/mman.h>
+#include <sys/param.h>
+
+#include <errno.h>
+#include <string.h>
+#include <stdio.h>
+#include <signal.h>
+#include <limits.h>
+#include <assert.h>
+#include <memory.h>
+
+#include "glo.h"
+#include "proto.h"
+#include "util.h"
+#include "region.h"
+#include "sanitycheck.h"
+#include "filemap.h"
+
+static struct fdref *fdrefs = NULL;	/* all files VM has open */
+
+static void mmap_reply(struct vfs_req *vr, message *reply);
+static void pagefault_reply(struct vfs_req *vr, message *reply);
+static void memreq_reply(struct vfs_req *vr, message *reply);
+static void write_reply(struct vfs_req *vr, message *reply);
+static void close_reply(struct vfs_req *vr, message *reply);
+
+/*===========================================================================*
+ *				fdref_get				     *
+ *===========================================================================*/
+static struct fdref *fdref_get(int fd, dev_t dev, ino_t ino,
+	endpoint_t fs_e)
+{
+/* VFS gave us descriptor 'fd' for a file. Return the fdref for the file
+ * with a reference for the caller, reusing the descriptor VM already has if
+ * the file is mapped already.
+ */
+	struct fdref *fdref;
+	struct vfs_req *vr;
+
+	for(fdref = fdrefs; fdref; fdref = fdref->next) {
+		if(fdref->dev == dev && fdref->ino == ino)
+			break;
+	}
+
+	if(!fdref && SLABALLOC(fdref)) {
+		USE(fdref,
+			fdref->fd = fd;
+			fdref->dev = dev;
+			fdref->ino = ino;
+			fdref->fs_e = fs_e;
+			fdref->refcount = 0;
+			fdref->shared = NULL;
+			fdref->next = fdrefs;);
+		fdrefs = fdref;
+	}
+
+	if(!fdref || fdref->fd != fd) {
+		/* Don't need this descriptor. */
+		if((vr = vfs_req_alloc(VMVFSREQ_FDCLOSE, NULL, close_reply))) {
+			USE(vr, vr->vr_fd = fd;);
+			vfs_req_send(vr);
+		}
+	}
+
+	if(fdref)
+		USE(fdref, fdref->refcount++;);
+
+	return fdref;
+}
+
+/*===========================================================================*
+ *				fdref_put				     *
+ *===========================================================================*/
+void fdref_put(struct fdref *fdref)
+{
+	struct fdref *prev;
+	struct vfs_req *vr;
+
+	assert(fdref->refcount > 0);
+	USE(fdref, fdref->refcount--;);
+	if(fdref->refcount > 0)
+		return;
+
+	assert(!fdref->shared);
+
+	if(fdrefs == fdref) {
+		fdrefs = fdref->next;
+	} else {
+		for(prev = fdrefs; prev->next != fdref; prev = prev->next)
+			assert(prev->next);
+		USE(prev, prev->next = fdref->next;);
+	}
+
+	if((vr = vfs_req_alloc(VMVFSREQ_FDCLOSE, NULL, close_reply))) {
+		USE(vr, vr->vr_fd = fdref->fd;);
+		vfs_req_send(vr);
+	}
+
+	SLABFREE(fdref);
+}
+
+/*===========================================================================*
+ *				filemap_link				     *
+ *===========================================================================*/
+void filemap_link(struct vir_region *region)
+{
+	struct fdref *fdref = region->fdref;
+
+	assert(region->flags & VR_FILE);
+	assert(fdref);
+
+	USE(fdref, fdref->refcount++;);
+
+	if(VR_FILE_SHARED(region)) {
+		USE(region, region->file_next = fdref->shared;);
+		USE(fdref, fdref->shared = region;);
+	}
+}
+
+/*===========================================================================*
+ *				filemap_unlink				     *
+ *===========================================================================*/
+void filemap_unlink(struct vir_region *region)
+{
+	struct fdref *fdref = region->fdref;
+	struct vir_region *prev;
+
+	assert(region->flags & VR_FILE);
+	assert(fdref);
+
+	if(VR_FILE_SHARED(region)) {
+		if(fdref->shared == region) {
+			USE(fdref, fdref->shared = region->file_next;);
+		} else {
+			for(prev = fdref->shared; prev->file_next != region;
+				prev = prev->file_next)
+				assert(prev->file_next);
+			USE(prev, prev->file_next = region->file_next;);
+		}
+	}
+
+	USE(region,
+		region->fdref = NULL;
+		region->file_next = NULL;);
+
+	fdref_put(fdref);
+}
+
+/*===========================================================================*
+ *				filemap_findpage			     *
+ *===========================================================================*/
+static struct phys_block *filemap_findpage(struct fdref *fdref,
+	off_t file_offset)
+{
+/* See if a shared mapping of the file already has the page at
+ * 'file_offset'.
+ */
+	struct vir_region *vr;
+	struct phys_block *pb;
+
+	for(vr = fdref->shared; vr; vr = vr->file_next) {
+		if(file_offset < vr->file_offset ||
+		   file_offset >= vr->file_offset + (off_t) vr->length)
+			continue;
+		pb = map_page_lookup(vr, file_offset - vr->file_offset);
+		if(pb && pb->refcount < UCHAR_MAX)
+			return pb;
+	}
+
+	return NULL;
+}
+
+/*===========================================================================*
+ *				filemap_mmap				     *
+ *===========================================================================*/
+int filemap_mmap(struct vmproc *vmp, message *m)
+{
+	struct vfs_req *vr;
+	int mode = R_BIT;
+
+	if(m->VMM_LEN <= 0 || (m->VMM_OFFSET % VM_PAGE_SIZE))
+		return EINVAL;
+
+	/* Exactly one of private and shared. */
+	if(!(m->VMM_FLAGS & MAP_SHARED) == !(m->VMM_FLAGS & MAP_PRIVATE))
+		return EINVAL;
+
+	if(m->VMM_FLAGS & (MAP_PREALLOC|MAP_CONTIG|MAP_LOWER16M|
+		MAP_LOWER1M|MAP_ALIGN64K|MAP_IPC_SHARED))
+		return EINVAL;
+
+	/* Writing to a shared mapping writes to the file. */
+	if((m->VMM_FLAGS & MAP_SHARED) && (m->VMM_PROT & PROT_WRITE))
+		mode |= W_BIT;
+
+	/* Ask VFS for a descriptor of our own; the region is made when it
+	 * answers. The process stays blocked until then.
+	 */
+	if(!(vr = vfs_req_alloc(VMVFSREQ_FDLOOKUP, NULL, mmap_reply)))
+		return ENOMEM;
+
+	USE(vr,
+		vr->vr_fd = m->VMM_FD;
+		vr->vr_mode = mode;
+		vr->vr_who = vmp->vm_endpoint;);
+	vmp->vm_state.mmap = *m;
+
+	vfs_req_send(vr);
+
+	return SUSPEND;
+}
+
+/*===========================================================================*
+ *				mmap_reply				     *
+ *===========================================================================*/
+static void mmap_reply(struct vfs_req *vr, message *reply)
+{
+	struct vmproc *vmp;
+	struct fdref *fdref = NULL;
+	struct vir_region *region;
+	message *m;
+	u32_t vrflags = VR_ANON | VR_FILE;
+	size_t len;
+	int r, n;
+
+	r = reply->VMV_RESULT;
+
+	if(r == OK && !(fdref = fdref_get(reply->VMV_FD, reply->VMV_DEV,
+		reply->VMV_INO, reply->VMV_FS)))
+		r = ENOMEM;
+
+	if(vm_isokendpt(vr->vr_who, &n) != OK) {
+		/* Process went away in the meantime. */
+		if(fdref) fdref_put(fdref);
+		return;
+	}
+
+	vmp = &vmproc[n];
+	m = &vmp->vm_state.mmap;
+
+	if(r == OK) {
+		if(m->VMM_PROT & PROT_WRITE) vrflags |= VR_WRITABLE;
+		if(m->VMM_FLAGS & MAP_SHARED) vrflags |= VR_SHARED;
+
+		len = (vir_bytes) m->VMM_LEN;
+		if(len % VM_PAGE_SIZE)
+			len += VM_PAGE_SIZE - (len % VM_PAGE_SIZE);
+
+		if(!(region = mmap_region(vmp, m->VMM_ADDR, m->VMM_FLAGS, len,
+			vrflags, 0))) {
+			r = ENOMEM;
+		} else {
+			USE(region,
+				region->fdref = fdref;
+				region->file_offset = m->VMM_OFFSET;);
+			filemap_link(region);
+			m->VMM_RETADDR = arch_map2vir(vmp, region->vaddr);
+		}
+	}
+
+	if(fdref)
+		fdref_put(fdref);
+
+	m->m_type = r;
+	if((r=send(vmp->vm_endpoint, m)) != OK)
+		panic("VM: couldn't send mmap reply to %d: %d",
+			vmp->vm_endpoint, r);
+}
+
+/*===========================================================================*
+ *				filemap_fill				     *
+ *===========================================================================*/
+static int filemap_fill(struct vmproc *vmp, struct vir_region *region,
+	vir_bytes offset, vfs_callback_t callback, struct vfs_req **vrp)
+{
+/* Page 'offset' of file region 'region' isn't there. Share it from another
+ * mapping if possible. Otherwise return SUSPEND, with in 'vrp' a request to
+ * read it in that the caller completes and sends.
+ */
+	struct phys_block *pb;
+	struct vfs_req *vr;
+
+	assert(region->flags & VR_FILE);
+	assert(!(offset % VM_PAGE_SIZE));
+
+	if(VR_FILE_SHARED(region) &&
+	   (pb = filemap_findpage(region->fdref, region->file_offset + offset)))
+		return map_share_page(vmp, region, offset, pb);
+
+	if(!(vr = vfs_req_alloc(VMVFSREQ_FDREAD, region->fdref, callback)))
+		return ENOMEM;
+
+	USE(vr,
+		vr->vr_offset = region->file_offset + offset;
+		vr->vr_who = vmp->vm_endpoint;
+		vr->vr_addr = region->vaddr + offset;);
+
+	*vrp = vr;
+	return SUSPEND;
+}
+
+/*===========================================================================*
+ *				filemap_place				     *
+ *===========================================================================*/
+static int filemap_place(struct vmproc *vmp, struct vfs_req *vr,
+	message *reply)
+{
+/* The page that 'vr' asked for has been read in; map it where it belongs,
+ * unless it got there in the meantime. Returns 0, or the signal the process
+ * deserves if that is impossible.
+ */
+	struct vir_region *region;
+	struct phys_block *pb;
+	vir_bytes offset;
+	int r;
+
+	/* The process has been waiting, so its mappings can't have changed;
+	 * check anyway.
+	 */
+	region = map_lookup(vmp, vr->vr_addr);
+	if(!region || !(region->flags & VR_FILE) ||
+	   region->fdref != vr->vr_fdref ||
+	   region->file_offset + (off_t) (vr->vr_addr - region->vaddr) !=
+	   vr->vr_offset) {
+		printf("VM: file region of %d changed during pagefault\n",
+			vmp->vm_endpoint);
+		return SIGSEGV;
+	}
+
+	offset = vr->vr_addr - region->vaddr;
+	r = reply->VMV_RESULT;
+
+	if(map_page_lookup(region, offset))
+		return 0;	/* There already. */
+
+	if(VR_FILE_SHARED(region) &&
+	  (pb = filemap_findpage(region->fdref, vr->vr_offset))) {
+		/* Read in for another mapping in the meantime. */
+		return map_share_page(vmp, region, offset, pb) != OK ?
+			SIGSEGV : 0;
+	}
+
+	/* Beyond the end of the file, or an I/O error. */
+	if(r <= 0)
+		return SIGBUS;
+
+	return map_file_page(vmp, region, offset, vfs_iobuf(), r) != OK ?
+		SIGSEGV : 0;
+}
+
+/*===========================================================================*
+ *				filemap_pagefault			     *
+ *===========================================================================*/
+int filemap_pagefault(struct vmproc *vmp, struct vir_region *region,
+	vir_bytes offset, int write)
+{
+/* A process touched a page of a file mapping that isn't there. Share it
+ * from another mapping if possible, otherwise have it read in. Returns
+ * SUSPEND if the process has to wait for the page.
+ */
+	struct vfs_req *vr;
+	int r;
+
+	offset -= offset % VM_PAGE_SIZE;
+
+	if((r=filemap_fill(vmp, region, offset, pagefault_reply, &vr)) !=
+		SUSPEND)
+		return r;
+
+	USE(vr, vr->vr_flags = write ? VRF_WRITE : 0;);
+
+	vfs_req_send(vr);
+
+	return SUSPEND;
+}
+
+/*===========================================================================*
+ *				pagefault_reply				     *
+ *===========================================================================*/
+static void pagefault_reply(struct vfs_req *vr, message *reply)
+{
+	struct vmproc *vmp;
+	struct vir_region *region;
+	endpoint_t ep = vr->vr_who;
+	int r, n, sig;
+
+	if(vm_isokendpt(ep, &n) != OK)
+		return;		/* Process went away in the meantime. */
+
+	vmp = &vmproc[n];
+
+	if(!(sig = filemap_place(vmp, vr, reply)) &&
+	   (vr->vr_flags & VRF_WRITE)) {
+		region = map_lookup(vmp, vr->vr_addr);
+		if(map_pf(vmp, region, vr->vr_addr - region->vaddr, 1) != OK)
+			sig = SIGSEGV;
+	}
+
+	if(sig) {
+		printf("VM: pagefault: %s %d file page at %s not handled\n",
+			sig == SIGBUS ? "SIGBUS" : "SIGSEGV", ep,
+			arch_map2str(vmp, vr->vr_addr));
+		if((r=sys_kill(ep, sig)) != OK)
+			panic("sys_kill failed: %d", r);
+	}
+
+	if((r=sys_vmctl(ep, VMCTL_CLEAR_PAGEFAULT, 0 /*unused*/)) != OK)
+		panic("pagefault_reply: sys_vmctl failed: %d", r);
+}
+
+/*===========================================================================*
+ *				filemap_memreq				     *
+ *===========================================================================*/
+int filemap_memreq(struct vmproc *vmp, struct vir_region *region,
+	vir_bytes offset, vir_bytes length, endpoint_t requestor,
+	vir_bytes mem, vir_bytes len, int wrflag)
+{
+/* The kernel wants to copy to or from pages 'offset' to 'offset'+'length'
+ * of file region 'region' on behalf of 'requestor'. Make sure they are all
+ * there. Returns SUSPEND if a page has to be read in first; what is left of
+ * the request, 'mem' to 'mem'+'len' of 'vmp' from this region on, is
+ * handled again when it is, and only then is the requestor answered.
+ */
+	struct vfs_req *vr;
+	int r;
+
+	assert(!(offset % VM_PAGE_SIZE));
+	assert(!(length % VM_PAGE_SIZE));
+
+	for(; length > 0; offset += VM_PAGE_SIZE, length -= VM_PAGE_SIZE) {
+		if(map_page_lookup(region, offset))
+			continue;
+
+		/* VFS, and the file system that has the file, can't read
+		 * it in while they are waiting for us.
+		 */
+		if(requestor == VFS_PROC_NR || requestor == region->fdref->fs_e)
+			return EFAULT;
+
+		if((r=filemap_fill(vmp, region, offset, memreq_reply, &vr)) ==
+			OK)
+			continue;
+		if(r != SUSPEND)
+			return r;
+
+		USE(vr,
+			vr->vr_flags = wrflag ? VRF_WRITE : 0;
+			vr->vr_requestor = requestor;
+			vr->vr_mem = mem;
+			vr->vr_len = len;);
+
+		vfs_req_send(vr);
+
+		return SUSPEND;
+	}
+
+	return OK;
+}
+
+/*===========================================================================*
+ *				memreq_reply				     *
+ *===========================================================================*/
+static void memreq_reply(struct vfs_req *vr, message *reply)
+{
+	struct vmproc *vmp;
+	int r = EFAULT, n;
+
+	if(vm_isokendpt(vr->vr_who, &n) == OK) {
+		vmp = &vmproc[n];
+		if(!filemap_place(vmp, vr, reply)) {
+			r = handle_memory(vmp, vr->vr_mem, vr->vr_len,
+				vr->vr_flags & VRF_WRITE, vr->vr_requestor);
+		}
+	}
+
+	/* Another page has to be read in first. */
+	if(r == SUSPEND)
+		return;
+
+	if((r=sys_vmctl(vr->vr_requestor, VMCTL_MEMREQ_REPLY, r)) != OK)
+		printf("VM: memreq_reply: sys_vmctl for %d failed: %d\n",
+			vr->vr_requestor, r);
+}
+
+/*===========================================================================*
+ *				filemap_flush				     *
+ *===========================================================================*/
+static struct vfs_req *filemap_flush(struct vir_region *region,
+	struct phys_region *pr)
+{
+/* Start writing out dirty page 'pr'. The page is write-protected again, so
+ * that new writes to it are noticed, and a copy of it is written out.
+ */
+	struct phys_block *pb = pr->ph;
+	struct vfs_req *vr;
+	phys_clicks copy;
+
+	assert(VR_FILE_SHARED(region));
+	assert(pb->flags & PBF_DIRTY);
+	assert(pb->length == VM_PAGE_SIZE);
+
+	if((copy = alloc_mem(ABS2CLICK(VM_PAGE_SIZE), 0)) == NO_MEM)
+		return NULL;
+
+	if(!(vr = vfs_req_alloc(VMVFSREQ_FDWRITE, region->fdref,
+		write_reply))) {
+		free_mem(copy, ABS2CLICK(VM_PAGE_SIZE));
+		return NULL;
+	}
+
+	USE(pb, pb->flags &= ~PBF_DIRTY;);
+	if(map_pb_writept(pb) != OK)
+		panic("VM: filemap_flush: map_pb_writept failed");
+
+	if(sys_abscopy(pb->phys, CLICK2ABS(copy), VM_PAGE_SIZE) != OK)
+		panic("VM: filemap_flush: sys_abscopy failed");
+
+	USE(vr,
+		vr->vr_page = CLICK2ABS(copy);
+		vr->vr_offset = region->file_offset + pr->offset;);
+
+	return vr;
+}
+
+/*===========================================================================*
+ *				filemap_writeback			     *
+ *===========================================================================*/
+void filemap_writeback(struct fdref *fdref, off_t file_offset,
+	phys_bytes page)
+{
+/* The last mapping of dirty page 'page' is gone; write it out. The
+ * request owns the page from now on.
+ */
+	struct vfs_req *vr;
+
+	if(!(vr = vfs_req_alloc(VMVFSREQ_FDWRITE, fdref, write_reply))) {
+		printf("VM: lost write of mapped file page\n");
+		free_mem(ABS2CLICK(page), ABS2CLICK(VM_PAGE_SIZE));
+		return;
+	}
+
+	USE(vr,
+		vr->vr_page = page;
+		vr->vr_offset = file_offset;);
+
+	vfs_req_send(vr);
+}
+
+/*===========================================================================*
+ *				write_reply				     *
+ *===========================================================================*/
+static void write_reply(struct vfs_req *vr, message *reply)
+{
+	struct vmproc *vmp;
+	message m;
+	int r, n;
+
+	r = reply->VMV_RESULT;
+	if(r < 0)
+		printf("VM: writing mapped file page failed: %d\n", r);
+
+	/* Is somebody waiting in msync()? */
+	if(vr->vr_who == NONE || vm_isokendpt(vr->vr_who, &n) != OK)
+		return;
+
+	vmp = &vmproc[n];
+	if(r < 0 && vmp->vm_state.msync.err == OK)
+		vmp->vm_state.msync.err = EIO;
+
+	if(vr->vr_flags & VRF_REPLY) {
+		memset(&m, 0, sizeof(m));
+		m.m_type = vmp->vm_state.msync.err;
+		if((r=send(vmp->vm_endpoint, &m)) != OK)
+			panic("VM: couldn't send msync reply to %d: %d",
+				vmp->vm_endpoint, r);
+	}
+}
+
+/*===========================================================================*
+ *				close_reply				     *
+ *===========================================================================*/
+static void close_reply(struct vfs_req *vr, message *reply)
+{
+	if(reply->VMV_RESULT != OK) {
+		printf("VM: closing mapped file %d failed: %d\n",
+			vr->vr_fd, reply->VMV_RESULT);
+	}
+}
+
+/*===========================================================================*
+ *				do_msync				     *
+ *===========================================================================*/
+int do_msync(message *m)
+{
+	struct vmproc *vmp;
+	struct vir_region *region;
+	struct phys_region *pr;
+	struct vfs_req *vr, *last = NULL;
+	physr_iter iter;
+	vir_bytes addr, len, end, start_off, end_off;
+	int n, flags, r = OK;
+
+	if(vm_isokendpt(m->m_source, &n) != OK)
+		panic("do_msync: message from strange source: %d",
+			m->m_source);
+	vmp = &vmproc[n];
+
+	if(!(vmp->vm_flags & VMF_HASPT))
+		return ENXIO;
+
+	flags = m->VMMS_FLAGS;
+	if((flags & ~(MS_ASYNC|MS_SYNC|MS_INVALIDATE)) ||
+	   (flags & (MS_ASYNC|MS_SYNC)) == (MS_ASYNC|MS_SYNC))
+		return EINVAL;
+
+	addr = arch_vir2map(vmp, (vir_bytes) m->VMMS_ADDR);
+	len = (vir_bytes) m->VMMS_LEN;
+	if(addr % VM_PAGE_SIZE)
+		return EINVAL;
+	if(len % VM_PAGE_SIZE)
+		len += VM_PAGE_SIZE - (len % VM_PAGE_SIZE);
+
+	vmp->vm_state.msync.err = OK;
+
+	/* Start writing out every dirty page in the range. Our page cache is
+	 * VFS', so MS_INVALIDATE has nothing to do.
+	 */
+	for(end = addr + len; addr < end && r == OK; ) {
+		if(!(region = map_lookup(vmp, addr)))
+			return ENOMEM;
+
+		start_off = addr - region->vaddr;
+		end_off = MIN(end, region->vaddr + region->length) -
+			region->vaddr;
+		addr = region->vaddr + end_off;
+
+		if(!VR_FILE_SHARED(region))
+			continue;
+
+		physr_start_iter(region->phys, &iter, start_off,
+			AVL_GREATER_EQUAL);
+		while((pr = physr_get_iter(&iter)) && pr->offset < end_off) {
+			physr_incr_iter(&iter);
+			if(!(pr->ph->flags & PBF_DIRTY))
+				continue;
+			if(!(vr = filemap_flush(region, pr))) {
+				r = ENOMEM;
+				break;
+			}
+			if(flags & MS_SYNC)
+				USE(vr, vr->vr_who = vmp->vm_endpoint;);
+			vfs_req_send(vr);
+			last = vr;
+		}
+	}
+
+	if(r != OK || !last || !(flags & MS_SYNC))
+		return r;
+
+	/* Reply when the last write is done. */
+	USE(last, last->vr_flags |= VRF_REPLY;);
+
+	return SUSPEND;
+}
@@ -0,0 +1,47 @@
+#ifndef _FILEMAP_H
+#define _FILEMAP_H 1
+
+#include <minix/type.h>
+
+/* A file that is mapped somewhere. VM keeps a descriptor of its own open
+ * in VFS for it, so that the file stays around while it is mapped.
+ */
+struct fdref {
+	int		fd;		/* VM's descriptor in VFS */
+	dev_t		dev;		/* device the file lives on */
+	ino_t		ino;		/* inode number of the file */
+	endpoint_t	fs_e;		/* file system the file is on */
+	int		refcount;	/* regions and requests using this */
+	struct vir_region *shared;	/* MAP_SHARED mappings of the file */
+	struct fdref	*next;
+};
+
+struct vfs_req;
+
+typedef void (*vfs_callback_t)(struct vfs_req *req, message *reply);
+
+/* A request to VFS. VFS gets one request at a time, in FIFO order. */
+struct vfs_req {
+	int		vr_req;		/* VMVFSREQ_* */
+	int		vr_reqid;	/* matches reply to request */
+	int		vr_fd;		/* descriptor the request is about */
+	off_t		vr_offset;	/* file offset, for reads and writes */
+	int		vr_mode;	/* access needed, for lookups */
+	phys_bytes	vr_page;	/* page to write, or MAP_NONE */
+	struct fdref	*vr_fdref;	/* file, referenced by the request */
+	vfs_callback_t	vr_callback;	/* called with the reply */
+	endpoint_t	vr_who;		/* process waiting for it, or NONE */
+	vir_bytes	vr_addr;	/* address the request is for */
+	int		vr_flags;
+	endpoint_t	vr_requestor;	/* kernel copy waiting for it */
+	vir_bytes	vr_mem;		/* range that kernel copy needs */
+	vir_bytes	vr_len;
+	struct vfs_req	*vr_next;
+};
+
+/* vr_flags */
+#define VRF_WRITE	0x01	/* pagefault or kernel copy was a write */
+#define VRF_REPLY	0x02	/* last write of an msync; reply to vr_who */
+
+#endif
+
@@ -73,6 +73,7 @@ int do_fork(message *msg)
   vmc->vm_endpoint = NONE;	/* In case someone tries to use it. */
   vmc->vm_pt = origpt;
   vmc->vm_flags &= ~VMF_HASPT;
+  pf_reset(vmc);
 
 #if VMSTATS
   vmc->vm_bytecopies = 0;
@@ -210,10 +211,10 @@ int do_fork(message *msg)
 	 * and its return value needn't be checked.
 	 */
 	vir = arch_vir2map(vmc, msgaddr);
-	if (handle_memory(vmc, vir, sizeof(message), 1) != OK)
+	if (handle_memory(vmc, vir, sizeof(message), 1, NONE) != OK)
 	    panic("do_fork: handle_memory for child failed\n");
 	vir = arch_vir2map(vmp, msgaddr);
-	if (handle_memory(vmp, vir, sizeof(message), 1) != OK)
+	if (handle_memory(vmp, vir, sizeof(message), 1, NONE) != OK)
 	    panic("do_fork: handle_memory for parent failed\n");
   }
 
@@ -339,6 +339,7 @@ static int sef_cb_init_fresh(int type, sef_init_info_t *info)
 	CALLMAP(VM_MUNMAP_TEXT, do_munmap);
 	CALLMAP(VM_MAP_PHYS, do_map_phys);
 	CALLMAP(VM_UNMAP_PHYS, do_unmap_phys);
+	CALLMAP(VM_MSYNC, do_msync);
 
 	/* Calls from PM. */
 	CALLMAP(VM_EXIT, do_exit);
@@ -357,6 +358,9 @@ static int sef_cb_init_fresh(int type, sef_init_info_t *info)
 	CALLMAP(VM_RS_UPDATE, do_rs_update);
 	CALLMAP(VM_RS_MEMCTL, do_rs_memctl);
 
+	/* Calls from VFS. */
+	CALLMAP(VM_VFS_REPLY, do_vfs_reply);
+
 	/* Generic calls. */
 	CALLMAP(VM_REMAP, do_remap);
 	CALLMAP(VM_REMAP_RO, do_remap);
@@ -377,6 +381,9 @@ static int sef_cb_init_fresh(int type, sef_init_info_t *info)
 	/* Initialize the structures for queryexit */
 	init_query_exit();
 
+	/* Set up talking to VFS, for file mappings. */
+	vfs_init();
+
 	/* Map all the services in the boot image. */
 	if((s = sys_safecopyfrom(RS_PROC_NR, info->rproctab_gid, 0,
 		(vir_bytes) rprocpub, sizeof(rprocpub), S)) != OK) {
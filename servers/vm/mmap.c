@@ -32,6 +32,32 @@
 #include "util.h"
 #include "region.h"
 
+/*===========================================================================*
+ *				mmap_region			     	     *
+ *===========================================================================*/
+struct vir_region *mmap_region(struct vmproc *vmp, vir_bytes addr,
+	u32_t vmm_flags, size_t len, u32_t vrflags, int mfflags)
+{
+	struct vir_region *vr = NULL;
+
+	if (addr) {
+		/* An address is given, first try at that address. */
+		addr = arch_vir2map(vmp, addr);
+		vr = map_page_region(vmp, addr, 0, len, MAP_NONE,
+			vrflags, mfflags);
+		if(!vr && (vmm_flags & MAP_FIXED))
+			return NULL;
+	}
+	if (!vr) {
+		/* No address given or address already in use. */
+		addr = arch_vir2map(vmp, vmp->vm_stacktop);
+		vr = map_page_region(vmp, addr, VM_DATATOP, len,
+			MAP_NONE, vrflags, mfflags);
+	}
+
+	return vr;
+}
+
 /*===========================================================================*
  *				do_mmap			     		     *
  *===========================================================================*/
@@ -40,7 +66,6 @@ int do_mmap(message *m)
 	int r, n;
 	struct vmproc *vmp;
 	int mfflags = 0;
-	vir_bytes addr;
 	struct vir_region *vr = NULL;
 
 	if((r=vm_isokendpt(m->m_source, &n)) != OK) {
@@ -60,6 +85,13 @@ int do_mmap(message *m)
 			return EINVAL;
 		}
 
+		/* Anonymous memory is private to the process and its
+		 * children; sharing it is only possible with MAP_IPC_SHARED.
+		 */
+		if(m->VMM_FLAGS & MAP_SHARED) {
+			return EINVAL;
+		}
+
 		/* Contiguous phys memory has to be preallocated. */
 		if((m->VMM_FLAGS & (MAP_CONTIG|MAP_PREALLOC)) == MAP_CONTIG) {
 			return EINVAL;
@@ -82,26 +114,13 @@ int do_mmap(message *m)
 		if(len % VM_PAGE_SIZE)
 			len += VM_PAGE_SIZE - (len % VM_PAGE_SIZE);
 
-		vr = NULL;
-		if (m->VMM_ADDR) {
-			/* An address is given, first try at that address. */
-			addr = arch_vir2map(vmp, m->VMM_ADDR);
-			vr = map_page_region(vmp, addr, 0, len, MAP_NONE,
-				vrflags, mfflags);
-			if(!vr && (m->VMM_FLAGS & MAP_FIXED))
-				return ENOMEM;
-		}
-		if (!vr) {
-			/* No address given or address already in use. */
-			addr = arch_vir2map(vmp, vmp->vm_stacktop);
-			vr = map_page_region(vmp, addr, VM_DATATOP, len,
-				MAP_NONE, vrflags, mfflags);
-		}
-		if (!vr) {
+		if(!(vr = mmap_region(vmp, m->VMM_ADDR, m->VMM_FLAGS, len,
+			vrflags, mfflags))) {
 			return ENOMEM;
 		}
 	} else {
-		return ENOSYS;
+		/* Mapping a file; VFS has to be asked about it first. */
+		return filemap_mmap(vmp, m);
 	}
 
 	/* Return mapping, as seen from process. */
@@ -48,6 +48,17 @@ char *pf_errstr(u32_t err)
 	return buf;
 }
 
+/*===========================================================================*
+ *				pf_reset	     		     	     *
+ *===========================================================================*/
+void pf_reset(struct vmproc *vmp)
+{
+/* Start a process with clean pagefault statistics. */
+	vmp->vm_pf_count = 0;
+	vmp->vm_pf_cow = 0;
+	vmp->vm_pf_around = 0;
+}
+
 /*===========================================================================*
  *				do_pagefaults	     		     *
  *===========================================================================*/
@@ -57,7 +68,7 @@ void do_pagefaults(message *m)
 	u32_t addr = m->VPF_ADDR;
 	u32_t err = m->VPF_FLAGS;
 	struct vmproc *vmp;
-	int s;
+	int r = OK, s;
 
 	struct vir_region *region;
 	vir_bytes offset;
@@ -68,6 +79,7 @@ void do_pagefaults(message *m)
 
 	vmp = &vmproc[p];
 	assert(vmp->vm_flags & VMF_INUSE);
+	vmp->vm_pf_count++;
 
 	/* See if address is valid at all. */
 	if(!(region = map_lookup(vmp, addr))) {
@@ -100,8 +112,19 @@ void do_pagefaults(message *m)
 	assert(addr >= region->vaddr);
 	offset = addr - region->vaddr;
 
+	/* Pages of a file mapping have to be filled from the file first. */
+	if((region->flags & VR_FILE) && !map_page_lookup(region, offset)) {
+		if((r=filemap_pagefault(vmp, region, offset, wr)) == SUSPEND)
+			return;	/* Process resumes when the page is there. */
+		if(r == OK && !wr) {
+			if((s=sys_vmctl(ep, VMCTL_CLEAR_PAGEFAULT, 0)) != OK)
+				panic("do_pagefaults: sys_vmctl failed: %d", ep);
+			return;
+		}
+	}
+
 	/* Access is allowed; handle it. */
-	if((map_pf(vmp, region, offset, wr)) != OK) {
+	if(r != OK || (map_pf(vmp, region, offset, wr)) != OK) {
 		printf("VM: pagefault: SIGSEGV %d pagefault not handled\n", ep);
 		if((s=sys_kill(vmp->vm_endpoint, SIGSEGV)) != OK)
 			panic("sys_kill failed: %d", s);
@@ -138,7 +161,7 @@ void do_memory(void)
 				panic("do_memory: bad endpoint: %d", who);
 			vmp = &vmproc[p];
 
-			r = handle_memory(vmp, mem, len, wrflag);
+			r = handle_memory(vmp, mem, len, wrflag, requestor);
 			break;
 		case VMPTYPE_COWMAP:
 			r = map_memory(who_s, who, mem_s, mem, len, -1);
@@ -153,13 +176,27 @@ void do_memory(void)
 			return;
 		}
 
+		/* Answered once the file pages it needs are read in. */
+		if(r == SUSPEND)
+			continue;
+
 		if(sys_vmctl(requestor, VMCTL_MEMREQ_REPLY, r) != OK)
 			panic("do_memory: sys_vmctl failed: %d", r);
 	}
 }
 
-int handle_memory(struct vmproc *vmp, vir_bytes mem, vir_bytes len, int wrflag)
+/*===========================================================================*
+ *				   handle_memory     			     *
+ *===========================================================================*/
+int handle_memory(struct vmproc *vmp, vir_bytes mem, vir_bytes len,
+	int wrflag, endpoint_t requestor)
 {
+/* Make the range 'mem' to 'mem'+'len' of 'vmp' present, and writable if
+ * 'wrflag' is set. If pages of a mapped file have to be read in for that,
+ * SUSPEND is returned and 'requestor', the process whose kernel call needs
+ * the range, is answered later. Without a requestor such pages can't be
+ * waited for and the range is not available.
+ */
 	struct vir_region *region;
 	vir_bytes o;
 
@@ -192,9 +229,20 @@ int handle_memory(struct vmproc *vmp, vir_bytes mem, vir_bytes len, int wrflag)
 			sublen = len;
 			if(offset + sublen > region->length)
 				sublen = region->length - offset;
-	
-			r = map_handle_memory(vmp, region, offset,
-				sublen, wrflag);
+
+			if((region->flags & VR_FILE) && requestor != NONE) {
+				/* The pages have to be read in first. Once
+				 * they are, there is only writing to allow.
+				 */
+				r = filemap_memreq(vmp, region, offset,
+					sublen, requestor, mem, len, wrflag);
+				if(r == OK && wrflag)
+					r = map_handle_memory(vmp, region,
+						offset, sublen, wrflag);
+			} else {
+				r = map_handle_memory(vmp, region, offset,
+					sublen, wrflag);
+			}
 
 			len -= sublen;
 			mem += sublen;
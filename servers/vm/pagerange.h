@@ -17,6 +17,10 @@
 typedef struct pagerange {
 	phys_bytes	addr;	/* in pages */
 	phys_bytes	size;	/* in pages */
+	int		order;	/* size is 1 << order */
+
+	/* free list of this order */
+	struct pagerange *next, *prev;
 
 	/* AVL fields */
 	struct pagerange *less, *greater;	/* children */
@@ -6,6 +6,9 @@ struct mem_map;
 struct memory;
 struct vir_region;
 struct phys_region;
+struct phys_block;
+struct fdref;
+struct vfs_req;
 
 #include <minix/ipc.h>
 #include <minix/endpoint.h>
@@ -25,7 +28,7 @@ int do_adddma(message *msg);
 int do_deldma(message *msg);
 int do_getdma(message *msg);
 void release_dma(struct vmproc *vmp);
-void memstats(int *nodes, int *pages, int *largest);
+void memstats(int *nodes, int *pages, int *largest, int *orders);
 void printmemstats(void);
 void usedpages_reset(void);
 int usedpages_add_f(phys_bytes phys, phys_bytes len, char *file, int
@@ -88,13 +91,38 @@ int do_remap(message *m);
 int do_get_phys(message *m);
 int do_shared_unmap(message *m);
 int do_get_refcount(message *m);
+struct vir_region *mmap_region(struct vmproc *vmp, vir_bytes addr, u32_t
+	vmm_flags, size_t len, u32_t vrflags, int mfflags);
+
+/* filemap.c */
+int filemap_mmap(struct vmproc *vmp, message *m);
+int filemap_pagefault(struct vmproc *vmp, struct vir_region *region,
+	vir_bytes offset, int write);
+int filemap_memreq(struct vmproc *vmp, struct vir_region *region,
+	vir_bytes offset, vir_bytes length, endpoint_t requestor, vir_bytes
+	mem, vir_bytes len, int wrflag);
+void filemap_writeback(struct fdref *fdref, off_t file_offset, phys_bytes
+	page);
+void filemap_link(struct vir_region *region);
+void filemap_unlink(struct vir_region *region);
+void fdref_put(struct fdref *fdref);
+int do_msync(message *m);
+
+/* vfs.c */
+void vfs_init(void);
+phys_bytes vfs_iobuf(void);
+struct vfs_req *vfs_req_alloc(int req, struct fdref *fdref, void
+	(*callback)(struct vfs_req *, message *));
+void vfs_req_send(struct vfs_req *vr);
+int do_vfs_reply(message *m);
 
 /* pagefaults.c */
 void do_pagefaults(message *m);
 void do_memory(void);
 char *pf_errstr(u32_t err);
+void pf_reset(struct vmproc *vmp);
 int handle_memory(struct vmproc *vmp, vir_bytes mem, vir_bytes len, int
-	wrflag);
+	wrflag, endpoint_t requestor);
 
 /* $(ARCH)/pagetable.c */
 void pt_init(phys_bytes limit);
@@ -156,6 +184,13 @@ struct vir_region *map_lookup(struct vmproc *vmp, vir_bytes addr);
 int map_pf(struct vmproc *vmp, struct vir_region *region, vir_bytes
 	offset, int write);
 int map_pin_memory(struct vmproc *vmp);
+struct phys_block *map_page_lookup(struct vir_region *region, vir_bytes
+	offset);
+int map_file_page(struct vmproc *vmp, struct vir_region *region,
+	vir_bytes offset, phys_bytes src, vir_bytes len);
+int map_share_page(struct vmproc *vmp, struct vir_region *region,
+	vir_bytes offset, struct phys_block *pb);
+int map_pb_writept(struct phys_block *pb);
 int map_handle_memory(struct vmproc *vmp, struct vir_region *region,
 	vir_bytes offset, vir_bytes len, int write);
 void map_printmap(struct vmproc *vmp);
@@ -34,9 +34,12 @@
 /* LRU list. */
 static yielded_t *lru_youngest = NULL, *lru_oldest = NULL;
 
-/* Should a physblock be mapped writable? */
+/* Should a physblock be mapped writable? Shared file pages are kept
+ * read-only until they are dirtied, so that writes can be noticed.
+ */
 #define WRITABLE(r, pb) \
 	(((r)->flags & VR_WRITABLE) && 			\
+		(!VR_FILE_SHARED(r) || ((pb)->flags & PBF_DIRTY)) && \
 		(((r)->flags & (VR_DIRECT | VR_SHARED)) ||	\
 		 (pb)->refcount == 1))
 
@@ -546,7 +549,13 @@ USE(newregion,
 	newregion->length = length;
 	newregion->flags = flags;
 	newregion->tag = VRT_NONE;
-	newregion->parent = vmp;);
+	newregion->parent = vmp;
+	newregion->fdref = NULL;
+	newregion->file_offset = 0;
+	newregion->file_next = NULL;
+	newregion->pf_lo = newregion->pf_hi = 0;
+	newregion->pf_window = 1;
+	newregion->pf_down = 0;);
 
 	SLABALLOC(phavl);
 	if(!phavl) {
@@ -632,7 +641,14 @@ void pb_unreferenced(struct vir_region *region, struct phys_region *pr)
 
 	if(pb->refcount == 0) {
 		assert(!pb->firstregion);
-		if(region->flags & VR_ANON) {
+		if(VR_FILE_SHARED(region) && (pb->flags & PBF_DIRTY)) {
+			/* Last reference to a modified file page; the
+			 * writeback takes over the memory.
+			 */
+			assert(pb->length == VM_PAGE_SIZE);
+			filemap_writeback(region->fdref,
+				region->file_offset + pr->offset, pb->phys);
+		} else if(region->flags & VR_ANON) {
 			free_mem(ABS2CLICK(pb->phys),
 				ABS2CLICK(pb->length));
 		} else if(region->flags & VR_DIRECT) {
@@ -739,6 +755,9 @@ static int map_free(struct vmproc *vmp, struct vir_region *region)
 		return r;
 	}
 
+	if(region->flags & VR_FILE)
+		filemap_unlink(region);
+
 	USE(region,
 		SLABFREE(region->phys););
 	SLABFREE(region);
@@ -1015,6 +1034,7 @@ int written;
 		USE(newpb,
 		newpb->phys = ml->phys;
 		newpb->refcount = 1;
+		newpb->flags = 0;
 		newpb->length = ml->length;
 		newpb->firstregion = newphysr;);
 
@@ -1163,6 +1183,116 @@ physr_iter *iter;
 }
 
 
+/*===========================================================================*
+ *				pf_window				     *
+ *===========================================================================*/
+static int pf_window(struct vir_region *region, vir_bytes vaddr)
+{
+/* Adapt the fault-around window of 'region' to a fault at page 'vaddr'. A
+ * fault right next to what the previous fault in the region mapped means the
+ * process is scanning through it, so the window grows, in the direction of
+ * the scan. Any other fault starts over at a single page, so that random
+ * access doesn't waste memory. The state is kept per region, so that faults
+ * in other regions (e.g. the stack, while scanning the heap) don't break the
+ * scan.
+ */
+	if(vaddr == region->pf_hi) {
+		USE(region, region->pf_down = 0;);
+	} else if(vaddr + VM_PAGE_SIZE == region->pf_lo) {
+		USE(region, region->pf_down = 1;);
+	} else {
+		USE(region, region->pf_window = 1;);
+		return 1;
+	}
+
+	USE(region, region->pf_window =
+		MIN(MAX(region->pf_window, 1) * 2, FAULTAROUND_MAX););
+
+	return region->pf_window;
+}
+
+/*===========================================================================*
+ *				pf_range				     *
+ *===========================================================================*/
+static void pf_range(struct vir_region *region, vir_bytes virpage,
+	int window, int down, vir_bytes *startp, vir_bytes *endp)
+{
+/* Grow the missing page at 'virpage' to a range of up to 'window' missing
+ * pages, upwards or downwards, staying within the region.
+ */
+	struct phys_region *ph;
+	vir_bytes span, limit;
+
+	span = (window - 1) * VM_PAGE_SIZE;
+
+	if(!down) {
+		limit = region->length;
+		if((ph = physr_search(region->phys, virpage, AVL_GREATER_EQUAL)))
+			limit = ph->offset;
+		assert(limit > virpage);
+		*endp = virpage + VM_PAGE_SIZE + MIN(span,
+			limit - virpage - VM_PAGE_SIZE);
+	} else {
+		limit = 0;
+		if((ph = physr_search(region->phys, virpage, AVL_LESS_EQUAL)))
+			limit = ph->offset + ph->ph->length;
+		assert(limit <= virpage);
+		*startp = virpage - MIN(span, virpage - limit);
+	}
+}
+
+/*===========================================================================*
+ *				pf_cow_around				     *
+ *===========================================================================*/
+static void pf_cow_around(struct vmproc *vmp, struct vir_region *region,
+	vir_bytes virpage)
+{
+/* The page at 'virpage' has just been copied on write. If the process is
+ * writing its way through memory, copy the next shared pages right away as
+ * well, instead of taking a fault for each of them.
+ */
+	struct phys_region *ph;
+	vir_bytes lo, hi, offset;
+	int window, pages;
+
+	ph = physr_search(region->phys, virpage, AVL_LESS_EQUAL);
+	assert(ph && ph->offset <= virpage);
+	lo = ph->offset;
+	hi = ph->offset + ph->ph->length;
+	pages = (hi - lo) / VM_PAGE_SIZE;
+
+	window = pf_window(region, region->vaddr + virpage);
+
+	while(pages < window && !(region->flags & (VR_SHARED|VR_DIRECT))) {
+		if(region->pf_down ? lo == 0 : hi >= region->length)
+			break;
+		offset = region->pf_down ? lo - VM_PAGE_SIZE : hi;
+		if(!(ph = physr_search(region->phys, offset, AVL_LESS_EQUAL)) ||
+		   offset >= ph->offset + ph->ph->length)
+			break;	/* Not there; nothing to copy. */
+
+		if(WRITABLE(region, ph->ph)) {
+			/* The other side copied it already. */
+			if(map_ph_writept(vmp, region, ph) != OK)
+				break;
+		} else if(ph->ph->share_flag == PBSH_COW) {
+			if(!(ph = map_clone_ph_block(vmp, region, ph, NULL)))
+				break;
+		} else {
+			break;
+		}
+
+		lo = MIN(lo, ph->offset);
+		hi = MAX(hi, ph->offset + ph->ph->length);
+		vmp->vm_pf_around += ph->ph->length / VM_PAGE_SIZE;
+		pages += ph->ph->length / VM_PAGE_SIZE;
+	}
+
+	USE(region,
+		region->pf_lo = region->vaddr + lo;
+		region->pf_hi = region->vaddr + hi;);
+}
+
 /*===========================================================================*
  *				map_pf			     *
  *===========================================================================*/
@@ -1193,6 +1323,12 @@ int write;
 		assert(region->flags & VR_WRITABLE);
 		assert(ph->ph->refcount > 0);
 
+		/* First write to a shared file page: from now on it
+		 * has to be written back.
+		 */
+		if(VR_FILE_SHARED(region))
+			USE(ph->ph, ph->ph->flags |= PBF_DIRTY;);
+
 		if(WRITABLE(region, ph->ph)) {
 			r = map_ph_writept(vmp, region, ph);
 			if(r != OK)
@@ -1205,14 +1341,47 @@ int write;
 			} else {
 				if(!map_clone_ph_block(vmp, region, ph, NULL))
 					r = ENOMEM;
+				else {
+					vmp->vm_pf_cow++;
+					pf_cow_around(vmp, region, virpage);
+				}
 			}
 		}
+	} else if(region->flags & VR_FILE) {
+		/* Contents have to come from the file. Pagefaults and kernel
+		 * copies have them read in first; see filemap.c.
+		 */
+		printf("VM: map_pf: file page not present\n");
+		r = EFAULT;
 	} else {
-		/* Pagefault in non-existing block. Map in new block. */
-		if(map_new_physblock(vmp, region, virpage,
-			VM_PAGE_SIZE, MAP_NONE, PAF_CLEAR, 0) != OK) {
+		/* Pagefault in non-existing block. Map in new block, together
+		 * with the pages next to it if the process is scanning.
+		 */
+		vir_bytes start = virpage, end = virpage + VM_PAGE_SIZE;
+		int window;
+
+		window = pf_window(region, region->vaddr + virpage);
+		if(window > 1 && !(region->flags & VR_CONTIG))
+			pf_range(region, virpage, window, region->pf_down,
+				&start, &end);
+
+		if(end - start > VM_PAGE_SIZE && map_new_physblock(vmp, region,
+			start, end - start, MAP_NONE, PAF_CLEAR, 0) != OK) {
+			/* Memory is tight; just the page that's needed. */
+			start = virpage;
+			end = virpage + VM_PAGE_SIZE;
+		}
+
+		if(end - start == VM_PAGE_SIZE && map_new_physblock(vmp,
+			region, virpage, VM_PAGE_SIZE, MAP_NONE, PAF_CLEAR,
+			0) != OK) {
 			printf("map_new_physblock failed\n");
 			r = ENOMEM;
+		} else {
+			vmp->vm_pf_around += (end - start) / VM_PAGE_SIZE - 1;
+			USE(region,
+				region->pf_lo = region->vaddr + start;
+				region->pf_hi = region->vaddr + end;);
 		}
 	}
 
@@ -1233,6 +1402,102 @@ int write;
 	return r;
 }
 
+/*===========================================================================*
+ *				map_page_lookup				     *
+ *===========================================================================*/
+struct phys_block *map_page_lookup(struct vir_region *region, vir_bytes offset)
+{
+/* Return the physical block mapped at 'offset' in 'region', if any. */
+	struct phys_region *ph;
+
+	if((ph = physr_search(region->phys, offset, AVL_LESS_EQUAL)) &&
+	   (ph->offset <= offset && offset < ph->offset + ph->ph->length))
+		return ph->ph;
+
+	return NULL;
+}
+
+/*===========================================================================*
+ *				map_file_page				     *
+ *===========================================================================*/
+int map_file_page(struct vmproc *vmp, struct vir_region *region,
+	vir_bytes offset, phys_bytes src, vir_bytes len)
+{
+/* Map a new page at 'offset' in a file region, holding 'len' bytes copied
+ * from physical address 'src' followed by zeroes.
+ */
+	int r;
+
+	assert(region->flags & VR_FILE);
+	assert(!(offset % VM_PAGE_SIZE));
+	assert(len <= VM_PAGE_SIZE);
+	assert(!map_page_lookup(region, offset));
+
+	if((r=map_new_physblock(vmp, region, offset, VM_PAGE_SIZE,
+		MAP_NONE, PAF_CLEAR, 0)) != OK)
+		return r;
+
+	if(len > 0 && (r=copy_abs2region(src, region, offset, len)) != OK)
+		return r;
+
+	return OK;
+}
+
+/*===========================================================================*
+ *				map_share_page				     *
+ *===========================================================================*/
+int map_share_page(struct vmproc *vmp, struct vir_region *region,
+	vir_bytes offset, struct phys_block *pb)
+{
+/* Map the existing page 'pb' of another mapping of the same file at
+ * 'offset' in 'region'.
+ */
+	struct phys_region *newphysr;
+
+	assert(region->flags & VR_FILE);
+	assert(!(offset % VM_PAGE_SIZE));
+	assert(pb->length == VM_PAGE_SIZE);
+	assert(pb->refcount > 0);
+	assert(!map_page_lookup(region, offset));
+
+	if(!SLABALLOC(newphysr))
+		return ENOMEM;
+
+	USE(newphysr,
+		newphysr->offset = offset;
+		newphysr->ph = pb;
+		newphysr->parent = region;
+		newphysr->next_ph_list = pb->firstregion;);
+#if SANITYCHECKS
+	USE(newphysr, newphysr->written = 0;);
+#endif
+	USE(pb,
+		pb->firstregion = newphysr;
+		pb->refcount++;);
+	physr_insert(region->phys, newphysr);
+
+	return map_ph_writept(vmp, region, newphysr);
+}
+
+/*===========================================================================*
+ *				map_pb_writept				     *
+ *===========================================================================*/
+int map_pb_writept(struct phys_block *pb)
+{
+/* Rewrite the pagetable entries of every mapping of 'pb', after its
+ * writability has changed.
+ */
+	struct phys_region *pr;
+	int r;
+
+	for(pr = pb->firstregion; pr; pr = pr->next_ph_list) {
+		if((r=map_ph_writept(pr->parent->parent, pr->parent, pr)) != OK)
+			return r;
+	}
+
+	return OK;
+}
+
 /*===========================================================================*
  *				map_pin_memory      			     *
  *===========================================================================*/
@@ -1276,6 +1541,8 @@ int write;
 		end   = MIN(end, r2->offset); }		\
 	if(start < end) {						\
 		SANITYCHECK(SCL_DETAIL);				\
+		if(region->flags & VR_FILE)				\
+			return EFAULT;					\
 		if(map_new_physblock(vmp, region, start,		\
 			end-start, MAP_NONE, PAF_CLEAR, 0) != OK) {	\
 			SANITYCHECK(SCL_DETAIL);			\
@@ -1324,6 +1591,8 @@ int write;
 
 		if(write) {
 		  assert(physr->ph->refcount > 0);
+		  if(VR_FILE_SHARED(region))
+			USE(physr->ph, physr->ph->flags |= PBF_DIRTY;);
 		  if(!WRITABLE(region, physr->ph)) {
 			if(!(physr = map_clone_ph_block(vmp, region,
 				physr, &iter))) {
@@ -1429,6 +1698,9 @@ static struct vir_region *map_copy_region(struct vmproc *vmp, struct vir_region
 		newvr->phys = phavl;
 	);
 
+	if(newvr->flags & VR_FILE)
+		filemap_link(newvr);
+
 	physr_init(newvr->phys);
 
 	physr_start_iter_least(vr->phys, &iter);
@@ -1814,7 +2086,8 @@ int map_unmap_region(struct vmproc *vmp, struct vir_region *r,
 		map_subfree(vmp, r, len);
 		USE(r,
 		r->vaddr += len;
-		r->length -= len;);
+		r->length -= len;
+		r->file_offset += len;);
 		physr_start_iter_least(r->phys, &iter);
 
 		/* vaddr has increased; to make all the phys_regions
@@ -1992,6 +2265,10 @@ void get_usage_info(struct vmproc *vmp, struct vm_usage_info *vui)
 
 	memset(vui, 0, sizeof(*vui));
 
+	vui->vui_faults = vmp->vm_pf_count;
+	vui->vui_cow_faults = vmp->vm_pf_cow;
+	vui->vui_faultaround = vmp->vm_pf_around;
+
 	while((vr = region_get_iter(&v_iter))) {
 		physr_start_iter_least(vr->phys, &iter);
 		while((ph = physr_get_iter(&iter))) {
@@ -2431,7 +2708,7 @@ get_clean_phys_region(struct vmproc *vmp, vir_bytes vaddr, vir_bytes length,
 		return NULL;
 	}
 
-	if(!(region->flags & VR_ANON)) {
+	if(!(region->flags & VR_ANON) || (region->flags & VR_FILE)) {
 		printf("VM: get_clean_phys_region: non-anon 0x%lx\n", vaddr);
 		return NULL;
 	}
@@ -29,6 +29,8 @@ struct phys_block {
 #define PBSH_COW	1
 #define PBSH_SMAP	2
 	u8_t			share_flag;	/* PBSH_COW or PBSH_SMAP */
+#define PBF_DIRTY	0x01	/* file page written since last writeback */
+	u8_t			flags;
 
 	/* first in list of phys_regions that reference this block */
 	struct phys_region	*firstregion;	
@@ -42,6 +44,18 @@ typedef struct vir_region {
 	u32_t tag;		/* Opaque to mapping code. */
 	struct vmproc *parent;	/* Process that owns this vir_region. */
 
+	/* File mappings (VR_FILE) only. */
+	struct fdref *fdref;	/* file this region maps */
+	off_t file_offset;	/* file offset of vaddr */
+	struct vir_region *file_next;	/* next shared mapping of file */
+
+	/* Fault-around state: what the last fault in this region mapped, and
+	 * how many pages the next fault will map if it continues the scan.
+	 */
+	vir_bytes pf_lo, pf_hi;	/* virtual addresses */
+	int pf_window;
+	int pf_down;		/* scanning downwards */
+
 	/* AVL fields */
 	struct vir_region *lower, *higher;
 	int		factor;
@@ -59,6 +73,11 @@ typedef struct vir_region {
 /* Mapping type: */
 #define VR_ANON		0x100	/* Memory to be cleared and allocated */
 #define VR_DIRECT	0x200	/* Mapped, but not managed by VM */
+#define VR_FILE		0x400	/* Anonymous memory filled from a file */
+
+/* Writes to this region have to go back to the file. */
+#define VR_FILE_SHARED(r) \
+	(((r)->flags & (VR_FILE | VR_SHARED)) == (VR_FILE | VR_SHARED))
 
 /* Tag values: */
 #define VRT_NONE	0xBEEF0000
@@ -179,7 +179,8 @@ int do_info(message *m)
 	static struct vm_region_info vri[MAX_VRI_COUNT];
 	struct vmproc *vmp;
 	vir_bytes addr, size, next, ptr;
-	int r, pr, dummy, count, free_pages, largest_contig;
+	int r, pr, dummy, count, free_pages, largest_contig, i;
+	int orders[BUDDY_ORDERS];
 
 	if (vm_isokendpt(m->m_source, &pr) != OK)
 		return EINVAL;
@@ -191,9 +192,11 @@ int do_info(message *m)
 	case VMIW_STATS:
 		vsi.vsi_pagesize = VM_PAGE_SIZE;
 		vsi.vsi_total = total_pages;
-		memstats(&dummy, &free_pages, &largest_contig);
+		memstats(&dummy, &free_pages, &largest_contig, orders);
 		vsi.vsi_free = free_pages;
 		vsi.vsi_largest = largest_contig;
+		for(i = 0; i < VSI_ORDERS; i++)
+			vsi.vsi_orders[i] = i < BUDDY_ORDERS ? orders[i] : 0;
 
 		get_stats_info(&vsi);
 
@@ -243,7 +246,8 @@ int do_info(message *m)
 	 * deadlock. Note that no memory mapping can be undone without the
 	 * involvement of VM, so we are safe until we're done.
 	 */
-	r = handle_memory(vmp, arch_vir2map(vmp, ptr), size, 1 /*wrflag*/);
+	r = handle_memory(vmp, arch_vir2map(vmp, ptr), size, 1 /*wrflag*/,
+		NONE);
 	if (r != OK) return r;
 
 	/* Now that we know the copy out will succeed, perform the actual copy
@@ -0,0 +1,194 @@
+/* This file contains the VM side of the VM-VFS protocol. VM may not block
+ * on VFS (VFS may need VM to make progress), so requests are sent
+ * asynchronously, one at a time, and the replies come back as VM_VFS_REPLY
+ * messages in the main loop. File data goes through a single page-sized
+ * buffer in VM's own address space.
+ */
+
+#define _SYSTEM 1
+
+#include <minix/callnr.h>
+#include <minix/com.h>
+#include <minix/config.h>
+#include <minix/const.h>
+#include <minix/ds.h>
+#include <minix/endpoint.h>
+#include <minix/keymap.h>
+#include <minix/minlib.h>
+#include <minix/type.h>
+#include <minix/ipc.h>
+#include <minix/sysutil.h>
+#include <minix/syslib.h>
+
+#include <errno.h>
+#include <string.h>
+#include <stdio.h>
+#include <assert.h>
+#include <memory.h>
+
+#include "glo.h"
+#include "proto.h"
+#include "util.h"
+#include "region.h"
+#include "sanitycheck.h"
+#include "filemap.h"
+
+static struct vfs_req *first_req = NULL, *last_req = NULL;
+static int vfs_busy = 0;	/* first_req has been sent to VFS */
+static int next_reqid = 0;
+
+static void *iobuf;		/* file data buffer */
+static phys_bytes iobuf_phys;
+
+/*===========================================================================*
+ *				vfs_init				     *
+ *===========================================================================*/
+void vfs_init(void)
+{
+	if(!(iobuf = vm_allocpage(&iobuf_phys, VMP_SLAB)))
+		panic("VM: no page for the VFS buffer");
+}
+
+/*===========================================================================*
+ *				vfs_iobuf				     *
+ *===========================================================================*/
+phys_bytes vfs_iobuf(void)
+{
+/* Where the data of the current read reply is. */
+	return iobuf_phys;
+}
+
+/*===========================================================================*
+ *				vfs_req_alloc				     *
+ *===========================================================================*/
+struct vfs_req *vfs_req_alloc(int req, struct fdref *fdref,
+	vfs_callback_t callback)
+{
+	struct vfs_req *vr;
+
+	if(!SLABALLOC(vr)) {
+		printf("VM: no memory for VFS request\n");
+		return NULL;
+	}
+
+	USE(vr,
+		vr->vr_req = req;
+		vr->vr_reqid = 0;
+		vr->vr_fd = fdref ? fdref->fd : -1;
+		vr->vr_offset = 0;
+		vr->vr_mode = 0;
+		vr->vr_page = MAP_NONE;
+		vr->vr_fdref = fdref;
+		vr->vr_callback = callback;
+		vr->vr_who = NONE;
+		vr->vr_addr = 0;
+		vr->vr_flags = 0;
+		vr->vr_requestor = NONE;
+		vr->vr_mem = 0;
+		vr->vr_len = 0;
+		vr->vr_next = NULL;);
+
+	if(fdref)
+		USE(fdref, fdref->refcount++;);
+
+	return vr;
+}
+
+/*===========================================================================*
+ *				vfs_activate				     *
+ *===========================================================================*/
+static void vfs_activate(void)
+{
+	struct vfs_req *vr;
+	message m;
+	int r;
+
+	if(vfs_busy || !(vr = first_req))
+		return;
+
+	if(vr->vr_page != MAP_NONE &&
+	   (r=sys_abscopy(vr->vr_page, iobuf_phys, VM_PAGE_SIZE)) != OK)
+		panic("VM: vfs_activate: sys_abscopy failed: %d", r);
+
+	vr->vr_reqid = ++next_reqid;
+
+	memset(&m, 0, sizeof(m));
+	m.m_type = VFS_VMCALL;
+	m.VFS_VMCALL_REQ = vr->vr_req;
+	m.VFS_VMCALL_FD = vr->vr_fd;
+	m.VFS_VMCALL_REQID = vr->vr_reqid;
+	m.VFS_VMCALL_OFFSET = vr->vr_offset;
+
+	switch(vr->vr_req) {
+	case VMVFSREQ_FDLOOKUP:
+		m.VFS_VMCALL_ENDPOINT = vr->vr_who;
+		m.VFS_VMCALL_MODE = vr->vr_mode;
+		break;
+	case VMVFSREQ_FDREAD:
+	case VMVFSREQ_FDWRITE:
+		m.VFS_VMCALL_ADDR = (long) iobuf;
+		m.VFS_VMCALL_LENGTH = VM_PAGE_SIZE;
+		break;
+	}
+
+	if((r=asynsend3(VFS_PROC_NR, &m, AMF_NOREPLY)) != OK)
+		panic("VM: asynsend to VFS failed: %d", r);
+
+	vfs_busy = 1;
+}
+
+/*===========================================================================*
+ *				vfs_req_send				     *
+ *===========================================================================*/
+void vfs_req_send(struct vfs_req *vr)
+{
+	assert(!vr->vr_next);
+
+	if(last_req) {
+		USE(last_req, last_req->vr_next = vr;);
+	} else {
+		first_req = vr;
+	}
+	last_req = vr;
+
+	vfs_activate();
+}
+
+/*===========================================================================*
+ *				do_vfs_reply				     *
+ *===========================================================================*/
+int do_vfs_reply(message *m)
+{
+	struct vfs_req *vr;
+
+	if(m->m_source != VFS_PROC_NR)
+		return EPERM;
+
+	vr = first_req;
+	if(!vfs_busy || !vr || m->VMV_REQID != vr->vr_reqid) {
+		printf("VM: unexpected reply %d from VFS\n", m->VMV_REQID);
+		return SUSPEND;
+	}
+
+	first_req = vr->vr_next;
+	if(!first_req)
+		last_req = NULL;
+	vfs_busy = 0;
+
+	vr->vr_callback(vr, m);
+
+	if(vr->vr_page != MAP_NONE)
+		free_mem(ABS2CLICK(vr->vr_page), ABS2CLICK(VM_PAGE_SIZE));
+	if(vr->vr_fdref)
+		fdref_put(vr->vr_fdref);
+	SLABFREE(vr);
+
+	pt_clearmapcache();
+
+	/* Next one, if any. */
+	vfs_activate();
+
+	/* VFS doesn't wait for an answer. */
+	return SUSPEND;
+}
+
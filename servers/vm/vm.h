@@ -22,6 +22,9 @@
 #define MEMPROTECT	0	/* Slab objects not mapped. Access with USE() */
 #define JUNKFREE	0	/* Fill freed pages with junk */
 #define NONCONTIGUOUS	0	/* Make phys pages max. noncontiguous */
+#define FAULTAROUND_MAX	16	/* Max. pages mapped by one pagefault */
+#define BUDDY_ORDERS	11	/* Free blocks of 1 to 1024 pages */
+#define PAGECACHE_SIZE	64	/* Free single pages kept for reuse */
 
 /* How noisy are we supposed to be? */
 #define VERBOSE		0
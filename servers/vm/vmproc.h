@@ -47,10 +47,19 @@ struct vmproc {
 	int vm_slot;		/* process table slot */
 	int vm_yielded;		/* yielded regions */
 
+	/* Pagefault statistics. */
+	u32_t vm_pf_count;	/* pagefaults handled */
+	u32_t vm_pf_cow;	/* of which copy-on-write */
+	u32_t vm_pf_around;	/* extra pages mapped by fault-around */
+
 	union {
 		struct {
 			cp_grant_id_t gid;
 		} open;	/* VM_VFS_OPEN */
+		message mmap;	/* VM_MMAP of a file, waiting for VFS */
+		struct {
+			int err;	/* first error writing pages */
+		} msync;	/* VM_MSYNC with MS_SYNC */
 	} vm_state;		/* Callback state. */
 #if VMSTATS
 	int vm_bytecopies;
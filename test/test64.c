@@ -0,0 +1,113 @@
+/* Large TCP write test. A single blocking write that is larger than 64KB
+ * must arrive in full and in order at the other end of the connection.
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#define MAX_ERROR 4
+#include "common.c"
+
+#define XFER_SIZE	(200 << 10)	/* well over what tcp_write() takes */
+
+static unsigned char pattern(size_t off)
+{
+  return (unsigned char) ((off * 7 + (off >> 16)) & 0xff);
+}
+
+static void writer(struct sockaddr_in *sin)
+{
+  unsigned char *buf;
+  ssize_t r;
+  size_t i;
+  int sd;
+
+  if ((buf = malloc(XFER_SIZE)) == NULL) exit(10);
+  for (i = 0; i < XFER_SIZE; i++)
+	buf[i] = pattern(i);
+
+  if ((sd = socket(AF_INET, SOCK_STREAM, 0)) < 0) exit(11);
+  if (connect(sd, (struct sockaddr *) sin, sizeof(*sin)) != 0) exit(12);
+
+  if ((r = write(sd, buf, XFER_SIZE)) != XFER_SIZE) exit(13);
+
+  if (close(sd) != 0) exit(14);
+  free(buf);
+  exit(EXIT_SUCCESS);
+}
+
+static void test_big_write(void)
+{
+  struct sockaddr_in sin;
+  socklen_t len;
+  unsigned char buf[4096];
+  size_t got, i;
+  ssize_t r;
+  int sd, cd, status;
+  pid_t pid;
+
+  subtest = 1;
+
+  if ((sd = socket(AF_INET, SOCK_STREAM, 0)) < 0) e(1);
+
+  memset(&sin, 0, sizeof(sin));
+  sin.sin_family = AF_INET;
+  sin.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  sin.sin_port = 0;
+  if (bind(sd, (struct sockaddr *) &sin, sizeof(sin)) != 0) e(2);
+  if (listen(sd, 1) != 0) e(3);
+
+  len = sizeof(sin);
+  if (getsockname(sd, (struct sockaddr *) &sin, &len) != 0) e(4);
+
+  switch (pid = fork()) {
+  case -1:
+	e(5);
+	return;
+  case 0:
+	close(sd);
+	writer(&sin);
+	/* NOTREACHED */
+  }
+
+  len = sizeof(sin);
+  if ((cd = accept(sd, (struct sockaddr *) &sin, &len)) < 0) e(6);
+
+  got = 0;
+  while ((r = read(cd, buf, sizeof(buf))) > 0) {
+	for (i = 0; i < (size_t) r; i++) {
+		if (buf[i] != pattern(got + i)) {
+			e(7);
+			break;
+		}
+	}
+	got += r;
+	if (got > XFER_SIZE) break;
+  }
+  if (r < 0) e(8);
+  if (got != XFER_SIZE) e(9);
+
+  close(cd);
+  close(sd);
+
+  if (waitpid(pid, &status, 0) != pid) e(10);
+  if (!WIFEXITED(status) || WEXITSTATUS(status) != EXIT_SUCCESS) e(11);
+}
+
+int main(void)
+{
+  start(64);
+
+  test_big_write();
+
+  quit();
+
+  return -1;
+}
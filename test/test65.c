@@ -0,0 +1,244 @@
+/* Test for mmap() of files: the mapping shows the file, changes to a
+ * MAP_SHARED mapping reach the file through msync() and munmap(), changes to
+ * a MAP_PRIVATE mapping do not, and the kernel can copy into mapped pages
+ * that were never touched.
+ */
+#include <sys/types.h>
+#include <sys/mman.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#define MAX_ERROR 4
+#include "common.c"
+
+#define FILE_PAGES	4
+#define FILE_NAME	"T65.file"
+
+static size_t pagesize, filesize;
+static char *image;		/* what the file ought to contain */
+
+static void make_file(void)
+{
+  size_t i;
+  int fd;
+
+  for (i = 0; i < filesize; i++)
+	image[i] = (char) ('a' + (i * 13 + i / pagesize) % 26);
+
+  if ((fd = open(FILE_NAME, O_RDWR | O_CREAT | O_TRUNC, 0644)) < 0) e(1);
+  if (write(fd, image, filesize) != (ssize_t) filesize) e(2);
+  if (close(fd) != 0) e(3);
+}
+
+static int file_matches(void)
+{
+  char *buf;
+  int fd, r;
+
+  if ((buf = malloc(filesize)) == NULL) return 0;
+  if ((fd = open(FILE_NAME, O_RDONLY)) < 0) {
+	free(buf);
+	return 0;
+  }
+  r = read(fd, buf, filesize) == (ssize_t) filesize &&
+	memcmp(buf, image, filesize) == 0;
+  close(fd);
+  free(buf);
+  return r;
+}
+
+static void check_file(int n)
+{
+  if (!file_matches()) e(n);
+}
+
+static void check_file_later(int n)
+{
+/* Pages written to through a mapping that is gone are written out in the
+ * background; give that a moment.
+ */
+  int i;
+
+  for (i = 0; i < 10 && !file_matches(); i++)
+	sleep(1);
+  if (i == 10) e(n);
+}
+
+static char *map_file(int fd, int prot, int flags, int n)
+{
+  char *p;
+
+  p = mmap(NULL, filesize, prot, flags, fd, 0);
+  if (p == MAP_FAILED) {
+	e(n);
+	quit();
+  }
+  return p;
+}
+
+static void test_read_mapping(void)
+{
+  char *p;
+  int fd;
+
+  subtest = 1;
+
+  make_file();
+  if ((fd = open(FILE_NAME, O_RDONLY)) < 0) e(1);
+  p = map_file(fd, PROT_READ, MAP_SHARED, 2);
+  if (memcmp(p, image, filesize) != 0) e(3);
+  if (munmap(p, filesize) != 0) e(4);
+  close(fd);
+}
+
+static void test_shared_writeback(void)
+{
+  char *p;
+  int fd;
+
+  subtest = 2;
+
+  make_file();
+  if ((fd = open(FILE_NAME, O_RDWR)) < 0) e(1);
+  p = map_file(fd, PROT_READ | PROT_WRITE, MAP_SHARED, 2);
+
+  /* Written back by msync(). */
+  memset(p + 10, 'X', 100);
+  memset(image + 10, 'X', 100);
+  if (msync(p, filesize, MS_SYNC) != 0) e(3);
+  check_file(4);
+
+  /* A page written to again after msync() must be written again. */
+  p[20] = 'Y';
+  image[20] = 'Y';
+  if (msync(p, pagesize, MS_SYNC) != 0) e(5);
+  check_file(6);
+
+  /* Written back when the mapping goes away. */
+  memset(p + 2 * pagesize + 7, 'Z', 50);
+  memset(image + 2 * pagesize + 7, 'Z', 50);
+  if (munmap(p, filesize) != 0) e(7);
+  close(fd);
+  check_file_later(8);
+
+  /* msync() with both MS_SYNC and MS_ASYNC is wrong. */
+  if ((fd = open(FILE_NAME, O_RDWR)) < 0) e(9);
+  p = map_file(fd, PROT_READ | PROT_WRITE, MAP_SHARED, 10);
+  if (msync(p, filesize, MS_SYNC | MS_ASYNC) != -1 || errno != EINVAL) e(11);
+  if (munmap(p, filesize) != 0) e(12);
+  close(fd);
+}
+
+static void test_shared_two_mappings(void)
+{
+  char *p, *q;
+  int fd;
+
+  subtest = 3;
+
+  make_file();
+  if ((fd = open(FILE_NAME, O_RDWR)) < 0) e(1);
+  p = map_file(fd, PROT_READ | PROT_WRITE, MAP_SHARED, 2);
+  q = map_file(fd, PROT_READ | PROT_WRITE, MAP_SHARED, 3);
+
+  /* Both see the same pages. */
+  p[pagesize + 1] = 'Q';
+  image[pagesize + 1] = 'Q';
+  if (q[pagesize + 1] != 'Q') e(4);
+
+  if (munmap(q, filesize) != 0) e(5);
+  if (munmap(p, filesize) != 0) e(6);
+  close(fd);
+  check_file_later(7);
+}
+
+static void test_private(void)
+{
+  char *p;
+  int fd;
+
+  subtest = 4;
+
+  make_file();
+  if ((fd = open(FILE_NAME, O_RDWR)) < 0) e(1);
+  p = map_file(fd, PROT_READ | PROT_WRITE, MAP_PRIVATE, 2);
+
+  /* Changes stay in the mapping. */
+  memset(p, 'P', pagesize + 3);
+  if (p[pagesize + 2] != 'P') e(3);
+  if (msync(p, filesize, MS_SYNC) != 0) e(4);
+  if (munmap(p, filesize) != 0) e(5);
+  close(fd);
+  check_file(6);
+}
+
+static void test_kernel_copy(void)
+{
+  char *p;
+  int fd, pfd[2];
+  size_t i;
+
+  subtest = 5;
+
+  make_file();
+  if ((fd = open(FILE_NAME, O_RDWR)) < 0) e(1);
+  p = map_file(fd, PROT_READ | PROT_WRITE, MAP_SHARED, 2);
+
+  /* read(2) into mapped pages nobody has touched yet. */
+  if (pipe(pfd) != 0) e(3);
+  for (i = 0; i < 2 * pagesize; i++)
+	image[pagesize / 2 + i] = (char) ('A' + i % 26);
+  if (write(pfd[1], image + pagesize / 2, 2 * pagesize) !=
+	(ssize_t) (2 * pagesize)) e(4);
+  if (read(pfd[0], p + pagesize / 2, 2 * pagesize) !=
+	(ssize_t) (2 * pagesize)) e(5);
+  if (memcmp(p, image, filesize) != 0) e(6);
+
+  /* write(2) from an untouched mapped page. */
+  if (write(pfd[1], p + 3 * pagesize, pagesize) != (ssize_t) pagesize) e(7);
+  if (read(pfd[0], image + 3 * pagesize, pagesize) != (ssize_t) pagesize)
+	e(8);
+  if (memcmp(p, image, filesize) != 0) e(9);
+
+  close(pfd[0]);
+  close(pfd[1]);
+  if (munmap(p, filesize) != 0) e(10);
+  close(fd);
+  check_file_later(11);
+}
+
+static void test_shared_anon(void)
+{
+  void *p;
+
+  subtest = 6;
+
+  /* Anonymous memory can't be shared this way. */
+  p = mmap(NULL, pagesize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANON,
+	-1, 0);
+  if (p != MAP_FAILED) e(1);
+  if (errno != EINVAL) e(2);
+}
+
+int main(void)
+{
+  start(65);
+
+  pagesize = (size_t) sysconf(_SC_PAGESIZE);
+  filesize = FILE_PAGES * pagesize;
+  if ((image = malloc(filesize)) == NULL) e(1);
+
+  test_read_mapping();
+  test_shared_writeback();
+  test_shared_two_mappings();
+  test_private();
+  test_kernel_copy();
+  test_shared_anon();
+
+  quit();
+
+  return -1;
+}
@@ -0,0 +1,278 @@
+/* Test for kqueue() and kevent(): registering descriptors with an event
+ * queue, waiting for them, and deleting the registrations again, on pipes
+ * and on sockets.
+ */
+#include <sys/types.h>
+#include <sys/event.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+
+#define MAX_ERROR 4
+#include "common.c"
+
+#define NEVENTS		4
+
+static struct timespec zero_ts;		/* poll */
+
+static int get_events(int kq, struct kevent *ev, const struct timespec *ts)
+{
+  return kevent(kq, NULL, 0, ev, NEVENTS, ts);
+}
+
+static int change(int kq, int fd, int filter, int flags, intptr_t udata)
+{
+  struct kevent kev;
+
+  EV_SET(&kev, fd, filter, flags, 0, 0, udata);
+  return kevent(kq, &kev, 1, NULL, 0, NULL);
+}
+
+static struct kevent *find_event(struct kevent *ev, int n, int fd, int filter)
+{
+  int i;
+
+  for (i = 0; i < n; i++)
+	if (ev[i].ident == (uintptr_t) fd && ev[i].filter == (uint32_t) filter)
+		return &ev[i];
+  return NULL;
+}
+
+static int wait_for(int kq, int fd, int filter, intptr_t udata)
+{
+/* Wait a few seconds for an event to be reported. Readiness of a socket comes
+ * from its driver, and may take a moment.
+ */
+  struct kevent ev[NEVENTS], *evp;
+  struct timespec ts;
+  int i, r;
+
+  ts.tv_sec = 1;
+  ts.tv_nsec = 0;
+  for (i = 0; i < 5; i++) {
+	if ((r = get_events(kq, ev, &ts)) < 0) return 0;
+	if ((evp = find_event(ev, r, fd, filter)) != NULL)
+		return evp->udata == udata;
+  }
+  return 0;
+}
+
+static void test_kqueue_fd(void)
+{
+  struct kevent ev[NEVENTS];
+  char c;
+  int kq, pfd[2], status;
+  pid_t pid;
+
+  subtest = 1;
+
+  if ((kq = kqueue()) < 0) e(1);
+
+  /* The queue is a descriptor at end of file. */
+  if (read(kq, &c, 1) != 0) e(2);
+
+  /* Nothing registered, nothing to report. */
+  if (get_events(kq, ev, &zero_ts) != 0) e(3);
+
+  /* Other descriptors are not event queues. */
+  if (pipe(pfd) != 0) e(4);
+  if (get_events(pfd[0], ev, &zero_ts) != -1 || errno != EBADF) e(5);
+
+  /* Not even the queue's own descriptor in a child. */
+  switch (pid = fork()) {
+  case -1:
+	e(6);
+	break;
+  case 0:
+	exit(get_events(kq, ev, &zero_ts) == -1 && errno == EBADF ?
+		EXIT_SUCCESS : EXIT_FAILURE);
+  default:
+	if (waitpid(pid, &status, 0) != pid) e(7);
+	if (!WIFEXITED(status) || WEXITSTATUS(status) != EXIT_SUCCESS) e(8);
+  }
+
+  /* Bad filters and descriptors. */
+  if (change(kq, pfd[0], EVFILT_SYSCOUNT, EV_ADD, 0) != -1 || errno != EINVAL)
+	e(9);
+  if (change(kq, OPEN_MAX + 1, EVFILT_READ, EV_ADD, 0) != -1 ||
+	errno != EBADF) e(10);
+  if (change(kq, pfd[0], EVFILT_READ, EV_DELETE, 0) != -1 || errno != ENOENT)
+	e(11);
+
+  /* Closing the queue releases it. */
+  if (close(kq) != 0) e(12);
+  if (get_events(kq, ev, &zero_ts) != -1 || errno != EBADF) e(13);
+
+  close(pfd[0]);
+  close(pfd[1]);
+}
+
+static void test_pair(int rfd, int wfd, int n)
+{
+/* Check the events of a connected pair of descriptors that nobody has written
+ * to yet. Errors are reported from n on.
+ */
+  struct kevent ev[NEVENTS];
+  struct timespec ts;
+  char c;
+  int kq, r, status;
+  pid_t pid;
+
+  if ((kq = kqueue()) < 0) e(n);
+
+  /* Register both ends. */
+  if (change(kq, rfd, EVFILT_READ, EV_ADD, 42) != 0) e(n + 1);
+  if (change(kq, wfd, EVFILT_WRITE, EV_ADD, 43) != 0) e(n + 1);
+
+  /* Only the writer is ready. */
+  if (!wait_for(kq, wfd, EVFILT_WRITE, 43)) e(n + 2);
+  r = get_events(kq, ev, &zero_ts);
+  if (r < 0 || find_event(ev, r, rfd, EVFILT_READ) != NULL) e(n + 2);
+
+  /* Now the reader is too, and stays so until the data is read. */
+  c = 'x';
+  if (write(wfd, &c, 1) != 1) e(n + 3);
+  if (!wait_for(kq, rfd, EVFILT_READ, 42)) e(n + 3);
+  if (!wait_for(kq, rfd, EVFILT_READ, 42)) e(n + 4);
+
+  if (read(rfd, &c, 1) != 1 || c != 'x') e(n + 5);
+  if (!wait_for(kq, wfd, EVFILT_WRITE, 43)) e(n + 5);
+  r = get_events(kq, ev, &zero_ts);
+  if (r < 0 || find_event(ev, r, rfd, EVFILT_READ) != NULL) e(n + 5);
+
+  /* A deleted registration is not reported, and can't be deleted twice. */
+  if (change(kq, wfd, EVFILT_WRITE, EV_DELETE, 0) != 0) e(n + 6);
+  if (get_events(kq, ev, &zero_ts) != 0) e(n + 6);
+  if (change(kq, wfd, EVFILT_WRITE, EV_DELETE, 0) != -1 || errno != ENOENT)
+	e(n + 6);
+
+  /* Wait for data that a child writes later. */
+  switch (pid = fork()) {
+  case -1:
+	e(n + 7);
+	break;
+  case 0:
+	sleep(1);
+	c = 'y';
+	exit(write(wfd, &c, 1) == 1 ? EXIT_SUCCESS : EXIT_FAILURE);
+  default:
+	r = get_events(kq, ev, NULL);
+	if (r != 1 || find_event(ev, r, rfd, EVFILT_READ) == NULL) e(n + 7);
+	if (waitpid(pid, &status, 0) != pid) e(n + 7);
+	if (!WIFEXITED(status) || WEXITSTATUS(status) != EXIT_SUCCESS)
+		e(n + 7);
+  }
+  if (read(rfd, &c, 1) != 1 || c != 'y') e(n + 8);
+
+  /* Nothing is ready; the timeout expires. */
+  ts.tv_sec = 0;
+  ts.tv_nsec = 100000000L;
+  if (get_events(kq, ev, &ts) != 0) e(n + 9);
+
+  /* A disabled registration is not reported until it is enabled again. */
+  if (change(kq, rfd, EVFILT_READ, EV_DISABLE, 0) != 0) e(n + 10);
+  c = 'z';
+  if (write(wfd, &c, 1) != 1) e(n + 10);
+  ts.tv_sec = 1;
+  ts.tv_nsec = 0;
+  if (get_events(kq, ev, &ts) != 0) e(n + 10);
+  if (change(kq, rfd, EVFILT_READ, EV_ENABLE, 0) != 0) e(n + 10);
+  if (!wait_for(kq, rfd, EVFILT_READ, 42)) e(n + 10);
+
+  /* A one-shot registration goes away once it has been reported. */
+  if (change(kq, rfd, EVFILT_READ, EV_DELETE, 0) != 0) e(n + 11);
+  if (change(kq, rfd, EVFILT_READ, EV_ADD | EV_ONESHOT, 44) != 0) e(n + 11);
+  if (!wait_for(kq, rfd, EVFILT_READ, 44)) e(n + 11);
+  if (get_events(kq, ev, &zero_ts) != 0) e(n + 12);
+  if (change(kq, rfd, EVFILT_READ, EV_DELETE, 0) != -1 || errno != ENOENT)
+	e(n + 12);
+  if (read(rfd, &c, 1) != 1 || c != 'z') e(n + 12);
+
+  /* Closing a descriptor drops its registrations. */
+  if (change(kq, wfd, EVFILT_WRITE, EV_ADD, 0) != 0) e(n + 13);
+  if (close(wfd) != 0) e(n + 13);
+  if (change(kq, wfd, EVFILT_WRITE, EV_DELETE, 0) != -1 || errno != ENOENT)
+	e(n + 13);
+
+  if (close(kq) != 0) e(n + 14);
+  close(rfd);
+}
+
+static void test_pipe(void)
+{
+  int pfd[2];
+
+  subtest = 2;
+
+  if (pipe(pfd) != 0) e(1);
+  test_pair(pfd[0], pfd[1], 10);
+}
+
+static void test_unix_socket(void)
+{
+  int sv[2];
+
+  subtest = 3;
+
+  if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv) != 0) e(1);
+  test_pair(sv[0], sv[1], 10);
+}
+
+static void test_udp_socket(void)
+{
+  struct kevent ev[NEVENTS];
+  struct sockaddr_in sin;
+  socklen_t len;
+  char c;
+  int kq, sd;
+
+  subtest = 4;
+
+  if ((sd = socket(AF_INET, SOCK_DGRAM, 0)) < 0) e(1);
+  memset(&sin, 0, sizeof(sin));
+  sin.sin_family = AF_INET;
+  sin.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  sin.sin_port = 0;
+  if (bind(sd, (struct sockaddr *) &sin, sizeof(sin)) != 0) e(2);
+  len = sizeof(sin);
+  if (getsockname(sd, (struct sockaddr *) &sin, &len) != 0) e(3);
+
+  if ((kq = kqueue()) < 0) e(4);
+  if (change(kq, sd, EVFILT_READ, EV_ADD, 0) != 0) e(5);
+  if (get_events(kq, ev, &zero_ts) != 0) e(6);
+
+  /* Send a datagram to ourselves and wait for it. */
+  c = 'u';
+  if (sendto(sd, &c, 1, 0, (struct sockaddr *) &sin, sizeof(sin)) != 1)
+	e(7);
+  if (!wait_for(kq, sd, EVFILT_READ, 0)) e(8);
+  if (recv(sd, &c, 1, 0) != 1 || c != 'u') e(9);
+
+  if (change(kq, sd, EVFILT_READ, EV_DELETE, 0) != 0) e(10);
+  if (change(kq, sd, EVFILT_READ, EV_DELETE, 0) != -1 || errno != ENOENT)
+	e(11);
+
+  close(kq);
+  close(sd);
+}
+
+int main(void)
+{
+  start(66);
+
+  test_kqueue_fd();
+  test_pipe();
+  test_unix_socket();
+  test_udp_socket();
+
+  quit();
+
+  return -1;
+}